@@ -75,6 +75,14 @@ END_RECV_TABLE()
 // was last time they setup their bones to determine if they need to re-setup their bones.
 static unsigned long	g_iModelBoneCounter = 0;
 
+// Live animating entities; the shared bone cache is sized to hold one setup for each
+static int s_nAnimatingEntities = 0;
+
+CON_COMMAND( cl_bonecache_stats, "Report on the client's shared bone cache" )
+{
+	Studio_ReportBoneCacheStats( s_nAnimatingEntities );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: convert axis rotations to a quaternion
 //-----------------------------------------------------------------------------
@@ -121,6 +129,8 @@ C_BaseAnimating::C_BaseAnimating()
 
 	m_nPrevNewSequenceParity = -1;
 	m_nPrevResetEventsParity = -1;
+
+	Studio_EnsureBoneCacheCapacity( ++s_nAnimatingEntities );
 }
 
 //-----------------------------------------------------------------------------
@@ -132,6 +142,7 @@ C_BaseAnimating::~C_BaseAnimating()
 	delete m_pRagdollInfo;
 	Assert(!m_pRagdoll);
 	delete m_pIk;
+	s_nAnimatingEntities--;
 }
 
 
@@ -913,6 +913,7 @@ public:
 	// Stubs on client
 	void	NetworkStateManualMode( bool activate )		{ }
 	void	NetworkStateChanged()						{ }
+	void	NetworkStateChanged( void *pVar, int nBytes )	{ }
 	void	NetworkStateSetUpdateInterval( float N )	{ }
 	void	NetworkStateForceUpdate()					{ }
 
@@ -29,6 +29,7 @@
 #include "c_te_effect_dispatch.h"
 #include <vgui_controls/Controls.h>
 #include <vgui/ISurface.h>
+#include "KeyValues.h"
 
 //-----------------------------------------------------------------------------
 // Purpose: Performs a var args printf into a static return buffer
@@ -576,7 +577,7 @@ public:
 	bool AddOrMarkPrecached( const char *pClassname );
 
 private:
-	CUtlSymbolTable		m_list;
+	CUtlHashSymbolTable	m_list;
 };
 
 void CPrecacheOtherList::LevelInitPreEntity()
@@ -596,7 +597,7 @@ void CPrecacheOtherList::LevelShutdownPostEntity()
 //-----------------------------------------------------------------------------
 bool CPrecacheOtherList::AddOrMarkPrecached( const char *pClassname )
 {
-	CUtlSymbol sym = m_list.Find( pClassname );
+	CUtlHashSymbol sym = m_list.Find( pClassname );
 	if ( sym.IsValid() )
 		return false;
 
@@ -868,4 +869,15 @@ int UTIL_ComputeStringWidth( vgui::HFont& font, const char *str )
 		pixels += vgui::surface()->GetCharacterWidth( font, *p++ );
 	}
 	return pixels;
-}
\ No newline at end of file
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Lets the client's KeyValues (HUD layouts, .res files) use and write
+//			.kvc binary caches
+//-----------------------------------------------------------------------------
+static void KeyValuesCacheChanged( ConVar *var, char const *pOldString )
+{
+	KeyValues::SetBinaryCacheMode( var->GetInt() >= 1, var->GetInt() >= 2 );
+}
+
+ConVar cl_keyvalues_cache( "cl_keyvalues_cache", "0", 0, "Client KeyValues binary caches: 0 = always parse text, 1 = load current .kvc files, 2 = also write them", KeyValuesCacheChanged );
\ No newline at end of file
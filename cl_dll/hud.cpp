@@ -286,6 +286,8 @@ void CHud::Init( void )
 	KeyValues *kv = new KeyValues( "layout" );
 	if ( kv )
 	{
+		// only read here and thrown away below, so one arena serves the whole file
+		kv->UseArenaAllocator();
 		if ( kv->LoadFromFile( filesystem, "scripts/HudLayout.res" ) )
 		{
 			int numelements = m_HudList.Size();
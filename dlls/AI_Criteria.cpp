@@ -1,15 +1,30 @@
 #include "cbase.h"
 #include "AI_Criteria.h"
 #include "ai_speech.h"
-#include <KeyValues.h>
 #include "engine/IEngineSound.h"
 
+//-----------------------------------------------------------------------------
+// Purpose: Criterion names are matched caselessly, as the KeyValues based
+//  set used to
+//-----------------------------------------------------------------------------
+CUtlHashSymbolTable& AI_CriteriaSet::NameTable()
+{
+	static CUtlHashSymbolTable s_Names( 0, 128, true );
+	return s_Names;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
 AI_CriteriaSet::AI_CriteriaSet()
 {
-	m_pCriteria = new KeyValues( "CriteriaSet" );
+	m_pCriteria = m_InlineCriteria;
+	m_nCount = 0;
+	m_nMaxCount = INLINE_CRITERIA;
+
+	m_pText = m_InlineText;
+	m_nTextUsed = 0;
+	m_nTextMax = INLINE_TEXT;
 }
 
 //-----------------------------------------------------------------------------
@@ -18,17 +33,31 @@ AI_CriteriaSet::AI_CriteriaSet()
 //-----------------------------------------------------------------------------
 AI_CriteriaSet::AI_CriteriaSet( const AI_CriteriaSet& src )
 {
-	m_pCriteria = new KeyValues( "CriteriaSet" );
-	if ( src.m_pCriteria )
+	m_pCriteria = m_InlineCriteria;
+	m_nCount = 0;
+	m_nMaxCount = INLINE_CRITERIA;
+
+	m_pText = m_InlineText;
+	m_nTextUsed = 0;
+	m_nTextMax = INLINE_TEXT;
+
+	if ( src.m_nCount > m_nMaxCount )
 	{
-		*m_pCriteria = *src.m_pCriteria;
+		m_nMaxCount = src.m_nCount;
+		m_pCriteria = new Criterion_t[ m_nMaxCount ];
 	}
 
-	KeyValues *kv;
-	for ( kv = m_pCriteria->GetFirstSubKey(); kv; kv = kv->GetNextKey() )
+	if ( src.m_nTextUsed > m_nTextMax )
 	{
-		m_Lookup.Insert( kv->GetName(), kv );
+		m_nTextMax = src.m_nTextUsed;
+		m_pText = new char[ m_nTextMax ];
 	}
+
+	m_nCount = src.m_nCount;
+	memcpy( m_pCriteria, src.m_pCriteria, m_nCount * sizeof( Criterion_t ) );
+
+	m_nTextUsed = src.m_nTextUsed;
+	memcpy( m_pText, src.m_pText, m_nTextUsed );
 }
 
 //-----------------------------------------------------------------------------
@@ -36,7 +65,86 @@ AI_CriteriaSet::AI_CriteriaSet( const AI_CriteriaSet& src )
 //-----------------------------------------------------------------------------
 AI_CriteriaSet::~AI_CriteriaSet()
 {
-	m_pCriteria->deleteThis();
+	if ( m_pCriteria != m_InlineCriteria )
+	{
+		delete[] m_pCriteria;
+	}
+
+	if ( m_pText != m_InlineText )
+	{
+		delete[] m_pText;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Copies the value text into the set
+// Output : int - offset of the copy
+//-----------------------------------------------------------------------------
+int AI_CriteriaSet::AddText( const char *value )
+{
+	if ( !value )
+	{
+		value = "";
+	}
+
+	int len = Q_strlen( value ) + 1;
+	if ( m_nTextUsed + len > m_nTextMax )
+	{
+		int newMax = m_nTextMax * 2;
+		while ( m_nTextUsed + len > newMax )
+		{
+			newMax *= 2;
+		}
+
+		char *pNewText = new char[ newMax ];
+		memcpy( pNewText, m_pText, m_nTextUsed );
+		if ( m_pText != m_InlineText )
+		{
+			delete[] m_pText;
+		}
+		m_pText = pNewText;
+		m_nTextMax = newMax;
+	}
+
+	int offset = m_nTextUsed;
+	memcpy( m_pText + offset, value, len );
+	m_nTextUsed += len;
+	return offset;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void AI_CriteriaSet::AppendCriterion( const char *criteria, const char *value, float weight, bool isNumeric, float numeric )
+{
+	UtlHashSymId_t name = NameTable().AddString( criteria );
+
+	int index = FindCriterionIndex( name );
+	if ( index == -1 )
+	{
+		if ( m_nCount == m_nMaxCount )
+		{
+			int newMax = m_nMaxCount * 2;
+			Criterion_t *pNewCriteria = new Criterion_t[ newMax ];
+			memcpy( pNewCriteria, m_pCriteria, m_nCount * sizeof( Criterion_t ) );
+			if ( m_pCriteria != m_InlineCriteria )
+			{
+				delete[] m_pCriteria;
+			}
+			m_pCriteria = pNewCriteria;
+			m_nMaxCount = newMax;
+		}
+
+		index = m_nCount++;
+		m_pCriteria[ index ].name = name;
+	}
+
+	// A replaced value's text is left behind, sets don't live long enough to care
+	Criterion_t *c = &m_pCriteria[ index ];
+	c->valueOffset = AddText( value );
+	c->weight = weight;
+	c->numeric = numeric;
+	c->isNumeric = isNumeric;
 }
 
 //-----------------------------------------------------------------------------
@@ -47,15 +155,21 @@ AI_CriteriaSet::~AI_CriteriaSet()
 //-----------------------------------------------------------------------------
 void AI_CriteriaSet::AppendCriteria( const char *criteria, const char *value /*= ""*/, float weight /*= 1.0f*/ )
 {
-	Assert( m_pCriteria );
-
-	KeyValues *sub = m_pCriteria->FindKey( criteria, true );
-	Assert( sub );
+	AppendCriterion( criteria, value, weight, false, 0.0f );
+}
 
-	sub->SetString( "value", value );
-	sub->SetFloat( "weight", weight );
+void AI_CriteriaSet::AppendCriteria( const char *criteria, int value, float weight /*= 1.0f*/ )
+{
+	char sz[ 32 ];
+	Q_snprintf( sz, sizeof( sz ), "%i", value );
+	AppendCriterion( criteria, sz, weight, true, (float)value );
+}
 
-	m_Lookup.Insert( criteria, sub );
+void AI_CriteriaSet::AppendCriteria( const char *criteria, float value, float weight /*= 1.0f*/ )
+{
+	char sz[ 32 ];
+	Q_snprintf( sz, sizeof( sz ), "%.3f", value );
+	AppendCriterion( criteria, sz, weight, true, (float)atof( sz ) );
 }
 
 //-----------------------------------------------------------------------------
@@ -64,7 +178,7 @@ void AI_CriteriaSet::AppendCriteria( const char *criteria, const char *value /*=
 //-----------------------------------------------------------------------------
 int AI_CriteriaSet::GetCount() const
 {
-	return m_Lookup.Count();
+	return m_nCount;
 }
 
 //-----------------------------------------------------------------------------
@@ -74,11 +188,22 @@ int AI_CriteriaSet::GetCount() const
 //-----------------------------------------------------------------------------
 int AI_CriteriaSet::FindCriterionIndex( const char *name ) const
 {
-	int idx = m_Lookup.Find( name );
-	if ( idx == m_Lookup.InvalidIndex() )
+	UtlHashSymId_t symbol = NameTable().Find( name );
+	if ( symbol == UTL_INVAL_HASH_SYMBOL )
 		return -1;
 
-	return idx;
+	return FindCriterionIndex( symbol );
+}
+
+int AI_CriteriaSet::FindCriterionIndex( UtlHashSymId_t symbol ) const
+{
+	for ( int i = 0; i < m_nCount; i++ )
+	{
+		if ( m_pCriteria[ i ].name == symbol )
+			return i;
+	}
+
+	return -1;
 }
 
 //-----------------------------------------------------------------------------
@@ -88,11 +213,18 @@ int AI_CriteriaSet::FindCriterionIndex( const char *name ) const
 //-----------------------------------------------------------------------------
 const char *AI_CriteriaSet::GetName( int index ) const
 {
-	if ( index < 0 || index >= (int)m_Lookup.Count() )
+	if ( index < 0 || index >= m_nCount )
 		return "";
 
-	KeyValues *sub = m_Lookup[ index ];
-	return sub->GetName();
+	return NameTable().String( m_pCriteria[ index ].name );
+}
+
+UtlHashSymId_t AI_CriteriaSet::GetNameSymbol( int index ) const
+{
+	if ( index < 0 || index >= m_nCount )
+		return UTL_INVAL_HASH_SYMBOL;
+
+	return m_pCriteria[ index ].name;
 }
 
 //-----------------------------------------------------------------------------
@@ -102,11 +234,10 @@ const char *AI_CriteriaSet::GetName( int index ) const
 //-----------------------------------------------------------------------------
 const char *AI_CriteriaSet::GetValue( int index ) const
 {
-	if ( index < 0 || index >= (int)m_Lookup.Count() )
+	if ( index < 0 || index >= m_nCount )
 		return "";
 
-	KeyValues *sub = m_Lookup[ index ];
-	return sub->GetString( "value", "" );
+	return m_pText + m_pCriteria[ index ].valueOffset;
 }
 
 //-----------------------------------------------------------------------------
@@ -116,11 +247,34 @@ const char *AI_CriteriaSet::GetValue( int index ) const
 //-----------------------------------------------------------------------------
 float AI_CriteriaSet::GetWeight( int index ) const
 {
-	if ( index < 0 || index >= (int)m_Lookup.Count() )
+	if ( index < 0 || index >= m_nCount )
 		return 1.0f;
 
-	KeyValues *sub = m_Lookup[ index ];
-	return sub->GetFloat( "weight", 1.0f );
+	return m_pCriteria[ index ].weight;
+}
+
+bool AI_CriteriaSet::IsNumeric( int index ) const
+{
+	if ( index < 0 || index >= m_nCount )
+		return false;
+
+	return m_pCriteria[ index ].isNumeric;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+// Input  : index - 
+// Output : float - the appended number, or the value text parsed as one
+//-----------------------------------------------------------------------------
+float AI_CriteriaSet::GetNumericValue( int index ) const
+{
+	if ( index < 0 || index >= m_nCount )
+		return 0.0f;
+
+	if ( m_pCriteria[ index ].isNumeric )
+		return m_pCriteria[ index ].numeric;
+
+	return (float)atof( GetValue( index ) );
 }
 
 //-----------------------------------------------------------------------------
@@ -128,23 +282,21 @@ float AI_CriteriaSet::GetWeight( int index ) const
 //-----------------------------------------------------------------------------
 void AI_CriteriaSet::Describe()
 {
-	KeyValues *kv = m_pCriteria->GetFirstSubKey();
-	while( kv )
+	for ( int i = 0; i < m_nCount; i++ )
 	{
-		const char *value = kv->GetString( "value", "" );
+		const char *value = GetValue( i );
 		if ( value && value[ 0 ] )
 		{
-			float w = kv->GetFloat( "weight", 1.0f );
+			float w = GetWeight( i );
 			if ( w != 1.0f )
 			{
-				Msg( "  %20s = '%s' (weight %f)\n", kv->GetName(), value, w );
+				Msg( "  %20s = '%s' (weight %f)\n", GetName( i ), value, w );
 			}
 			else
 			{
-				Msg( "  %20s = '%s'\n", kv->GetName(), value );
+				Msg( "  %20s = '%s'\n", GetName( i ), value );
 			}
 		}
-		kv = kv->GetNextKey();
 	}
 }
 
@@ -12,9 +12,15 @@
 
 class CAI_ExpressiveNPC;
 
-#include "utldict.h"
+#include "utlsymbol.h"
 #include "interval.h"
 
+//-----------------------------------------------------------------------------
+// Purpose: The set of criteria a speech query is matched against. Names are
+//  interned in a table shared by every set, and the entries and their value
+//  text live in fixed buffers inside the set, so building one on the stack
+//  doesn't touch the heap unless it outgrows them.
+//-----------------------------------------------------------------------------
 class AI_CriteriaSet
 {
 public:
@@ -22,21 +28,63 @@ public:
 	AI_CriteriaSet( const AI_CriteriaSet& src );
 	~AI_CriteriaSet();
 
+	// Appending a criterion the set already has replaces its value. Floats are
+	// kept to 3 decimals, as their text is, so rules see the same number either way
 	void AppendCriteria( const char *criteria, const char *value = "", float weight = 1.0f );
+	void AppendCriteria( const char *criteria, int value, float weight = 1.0f );
+	void AppendCriteria( const char *criteria, float value, float weight = 1.0f );
 
 	void Describe();
 
 	int GetCount() const;
 	int			FindCriterionIndex( const char *name ) const;
+	int			FindCriterionIndex( UtlHashSymId_t symbol ) const;
 
 	const char *GetName( int index ) const;
+	UtlHashSymId_t GetNameSymbol( int index ) const;
 	const char *GetValue( int index ) const;
 	float		GetWeight( int index ) const;
 
+	// Numeric values were appended as numbers, and don't need parsing
+	bool		IsNumeric( int index ) const;
+	float		GetNumericValue( int index ) const;
+
+	// The table criterion names are interned in
+	static CUtlHashSymbolTable& NameTable();
+
 private:
+	enum
+	{
+		INLINE_CRITERIA = 32,
+		INLINE_TEXT = 512,
+	};
+
+	struct Criterion_t
+	{
+		UtlHashSymId_t	name;
+		int				valueOffset;	// in m_pText
+		float			weight;
+		float			numeric;
+		bool			isNumeric;
+	};
+
+	void AppendCriterion( const char *criteria, const char *value, float weight, bool isNumeric, float numeric );
+	int AddText( const char *value );
+
+	// Stay in the inline buffers until they overflow
+	Criterion_t	*m_pCriteria;
+	int			m_nCount;
+	int			m_nMaxCount;
+
+	char		*m_pText;
+	int			m_nTextUsed;
+	int			m_nTextMax;
+
+	Criterion_t	m_InlineCriteria[ INLINE_CRITERIA ];
+	char		m_InlineText[ INLINE_TEXT ];
 
-	KeyValues	*m_pCriteria;
-	CUtlDict< KeyValues *, int > m_Lookup;
+	// Not supported
+	AI_CriteriaSet& operator=( const AI_CriteriaSet& src );
 };
 
 struct AI_ResponseParams
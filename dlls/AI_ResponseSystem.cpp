@@ -11,6 +11,7 @@
 #include <KeyValues.h>
 #include "filesystem.h"
 #include "utldict.h"
+#include "utlsymbol.h"
 #include "ai_speech.h"
 #include <ctype.h>
 
@@ -39,6 +40,7 @@ public:
 
 	// IResponseSystem
 	virtual bool FindBestResponse( const AI_CriteriaSet& set, AI_Response& response );
+	virtual bool HasMatchingRule( const AI_CriteriaSet& set );
 
 	virtual void Release() = 0;
 
@@ -70,6 +72,8 @@ private:
 			usemax = false;
 			maxequals = false;
 			maxval = false;
+
+			tokenvalue = 0.0f;
 		}
 
 		void Describe( void )
@@ -132,6 +136,9 @@ private:
 
 		char	token[ 128 ];
 		char	rawtoken[ 128 ];
+
+		// token parsed as a number, for numeric equality tests
+		float	tokenvalue;
 	};
 
 	struct Response
@@ -267,6 +274,7 @@ private:
 		Criteria()
 		{
 			name = NULL;
+			nameSymbol = UTL_INVAL_HASH_SYMBOL;
 			value = NULL;
 			weight = 1.0f;
 			required = false;
@@ -277,6 +285,7 @@ private:
 				return *this;
 
 			name = CopyString( src.name );
+			nameSymbol = src.nameSymbol;
 			value = CopyString( src.value );
 			weight = src.weight;
 			required = src.required;
@@ -294,6 +303,7 @@ private:
 		Criteria(const Criteria& src )
 		{
 			name = CopyString( src.name );
+			nameSymbol = src.nameSymbol;
 			value = CopyString( src.value );
 			weight = src.weight;
 			required = src.required;
@@ -318,6 +328,7 @@ private:
 		}
 
 		char						*name;
+		UtlHashSymId_t				nameSymbol;	// in m_CriterionNames
 		char						*value;
 		float						weight;
 		bool						required;
@@ -334,6 +345,7 @@ private:
 		{
 			m_bMatchOnce = false;
 			m_bEnabled = true;
+			m_nNextInBucket = -1;
 		}
 
 		Rule& operator =( const Rule& src )
@@ -358,6 +370,7 @@ private:
 
 			m_bMatchOnce = src.m_bMatchOnce;
 			m_bEnabled = src.m_bEnabled;
+			m_nNextInBucket = src.m_nNextInBucket;
 			return *this;
 		}
 
@@ -380,6 +393,7 @@ private:
 
 			m_bMatchOnce = src.m_bMatchOnce;
 			m_bEnabled = src.m_bEnabled;
+			m_nNextInBucket = src.m_nNextInBucket;
 		}
 
 		bool	IsEnabled() const { return m_bEnabled; }
@@ -392,6 +406,9 @@ private:
 
 		bool				m_bMatchOnce;
 		bool				m_bEnabled;
+
+		// Next rule in the same bucket of the rule index
+		int					m_nNextInBucket;
 	};
 
 	struct Enumeration
@@ -470,14 +487,20 @@ private:
 
 	int			ParseOneCriterion( const char *criterionName );
 	
-	bool		Compare( const char *setValue, Criteria *c, bool verbose = false );
-	bool		CompareUsingMatcher( const char *setValue, Matcher& m, bool verbose = false );
+	bool		Compare( const char *setValue, float setNumeric, Criteria *c, bool verbose = false );
+	bool		CompareUsingMatcher( const char *setValue, float setNumeric, Matcher& m, bool verbose = false );
 	void		ComputeMatcher( Criteria *c, Matcher& matcher );
 	void		ResolveToken( Matcher& matcher );
 	float		LookupEnumeration( const char *name, bool& found );
 
 	int			FindBestMatchingRule( const AI_CriteriaSet& set, bool verbose );
 
+	void		CompileRules();
+	bool		IsRuleKeyCriterion( int icriterion );
+	void		BeginQuery( const AI_CriteriaSet& set );
+	void		EndQuery();
+	void		GatherCandidateRules( CUtlVector< int >& candidates );
+
 	float		ScoreCriteriaAgainstRule( const AI_CriteriaSet& set, int irule, bool verbose = false );
 	float		RecursiveScoreSubcriteriaAgainstRule( const AI_CriteriaSet& set, Criteria *parent, bool& exclude, bool verbose /*=false*/ );
 	float		ScoreCriteriaAgainstRuleCriteria( const AI_CriteriaSet& set, int icriterion, bool& exclude, bool verbose = false );
@@ -504,6 +527,34 @@ private:
 	CUtlDict< Rule, int >	m_Rules;
 	CUtlDict< Enumeration, int > m_Enumerations;
 
+	// Criterion names, interned so that scoring looks criteria up by symbol
+	CUtlHashSymbolTable		m_CriterionNames;
+
+	// Rules indexed by the value one of their required criteria must have
+	// ("concept", when there is one). A query only scores the rules in the
+	// buckets its own values select, plus the rules with no such criterion.
+	CUtlHashSymbolTable		m_RuleKeys;			// "name\nvalue"
+	CUtlVector< int >		m_RuleKeyHeads;		// by m_RuleKeys symbol, first rule in the bucket
+	CUtlVector< bool >		m_KeyCriterion;		// by criterion symbol, do any rules key on it
+	int						m_nUnkeyedRules;	// first rule that isn't in a bucket
+	bool					m_bRulesCompiled;
+
+	// The set being scored, by criterion symbol, with its values parsed once
+	struct QueryValue
+	{
+		UtlHashSymId_t	symbol;
+		const char		*value;
+		float			numeric;
+		float			weight;
+	};
+	CUtlVector< int >			m_QueryIndex;	// by criterion symbol, -1 if the set doesn't have it
+	CUtlVector< QueryValue >	m_QueryValues;
+	CUtlVector< int >			m_CandidateRules;
+
+	// AI_CriteriaSet name symbol -> criterion symbol, rebuilt when criteria are added
+	CUtlVector< UtlHashSymId_t >	m_SetNameToCriterion;
+	int							m_nCriterionNamesMapped;
+
 	char		token[ 1204 ];
 
 	bool		m_bUnget;
@@ -522,10 +573,15 @@ private:
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-CResponseSystem::CResponseSystem()
+CResponseSystem::CResponseSystem() :
+	m_CriterionNames( 0, 32, true ),
+	m_RuleKeys( 0, 32, true )
 {
 	token[0] = 0;
 	m_bUnget = false;
+	m_nUnkeyedRules = -1;
+	m_bRulesCompiled = false;
+	m_nCriterionNamesMapped = 0;
 }
 
 //-----------------------------------------------------------------------------
@@ -575,6 +631,16 @@ void CResponseSystem::Clear()
 	m_Criteria.RemoveAll();
 	m_Rules.RemoveAll();
 	m_Enumerations.RemoveAll();
+
+	m_CriterionNames.RemoveAll();
+	m_RuleKeys.RemoveAll();
+	m_RuleKeyHeads.RemoveAll();
+	m_KeyCriterion.RemoveAll();
+	m_QueryIndex.RemoveAll();
+	m_SetNameToCriterion.RemoveAll();
+	m_nCriterionNamesMapped = 0;
+	m_nUnkeyedRules = -1;
+	m_bRulesCompiled = false;
 }
 
 //-----------------------------------------------------------------------------
@@ -742,20 +808,16 @@ void CResponseSystem::ComputeMatcher( Criteria *c, Matcher& matcher )
 		in++;
 	}
 
+	matcher.tokenvalue = (float)atof( matcher.token );
 	matcher.valid = true;
 }
 
-bool CResponseSystem::CompareUsingMatcher( const char *setValue, Matcher& m, bool verbose /*=false*/ )
+bool CResponseSystem::CompareUsingMatcher( const char *setValue, float setNumeric, Matcher& m, bool verbose /*=false*/ )
 {
 	if ( !m.valid )
 		return false;
 
-	float v = (float)atof( setValue );
-	if ( setValue[0] == '[' )
-	{
-		bool found = false;
-		v = LookupEnumeration( setValue, found );
-	}
+	float v = setNumeric;
 	
 	int minmaxcount = 0;
 
@@ -801,7 +863,7 @@ bool CResponseSystem::CompareUsingMatcher( const char *setValue, Matcher& m, boo
 	{
 		if ( m.isnumeric )
 		{
-			if ( v == (float)atof( m.token ) )
+			if ( v == m.tokenvalue )
 				return false;
 		}
 		else
@@ -815,18 +877,18 @@ bool CResponseSystem::CompareUsingMatcher( const char *setValue, Matcher& m, boo
 
 	if ( m.isnumeric )
 	{
-		return v == (float)atof( m.token );
+		return v == m.tokenvalue;
 	}
 
 	return !Q_stricmp( setValue, m.token ) ? true : false;
 }
 
-bool CResponseSystem::Compare( const char *setValue, Criteria *c, bool verbose /*= false*/ )
+bool CResponseSystem::Compare( const char *setValue, float setNumeric, Criteria *c, bool verbose /*= false*/ )
 {
 	Assert( c );
 	Assert( setValue );
 
-	bool bret = CompareUsingMatcher( setValue, c->matcher, verbose );
+	bool bret = CompareUsingMatcher( setValue, setNumeric, c->matcher, verbose );
 
 	if ( verbose )
 	{
@@ -880,23 +942,20 @@ float CResponseSystem::ScoreCriteriaAgainstRuleCriteria( const AI_CriteriaSet& s
 	float score = 0.0f;
 
 	const char *actualValue = "";
+	float actualNumeric = 0.0f;
+	float w = 1.0f;
 
-	int found = set.FindCriterionIndex( c->name );
+	int found = ( c->nameSymbol != UTL_INVAL_HASH_SYMBOL ) ? m_QueryIndex[ c->nameSymbol ] : -1;
 	if ( found != -1 )
 	{
-		actualValue = set.GetValue( found );
-		if ( !actualValue )
-		{
-			Assert( 0 );
-			return score;
-		}
+		const QueryValue &qv = m_QueryValues[ found ];
+		actualValue = qv.value;
+		actualNumeric = qv.numeric;
+		w = qv.weight;
 	}
 
-	Assert( actualValue );
-
-	if ( Compare( actualValue, c, verbose ) )
+	if ( Compare( actualValue, actualNumeric, c, verbose ) )
 	{
-		float w = set.GetWeight( found );
 		score = w * c->weight;
 
 		if ( verbose )
@@ -1179,10 +1238,13 @@ int CResponseSystem::FindBestMatchingRule( const AI_CriteriaSet& set, bool verbo
 	CUtlVector< int >	bestrules;
 	float bestscore = 0.001f;
 
-	int c = m_Rules.Count();
-	int i;
-	for ( i = 0; i < c; i++ )
+	// Rules outside the candidates have a required criterion the set can't match
+	GatherCandidateRules( m_CandidateRules );
+
+	int c = m_CandidateRules.Count();
+	for ( int candidate = 0; candidate < c; candidate++ )
 	{
+		int i = m_CandidateRules[ candidate ];
 		float score = ScoreCriteriaAgainstRule( set, i, verbose );
 		// Check equals so that we keep track of all matching rules
 		if ( score >= bestscore )
@@ -1215,6 +1277,225 @@ int CResponseSystem::FindBestMatchingRule( const AI_CriteriaSet& set, bool verbo
 	return bestrules[ idx ];
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Can a rule be filed under this criterion's value? It has to be a
+//			plain, required string match, so that a set with any other value
+//			is sure to fail the rule.
+//-----------------------------------------------------------------------------
+bool CResponseSystem::IsRuleKeyCriterion( int icriterion )
+{
+	Criteria *c = &m_Criteria[ icriterion ];
+	if ( c->IsSubCriteriaType() || !c->required || c->nameSymbol == UTL_INVAL_HASH_SYMBOL )
+		return false;
+
+	Matcher &m = c->matcher;
+	if ( !m.valid || m.usemin || m.usemax || m.notequal || m.isnumeric )
+		return false;
+
+	// an empty value would match a set that doesn't have the criterion at all
+	return ( m.token[ 0 ] != 0 );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Builds the rule index once all the scripts are loaded
+//-----------------------------------------------------------------------------
+void CResponseSystem::CompileRules()
+{
+	m_RuleKeys.RemoveAll();
+	m_RuleKeyHeads.RemoveAll();
+	m_nUnkeyedRules = -1;
+
+	m_KeyCriterion.SetSize( m_CriterionNames.Count() );
+	int i;
+	for ( i = 0; i < m_KeyCriterion.Count(); i++ )
+	{
+		m_KeyCriterion[ i ] = false;
+	}
+
+	m_QueryIndex.SetSize( m_CriterionNames.Count() );
+	for ( i = 0; i < m_QueryIndex.Count(); i++ )
+	{
+		m_QueryIndex[ i ] = -1;
+	}
+
+	// Walk backwards and link at the head, so every bucket lists its
+	// rules in the order they're scored in
+	int nKeyed = 0;
+	for ( i = m_Rules.Count() - 1; i >= 0; i-- )
+	{
+		Rule *rule = &m_Rules[ i ];
+
+		int ikey = -1;
+		for ( int j = 0; j < rule->m_Criteria.Count(); j++ )
+		{
+			int icriterion = rule->m_Criteria[ j ];
+			if ( !IsRuleKeyCriterion( icriterion ) )
+				continue;
+
+			// concept is the most selective, take it if the rule has one
+			if ( ikey == -1 || !Q_stricmp( m_Criteria[ icriterion ].name, "concept" ) )
+			{
+				ikey = icriterion;
+			}
+		}
+
+		if ( ikey == -1 )
+		{
+			rule->m_nNextInBucket = m_nUnkeyedRules;
+			m_nUnkeyedRules = i;
+			continue;
+		}
+
+		Criteria *c = &m_Criteria[ ikey ];
+		char key[ 256 ];
+		Q_snprintf( key, sizeof( key ), "%s\n%s", c->name, c->matcher.token );
+
+		UtlHashSymId_t bucket = m_RuleKeys.AddString( key );
+		while ( m_RuleKeyHeads.Count() <= (int)bucket )
+		{
+			m_RuleKeyHeads.AddToTail( -1 );
+		}
+
+		rule->m_nNextInBucket = m_RuleKeyHeads[ bucket ];
+		m_RuleKeyHeads[ bucket ] = i;
+		m_KeyCriterion[ c->nameSymbol ] = true;
+		nKeyed++;
+	}
+
+	m_bRulesCompiled = true;
+
+	DevMsg( 1, "CResponseSystem:  %i of %i rules indexed under %i keys\n", nKeyed, m_Rules.Count(), m_RuleKeys.Count() );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Copies the set's values into the query tables, parsing numbers
+//			and enumerations once instead of once per comparison
+//-----------------------------------------------------------------------------
+void CResponseSystem::BeginQuery( const AI_CriteriaSet& set )
+{
+	// criteria can be added without a recompile if a script failed to load
+	while ( m_QueryIndex.Count() < m_CriterionNames.Count() )
+	{
+		m_QueryIndex.AddToTail( -1 );
+	}
+
+	// A name the scripts didn't know about may be a criterion now
+	if ( m_nCriterionNamesMapped != m_CriterionNames.Count() )
+	{
+		m_SetNameToCriterion.RemoveAll();
+		m_nCriterionNamesMapped = m_CriterionNames.Count();
+	}
+
+	m_QueryValues.RemoveAll();
+
+	int c = set.GetCount();
+	for ( int i = 0; i < c; i++ )
+	{
+		UtlHashSymId_t name = set.GetNameSymbol( i );
+		if ( (int)name >= m_SetNameToCriterion.Count() )
+		{
+			int first = m_SetNameToCriterion.AddMultipleToTail( (int)name + 1 - m_SetNameToCriterion.Count() );
+			for ( int j = first; j < m_SetNameToCriterion.Count(); j++ )
+			{
+				m_SetNameToCriterion[ j ] = m_CriterionNames.Find( AI_CriteriaSet::NameTable().String( j ) );
+			}
+		}
+
+		UtlHashSymId_t symbol = m_SetNameToCriterion[ name ];
+		if ( symbol == UTL_INVAL_HASH_SYMBOL || m_QueryIndex[ symbol ] != -1 )
+			continue;
+
+		QueryValue qv;
+		qv.symbol = symbol;
+		qv.value = set.GetValue( i );
+		qv.weight = set.GetWeight( i );
+		if ( set.IsNumeric( i ) )
+		{
+			qv.numeric = set.GetNumericValue( i );
+		}
+		else if ( qv.value[0] == '[' )
+		{
+			bool found = false;
+			qv.numeric = LookupEnumeration( qv.value, found );
+		}
+		else
+		{
+			qv.numeric = (float)atof( qv.value );
+		}
+
+		m_QueryIndex[ symbol ] = m_QueryValues.AddToTail( qv );
+	}
+}
+
+void CResponseSystem::EndQuery()
+{
+	for ( int i = 0; i < m_QueryValues.Count(); i++ )
+	{
+		m_QueryIndex[ m_QueryValues[ i ].symbol ] = -1;
+	}
+	m_QueryValues.RemoveAll();
+}
+
+static int __cdecl RuleIndexCompare( const int *lhs, const int *rhs )
+{
+	return *lhs - *rhs;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Lists the rules the current query could match, in rule order
+//-----------------------------------------------------------------------------
+void CResponseSystem::GatherCandidateRules( CUtlVector< int >& candidates )
+{
+	candidates.RemoveAll();
+
+	int i;
+	if ( !m_bRulesCompiled )
+	{
+		for ( i = 0; i < m_Rules.Count(); i++ )
+		{
+			candidates.AddToTail( i );
+		}
+		return;
+	}
+
+	int nLists = 0;
+	for ( i = m_nUnkeyedRules; i != -1; i = m_Rules[ i ].m_nNextInBucket )
+	{
+		candidates.AddToTail( i );
+	}
+	if ( candidates.Count() )
+	{
+		nLists++;
+	}
+
+	for ( int v = 0; v < m_QueryValues.Count(); v++ )
+	{
+		const QueryValue &qv = m_QueryValues[ v ];
+		if ( (int)qv.symbol >= m_KeyCriterion.Count() || !m_KeyCriterion[ qv.symbol ] )
+			continue;
+
+		char key[ 256 ];
+		Q_snprintf( key, sizeof( key ), "%s\n%s", m_CriterionNames.String( qv.symbol ), qv.value );
+
+		UtlHashSymId_t bucket = m_RuleKeys.Find( key );
+		if ( bucket == UTL_INVAL_HASH_SYMBOL )
+			continue;
+
+		for ( i = m_RuleKeyHeads[ bucket ]; i != -1; i = m_Rules[ i ].m_nNextInBucket )
+		{
+			candidates.AddToTail( i );
+		}
+		nLists++;
+	}
+
+	// each list is in order, but they interleave
+	if ( nLists > 1 )
+	{
+		qsort( candidates.Base(), candidates.Count(), sizeof( int ), 
+			( int (__cdecl *)( const void *, const void * ) )RuleIndexCompare );
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : set - 
@@ -1227,6 +1508,8 @@ bool CResponseSystem::FindBestResponse( const AI_CriteriaSet& set, AI_Response&
 	bool showRules = ( sv_debugresponses.GetInt() >= 2 ) ? true : false;
 	bool showResult = sv_debugresponses.GetBool();
 
+	BeginQuery( set );
+
 	// Look for match
 	int bestRule = FindBestMatchingRule( set, showRules );
 
@@ -1271,9 +1554,40 @@ bool CResponseSystem::FindBestResponse( const AI_CriteriaSet& set, AI_Response&
 		response.Describe();
 	}
 
+	EndQuery();
+
 	return valid;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Gathers and scores rules as FindBestResponse does, but changes
+//			nothing: no tie is broken with the random stream, no response is
+//			selected, no group is depleted and match once rules stay enabled
+// Input  : set - 
+// Output : Returns true if a rule matched
+//-----------------------------------------------------------------------------
+bool CResponseSystem::HasMatchingRule( const AI_CriteriaSet& set )
+{
+	BeginQuery( set );
+
+	GatherCandidateRules( m_CandidateRules );
+
+	bool bMatched = false;
+	int c = m_CandidateRules.Count();
+	for ( int candidate = 0; candidate < c; candidate++ )
+	{
+		// same threshold as FindBestMatchingRule
+		if ( ScoreCriteriaAgainstRule( set, m_CandidateRules[ candidate ] ) >= 0.001f )
+		{
+			bMatched = true;
+		}
+	}
+
+	EndQuery();
+
+	return bMatched;
+}
+
 void CResponseSystem::ParseInclude( void )
 {
 	char includefile[ 256 ];
@@ -1360,6 +1674,8 @@ void CResponseSystem::LoadRuleSet( const char *basescript )
 	LoadFromBuffer( basescript, (const char *)buffer );
 
 	Assert( m_ScriptStack.Count() == 0 );
+
+	CompileRules();
 }
 
 static AI_Response::RESPONSETYPE ComputeResponseType( const char *s )
@@ -1668,6 +1984,7 @@ int CResponseSystem::ParseOneCriterion( const char *criterionName )
 			Q_strncpy( value, token, sizeof( value ) );
 
 			newCriterion.name = CopyString( key );
+			newCriterion.nameSymbol = m_CriterionNames.AddString( key );
 			newCriterion.value = CopyString( value );
 
 			gotbody = true;
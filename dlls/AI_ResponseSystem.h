@@ -17,6 +17,10 @@ class IResponseSystem
 {
 public:
 	virtual bool FindBestResponse( const AI_CriteriaSet& set, AI_Response& response ) = 0;
+
+	// Whether FindBestResponse would find a rule, without picking a response
+	// or using anything up. For timing and debugging.
+	virtual bool HasMatchingRule( const AI_CriteriaSet& set ) = 0;
 };
 
 IResponseSystem *InstancedResponseSystemCreate( const char *scriptfile );
@@ -43,6 +43,7 @@
 #include "ammodef.h"
 #include "player.h"
 #include "sceneentity.h"
+#include "igamesystem.h"
 #include "ndebugoverlay.h"
 #include "mathlib.h"
 #include "bone_setup.h"
@@ -60,6 +61,7 @@
 #include "saverestore_bitstring.h"
 #include "checksum_crc.h"
 #include "iservervehicle.h"
+#include "bspfile.h"
 #ifdef HL2_DLL
 #include "npc_bullseye.h"
 #include "hl2_player.h"
@@ -126,6 +128,7 @@ CAI_Manager g_AI_Manager;
 CAI_Manager::CAI_Manager()
 {
 	m_AIs.EnsureCapacity( MAX_AIS );
+	m_iChangeCount = 0;
 }
 
 //-------------------------------------
@@ -149,6 +152,7 @@ int CAI_Manager::NumAIs()
 void CAI_Manager::AddAI( CAI_BaseNPC *pAI )
 {
 	m_AIs.AddToTail( pAI );
+	m_iChangeCount++;
 }
 
 //-------------------------------------
@@ -160,9 +164,237 @@ void CAI_Manager::RemoveAI( CAI_BaseNPC *pAI )
 //	Assert( i != -1 );
 
 	if ( i != -1 )
+	{
 		m_AIs.FastRemove( i );
+		m_iChangeCount++;
+	}
+}
+
+//-----------------------------------------------------------------------------
+//
+// CAI_ThinkBudget
+//
+//-----------------------------------------------------------------------------
+
+ConVar	ai_think_budget( "ai_think_budget", "1", 0, "Stagger and defer expensive AI work for NPCs away from the players" );
+ConVar	ai_think_budget_ms( "ai_think_budget_ms", "4", 0, "Milliseconds of NPC thinking per frame before deferrable work is put off" );
+ConVar	ai_think_tier_mid_dist( "ai_think_tier_mid_dist", "1500", 0, "NPCs farther than this from every player think in the mid tier" );
+ConVar	ai_think_tier_far_dist( "ai_think_tier_far_dist", "3500", 0, "NPCs farther than this from every player think in the far tier" );
+ConVar	ai_think_max_deferrals( "ai_think_max_deferrals", "8", 0, "Most thinks in a row a phase may be put off" );
+
+CAI_ThinkBudget g_AI_ThinkBudget;
+
+static const char *g_ppszThinkTierNames[NUM_AI_THINK_TIERS] = { "near", "mid", "far" };
+
+// How often each tier senses, in thinks
+static const unsigned g_SenseInterval[NUM_AI_THINK_TIERS] = { 1, 2, 4 };
+
+// Clusters any player can see this frame
+static byte g_AIPlayerPVS[MAX_MAP_LEAFS/8];
+
+//-------------------------------------
+
+CAI_ThinkBudget::CAI_ThinkBudget()
+{
+	m_flFrameMs = 0;
+	m_bOverBudget = false;
+	m_bPlayerPVSValid = false;
+	ResetStats();
+}
+
+//-------------------------------------
+
+void CAI_ThinkBudget::FrameUpdate()
+{
+	m_flFrameMs = 0;
+	m_bOverBudget = false;
+	m_bPlayerPVSValid = false;
+	m_nFrames++;
+}
+
+//-------------------------------------
+
+bool CAI_ThinkBudget::IsInAnyPlayerPVS( CAI_BaseNPC *pNPC )
+{
+	if ( !m_bPlayerPVSValid )
+	{
+		m_bPlayerPVSValid = true;
+		memset( g_AIPlayerPVS, 0, sizeof( g_AIPlayerPVS ) );
+
+		byte pvs[MAX_MAP_LEAFS/8];
+		int lastCluster = -1;
+
+		for ( int i = 1; i <= gpGlobals->maxClients; i++ )
+		{
+			CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
+			if ( !pPlayer )
+				continue;
+
+			int cluster = engine->GetClusterForOrigin( pPlayer->EyePosition() );
+			if ( cluster == lastCluster )
+				continue;
+			lastCluster = cluster;
+
+			int nBytes = engine->GetPVSForCluster( cluster, sizeof( pvs ), pvs );
+			for ( int j = 0; j < nBytes; j++ )
+			{
+				g_AIPlayerPVS[j] |= pvs[j];
+			}
+		}
+	}
+
+	return engine->CheckOriginInPVS( pNPC->EyePosition(), g_AIPlayerPVS );
+}
+
+//-------------------------------------
+
+AI_ThinkTier_t CAI_ThinkBudget::ClassifyNPC( CAI_BaseNPC *pNPC )
+{
+	if ( !ai_think_budget.GetBool() ||
+		 pNPC->HasSpawnFlags( SF_NPC_ALWAYSTHINK ) ||
+		 pNPC->m_NPCState == NPC_STATE_COMBAT ||
+		 pNPC->m_NPCState == NPC_STATE_SCRIPT )
+	{
+		return AITT_NEAR;
+	}
+
+	const Vector &origin = pNPC->GetAbsOrigin();
+	float flNearestSq = FLT_MAX;
+
+	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
+	{
+		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
+		if ( pPlayer )
+		{
+			flNearestSq = min( flNearestSq, origin.DistToSqr( pPlayer->GetAbsOrigin() ) );
+		}
+	}
+
+	float flMidDist = ai_think_tier_mid_dist.GetFloat();
+	float flFarDist = ai_think_tier_far_dist.GetFloat();
+
+	if ( flNearestSq < flMidDist * flMidDist )
+		return AITT_NEAR;
+
+	// Nobody can see an NPC outside every player's PVS, so it drops a tier
+	if ( flNearestSq >= flFarDist * flFarDist || !IsInAnyPlayerPVS( pNPC ) )
+		return AITT_FAR;
+
+	return AITT_MID;
+}
+
+//-------------------------------------
+
+bool CAI_ThinkBudget::ShouldRunPhase( CAI_BaseNPC *pNPC, AI_ThinkPhase_t phase )
+{
+	AI_ThinkTier_t tier = pNPC->m_ThinkTier;
+	if ( tier == AITT_NEAR )
+		return true;
+
+	unsigned char &nDeferrals = pNPC->m_nThinkDeferrals[phase];
+	bool bRun;
+
+	if ( nDeferrals >= ai_think_max_deferrals.GetInt() )
+		bRun = true;	// don't starve anyone
+	else if ( m_bOverBudget )
+		bRun = false;
+	else if ( phase == AITP_SENSING )
+		bRun = ( ( pNPC->m_nThinkSerial + pNPC->entindex() ) % g_SenseInterval[tier] == 0 );
+	else
+		bRun = true;
+
+	if ( bRun )
+	{
+		nDeferrals = 0;
+		m_Stats[tier].nRun[phase]++;
+	}
+	else
+	{
+		nDeferrals++;
+		m_Stats[tier].nDeferred[phase]++;
+	}
+
+	return bRun;
+}
+
+//-------------------------------------
+
+void CAI_ThinkBudget::RecordThink( AI_ThinkTier_t tier, float flMilliseconds )
+{
+	TierStats_t &stats = m_Stats[tier];
+	stats.nThinks++;
+	stats.flTotalMs += flMilliseconds;
+	stats.flMaxMs = max( stats.flMaxMs, flMilliseconds );
+
+	m_flFrameMs += flMilliseconds;
+	if ( !m_bOverBudget && m_flFrameMs > ai_think_budget_ms.GetFloat() )
+	{
+		m_bOverBudget = true;
+		m_nOverBudgetFrames++;
+	}
+}
+
+//-------------------------------------
+
+void CAI_ThinkBudget::ReportStats()
+{
+	int nInTier[NUM_AI_THINK_TIERS] = { 0 };
+	CAI_BaseNPC **ppAIs = g_AI_Manager.AccessAIs();
+	int i;
+
+	for ( i = 0; i < g_AI_Manager.NumAIs(); i++ )
+	{
+		nInTier[ppAIs[i]->GetThinkTier()]++;
+	}
+
+	Msg( "AI think budget: %d of %d frames over %.1fms\n", m_nOverBudgetFrames, m_nFrames, ai_think_budget_ms.GetFloat() );
+	Msg( "  tier  npcs  thinks   avg ms   max ms   sense run/deferred   route run/deferred\n" );
+	for ( i = 0; i < NUM_AI_THINK_TIERS; i++ )
+	{
+		const TierStats_t &stats = m_Stats[i];
+		Msg( "  %-4s  %4d  %6d  %7.3f  %7.3f   %8d/%-8d   %8d/%-8d\n",
+			 g_ppszThinkTierNames[i], nInTier[i], stats.nThinks,
+			 ( stats.nThinks ) ? stats.flTotalMs / stats.nThinks : 0.0f, stats.flMaxMs,
+			 stats.nRun[AITP_SENSING], stats.nDeferred[AITP_SENSING],
+			 stats.nRun[AITP_ROUTE_REBUILD], stats.nDeferred[AITP_ROUTE_REBUILD] );
+	}
+}
+
+//-------------------------------------
+
+void CAI_ThinkBudget::ResetStats()
+{
+	memset( m_Stats, 0, sizeof( m_Stats ) );
+	m_nFrames = 0;
+	m_nOverBudgetFrames = 0;
+}
+
+//-------------------------------------
+
+CON_COMMAND( ai_think_budget_report, "Print per-tier NPC think timings since the last report, then reset them" )
+{
+	g_AI_ThinkBudget.ReportStats();
+	g_AI_ThinkBudget.ResetStats();
 }
 
+//-------------------------------------
+
+class CAI_ThinkBudgetHook : public CAutoGameSystem
+{
+public:
+	void LevelInitPreEntity()
+	{
+		g_AI_ThinkBudget.ResetStats();
+	}
+
+	void FrameUpdatePreEntityThink()
+	{
+		g_AI_ThinkBudget.FrameUpdate();
+	}
+};
+
+static CAI_ThinkBudgetHook g_AIThinkBudgetHook;
+
 
 //-----------------------------------------------------------------------------
 
@@ -2421,16 +2653,25 @@ void CAI_BaseNPC::NPCThink( void )
 	{
 		VPROF_BUDGET( "NPCs", VPROF_BUDGETGROUP_NPCS );
 
-		if ( !PreThink() )
-			return;
+		m_ThinkTier = g_AI_ThinkBudget.ClassifyNPC( this );
+		m_nThinkSerial++;
+
+		CFastTimer thinkTimer;
+		thinkTimer.Start();
+
+		if ( PreThink() )
+		{
+			RunAI();
 
-		RunAI();
+			PostRun();
 
-		PostRun();
+			PerformMovement();
 
-		PerformMovement();
+			SetSimulationTime( gpGlobals->curtime );
+		}
 
-		SetSimulationTime( gpGlobals->curtime );
+		thinkTimer.End();
+		g_AI_ThinkBudget.RecordThink( m_ThinkTier, thinkTimer.GetDuration().GetMillisecondsF() );
 	}
 }
 
@@ -2805,16 +3046,24 @@ void CAI_BaseNPC::GatherConditions( void )
 		if ( ( GetEfficiency() == AIE_NORMAL ) && 
 			 ( HasSpawnFlags(SF_NPC_ALWAYSTHINK) || UTIL_FindClientInPVS( edict() ) || ( m_NPCState == NPC_STATE_COMBAT ) ) )
 		{
-			if ( ShouldPlayIdleSound() )
+			// NPCs away from the players sense less often. Sightings and sounds
+			// aren't carried over a skipped pass, or a danger heard once would
+			// keep interrupting schedules until the next one.
+			if ( g_AI_ThinkBudget.ShouldRunPhase( this, AITP_SENSING ) )
 			{
-				AI_PROFILE_SCOPE(CAI_BaseNPC_IdleSound);
-				IdleSound();
-			}
+				if ( ShouldPlayIdleSound() )
+				{
+					AI_PROFILE_SCOPE(CAI_BaseNPC_IdleSound);
+					IdleSound();
+				}
 
-			PerformSensing();
+				PerformSensing();
 
-			GetEnemies()->RefreshMemories();
-			ChooseEnemy();
+				GetEnemies()->RefreshMemories();
+				ChooseEnemy();
+			}
+			else
+				ClearSenseConditions();
 		}
 		else
 			ClearSenseConditions(); // if not done, can have problems if leave PVS in same frame heard/saw things, since only PerformSensing clears conditions
@@ -7143,6 +7392,10 @@ CAI_BaseNPC::CAI_BaseNPC(void)
 	m_interuptSchedule			= NULL;
 	m_nDebugPauseIndex			= 0;
 
+	m_ThinkTier					= AITT_NEAR;
+	m_nThinkSerial				= 0;
+	memset( m_nThinkDeferrals, 0, sizeof( m_nThinkDeferrals ) );
+
 	// Player command
 	PlayerSelect( false );
 
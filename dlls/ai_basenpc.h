@@ -144,6 +144,31 @@ enum AI_Efficiency_t
 	AIE_EFFICIENT
 };
 
+//-------------------------------------
+//
+// Think tiers, assigned each think by distance and visibility to the players.
+// Expensive phases of AIs in the outer tiers are staggered across thinks and
+// put off when the frame's AI budget is spent.
+//
+//-------------------------------------
+
+enum AI_ThinkTier_t
+{
+	AITT_NEAR,			// close to a player, fighting or scripted; always runs in full
+	AITT_MID,
+	AITT_FAR,
+
+	NUM_AI_THINK_TIERS
+};
+
+enum AI_ThinkPhase_t
+{
+	AITP_SENSING,
+	AITP_ROUTE_REBUILD,
+
+	NUM_AI_THINK_PHASES
+};
+
 //-------------------------------------
 //
 // Debug bits
@@ -224,6 +249,9 @@ public:
 	
 	void AddAI( CAI_BaseNPC *pAI );
 	void RemoveAI( CAI_BaseNPC *pAI );
+
+	// Bumped whenever the array changes, so caches of AI indices know to rebuild
+	int				GetChangeCount() const	{ return m_iChangeCount; }
 	
 private:
 	enum
@@ -234,6 +262,7 @@ private:
 	typedef CUtlVector<CAI_BaseNPC *> CAIArray;
 	
 	CAIArray m_AIs;
+	int		 m_iChangeCount;
 
 };
 
@@ -241,6 +270,53 @@ private:
 
 extern CAI_Manager g_AI_Manager;
 
+//=============================================================================
+//
+// class CAI_ThinkBudget
+//
+// Tracks the time AIs spend thinking each frame and decides when deferrable
+// work for AIs away from the players can be put off.
+//
+//=============================================================================
+
+class CAI_ThinkBudget
+{
+public:
+	CAI_ThinkBudget();
+
+	void			FrameUpdate();
+
+	AI_ThinkTier_t	ClassifyNPC( CAI_BaseNPC *pNPC );
+	bool			ShouldRunPhase( CAI_BaseNPC *pNPC, AI_ThinkPhase_t phase );
+	void			RecordThink( AI_ThinkTier_t tier, float flMilliseconds );
+
+	void			ReportStats();
+	void			ResetStats();
+
+private:
+	bool			IsInAnyPlayerPVS( CAI_BaseNPC *pNPC );
+
+	struct TierStats_t
+	{
+		int		nThinks;
+		float	flTotalMs;
+		float	flMaxMs;
+		int		nRun[NUM_AI_THINK_PHASES];
+		int		nDeferred[NUM_AI_THINK_PHASES];
+	};
+
+	float			m_flFrameMs;
+	int				m_nFrames;
+	int				m_nOverBudgetFrames;
+	bool			m_bOverBudget;
+	bool			m_bPlayerPVSValid;			// union of every player's PVS gathered this frame
+	TierStats_t		m_Stats[NUM_AI_THINK_TIERS];
+};
+
+//-------------------------------------
+
+extern CAI_ThinkBudget g_AI_ThinkBudget;
+
 //=============================================================================
 //
 //	class CAI_BaseNPC
@@ -547,6 +623,8 @@ public:
 	AI_Efficiency_t		GetEfficiency() const						{ return m_Efficiency; }
 	void				SetEfficiency( AI_Efficiency_t efficiency )	{ m_Efficiency = efficiency; }
 
+	AI_ThinkTier_t		GetThinkTier() const						{ return m_ThinkTier; }
+
 
 	//---------------------------------
 
@@ -557,6 +635,13 @@ public:
 private:
 	AI_Efficiency_t		m_Efficiency;
 
+	friend class CAI_ThinkBudget;
+
+	// Not saved, recomputed every think
+	AI_ThinkTier_t		m_ThinkTier;
+	unsigned			m_nThinkSerial;
+	unsigned char		m_nThinkDeferrals[NUM_AI_THINK_PHASES];
+
 public:
 	//-----------------------------------------------------
 	//
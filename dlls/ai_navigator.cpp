@@ -2237,6 +2237,14 @@ bool CAI_Navigator::FindPath( bool fSignalTaskStatus )
 		// If its time to try again do so
 		else if (m_timePathRebuildNext < gpGlobals->curtime)
 		{
+			// Retries can wait a think when the AI budget is spent, so long as
+			// there's time left before the task gives up
+			if ( m_timePathRebuildFail - gpGlobals->curtime > 0.2 &&
+				 !g_AI_ThinkBudget.ShouldRunPhase( GetOuter(), AITP_ROUTE_REBUILD ) )
+			{
+				return false;
+			}
+
 			// If I suceeded I'm done
 			if (DoFindPath())
 			{	
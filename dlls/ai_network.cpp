@@ -99,6 +99,11 @@ public:
 // PERFORMANCE: Tune this number
 #define MAX_NEAR_NODES	10			// Trace to 10 nodes at most
 
+// Node grid cells are at least this big, and there are at most
+// AI_NODE_GRID_MAX_DIM cells along each axis
+#define AI_NODE_GRID_CELL_SIZE	256.0f
+#define AI_NODE_GRID_MAX_DIM	256
+
 //-----------------------------------------------------------------------------
 
 CAI_Network::CAI_Network()
@@ -107,6 +112,13 @@ CAI_Network::CAI_Network()
 	m_pAInode				= NULL;		// Array of all nodes in this network
 
 	m_nNearestCacheIndex	= 0;
+
+	m_flGridMinX			= 0;
+	m_flGridMinY			= 0;
+	m_flGridCellSize		= AI_NODE_GRID_CELL_SIZE;
+	m_nGridCols				= 0;
+	m_nGridRows				= 0;
+
 	// Force empty node caches to be rebuild
 	for (int node=0;node<NEARNODE_CACHE_SIZE;node++)
 	{
@@ -192,34 +204,51 @@ int CAI_Network::ListNodesInBox( CNodeList &list, int maxListCount, const Vector
 	float flClosest = 1000000.0 * 1000000;
 	int closest = 0;
 
-// UNDONE: Store the nodes in a tree and query the tree instead of the entire list!!!
-	for ( int node = 0; node < m_iNumNodes; node++ )
+	if ( NodeGridNeedsBuild() )
 	{
-		if ( !pFilter->NodeIsValid(*m_pAInode[node]) )
-			continue;
-
-		// in box?
-		if ( m_pAInode[node]->GetOrigin().x < mins.x || m_pAInode[node]->GetOrigin().x > maxs.x ||
-			m_pAInode[node]->GetOrigin().y < mins.y || m_pAInode[node]->GetOrigin().y > maxs.y ||
-			m_pAInode[node]->GetOrigin().z < mins.z || m_pAInode[node]->GetOrigin().z > maxs.z )
-			continue;
+		BuildNodeGrid();
+	}
 
-		float flDist = pFilter->NodeDistanceSqr(*m_pAInode[node]);
+	int colMin, colMax, rowMin, rowMax;
+	GetGridCellRange( mins, maxs, &colMin, &colMax, &rowMin, &rowMax );
 
-		if ( flDist < flClosest )
+	for ( int row = rowMin; row <= rowMax; row++ )
+	{
+		for ( int col = colMin; col <= colMax; col++ )
 		{
-			closest = node;
-			flClosest = flDist;
-		}
+			int cell = row * m_nGridCols + col;
+			int iEnd = m_GridCellStart[cell + 1];
+			for ( int i = m_GridCellStart[cell]; i < iEnd; i++ )
+			{
+				int node = m_GridNodes[i];
 
-		if ( !full || (flDist < result.ElementAtHead().dist) )
-		{
-			if ( full )
-				result.RemoveAtHead();
+				if ( !pFilter->NodeIsValid(*m_pAInode[node]) )
+					continue;
 
-			result.Insert( AI_NearNode_t(node, flDist) );
-	
-			full = (result.Count() == maxListCount);
+				// in box?
+				if ( m_pAInode[node]->GetOrigin().x < mins.x || m_pAInode[node]->GetOrigin().x > maxs.x ||
+					m_pAInode[node]->GetOrigin().y < mins.y || m_pAInode[node]->GetOrigin().y > maxs.y ||
+					m_pAInode[node]->GetOrigin().z < mins.z || m_pAInode[node]->GetOrigin().z > maxs.z )
+					continue;
+
+				float flDist = pFilter->NodeDistanceSqr(*m_pAInode[node]);
+
+				if ( flDist < flClosest )
+				{
+					closest = node;
+					flClosest = flDist;
+				}
+
+				if ( !full || (flDist < result.ElementAtHead().dist) )
+				{
+					if ( full )
+						result.RemoveAtHead();
+
+					result.Insert( AI_NearNode_t(node, flDist) );
+			
+					full = (result.Count() == maxListCount);
+				}
+			}
 		}
 	}
 	
@@ -233,6 +262,135 @@ int CAI_Network::ListNodesInBox( CNodeList &list, int maxListCount, const Vector
 	return list.Count();
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Buckets the nodes into a 2D grid by origin so ListNodesInBox only
+//			has to look at the cells its box overlaps.  Node origins never
+//			change once added, so the grid is only rebuilt when the node
+//			count changes.
+//-----------------------------------------------------------------------------
+
+void CAI_Network::BuildNodeGrid()
+{
+	m_GridCellStart.RemoveAll();
+	m_GridNodes.RemoveAll();
+
+	if ( !m_iNumNodes )
+	{
+		m_nGridCols = m_nGridRows = 0;
+		m_GridCellStart.AddToTail( 0 );
+		return;
+	}
+
+	float flMaxX, flMaxY;
+	m_flGridMinX = flMaxX = m_pAInode[0]->GetOrigin().x;
+	m_flGridMinY = flMaxY = m_pAInode[0]->GetOrigin().y;
+
+	int node;
+	for ( node = 1; node < m_iNumNodes; node++ )
+	{
+		const Vector &origin = m_pAInode[node]->GetOrigin();
+		m_flGridMinX = min( m_flGridMinX, origin.x );
+		m_flGridMinY = min( m_flGridMinY, origin.y );
+		flMaxX		 = max( flMaxX, origin.x );
+		flMaxY		 = max( flMaxY, origin.y );
+	}
+
+	float flExtent = max( flMaxX - m_flGridMinX, flMaxY - m_flGridMinY );
+	m_flGridCellSize = max( AI_NODE_GRID_CELL_SIZE, flExtent / ( AI_NODE_GRID_MAX_DIM - 1 ) );
+	m_nGridCols = (int)( ( flMaxX - m_flGridMinX ) / m_flGridCellSize ) + 1;
+	m_nGridRows = (int)( ( flMaxY - m_flGridMinY ) / m_flGridCellSize ) + 1;
+
+	int nCells = m_nGridCols * m_nGridRows;
+	CUtlVector<int> nodeCell;
+	nodeCell.SetCount( m_iNumNodes );
+
+	// Count the nodes in each cell, then turn the counts into start offsets
+	m_GridCellStart.SetCount( nCells + 1 );
+	memset( m_GridCellStart.Base(), 0, ( nCells + 1 ) * sizeof(int) );
+
+	for ( node = 0; node < m_iNumNodes; node++ )
+	{
+		const Vector &origin = m_pAInode[node]->GetOrigin();
+		int col = min( m_nGridCols - 1, (int)( ( origin.x - m_flGridMinX ) / m_flGridCellSize ) );
+		int row = min( m_nGridRows - 1, (int)( ( origin.y - m_flGridMinY ) / m_flGridCellSize ) );
+		nodeCell[node] = row * m_nGridCols + col;
+		m_GridCellStart[ nodeCell[node] + 1 ]++;
+	}
+
+	int cell;
+	for ( cell = 0; cell < nCells; cell++ )
+	{
+		m_GridCellStart[cell + 1] += m_GridCellStart[cell];
+	}
+
+	// Fill the cells, keeping node order within each cell
+	CUtlVector<int> fill;
+	fill.CopyArray( m_GridCellStart.Base(), nCells );
+
+	m_GridNodes.SetCount( m_iNumNodes );
+	for ( node = 0; node < m_iNumNodes; node++ )
+	{
+		m_GridNodes[ fill[ nodeCell[node] ]++ ] = node;
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_Network::GetGridCellRange( const Vector &mins, const Vector &maxs, int *pColMin, int *pColMax, int *pRowMin, int *pRowMax ) const
+{
+	*pColMin = max( 0, (int)floor( ( mins.x - m_flGridMinX ) / m_flGridCellSize ) );
+	*pColMax = min( m_nGridCols - 1, (int)floor( ( maxs.x - m_flGridMinX ) / m_flGridCellSize ) );
+	*pRowMin = max( 0, (int)floor( ( mins.y - m_flGridMinY ) / m_flGridCellSize ) );
+	*pRowMax = min( m_nGridRows - 1, (int)floor( ( maxs.y - m_flGridMinY ) / m_flGridCellSize ) );
+}
+
+//-----------------------------------------------------------------------------
+
+static int __cdecl CompareNodeIDs( const void *pLeft, const void *pRight )
+{
+	return ( *(const int *)pLeft - *(const int *)pRight );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Used by the graph builder to limit the pairs it tests to nodes
+//			that are near each other
+//-----------------------------------------------------------------------------
+
+void CAI_Network::ListNodeIDsInBox( CUtlVector<int> &result, const Vector &mins, const Vector &maxs )
+{
+	result.RemoveAll();
+
+	if ( NodeGridNeedsBuild() )
+	{
+		BuildNodeGrid();
+	}
+
+	int colMin, colMax, rowMin, rowMax;
+	GetGridCellRange( mins, maxs, &colMin, &colMax, &rowMin, &rowMax );
+
+	for ( int row = rowMin; row <= rowMax; row++ )
+	{
+		for ( int col = colMin; col <= colMax; col++ )
+		{
+			int cell = row * m_nGridCols + col;
+			int iEnd = m_GridCellStart[cell + 1];
+			for ( int i = m_GridCellStart[cell]; i < iEnd; i++ )
+			{
+				const Vector &origin = m_pAInode[ m_GridNodes[i] ]->GetOrigin();
+				if ( origin.x < mins.x || origin.x > maxs.x ||
+					 origin.y < mins.y || origin.y > maxs.y ||
+					 origin.z < mins.z || origin.z > maxs.z )
+					continue;
+
+				result.AddToTail( m_GridNodes[i] );
+			}
+		}
+	}
+
+	if ( result.Count() )
+		qsort( result.Base(), result.Count(), sizeof(int), CompareNodeIDs );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Return ID of node nearest of vecOrigin for pNPC with the given
 //			tolerance distance.  If a route is required to get to the node
@@ -249,14 +407,12 @@ int	CAI_Network::NearestNodeToNPCAtPoint( CAI_BaseNPC *pNPC, const Vector &vecOr
 
 	CNodeNPCFilter filter( pNPC, vecOrigin );
 	// ----------------------------------------------------------------
-	//  First check cached nearest node positions
+	//  First check cached nearest node positions.  The filter, fit and
+	//  visibility tests all depend on the NPC, so entries are per NPC.
 	// ----------------------------------------------------------------
-	int nodeID = GetCachedNode(vecOrigin);
-	if (nodeID >= 0 )
-	{
-		if ( filter.NodeIsValid( *m_pAInode[nodeID] ) && pNPC->GetNavigator()->CanFitAtNode(nodeID) )
-			return nodeID;
-	}
+	int nodeID = GetCachedNode(vecOrigin,pNPC->GetHullType(),pNPC);
+	if (nodeID != NOT_CACHED)
+		return nodeID;
 
 	
 	// ---------------------------------------------------------------
@@ -299,11 +455,15 @@ int	CAI_Network::NearestNodeToNPCAtPoint( CAI_BaseNPC *pNPC, const Vector &vecOr
 			MASK_NPCSOLID_BRUSHONLY, NULL, COLLISION_GROUP_NONE, &tr );
 
 		if ( tr.fraction == 1.0 )
+		{
+			// Store nearest node in cache for later use
+			SetCachedNearestNode(vecOrigin,smallest,pNPC->GetHullType(),pNPC);
 			return smallest;
+		}
 	}
 
 	// Store inability to reach in cache for later use
-	SetCachedNearestNode(vecOrigin,NO_NODE,pNPC->GetHullType());
+	SetCachedNearestNode(vecOrigin,NO_NODE,pNPC->GetHullType(),pNPC);
 
 	return NO_NODE;
 }
@@ -325,7 +485,7 @@ int	CAI_Network::NearestNodeToPoint(const Vector &vPosition)
 	// ----------------------------------------------------------------
 	//  First check cached nearest node positions
 	// ----------------------------------------------------------------
-	int nodeID = GetCachedNode(vPosition);
+	int nodeID = GetCachedNode(vPosition,HULL_NONE,NULL);
 	if (nodeID != NOT_CACHED)
 		return nodeID;
 
@@ -360,12 +520,12 @@ int	CAI_Network::NearestNodeToPoint(const Vector &vPosition)
 		if ( tr.fraction == 1.0 )
 		{
 			// Store nearest node in cache for later use
-			SetCachedNearestNode(vPosition,smallest,HULL_NONE);
+			SetCachedNearestNode(vPosition,smallest,HULL_NONE,NULL);
 			return smallest;
 		}
 	}
 	// Store inability to reach in cache for later use
-	SetCachedNearestNode(vPosition,NO_NODE,HULL_NONE);
+	SetCachedNearestNode(vPosition,NO_NODE,HULL_NONE,NULL);
 
 	return NO_NODE;
 }
@@ -373,10 +533,11 @@ int	CAI_Network::NearestNodeToPoint(const Vector &vPosition)
 //-----------------------------------------------------------------------------
 // Purpose: Check nearest node cache for checkPos and return cached nearest
 //			node if it exists in the cache.  Doesn't care about reachability,
-//			only if the node is visible
+//			only if the node is visible.  Only entries recorded for nHull
+//			and pNPC are considered.
 //-----------------------------------------------------------------------------
 
-int	CAI_Network::GetCachedNode(const Vector &checkPos)
+int	CAI_Network::GetCachedNode(const Vector &checkPos, Hull_t nHull, CAI_BaseNPC *pNPC)
 {
 	// undone: check if this type of npc can actually get there...
 	for (int node=0;node<NEARNODE_CACHE_SIZE;node++)
@@ -387,15 +548,20 @@ int	CAI_Network::GetCachedNode(const Vector &checkPos)
 			continue;
 		}
 
-		// If hull type isn't HULL_NONE, skip as we aren't concerned about 
-		// reachablility, we only care if this is the nearest reachable node
-		if (m_pNearestCache[node].nHullType != HULL_NONE)
+		// Entries for other hulls were tested for a different reachability, skip them
+		if (m_pNearestCache[node].nHullType != nHull)
+		{
+			continue;
+		}
+
+		// Entries for other NPCs passed a different filter, skip them
+		if (m_pNearestCache[node].hNPC != pNPC)
 		{
 			continue;
 		}
 
 		// Check if positions match
-		if ((m_pNearestCache[node].vTestPosition - checkPos).Length() < 24.0)
+		if ((m_pNearestCache[node].vTestPosition - checkPos).LengthSqr() < 24.0*24.0)
 		{
 			return m_pNearestCache[node].nNearestNode;
 		}
@@ -406,9 +572,10 @@ int	CAI_Network::GetCachedNode(const Vector &checkPos)
 //-----------------------------------------------------------------------------
 // Purpose: Update nearest node cache with new data
 //			if nHull == HULL_NONE, reachability of this node wasn't checked
+//			if pNPC == NULL, no NPC filter was applied
 //-----------------------------------------------------------------------------
 
-void CAI_Network::SetCachedNearestNode(const Vector &checkPos, int nodeID, Hull_t nHull)
+void CAI_Network::SetCachedNearestNode(const Vector &checkPos, int nodeID, Hull_t nHull, CAI_BaseNPC *pNPC)
 {
 	if (m_pNearestCache[m_nNearestCacheIndex].fTime == gpGlobals->curtime)
 	{
@@ -418,6 +585,7 @@ void CAI_Network::SetCachedNearestNode(const Vector &checkPos, int nodeID, Hull_
 	m_pNearestCache[m_nNearestCacheIndex].vTestPosition = checkPos;
 	m_pNearestCache[m_nNearestCacheIndex].nNearestNode  = nodeID;
 	m_pNearestCache[m_nNearestCacheIndex].nHullType		= nHull;
+	m_pNearestCache[m_nNearestCacheIndex].hNPC			= pNPC;
 	m_pNearestCache[m_nNearestCacheIndex].fTime			= gpGlobals->curtime;
 
 	m_nNearestCacheIndex++;
@@ -448,6 +616,28 @@ Vector CAI_Network::GetNodePosition( Hull_t hull, int nodeID )
 
 //-----------------------------------------------------------------------------
 
+void CAI_Network::BuildNodePositions( Hull_t hull )
+{
+	CUtlVector<Vector> &positions = m_HullPositions[hull];
+	positions.SetCount( m_iNumNodes );
+	for ( int node = 0; node < m_iNumNodes; node++ )
+	{
+		positions[node] = m_pAInode[node]->GetPosition( hull );
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_Network::InvalidateNodePositions()
+{
+	for ( int hull = 0; hull < NUM_HULLS; hull++ )
+	{
+		m_HullPositions[hull].Purge();
+	}
+}
+
+//-----------------------------------------------------------------------------
+
 Vector CAI_Network::GetNodePosition( CBaseCombatCharacter *pNPC, int nodeID )
 {
 	if ( pNPC == NULL )
@@ -502,6 +692,8 @@ CAI_Node *CAI_Network::AddNode( const Vector &origin, float yaw )
 	m_pAInode[m_iNumNodes] = new CAI_Node( m_iNumNodes, origin, yaw );
 	m_iNumNodes++;
 
+	InvalidateNodePositions();
+
 	return m_pAInode[m_iNumNodes-1];
 };
 
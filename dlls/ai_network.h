@@ -13,6 +13,7 @@
 #endif
 
 #include "utlpriorityqueue.h"
+#include "ai_hull.h"
 
 // ------------------------------------
 
@@ -86,6 +87,11 @@ public:
 	
 	Vector			GetNodePosition( CBaseCombatCharacter *pNPC, int nodeID );
 	Vector			GetNodePosition( Hull_t hull, int nodeID );
+
+	// Same as GetNodePosition, but computed once per hull and kept until the
+	// nodes are moved.  Anything that moves nodes must call InvalidateNodePositions.
+	const Vector &	GetCachedNodePosition( Hull_t hull, int nodeID );
+	void			InvalidateNodePositions();
 	float			GetNodeYaw( int nodeID );
 
 	static int		FindBSSmallest(CBitString *bitString, float *float_array, int array_size); 
@@ -97,18 +103,26 @@ public:
 	CAI_Node*		GetNode( int id )	{ if (id < m_iNumNodes ) return m_pAInode[id]; AssertMsg(0, "Node out of range"); return NULL; }
 	
 	CAI_Node**		AccessNodes() const	{ return m_pAInode; }
+
+	// Adds the IDs of all nodes whose origin is inside the box, in ascending order
+	void			ListNodeIDsInBox( CUtlVector<int> &result, const Vector &mins, const Vector &maxs );
 	
 private:
 	friend class CAI_NetworkManager;
 
-	int				GetCachedNode(const Vector &checkPos);
-	void			SetCachedNearestNode(const Vector &checkPos, int nodeID, Hull_t nHull);
+	int				GetCachedNode(const Vector &checkPos, Hull_t nHull, CAI_BaseNPC *pNPC);
+	void			SetCachedNearestNode(const Vector &checkPos, int nodeID, Hull_t nHull, CAI_BaseNPC *pNPC);
 
 	int				ListNodesInBox( CNodeList &list, int maxListCount, const Vector &mins, const Vector &maxs, INodeListFilter *pFilter );
 
 	void			InitZones();
 	void			FloodFillZone( CAI_Node *pNode, int zone );
 
+	void			BuildNodePositions( Hull_t hull );
+	void			BuildNodeGrid();
+	void			GetGridCellRange( const Vector &mins, const Vector &maxs, int *pColMin, int *pColMax, int *pRowMin, int *pRowMax ) const;
+	bool			NodeGridNeedsBuild() const	{ return ( m_GridNodes.Count() != m_iNumNodes ); }
+
 	//---------------------------------
 
 	enum
@@ -123,6 +137,7 @@ private:
 		float	fTime;						// Time tested
 		int		nNearestNode;				// Nearest Node to position
 		int		nHullType;					// Hull	type tested (or HULL_NONE is only visibility tested)
+		EHANDLE	hNPC;						// NPC whose filter was applied (or NULL if none)
 
 	};
 
@@ -131,6 +146,18 @@ private:
 
 	NearNodeCache_T		m_pNearestCache[NEARNODE_CACHE_SIZE];	// Cache of nearest nodes
 	int					m_nNearestCacheIndex;					// Oldest record in the cache
+
+	CUtlVector<Vector>	m_HullPositions[NUM_HULLS];				// Cache of CAI_Node::GetPosition() per hull
+
+	// 2D grid over node origins, used by ListNodesInBox.  Nodes in cell c are
+	// m_GridNodes[ m_GridCellStart[c] ] .. m_GridNodes[ m_GridCellStart[c+1] - 1 ]
+	CUtlVector<int>		m_GridCellStart;
+	CUtlVector<int>		m_GridNodes;
+	float				m_flGridMinX;
+	float				m_flGridMinY;
+	float				m_flGridCellSize;
+	int					m_nGridCols;
+	int					m_nGridRows;
 };
 
 //-----------------------------------------------------------------------------
@@ -176,6 +203,18 @@ Vector PointOnLineNearestPoint(const Vector& vStartPos, const Vector& vEndPos, c
 extern CAI_NetworkManager *	g_pAINetworkManager;			
 extern CAI_Network * 		g_pBigAINet;			
 
+//-----------------------------------------------------------------------------
+
+inline const Vector &CAI_Network::GetCachedNodePosition( Hull_t hull, int nodeID )
+{
+	if ( m_HullPositions[hull].Count() != m_iNumNodes )
+	{
+		BuildNodePositions( hull );
+	}
+
+	return m_HullPositions[hull][nodeID];
+}
+
 //=============================================================================
 
 #endif // AI_NETWORK_H
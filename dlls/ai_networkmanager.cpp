@@ -10,6 +10,8 @@
 #include "filesystem.h"
 #include "utlbuffer.h"
 #include "editor_sendcommand.h"
+#include "checksum_crc.h"
+#include "bspfile.h"
 
 #include "ai_networkmanager.h"
 #include "ai_network.h"
@@ -24,7 +26,48 @@
 #include "tier0/memdbgon.h"
 
 // Increment this to force rebuilding of all networks
-#define	 AINET_VERSION_NUMBER	25
+#define	 AINET_VERSION_NUMBER	26
+
+//-----------------------------------------------------------------------------
+// Binary .ain layout.  The header is followed by numNodes AINetFileNode_t,
+// numLinks AINetFileLink_t and numNodes ints of WC index table, each at the
+// offset recorded in the header.
+//-----------------------------------------------------------------------------
+
+#define AINET_FILE_ID	(('B'<<24)+('N'<<16)+('I'<<8)+'A')		// little-endian "AINB"
+
+#pragma pack(1)
+
+struct AINetFileHeader_t
+{
+	int				id;
+	int				version;
+	unsigned int	bspChecksum;		// CRC of the BSP header the graph was built against
+	int				numNodes;
+	int				numLinks;
+	int				nodeOffset;
+	int				linkOffset;
+	int				nodeIndexOffset;
+};
+
+struct AINetFileNode_t
+{
+	Vector			origin;
+	float			yaw;
+	float			vOffset[NUM_HULLS];
+	int				type;
+	int				info;
+	int				zone;
+};
+
+struct AINetFileLink_t
+{
+	short			srcID;
+	short			destID;
+	unsigned char	acceptedMoveTypes[NUM_HULLS];
+};
+
+#pragma pack()
 
 //-----------------------------------------------------------------------------
 
@@ -58,6 +101,9 @@ CON_COMMAND(ai_debug_node_connect, "Debug the attempted connection between two n
 
 ConVar g_ai_norebuildgraph( "ai_norebuildgraph", "0" );
 
+// Also write maps/graphs/<map>.ain.txt in the old text format when a graph is saved
+ConVar ai_graph_text_export( "ai_graph_text_export", "0" );
+
 //-----------------------------------------------------------------------------
 // CAI_NetworkManager
 //
@@ -212,8 +258,147 @@ void CAI_NetworkManager::SaveNetworkGraph( void )
 	strcat( szNrpFilename, STRING( gpGlobals->mapname ) );
 	strcat( szNrpFilename, ".ain" );
 
-	CUtlBuffer buf( 0, 256, true );
+	CUtlBuffer buf;
+	SaveNetworkGraphBinary( buf );
+
+	// -------------------------------
+	// Write the file out
+	// -------------------------------
+
+	FileHandle_t fh = filesystem->Open ( szNrpFilename, "wb" );
+	if ( !fh )
+	{
+		DevWarning( 2, "Couldn't create %s!\n", szNrpFilename );
+		return;
+	}
+
+	filesystem->Write( buf.Base(), buf.TellPut(), fh );
+	filesystem->Close(fh);
+
+	// -------------------------------
+	// Text copy for debugging
+	// -------------------------------
+	if ( ai_graph_text_export.GetBool() )
+	{
+		char szTextFilename[MAX_PATH];
+		Q_snprintf( szTextFilename, sizeof( szTextFilename ), "%s.txt", szNrpFilename );
+
+		CUtlBuffer textBuf( 0, 256, true );
+		SaveNetworkGraphText( textBuf );
 
+		fh = filesystem->Open( szTextFilename, "w+" );
+		if ( !fh )
+		{
+			DevWarning( 2, "Couldn't create %s!\n", szTextFilename );
+			return;
+		}
+
+		filesystem->Write( textBuf.Base(), textBuf.TellPut(), fh );
+		filesystem->Close( fh );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:  Writes the network in the binary .ain format: a header followed
+//			 by flat node, link and WC index arrays
+//-----------------------------------------------------------------------------
+
+void CAI_NetworkManager::SaveNetworkGraphBinary( CUtlBuffer &buf )
+{
+	int node;
+	int totalNumLinks = 0;
+	for ( node = 0; node < m_pNetwork->m_iNumNodes; node++)
+	{
+		for (int link = 0; link < m_pNetwork->GetNode(node)->NumLinks(); link++)
+		{
+			// Only count if link source
+			if (node == m_pNetwork->GetNode(node)->GetLinkByIndex(link)->m_iSrcID)
+			{
+				totalNumLinks++;
+			}
+		}
+	}
+
+	AINetFileHeader_t header;
+	memset( &header, 0, sizeof(header) );
+	header.id				= AINET_FILE_ID;
+	header.version			= AINET_VERSION_NUMBER;
+	header.numNodes			= m_pNetwork->m_iNumNodes;
+	header.numLinks			= totalNumLinks;
+	header.nodeOffset		= sizeof( AINetFileHeader_t );
+	header.linkOffset		= header.nodeOffset + header.numNodes * sizeof( AINetFileNode_t );
+	header.nodeIndexOffset	= header.linkOffset + header.numLinks * sizeof( AINetFileLink_t );
+	
+	if ( !GetBSPChecksum( STRING( gpGlobals->mapname ), &header.bspChecksum ) )
+	{
+		DevWarning( 2, "Couldn't checksum BSP for %s, graph will be rebuilt on next load\n", STRING( gpGlobals->mapname ) );
+	}
+
+	buf.Put( &header, sizeof(header) );
+
+	// -------------------------------
+	// Dump all the nodes
+	// -------------------------------
+	for ( node = 0; node < m_pNetwork->m_iNumNodes; node++)
+	{
+		CAI_Node *pNode = m_pNetwork->GetNode(node);
+		Assert( pNode->GetZone() != AI_NODE_ZONE_UNKNOWN );
+
+		AINetFileNode_t fileNode;
+		fileNode.origin		= pNode->GetOrigin();
+		fileNode.yaw		= pNode->GetYaw();
+		for (int hull =0;hull<NUM_HULLS;hull++)
+		{
+			fileNode.vOffset[hull] = pNode->m_flVOffset[hull];
+		}
+		fileNode.type		= pNode->GetType();
+		fileNode.info		= pNode->m_eNodeInfo;
+		fileNode.zone		= pNode->GetZone();
+
+		buf.Put( &fileNode, sizeof(fileNode) );
+	}
+
+	// -------------------------------
+	// Dump all the links
+	// -------------------------------
+	for (node = 0; node < m_pNetwork->m_iNumNodes; node++)
+	{
+		for (int link = 0; link < m_pNetwork->GetNode(node)->NumLinks(); link++)
+		{
+			CAI_Link *pLink = m_pNetwork->GetNode(node)->GetLinkByIndex(link);
+
+			// Only dump if link source
+			if (node == pLink->m_iSrcID)
+			{
+				AINetFileLink_t fileLink;
+				fileLink.srcID	= pLink->m_iSrcID;
+				fileLink.destID	= pLink->m_iDestID;
+
+				for (int hull =0;hull<NUM_HULLS;hull++)
+				{
+					// Only movement capabilities are ever stored on links
+					Assert( pLink->m_iAcceptedMoveTypes[hull] >= 0 && pLink->m_iAcceptedMoveTypes[hull] <= 0xff );
+					fileLink.acceptedMoveTypes[hull] = (unsigned char)pLink->m_iAcceptedMoveTypes[hull];
+				}
+
+				buf.Put( &fileLink, sizeof(fileLink) );
+			}
+		}
+	}
+
+	// -------------------------------
+	// Dump WC lookup table
+	// -------------------------------
+	buf.Put( GetEditOps()->m_pNodeIndexTable, m_pNetwork->m_iNumNodes * sizeof(int) );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:  Writes the network in the original text format. Loadable, but
+//			 only written when ai_graph_text_export is set
+//-----------------------------------------------------------------------------
+
+void CAI_NetworkManager::SaveNetworkGraphText( CUtlBuffer &buf )
+{
 	// ---------------------------
 	// Save the version number
 	// ---------------------------
@@ -282,20 +467,6 @@ void CAI_NetworkManager::SaveNetworkGraph( void )
 	{
 		buf.Printf( "%d ",GetEditOps()->m_pNodeIndexTable[node]);
 	}
-
-	// -------------------------------
-	// Write the file out
-	// -------------------------------
-
-	FileHandle_t fh = filesystem->Open ( szNrpFilename, "w+" );
-	if ( !fh )
-	{
-		DevWarning( 2, "Couldn't create %s!\n", szNrpFilename );
-		return;
-	}
-
-	filesystem->Write( buf.Base(), buf.TellPut(), fh );
-	filesystem->Close(fh);
 }
 
 /* Keep this around for debugging
@@ -434,7 +605,7 @@ void CAI_NetworkManager::LoadNetworkGraph( void )
 	strcat( szNrpFilename, STRING( gpGlobals->mapname ) );
 	strcat( szNrpFilename, ".ain" );
 
-	FileHandle_t fh = filesystem->Open ( szNrpFilename, "r" );
+	FileHandle_t fh = filesystem->Open ( szNrpFilename, "rb" );
 
 	// -----------------------------
 	// Make sure the file opened ok
@@ -445,14 +616,172 @@ void CAI_NetworkManager::LoadNetworkGraph( void )
 		return;
 	}
  
-	// Create a text buffer for unserialization
-	int fileSize = filesystem->Size( fh );
-	CUtlBuffer buf( 0, fileSize, true );
-	
 	// Read the file in one gulp
+	int fileSize = filesystem->Size( fh );
+	CUtlBuffer buf( 0, fileSize );
 	filesystem->Read( buf.Base(), fileSize, fh );
 	filesystem->Close( fh );
+	buf.SeekPut( CUtlBuffer::SEEK_HEAD, fileSize );
+
+	// ---------------------------------------------------
+	// Binary graphs start with AINET_FILE_ID, anything
+	// else is treated as the old text format
+	// ---------------------------------------------------
+	bool bLoaded;
+	if ( fileSize >= (int)sizeof(int) && *(int *)buf.Base() == AINET_FILE_ID )
+	{
+		bLoaded = LoadNetworkGraphBinary( buf );
+	}
+	else
+	{
+		CUtlBuffer textBuf( buf.Base(), fileSize, true );
+		bLoaded = LoadNetworkGraphText( textBuf );
+	}
+
+	if ( !bLoaded )
+	{
+		return;
+	}
+
+	// Node types and offsets were read after the nodes were added
+	m_pNetwork->InvalidateNodePositions();
+
+	gm_fNetworksLoaded = true;
+}
 
+//-----------------------------------------------------------------------------
+// Purpose:  Checks that count elements at offset lie inside the file.  Written
+//			 so that nothing read from a bad file can overflow the sums.
+//-----------------------------------------------------------------------------
+
+static bool AINetFileArrayFits( int offset, int count, int elementSize, int fileSize )
+{
+	if ( offset < 0 || offset > fileSize || count < 0 )
+	{
+		return false;
+	}
+
+	return ( count <= ( fileSize - offset ) / elementSize );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:  Loads a graph written by SaveNetworkGraphBinary.  The node and
+//			 link arrays are read in place out of the file buffer.
+//-----------------------------------------------------------------------------
+
+bool CAI_NetworkManager::LoadNetworkGraphBinary( CUtlBuffer &buf )
+{
+	int fileSize = buf.TellPut();
+	if ( fileSize < (int)sizeof(AINetFileHeader_t) )
+	{
+		return false;
+	}
+
+	const AINetFileHeader_t *pHeader = (const AINetFileHeader_t *)buf.Base();
+	if ( pHeader->version != AINET_VERSION_NUMBER )
+	{
+		return false;
+	}
+
+	// ---------------------------------------------------
+	// Make sure the arrays are where the header says
+	// ---------------------------------------------------
+	if ( pHeader->numNodes > MAX_NODES ||
+		 pHeader->nodeOffset < (int)sizeof(AINetFileHeader_t) ||
+		 !AINetFileArrayFits( pHeader->nodeOffset, pHeader->numNodes, sizeof(AINetFileNode_t), fileSize ) ||
+		 !AINetFileArrayFits( pHeader->linkOffset, pHeader->numLinks, sizeof(AINetFileLink_t), fileSize ) ||
+		 !AINetFileArrayFits( pHeader->nodeIndexOffset, pHeader->numNodes, sizeof(int), fileSize ) )
+	{
+		Warning( "LoadNetworkGraph:  Graph file is corrupt, rebuilding\n" );
+		return false;
+	}
+
+	// ---------------------------------------------------
+	// The graph is only good for the BSP it was built from
+	// ---------------------------------------------------
+	unsigned int bspChecksum;
+	if ( !GetBSPChecksum( STRING( gpGlobals->mapname ), &bspChecksum ) || bspChecksum != pHeader->bspChecksum )
+	{
+		if ( !g_ai_norebuildgraph.GetInt() )
+		{
+			DevMsg( 2, ".AIN File does not match BSP, will be updated\n\n" );
+			return false;
+		}
+		DevMsg( 2, ".AIN File does not match BSP, *NOT* updating. User Override.\n\n" );
+	}
+
+	int numNodes = pHeader->numNodes;
+	const AINetFileNode_t *pFileNodes = (const AINetFileNode_t *)( (const byte *)buf.Base() + pHeader->nodeOffset );
+	const AINetFileLink_t *pFileLinks = (const AINetFileLink_t *)( (const byte *)buf.Base() + pHeader->linkOffset );
+	const int *pNodeIndexTable		  = (const int *)( (const byte *)buf.Base() + pHeader->nodeIndexOffset );
+
+	m_pNetwork->m_pAInode = new CAI_Node*[ max( numNodes, 1 ) ];
+
+	// -------------------------------
+	// Load all the nodes
+	// -------------------------------
+	int node;
+	for ( node = 0; node < numNodes; node++)
+	{
+		const AINetFileNode_t &fileNode = pFileNodes[node];
+
+		CAI_Node *new_node = m_pNetwork->AddNode( fileNode.origin, fileNode.yaw );
+
+		for (int hull =0;hull<NUM_HULLS;hull++)
+		{
+			new_node->m_flVOffset[hull] = fileNode.vOffset[hull];
+		}
+
+		new_node->m_eNodeType	= (NodeType_e)fileNode.type;
+		new_node->m_eNodeInfo	= fileNode.info;
+		new_node->m_zone		= fileNode.zone;
+		Assert( new_node->GetZone() != AI_NODE_ZONE_UNKNOWN );
+	}
+
+	// -------------------------------
+	// Load all the links
+	// -------------------------------
+	for (int link = 0; link < pHeader->numLinks; link++)
+	{
+		const AINetFileLink_t &fileLink = pFileLinks[link];
+
+		if ( fileLink.srcID < 0 || fileLink.srcID >= numNodes || 
+			 fileLink.destID < 0 || fileLink.destID >= numNodes )
+		{
+			Assert( 0 );
+			continue;
+		}
+
+		CAI_Link *new_link = new CAI_Link;
+
+		new_link->m_iSrcID	= fileLink.srcID;
+		new_link->m_iDestID	= fileLink.destID;
+
+		for (int hull =0;hull<NUM_HULLS;hull++)
+		{
+			new_link->m_iAcceptedMoveTypes[hull] = fileLink.acceptedMoveTypes[hull];
+		}
+		// Now add link to source and destination nodes
+		m_pNetwork->GetNode(new_link->m_iSrcID)->AddLink(new_link);
+		m_pNetwork->GetNode(new_link->m_iDestID)->AddLink(new_link);
+	}
+
+	// -------------------------------
+	// Load WC lookup table
+	// -------------------------------
+	delete [] GetEditOps()->m_pNodeIndexTable;
+	GetEditOps()->m_pNodeIndexTable	= new int[max( m_pNetwork->m_iNumNodes, 1 )];
+	memcpy( GetEditOps()->m_pNodeIndexTable, pNodeIndexTable, m_pNetwork->m_iNumNodes * sizeof(int) );
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:  Loads a graph written by SaveNetworkGraphText
+//-----------------------------------------------------------------------------
+
+bool CAI_NetworkManager::LoadNetworkGraphText( CUtlBuffer &buf )
+{
 	// ---------------------------
 	// Check the version number
 	// ---------------------------
@@ -462,7 +791,7 @@ void CAI_NetworkManager::LoadNetworkGraph( void )
 	buf.Scanf("%i\n",&version);
 	if (version!=AINET_VERSION_NUMBER)
 	{
-		return;
+		return false;
 	}
 
 	// ----------------------------------------
@@ -557,7 +886,7 @@ void CAI_NetworkManager::LoadNetworkGraph( void )
 		buf.Scanf("%d",&GetEditOps()->m_pNodeIndexTable[node]);
 	}
 
-	gm_fNetworksLoaded = true;
+	return true;
 }
 
 /* Keep this around for debugging
@@ -789,6 +1118,39 @@ void CAI_NetworkManager::InitializeAINetworks()
 #define MAX_PATH	256
 #endif
 
+//-----------------------------------------------------------------------------
+// Purpose: CRCs the map's BSP header.  The lump directory and map revision
+//			change whenever the map is recompiled, so this is enough to tell
+//			whether a graph was built from this BSP without reading all of it.
+//-----------------------------------------------------------------------------
+
+bool CAI_NetworkManager::GetBSPChecksum( const char *szMapName, unsigned int *pChecksum )
+{
+	*pChecksum = 0;
+
+	char szBspFilename[MAX_PATH];
+	Q_snprintf( szBspFilename, sizeof( szBspFilename ), "maps/%s.bsp", szMapName );
+
+	FileHandle_t fh = filesystem->Open( szBspFilename, "rb" );
+	if ( !fh )
+		return false;
+
+	dheader_t header;
+	int nRead = filesystem->Read( &header, sizeof(header), fh );
+	filesystem->Close( fh );
+
+	if ( nRead != sizeof(header) )
+		return false;
+
+	CRC32_t crc;
+	CRC32_Init( &crc );
+	CRC32_ProcessBuffer( &crc, &header, sizeof(header) );
+	CRC32_Final( &crc );
+
+	*pChecksum = (unsigned int)crc;
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Returns true if the AINetwork data files are up to date
 //-----------------------------------------------------------------------------
@@ -1949,6 +2311,11 @@ void CAI_NetworkBuilder::Rebuild( CAI_Network *pNetwork )
 void CAI_NetworkBuilder::BeginBuild()
 {
 	m_pTestHull = CAI_TestHull::GetTestHull();
+
+	for ( int hull = 0; hull < NUM_HULLS; hull++ )
+	{
+		m_CanFitAtNode[hull].RemoveAll();
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -1957,6 +2324,11 @@ void CAI_NetworkBuilder::EndBuild()
 {
 	m_NeighborsTable.SetSize(0);
 	m_DidSetNeighborsTable.Resize(0);
+	m_CandidateNodes.Purge();
+	for ( int hull = 0; hull < NUM_HULLS; hull++ )
+	{
+		m_CanFitAtNode[hull].Purge();
+	}
 	CAI_TestHull::ReturnTestHull();
 }
 
@@ -2036,9 +2408,16 @@ void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
 		// Make sure all the links are clear
 		ppNodes[i]->m_iNumLinks = 0;
 	}
+	int nextProgress = nNodes / 10;
 	for (i = 0; i < nNodes; i++)
 	{	
 		InitLinks( pNetwork, ppNodes[i] );
+
+		if ( i == nextProgress && i > 0 )
+		{
+			Msg( "   %d%% (%d of %d nodes)\n", ( 100 * i ) / nNodes, i, nNodes );
+			nextProgress += nNodes / 10;
+		}
 	}
 	timer.End();
 	Msg( "...done determining links. %f seconds\n", timer.GetDuration().GetSeconds() );
@@ -2296,6 +2675,7 @@ void CAI_NetworkBuilder::InitNodePosition(CAI_Network *pNetwork, CAI_Node *pNode
 	else if (pNode->m_eNodeType == NODE_CLIMB)
 	{
 		InitClimbNodePosition(pNetwork, pNode);
+		pNetwork->InvalidateNodePositions();
 		return;
 	}
 
@@ -2304,6 +2684,7 @@ void CAI_NetworkBuilder::InitNodePosition(CAI_Network *pNetwork, CAI_Node *pNode
 	else if (pNode->m_eNodeType == NODE_GROUND)
 	{
 		InitGroundNodePosition( pNetwork, pNode );
+		pNetwork->InvalidateNodePositions();
 
 		if (pNode->m_flVOffset[HULL_SMALL_CENTERED] < -100)
 		{
@@ -2346,9 +2727,15 @@ void CAI_NetworkBuilder::InitVisibility(CAI_Network *pNetwork, CAI_Node *pNode)
 	// position using the smallest hull to make sure were not in geometry
 	Vector srcPos = pNode->GetPosition(HULL_SMALL_CENTERED);
 
-	// Check the visibility on every other node in the network
-	for (int testnode = 0; testnode < pNetwork->NumNodes(); testnode++ )
+	// Nothing past the air link distance can become a neighbor, so only
+	// look at the nodes in that box
+	Vector ext( MAX_AIR_NODE_LINK_DIST, MAX_AIR_NODE_LINK_DIST, MAX_AIR_NODE_LINK_DIST );
+	pNetwork->ListNodeIDsInBox( m_CandidateNodes, pNode->m_vOrigin - ext, pNode->m_vOrigin + ext );
+
+	// Check the visibility on every other nearby node in the network
+	for (int candidate = 0; candidate < m_CandidateNodes.Count(); candidate++ )
   	{
+		int testnode = m_CandidateNodes[candidate];
 		CAI_Node *testNode = pNetwork->GetNode( testnode );
 
 		if ( DebuggingConnect( pNode->m_iID, testnode ) )
@@ -2528,10 +2915,25 @@ void CAI_NetworkBuilder::InitNeighbors(CAI_Network *pNetwork, CAI_Node *pNode)
 	{
 	AI_PROFILE_SCOPE( CAI_Node_InitNeighbors );
 
+	// Only the nearby nodes can have been marked visible
+	CUtlVector<int> &neighbors = m_CandidateNodes;
+	int nNeighbors = 0;
+	int candidate;
+	for ( candidate = 0; candidate < neighbors.Count(); candidate++ )
+	{
+		if ( m_NeighborsTable[pNode->m_iID].GetBit( neighbors[candidate] ) )
+		{
+			neighbors[nNeighbors++] = neighbors[candidate];
+		}
+	}
+	neighbors.SetCount( nNeighbors );
+
 	// Now check each neighbor against all other neighbors to see if one of
 	// them is a redundant connection
-	for (int checknode = 0; checknode < pNetwork->NumNodes(); checknode++ )
+	for ( int iCheck = 0; iCheck < nNeighbors; iCheck++ )
 	{
+		int checknode = neighbors[iCheck];
+
 		if ( DebuggingConnect( pNode->m_iID, checknode ) )
 		{
 			Msg( "" ); // break here..
@@ -2552,8 +2954,10 @@ void CAI_NetworkBuilder::InitNeighbors(CAI_Network *pNetwork, CAI_Node *pNode)
 
 		CAI_Node *pCheckNode = pNetwork->GetNode(checknode);
 
-		for (int testnode = 0; testnode < pNetwork->NumNodes(); testnode++ )
+		for ( int iTest = 0; iTest < nNeighbors; iTest++ )
 		{
+			int testnode = neighbors[iTest];
+
 			// don't check against itself
 			if (( testnode == checknode ) || (testnode == pNode->m_iID))
 			{
@@ -2651,6 +3055,30 @@ static bool IsInLineForClimb( const Vector &srcPos, const Vector &srcFacing, con
 	return true;
 }
 
+//-------------------------------------
+// Purpose: CanFitAtNode() for the test hull, remembered for the rest of the
+//			build since nodes don't move once positions are initialized
+//-------------------------------------
+
+bool CAI_NetworkBuilder::TestHullCanFitAtNode( int nodeID, Hull_t hull )
+{
+	CUtlVector<char> &canFit = m_CanFitAtNode[hull];
+	
+	if ( canFit.Count() <= nodeID )
+	{
+		int iFirstNew = canFit.Count();
+		canFit.SetCount( nodeID + 1 );
+		memset( canFit.Base() + iFirstNew, -1, canFit.Count() - iFirstNew );
+	}
+
+	if ( canFit[nodeID] == -1 )
+	{
+		canFit[nodeID] = m_pTestHull->GetNavigator()->CanFitAtNode( nodeID, MASK_NPCWORLDSTATIC );
+	}
+
+	return ( canFit[nodeID] != 0 );
+}
+
 //-------------------------------------
 
 int CAI_NetworkBuilder::ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNode, Hull_t hull )
@@ -2676,14 +3104,13 @@ int CAI_NetworkBuilder::ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNo
 	// ==============================================================
 	// FIRST CHECK IF HULL CAN EVEN FIT AT THESE NODES
 	// ==============================================================
-	// @Note (toml 02-10-03): this should be optimized, caching the results of CanFitAtNode() 
-	if ( !m_pTestHull->GetNavigator()->CanFitAtNode(srcId,MASK_NPCWORLDSTATIC) )
+	if ( !TestHullCanFitAtNode( srcId, hull ) )
 	{
 		DebugConnectMsg( srcId, destId, "      Cannot fit at node %d\n", srcId );
 		return 0;
 	}
 	
-	if ( !m_pTestHull->GetNavigator()->CanFitAtNode(destId,MASK_NPCWORLDSTATIC) )
+	if ( !TestHullCanFitAtNode( destId, hull ) )
 	{
 		DebugConnectMsg( srcId, destId, "      Cannot fit at node %d\n", destId );
 		return 0;
@@ -19,6 +19,7 @@ class CAI_Network;
 class CAI_Node;
 class CAI_Link;
 class CAI_TestHull;
+class CUtlBuffer;
 
 //-----------------------------------------------------------------------------
 // CAI_NetworkManager
@@ -63,7 +64,12 @@ private:
 	void			DelayedInit();
 	void			RebuildThink();
 	void			SaveNetworkGraph( void) ;	
+	void			SaveNetworkGraphBinary( CUtlBuffer &buf );
+	void			SaveNetworkGraphText( CUtlBuffer &buf );
+	bool			LoadNetworkGraphBinary( CUtlBuffer &buf );
+	bool			LoadNetworkGraphText( CUtlBuffer &buf );
 	static bool		IsAIFileCurrent( const char *szMapName );		
+	static bool		GetBSPChecksum( const char *szMapName, unsigned int *pChecksum );
 	
 	static bool				gm_fNetworksLoaded;							// Have AINetworks been loaded
 	
@@ -97,6 +103,7 @@ private:
 	void			FloodFillZone( CAI_Node **ppNodes, CAI_Node *pNode, int zone );
 
 	int				ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNode, Hull_t hull );
+	bool			TestHullCanFitAtNode( int nodeID, Hull_t hull );
 	
 	void 			BeginBuild();
 	void			EndBuild();
@@ -104,6 +111,9 @@ private:
 	CUtlVector<CBitString>	m_NeighborsTable;
 	CBitString				m_DidSetNeighborsTable;
 	CAI_TestHull *			m_pTestHull;
+
+	CUtlVector<int>			m_CandidateNodes;			// Scratch list of nodes near the node being built
+	CUtlVector<char>		m_CanFitAtNode[NUM_HULLS];	// -1 untested, else result of CanFitAtNode()
 };
 
 extern CAI_NetworkBuilder g_AINetworkBuilder;
@@ -20,6 +20,7 @@
 #include "ai_moveprobe.h"
 #include "ai_dynamiclink.h"
 #include "bitstring.h"
+#include "utlpriorityqueue.h"
 
 //@todo: bad dependency!
 #include "ai_navigator.h"
@@ -223,6 +224,68 @@ bool CAI_Pathfinder::IsLinkStillStale(int moveType, CAI_Link *nodeLink)
 	return true;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Open set entry for FindBestPath. Entries are not updated in place
+//			when a node's cost drops; a new entry is pushed instead and the
+//			stale one is discarded when it reaches the head.
+//-----------------------------------------------------------------------------
+
+struct AI_OpenNode_t
+{
+	int		nodeID;
+	float	f;
+};
+
+static bool OpenNodeLessFunc( AI_OpenNode_t const &a, AI_OpenNode_t const &b )
+{
+	// Head of the queue is the cheapest node, ties go to the lowest node id
+	if ( a.f != b.f )
+		return ( a.f > b.f );
+	return ( a.nodeID > b.nodeID );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Per node scratch for FindBestPath.  The outermost search uses a
+//			shared instance that is kept between searches and only reallocated
+//			when the node count changes; a search started from inside another
+//			(e.g., from an IsUnusableNode or MovementCost override) gets its own.
+//-----------------------------------------------------------------------------
+
+struct AI_PathScratch_t
+{
+	AI_PathScratch_t() : openSet( 0, 0, OpenNodeLessFunc ) {}
+
+	void Init( int nNodes )
+	{
+		if ( nodeG.Count() != nNodes )
+		{
+			openBS.Resize( nNodes );
+			closeBS.Resize( nNodes );
+			nodeG.SetCount( nNodes );
+			nodeF.SetCount( nNodes );
+			nodeP.SetCount( nNodes );
+		}
+		openSet.RemoveAll();
+	}
+
+	CUtlPriorityQueue<AI_OpenNode_t> openSet;
+	CBitString			openBS;
+	CBitString			closeBS;
+	CUtlVector<float>	nodeG;
+	CUtlVector<float>	nodeF;
+	CUtlVector<int>		nodeP;		// Node parent 
+};
+
+static AI_PathScratch_t	g_AIPathScratch;
+static int				g_nAIPathSearchDepth;
+
+class CAI_PathSearchScope
+{
+public:
+	CAI_PathSearchScope()	{ g_nAIPathSearchDepth++; }
+	~CAI_PathSearchScope()	{ g_nAIPathSearchDepth--; }
+};
+
 //-----------------------------------------------------------------------------
 // Purpose: Build a path between two nodes
 //-----------------------------------------------------------------------------
@@ -238,35 +301,57 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 
 	int nNodes = GetNetwork()->NumNodes();
 	CAI_Node **pAInode = GetNetwork()->AccessNodes();
-
-	CBitString	openBS(nNodes);
-	CBitString	closeBS(nNodes);
+	Hull_t hull = GetHullType();
 
 	// ------------- INITIALIZE ------------------------
-	float* nodeG = (float *)stackalloc( nNodes * sizeof(float) );
-	float* nodeH = (float *)stackalloc( nNodes * sizeof(float) );
-	float* nodeF = (float *)stackalloc( nNodes * sizeof(float) );
-	int*   nodeP = (int *)stackalloc( nNodes * sizeof(int) );		// Node parent 
+	AI_PathScratch_t nestedScratch;
+	AI_PathScratch_t &scratch = ( g_nAIPathSearchDepth == 0 ) ? g_AIPathScratch : nestedScratch;
+	CAI_PathSearchScope searchScope;
 
+	scratch.Init( nNodes );
+
+	CBitString &openBS	= scratch.openBS;
+	CBitString &closeBS	= scratch.closeBS;
+	float* nodeG = scratch.nodeG.Base();
+	float* nodeF = scratch.nodeF.Base();
+	int*   nodeP = scratch.nodeP.Base();
+
+	openBS.ClearAllBits();
+	closeBS.ClearAllBits();
 	for (int node=0;node<nNodes;node++)
 	{
 		nodeG[node] = FLT_MAX;
 		nodeP[node] = -1;
 	}
 
-	nodeG[startID] = 0;
+	// A copy, since the position cache is a vector that can be rebuilt
+	Vector vEndPos = GetNetwork()->GetCachedNodePosition( hull, endID );
 
-	nodeH[startID] = 0.1*(pAInode[startID]->GetPosition(GetHullType())-pAInode[endID]->GetPosition(GetHullType())).Length(); // Don't want to over estimate
-	nodeF[startID] = nodeG[startID] + nodeH[startID];
+	nodeG[startID] = 0;
+	nodeF[startID] = 0.1*(GetNetwork()->GetCachedNodePosition( hull, startID )-vEndPos).Length(); // Don't want to over estimate
 
 	openBS.SetBit(startID);
 	closeBS.SetBit( startID );
 
+	CUtlPriorityQueue<AI_OpenNode_t> &openSet = scratch.openSet;
+
+	AI_OpenNode_t entry;
+	entry.nodeID = startID;
+	entry.f		 = nodeF[startID];
+	openSet.Insert( entry );
+
 	// --------------- FIND BEST PATH ------------------
-	while (!openBS.IsAllClear()) 
+	while ( openSet.Count() ) 
 	{
-		int smallestID = CAI_Network::FindBSSmallest(&openBS,nodeF,nNodes);
-	
+		entry = openSet.ElementAtHead();
+		openSet.RemoveAtHead();
+
+		int smallestID = entry.nodeID;
+
+		// Skip entries superseded by a cheaper one
+		if ( !openBS.GetBit(smallestID) || entry.f != nodeF[smallestID] )
+			continue;
+
 		openBS.ClearBit(smallestID);
 
 		CAI_Node *pSmallestNode = pAInode[smallestID];
@@ -276,6 +361,7 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 
 		if (smallestID == endID) 
 		{
+			openSet.RemoveAll();
 			AI_Waypoint_t* route = MakeRouteFromParents(&nodeP[0], endID);
 			return route;
 		}
@@ -290,11 +376,11 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 				continue;
 
 			// FIXME: the cost function should take into account Node costs (danger, flanking, etc).
-			int moveType = nodeLink->m_iAcceptedMoveTypes[GetHullType()] & CapabilitiesGet();
+			int moveType = nodeLink->m_iAcceptedMoveTypes[hull] & CapabilitiesGet();
 			int testID	 = nodeLink->DestNodeID(smallestID);
 
-			Vector r1 = pSmallestNode->GetPosition(GetHullType());
-			Vector r2 = pAInode[testID]->GetPosition(GetHullType());
+			Vector r1 = GetNetwork()->GetCachedNodePosition( hull, smallestID );
+			Vector r2 = GetNetwork()->GetCachedNodePosition( hull, testID );
 			float dist   = GetOuter()->GetNavigator()->MovementCost( moveType, r1, r2 ); // MovementCost takes ref parameters!!
 
 			if ( dist == FLT_MAX )
@@ -306,11 +392,14 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 			{
 				nodeP[testID] = smallestID;
 				nodeG[testID] = new_g;
-				nodeH[testID] = (pAInode[testID]->GetPosition(GetHullType())-pAInode[endID]->GetPosition(GetHullType())).Length();
-				nodeF[testID] = nodeG[testID] + nodeH[testID];
+				nodeF[testID] = new_g + (GetNetwork()->GetCachedNodePosition( hull, testID )-vEndPos).Length();
 
 				closeBS.SetBit( testID );
 				openBS.SetBit( testID );
+
+				entry.nodeID = testID;
+				entry.f		 = nodeF[testID];
+				openSet.Insert( entry );
 			}
 		}
 	}
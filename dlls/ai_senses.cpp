@@ -36,6 +36,215 @@ struct AISightIterVal_t
 
 #pragma pack(pop)
 
+//=============================================================================
+//
+// CAI_SightGrid
+//
+// Purpose: Buckets all the NPCs into a 2D grid once per frame, so each NPC's
+//			LookForNPCs only has to test the NPCs near it instead of all of them
+//
+//=============================================================================
+
+// NPCs that think later in the frame have moved since the grid was built,
+// so queries are padded by this much.  An NPC that gets further than this
+// from where the grid put it (a teleport, say) marks the grid dirty instead;
+// see AI_NoteNPCMoved().
+#define AI_SIGHT_GRID_SLOP			128.0f
+#define AI_SIGHT_GRID_CELL_SIZE		512.0f
+#define AI_SIGHT_GRID_MAX_DIM		64
+
+class CAI_SightGrid
+{
+public:
+	CAI_SightGrid()
+	 :	m_flBuildTime( -1 ),
+		m_iBuildChangeCount( -1 ),
+		m_bDirty( true )
+	{
+	}
+
+	// Indices into g_AI_Manager.AccessAIs() of NPCs that may be within flDist
+	// of vecOrigin, in ascending order.  The caller does the exact test.
+	void ListNPCs( const Vector &vecOrigin, float flDist, CUtlVector<int> &result );
+
+	// Marks the grid dirty if the NPC is now outside the slop of its cell
+	void NoteMoved( int iEntIndex, const Vector &vecOrigin );
+
+private:
+	void Build();
+
+	float				m_flBuildTime;
+	int					m_iBuildChangeCount;
+	bool				m_bDirty;
+
+	CUtlVector<int>		m_Parented;			// carried by their move parent without being told, so always candidates
+	Vector2D			m_BuildOrigins[MAX_EDICTS];	// where each NPC was at Build(), by entindex
+
+	CUtlVector<int>		m_CellStart;		// AIs in cell c are m_CellAIs[ m_CellStart[c] ] .. m_CellAIs[ m_CellStart[c+1] - 1 ]
+	CUtlVector<int>		m_CellAIs;
+	float				m_flMinX;
+	float				m_flMinY;
+	float				m_flCellSize;
+	int					m_nCols;
+	int					m_nRows;
+};
+
+static CAI_SightGrid g_AISightGrid;
+
+//-----------------------------------------------------------------------------
+
+void CAI_SightGrid::Build()
+{
+	m_flBuildTime = gpGlobals->curtime;
+	m_iBuildChangeCount = g_AI_Manager.GetChangeCount();
+	m_bDirty = false;
+
+	m_CellStart.RemoveAll();
+	m_CellAIs.RemoveAll();
+	m_Parented.RemoveAll();
+
+	int nAIs = g_AI_Manager.NumAIs();
+	CAI_BaseNPC **ppAIs = g_AI_Manager.AccessAIs();
+	if ( !nAIs )
+	{
+		m_nCols = m_nRows = 0;
+		return;
+	}
+
+	float flMaxX, flMaxY;
+	m_flMinX = flMaxX = ppAIs[0]->GetAbsOrigin().x;
+	m_flMinY = flMaxY = ppAIs[0]->GetAbsOrigin().y;
+
+	int i;
+	for ( i = 1; i < nAIs; i++ )
+	{
+		const Vector &origin = ppAIs[i]->GetAbsOrigin();
+		m_flMinX = min( m_flMinX, origin.x );
+		m_flMinY = min( m_flMinY, origin.y );
+		flMaxX	 = max( flMaxX, origin.x );
+		flMaxY	 = max( flMaxY, origin.y );
+	}
+
+	m_flCellSize = max( AI_SIGHT_GRID_CELL_SIZE, max( flMaxX - m_flMinX, flMaxY - m_flMinY ) / ( AI_SIGHT_GRID_MAX_DIM - 1 ) );
+	m_nCols = (int)( ( flMaxX - m_flMinX ) / m_flCellSize ) + 1;
+	m_nRows = (int)( ( flMaxY - m_flMinY ) / m_flCellSize ) + 1;
+
+	int nCells = m_nCols * m_nRows;
+	int *pAICell = (int *)stackalloc( nAIs * sizeof(int) );
+
+	// Count the AIs in each cell, then turn the counts into start offsets
+	m_CellStart.SetCount( nCells + 1 );
+	memset( m_CellStart.Base(), 0, ( nCells + 1 ) * sizeof(int) );
+
+	for ( i = 0; i < nAIs; i++ )
+	{
+		int iEntIndex = ppAIs[i]->entindex();
+		if ( iEntIndex >= 0 && iEntIndex < MAX_EDICTS )
+		{
+			m_BuildOrigins[iEntIndex] = ppAIs[i]->GetAbsOrigin().AsVector2D();
+		}
+
+		if ( ppAIs[i]->GetMoveParent() )
+		{
+			pAICell[i] = -1;
+			m_Parented.AddToTail( i );
+			continue;
+		}
+
+		const Vector &origin = ppAIs[i]->GetAbsOrigin();
+		int col = min( m_nCols - 1, (int)( ( origin.x - m_flMinX ) / m_flCellSize ) );
+		int row = min( m_nRows - 1, (int)( ( origin.y - m_flMinY ) / m_flCellSize ) );
+		pAICell[i] = row * m_nCols + col;
+		m_CellStart[ pAICell[i] + 1 ]++;
+	}
+
+	int cell;
+	for ( cell = 0; cell < nCells; cell++ )
+	{
+		m_CellStart[cell + 1] += m_CellStart[cell];
+	}
+
+	int *pFill = (int *)stackalloc( nCells * sizeof(int) );
+	memcpy( pFill, m_CellStart.Base(), nCells * sizeof(int) );
+
+	m_CellAIs.SetCount( nAIs - m_Parented.Count() );
+	for ( i = 0; i < nAIs; i++ )
+	{
+		if ( pAICell[i] != -1 )
+		{
+			m_CellAIs[ pFill[ pAICell[i] ]++ ] = i;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+static int __cdecl CompareAIIndices( const void *pLeft, const void *pRight )
+{
+	return ( *(const int *)pLeft - *(const int *)pRight );
+}
+
+void CAI_SightGrid::ListNPCs( const Vector &vecOrigin, float flDist, CUtlVector<int> &result )
+{
+	result.RemoveAll();
+
+	if ( m_bDirty || m_flBuildTime != gpGlobals->curtime || m_iBuildChangeCount != g_AI_Manager.GetChangeCount() )
+	{
+		Build();
+	}
+
+	float flReach = flDist + AI_SIGHT_GRID_SLOP;
+	int colMin = max( 0, (int)floor( ( vecOrigin.x - flReach - m_flMinX ) / m_flCellSize ) );
+	int colMax = min( m_nCols - 1, (int)floor( ( vecOrigin.x + flReach - m_flMinX ) / m_flCellSize ) );
+	int rowMin = max( 0, (int)floor( ( vecOrigin.y - flReach - m_flMinY ) / m_flCellSize ) );
+	int rowMax = min( m_nRows - 1, (int)floor( ( vecOrigin.y + flReach - m_flMinY ) / m_flCellSize ) );
+
+	for ( int row = rowMin; row <= rowMax; row++ )
+	{
+		for ( int col = colMin; col <= colMax; col++ )
+		{
+			int cell = row * m_nCols + col;
+			for ( int i = m_CellStart[cell]; i < m_CellStart[cell + 1]; i++ )
+			{
+				result.AddToTail( m_CellAIs[i] );
+			}
+		}
+	}
+
+	result.AddMultipleToTail( m_Parented.Count(), m_Parented.Base() );
+
+	// Keep the order the full scan of g_AI_Manager used
+	if ( result.Count() )
+	{
+		qsort( result.Base(), result.Count(), sizeof(int), CompareAIIndices );
+	}
+}
+
+void CAI_SightGrid::NoteMoved( int iEntIndex, const Vector &vecOrigin )
+{
+	// NPCs added since the build change the AI manager's change count instead
+	if ( m_bDirty || iEntIndex < 0 || iEntIndex >= MAX_EDICTS )
+		return;
+
+	// Measured from the build, not the last step, so small moves can't add up
+	if ( ( vecOrigin.AsVector2D() - m_BuildOrigins[iEntIndex] ).LengthSqr() > AI_SIGHT_GRID_SLOP * AI_SIGHT_GRID_SLOP )
+	{
+		m_bDirty = true;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called by CBaseEntity when an unparented NPC's origin is set.
+//			Positions within AI_SIGHT_GRID_SLOP of where the grid was built
+//			are covered by the query padding; anything further would leave
+//			the NPC outside its cell, so rebuild.
+//-----------------------------------------------------------------------------
+
+void AI_NoteNPCMoved( CBaseEntity *pNPC, const Vector &vecAbsOrigin )
+{
+	g_AISightGrid.NoteMoved( pNPC->entindex(), vecAbsOrigin );
+}
+
 //=============================================================================
 //
 // CAI_Senses
@@ -406,9 +615,14 @@ int CAI_Senses::LookForNPCs( int iDistance )
 		float distSq = ( iDistance * iDistance );
 		const Vector &origin = GetLocalOrigin();
 		CAI_BaseNPC **ppAIs = g_AI_Manager.AccessAIs();
-		
-		for ( int i = 0; i < g_AI_Manager.NumAIs(); i++ )
+
+		CUtlVector<int> &candidates = m_NearbyAIs;
+		g_AISightGrid.ListNPCs( origin, iDistance, candidates );
+
+		for ( int iCandidate = 0; iCandidate < candidates.Count(); iCandidate++ )
 		{
+			int i = candidates[iCandidate];
+
 #if OTHER_IMPORTANT_ENTITIES_NOT_BAKED
 			if ( ppAIs[i] != GetOuter()->GetTarget() && ppAIs[i] != GetOuter()->GetEnemy() )
 #endif
@@ -99,6 +99,8 @@ private:
 	CUtlVector<EHANDLE> m_SeenMisc;
 	
 	CUtlVector<EHANDLE> *m_SeenArrays[3];
+
+	CUtlVector<int>	m_NearbyAIs;				// scratch for LookForNPCs
 	
 	CSimTimer		m_HighPriorityTimer;
 	CSimTimer		m_NPCsTimer;
@@ -107,4 +109,10 @@ private:
 
 //-----------------------------------------------------------------------------
 
+// Tells the sight grid an NPC was moved, so straying far enough from where the
+// grid put it can rebuild it
+void AI_NoteNPCMoved( CBaseEntity *pNPC, const Vector &vecAbsOrigin );
+
+//-----------------------------------------------------------------------------
+
 #endif // AI_SENSES_H
@@ -15,6 +15,9 @@
 #include "AI_Criteria.h"
 #include "AI_ResponseSystem.h"
 #include "isaverestore.h"
+#include "entitylist.h"
+#include "utldict.h"
+#include "tier0/fasttimer.h"
 
 //-----------------------------------------------------------------------------
 
@@ -639,7 +642,7 @@ void CAI_ExpressiveNPC::ModifyOrAppendCriteria( AI_CriteriaSet& set )
 		set.AppendCriteria( "enemy", GetEnemy()->GetClassname() );
 	}
 
-	set.AppendCriteria( "speed", UTIL_VarArgs( "%.3f", GetAbsVelocity().Length() ) );
+	set.AppendCriteria( "speed", GetAbsVelocity().Length() );
 
 	CBaseCombatWeapon *weapon = GetActiveWeapon();
 	if ( weapon )
@@ -661,7 +664,7 @@ void CAI_ExpressiveNPC::ModifyOrAppendCriteria( AI_CriteriaSet& set )
 	}
 	else
 	{
-		set.AppendCriteria( "distancetoplayer", UTIL_VarArgs( "%i", MAX_COORD_RANGE ) );
+		set.AppendCriteria( "distancetoplayer", MAX_COORD_RANGE );
 	}
 }
 
@@ -671,3 +674,162 @@ IResponseSystem *CAI_ExpressiveNPC::GetResponseSystem()
 	// Expressive NPC's use the general response system
 	return g_pResponseSystem;
 }
+
+//-----------------------------------------------------------------------------
+// Times building criteria sets and querying the response system for every
+// expressive NPC class with a factory.  NPCs in the level are benched as they
+// are; a class with none in the level is benched on a temporary, unspawned
+// instance.
+//-----------------------------------------------------------------------------
+
+struct SpeechBenchClass_t
+{
+	bool	bUnspawned;
+	int		nNPCs;
+	int		nCriteria;
+	int		nMatched;
+	float	flBuildMs;
+	float	flQueryMs;
+};
+
+CON_COMMAND( ai_speech_bench, "Time criteria sets and rule matching for each talker class: ai_speech_bench [concept] [iterations]" )
+{
+	const char *pszConcept = ( engine->Cmd_Argc() > 1 ) ? engine->Cmd_Argv( 1 ) : "TLK_IDLE";
+	int nIterations = ( engine->Cmd_Argc() > 2 ) ? atoi( engine->Cmd_Argv( 2 ) ) : 100;
+	if ( nIterations < 1 )
+	{
+		nIterations = 1;
+	}
+
+	CUtlDict< SpeechBenchClass_t, int > classes( true );
+	CFastTimer timer;
+	int i;
+
+	CUtlVector<CBaseEntity *> talkers;
+	for ( CBaseEntity *pEntity = gEntList.FirstEnt(); pEntity; pEntity = gEntList.NextEnt( pEntity ) )
+	{
+		if ( dynamic_cast< CAI_ExpressiveNPC * >( pEntity ) )
+		{
+			talkers.AddToTail( pEntity );
+		}
+	}
+
+	// Classes with nobody in the level get a temporary.  Temporaries are only
+	// constructed, never spawned, and are removed once the bench is done.
+	CUtlVector<const char *> classNames;
+	CUtlVector<CBaseEntity *> temporaries;
+	EntityFactoryDictionary()->GetFactoryNames( classNames );
+	for ( i = 0; i < classNames.Count(); i++ )
+	{
+		if ( gEntList.FindEntityByClassname( NULL, classNames[i] ) )
+			continue;
+
+		// Players and the world are tied to fixed edicts
+		if ( !stricmp( classNames[i], "worldspawn" ) || !stricmp( classNames[i], "player" ) )
+			continue;
+
+		CBaseEntity *pEntity = CreateEntityByName( classNames[i] );
+		if ( !pEntity )
+			continue;
+
+		if ( dynamic_cast< CAI_ExpressiveNPC * >( pEntity ) )
+		{
+			talkers.AddToTail( pEntity );
+			temporaries.AddToTail( pEntity );
+		}
+		else
+		{
+			UTIL_RemoveImmediate( pEntity );
+		}
+	}
+
+	for ( int iTalker = 0; iTalker < talkers.Count(); iTalker++ )
+	{
+		CBaseEntity *pEntity = talkers[ iTalker ];
+
+		IResponseSystem *rs = pEntity->GetResponseSystem();
+		if ( !rs )
+			continue;
+
+		int iClass = classes.Find( pEntity->GetClassname() );
+		if ( iClass == classes.InvalidIndex() )
+		{
+			iClass = classes.Insert( pEntity->GetClassname() );
+			memset( &classes[ iClass ], 0, sizeof( SpeechBenchClass_t ) );
+			classes[ iClass ].bUnspawned = ( temporaries.Find( pEntity ) != temporaries.InvalidIndex() );
+		}
+		SpeechBenchClass_t &stats = classes[ iClass ];
+
+		// Build the set the way CAI_Expresser::Speak does
+		timer.Start();
+		for ( i = 0; i < nIterations; i++ )
+		{
+			AI_CriteriaSet set;
+			set.AppendCriteria( "concept", pszConcept, CONCEPT_WEIGHT );
+			pEntity->ModifyOrAppendCriteria( set );
+			CBasePlayer::ModifyOrAppendPlayerCriteria( set );
+			if ( i == 0 )
+			{
+				stats.nCriteria += set.GetCount();
+			}
+		}
+		timer.End();
+		stats.flBuildMs += timer.GetDuration().GetMillisecondsF();
+
+		AI_CriteriaSet set;
+		set.AppendCriteria( "concept", pszConcept, CONCEPT_WEIGHT );
+		pEntity->ModifyOrAppendCriteria( set );
+		CBasePlayer::ModifyOrAppendPlayerCriteria( set );
+
+		// Match and score only: picking a response would deplete groups and
+		// disable match once rules, changing what the NPCs say afterwards
+		timer.Start();
+		for ( i = 0; i < nIterations; i++ )
+		{
+			if ( rs->HasMatchingRule( set ) && i == 0 )
+			{
+				stats.nMatched++;
+			}
+		}
+		timer.End();
+		stats.flQueryMs += timer.GetDuration().GetMillisecondsF();
+
+		stats.nNPCs++;
+	}
+
+	for ( i = 0; i < temporaries.Count(); i++ )
+	{
+		UTIL_RemoveImmediate( temporaries[ i ] );
+	}
+
+	if ( !classes.Count() )
+	{
+		Msg( "ai_speech_bench: no expressive NPC classes\n" );
+		return;
+	}
+
+	Msg( "ai_speech_bench: concept %s, %d iterations per NPC\n", pszConcept, nIterations );
+	Msg( "  %-32s %5s %8s %9s %12s %12s\n", "class", "npcs", "criteria", "matched", "build us", "match us" );
+
+	int nTotal = 0;
+	float flBuildMs = 0.0f, flQueryMs = 0.0f;
+	for ( i = classes.First(); i != classes.InvalidIndex(); i = classes.Next( i ) )
+	{
+		const SpeechBenchClass_t &stats = classes[ i ];
+		float flScale = 1000.0f / ( (float)stats.nNPCs * nIterations );
+		Msg( "  %-31s%c %5d %8d %9d %12.2f %12.2f\n", classes.GetElementName( i ), stats.bUnspawned ? '*' : ' ', stats.nNPCs, 
+			stats.nCriteria / stats.nNPCs, stats.nMatched, stats.flBuildMs * flScale, stats.flQueryMs * flScale );
+
+		nTotal += stats.nNPCs;
+		flBuildMs += stats.flBuildMs;
+		flQueryMs += stats.flQueryMs;
+	}
+
+	float flSeconds = ( flBuildMs + flQueryMs ) * 0.001f;
+	Msg( "  %d NPCs, %.0f speech queries/sec (%.2fms building sets, %.2fms matching rules)\n", 
+		nTotal, flSeconds > 0.0f ? ( nTotal * nIterations ) / flSeconds : 0.0f, flBuildMs, flQueryMs );
+	if ( temporaries.Count() )
+	{
+		Msg( "  * not in the level, benched on an unspawned instance\n" );
+	}
+}
@@ -113,6 +113,9 @@ IMPLEMENT_SERVERCLASS_ST(CBaseAnimating, DT_BaseAnimating)
 END_SEND_TABLE()
 
 
+// Live animating entities; the shared bone cache is sized to hold one setup for each
+static int s_nAnimatingEntities = 0;
+
 CBaseAnimating::CBaseAnimating()
 {
 #ifdef _DEBUG
@@ -121,11 +124,19 @@ CBaseAnimating::CBaseAnimating()
 
 	m_bClientSideAnimation = false;
 	m_pIk = NULL;
+
+	Studio_EnsureBoneCacheCapacity( ++s_nAnimatingEntities );
 }
 
 CBaseAnimating::~CBaseAnimating()
 {
 	delete m_pIk;
+	s_nAnimatingEntities--;
+}
+
+CON_COMMAND( bonecache_stats, "Report on the server's shared bone cache" )
+{
+	Studio_ReportBoneCacheStats( s_nAnimatingEntities );
 }
 
 void CBaseAnimating::UseClientSideAnimation()
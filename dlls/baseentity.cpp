@@ -39,6 +39,7 @@
 #include "te_effect_dispatch.h"
 #include "AI_Criteria.h"
 #include "AI_ResponseSystem.h"
+#include "ai_senses.h"
 #include "world.h"
 #include "globals.h"
 #include "saverestoretypes.h"
@@ -645,13 +646,34 @@ bool CBaseEntity::KeyValue( const char *szKeyName, const char *szValue )
 		return true;
 	}
 
+	// Not left to the data description, so the spatial hash hears about them
+	if( FStrEq( szKeyName, "absmin" ) )
+	{
+		Vector vecMins;
+		UTIL_StringToVector( vecMins.Base(), szValue );
+		SetAbsMins( vecMins );
+		return true;
+	}
+
+	if( FStrEq( szKeyName, "absmax" ) )
+	{
+		Vector vecMaxs;
+		UTIL_StringToVector( vecMaxs.Base(), szValue );
+		SetAbsMaxs( vecMaxs );
+		return true;
+	}
+
 	// loop through the data description, and try and place the keys in
 	if ( !*ent_debugkeys.GetString() )
 	{
 		for ( datamap_t *dmap = GetDataDescMap(); dmap != NULL; dmap = dmap->baseMap )
 		{
 			if ( ::ParseKeyvalue(this, dmap->dataDesc, dmap->dataNumFields, szKeyName, szValue) )
+			{
+				// May have been targetname, model, etc.
+				gEntList.ReindexEntity( this );
 				return true;
+			}
 		}
 	}
 	else
@@ -682,6 +704,7 @@ bool CBaseEntity::KeyValue( const char *szKeyName, const char *szValue )
 				if ( printKeyHits )
 					Msg( "(%s) key: %-16s value: %s\n", debugName, szKeyName, szValue );
 				
+				gEntList.ReindexEntity( this );
 				return true;
 			}
 		}
@@ -818,6 +841,8 @@ void CBaseEntity::SetClassname( const char *className )
 	{
 		pev->classname = m_iClassname;
 	}
+
+	gEntList.ReindexEntity( this );
 }
 
 const char* CBaseEntity::GetClassname()
@@ -1053,6 +1078,21 @@ int CBaseEntity::DrawDebugTextOverlays(void)
 void CBaseEntity::SetName( string_t newName )
 {
 	m_iName = newName;
+	gEntList.ReindexEntity( this );
+}
+
+
+void CBaseEntity::SetTarget( string_t newTarget )
+{
+	m_target = newTarget;
+	gEntList.ReindexEntity( this );
+}
+
+
+void CBaseEntity::SetModelName( string_t name )
+{
+	m_ModelName = name;
+	gEntList.ReindexEntity( this );
 }
 
 
@@ -2160,6 +2200,22 @@ bool CBaseEntity::IsInPVS( const edict_t *pPlayer, const void *pvs )
 }
 
 
+//-----------------------------------------------------------------------------
+// Abs bounds; the entity list's spatial hash is relinked lazily from these
+//-----------------------------------------------------------------------------
+void CBaseEntity::SetAbsMins( const Vector& mins )
+{
+	m_vecAbsMins = mins;
+	gEntList.MarkSpatialDirty( this );
+}
+
+void CBaseEntity::SetAbsMaxs( const Vector& maxs )
+{
+	m_vecAbsMaxs = maxs;
+	gEntList.MarkSpatialDirty( this );
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: Initialize absmin & absmax to the appropriate box
 //-----------------------------------------------------------------------------
@@ -2467,6 +2523,10 @@ int CBaseEntity::Restore( IRestore &restore )
 	// loops through the data description list, restoring each data desc block in order
 	int status = RestoreDataDescBlock( restore, GetDataDescMap() );
 
+	// Name, classname, bounds, etc. were just written underneath the entity list
+	gEntList.ReindexEntity( this );
+	gEntList.MarkSpatialDirty( this );
+
 	// if we have an attached edict, restore those fields
 	if ( pev )
 	{
@@ -3070,86 +3130,280 @@ void CBaseEntity::DrawOutputOverlay(CEventAction *ev)
 
 
 //-----------------------------------------------------------------------------
-// Purpose: calls the appropriate message mapped function in the entity according
-//			to the fired action.
-// Input  : char *szInputName - input destination
-//			*pActivator - entity which initiated this sequence of actions
-//			*pCaller - entity from which this event is sent
-// Output : Returns true on success, false on failure.
+// Input dispatch tables
+//
+// Each datamap gets an open-addressed hash of every input in its chain the
+// first time an entity of that class accepts an input.  Derived maps come
+// first, so a derived input hides a base one of the same name just like the
+// old linear search.  Datamaps are static, so the tables are never freed.
 //-----------------------------------------------------------------------------
-bool CBaseEntity::AcceptInput( const char *szInputName, CBaseEntity *pActivator, CBaseEntity *pCaller, variant_t Value, int outputID )
+struct inputdispatch_t
 {
-	// loop through the data description list, restoring each data desc block
-	for ( datamap_t *dmap = GetDataDescMap(); dmap != NULL; dmap = dmap->baseMap )
+	unsigned int		nMask;			// slot count - 1, slot count is a power of two
+	typedescription_t	**ppSlots;		// NULL for empty slots
+};
+
+static unsigned int HashInputName( const char *pszName )
+{
+	unsigned int hash = 0;
+	while ( *pszName )
+	{
+		hash = ( hash * 31 ) + tolower( (unsigned char)*pszName++ );
+	}
+	return hash;
+}
+
+static inputdispatch_t *BuildInputDispatch( datamap_t *pMap )
+{
+	int nInputs = 0;
+	datamap_t *dmap;
+	for ( dmap = pMap; dmap != NULL; dmap = dmap->baseMap )
 	{
-		// search through all the actions in the data description, looking for a match
 		for ( int i = 0; i < dmap->dataNumFields; i++ )
 		{
 			if ( dmap->dataDesc[i].flags & FTYPEDESC_INPUT )
 			{
-				if ( !stricmp(dmap->dataDesc[i].externalName, szInputName) )
+				nInputs++;
+			}
+		}
+	}
+
+	// Keep the load under 50%
+	unsigned int nSlots = 4;
+	while ( nSlots < (unsigned int)( nInputs * 2 ) )
+	{
+		nSlots <<= 1;
+	}
+
+	inputdispatch_t *pDispatch = new inputdispatch_t;
+	pDispatch->nMask = nSlots - 1;
+	pDispatch->ppSlots = new typedescription_t *[nSlots];
+	memset( pDispatch->ppSlots, 0, nSlots * sizeof(typedescription_t *) );
+
+	for ( dmap = pMap; dmap != NULL; dmap = dmap->baseMap )
+	{
+		for ( int i = 0; i < dmap->dataNumFields; i++ )
+		{
+			typedescription_t *pDesc = &dmap->dataDesc[i];
+			if ( !( pDesc->flags & FTYPEDESC_INPUT ) || !pDesc->externalName )
+				continue;
+
+			unsigned int slot = HashInputName( pDesc->externalName ) & pDispatch->nMask;
+			while ( pDispatch->ppSlots[slot] && stricmp( pDispatch->ppSlots[slot]->externalName, pDesc->externalName ) )
+			{
+				slot = ( slot + 1 ) & pDispatch->nMask;
+			}
+
+			// A more derived map already claimed this name
+			if ( pDispatch->ppSlots[slot] )
+				continue;
+
+			pDispatch->ppSlots[slot] = pDesc;
+		}
+	}
+
+	return pDispatch;
+}
+
+static typedescription_t *FindInputDesc( datamap_t *pMap, const char *szInputName )
+{
+	if ( !pMap->inputDispatch )
+	{
+		pMap->inputDispatch = BuildInputDispatch( pMap );
+	}
+
+	inputdispatch_t *pDispatch = pMap->inputDispatch;
+	unsigned int slot = HashInputName( szInputName ) & pDispatch->nMask;
+	while ( pDispatch->ppSlots[slot] )
+	{
+		if ( !stricmp( pDispatch->ppSlots[slot]->externalName, szInputName ) )
+			return pDispatch->ppSlots[slot];
+
+		slot = ( slot + 1 ) & pDispatch->nMask;
+	}
+
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The search AcceptInput used before the dispatch tables, kept for
+//			comparison by ent_input_lookup_bench
+//-----------------------------------------------------------------------------
+static typedescription_t *FindInputDescLinear( datamap_t *pMap, const char *szInputName )
+{
+	for ( datamap_t *dmap = pMap; dmap != NULL; dmap = dmap->baseMap )
+	{
+		for ( int i = 0; i < dmap->dataNumFields; i++ )
+		{
+			if ( ( dmap->dataDesc[i].flags & FTYPEDESC_INPUT ) && !stricmp( dmap->dataDesc[i].externalName, szInputName ) )
+				return &dmap->dataDesc[i];
+		}
+	}
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Times the linear and hashed input lookups for every input of every
+//			entity class with a factory, and checks that they agree.
+//-----------------------------------------------------------------------------
+CON_COMMAND( ent_input_lookup_bench, "Compare input name lookup times over every entity class" )
+{
+	int nIterations = ( engine->Cmd_Argc() > 1 ) ? max( 1, atoi( engine->Cmd_Argv(1) ) ) : 100;
+
+	CUtlVector<const char *> classNames;
+	EntityFactoryDictionary()->GetFactoryNames( classNames );
+
+	CUtlVector<datamap_t *> maps;
+	CUtlVector<const char *> names;
+
+	// One entry per input per class
+	int nClasses = 0;
+	for ( int iClass = 0; iClass < classNames.Count(); iClass++ )
+	{
+		// Use a live instance where there is one.  The world and players are
+		// tied to fixed edicts, so they're never created here.
+		CBaseEntity *pEntity = gEntList.FindEntityByClassname( NULL, classNames[iClass] );
+		bool bCreated = false;
+		if ( !pEntity )
+		{
+			if ( !stricmp( classNames[iClass], "worldspawn" ) || !stricmp( classNames[iClass], "player" ) )
+				continue;
+
+			pEntity = CreateEntityByName( classNames[iClass] );
+			if ( !pEntity )
+				continue;
+			bCreated = true;
+		}
+
+		// Data maps are static, so they outlive the instance
+		datamap_t *pMap = pEntity->GetDataDescMap();
+		if ( bCreated )
+		{
+			UTIL_RemoveImmediate( pEntity );
+		}
+		nClasses++;
+
+		for ( datamap_t *dmap = pMap; dmap != NULL; dmap = dmap->baseMap )
+		{
+			for ( int i = 0; i < dmap->dataNumFields; i++ )
+			{
+				if ( dmap->dataDesc[i].flags & FTYPEDESC_INPUT )
 				{
-					// found a match
+					maps.AddToTail( pMap );
+					names.AddToTail( dmap->dataDesc[i].externalName );
+				}
+			}
+		}
+	}
 
-					// mapper debug message
-					if (pCaller != NULL)
-					{
-						DevMsg( 2, "input %s: %s.%s(%s)\n", STRING(pCaller->m_iName), GetDebugName(), szInputName, Value.String());
-					}
-					else
-					{
-						DevMsg( 2, "input <NULL>: %s.%s(%s)\n", GetDebugName(), szInputName, Value.String());
-					}
+	int nMismatches = 0;
+	int i;
+	for ( i = 0; i < maps.Count(); i++ )
+	{
+		if ( FindInputDesc( maps[i], names[i] ) != FindInputDescLinear( maps[i], names[i] ) )
+		{
+			nMismatches++;
+		}
+	}
 
-					if (m_debugOverlays & OVERLAY_MESSAGE_BIT)
-					{
-						DrawInputOverlay(szInputName,pCaller,Value);
-					}
+	CFastTimer timer;
+	int iter;
+	void *volatile pResult = NULL;
 
-					// convert the value if necessary
-					if ( Value.FieldType() != dmap->dataDesc[i].fieldType )
-					{
-						if ( !(Value.FieldType() == FIELD_VOID && dmap->dataDesc[i].fieldType == FIELD_STRING) ) // allow empty strings
-						{
-							if ( !Value.Convert( dmap->dataDesc[i].fieldType ) )
-							{
-								// bad conversion
-								Warning( "!! ERROR: bad input/output link:\n!! %s(%s,%s) doesn't match type from %s(%s)\n", 
-									STRING(m_iClassname), GetDebugName(), szInputName, 
-									( pCaller != NULL ) ? STRING(pCaller->m_iClassname) : "<null>",
-									( pCaller != NULL ) ? STRING(pCaller->m_iName) : "<null>" );
-								return false;
-							}
-						}
-					}
+	timer.Start();
+	for ( iter = 0; iter < nIterations; iter++ )
+	{
+		for ( i = 0; i < maps.Count(); i++ )
+		{
+			pResult = FindInputDescLinear( maps[i], names[i] );
+		}
+	}
+	timer.End();
+	float flLinear = timer.GetDuration().GetMillisecondsF();
 
-					// call the input handler, or if there is none just set the value
-					inputfunc_t pfnInput = dmap->dataDesc[i].inputFunc;
+	timer.Start();
+	for ( iter = 0; iter < nIterations; iter++ )
+	{
+		for ( i = 0; i < maps.Count(); i++ )
+		{
+			pResult = FindInputDesc( maps[i], names[i] );
+		}
+	}
+	timer.End();
+	float flHashed = timer.GetDuration().GetMillisecondsF();
 
-					if ( pfnInput )
-					{ 
-						// Package the data into a struct for passing to the input handler.
-						inputdata_t data;
-						data.pActivator = pActivator;
-						data.pCaller = pCaller;
-						data.value = Value;
-						data.nOutputID = outputID;
+	Msg( "%d classes, %d lookups x %d: linear %.3f ms, hashed %.3f ms, %d mismatches\n", nClasses, maps.Count(), nIterations, flLinear, flHashed, nMismatches );
+}
 
-						(this->*pfnInput)( data );
-					}
-					else if ( dmap->dataDesc[i].flags & FTYPEDESC_KEY )
-					{
-						// set the value directly
-						Value.SetOther( ((char*)this) + dmap->dataDesc[i].fieldOffset[ TD_OFFSET_NORMAL ]);
-					}
+//-----------------------------------------------------------------------------
+// Purpose: calls the appropriate message mapped function in the entity according
+//			to the fired action.
+// Input  : char *szInputName - input destination
+//			*pActivator - entity which initiated this sequence of actions
+//			*pCaller - entity from which this event is sent
+// Output : Returns true on success, false on failure.
+//-----------------------------------------------------------------------------
+bool CBaseEntity::AcceptInput( const char *szInputName, CBaseEntity *pActivator, CBaseEntity *pCaller, variant_t Value, int outputID )
+{
+	typedescription_t *pDesc = FindInputDesc( GetDataDescMap(), szInputName );
+	if ( pDesc )
+	{
+		// mapper debug message
+		if (pCaller != NULL)
+		{
+			DevMsg( 2, "input %s: %s.%s(%s)\n", STRING(pCaller->m_iName), GetDebugName(), szInputName, Value.String());
+		}
+		else
+		{
+			DevMsg( 2, "input <NULL>: %s.%s(%s)\n", GetDebugName(), szInputName, Value.String());
+		}
 
-					// If this is a manual-networked entity, then mark it dirty.
-					NetworkStateChanged();
+		if (m_debugOverlays & OVERLAY_MESSAGE_BIT)
+		{
+			DrawInputOverlay(szInputName,pCaller,Value);
+		}
 
-					return true;
+		// convert the value if necessary
+		if ( Value.FieldType() != pDesc->fieldType )
+		{
+			if ( !(Value.FieldType() == FIELD_VOID && pDesc->fieldType == FIELD_STRING) ) // allow empty strings
+			{
+				if ( !Value.Convert( pDesc->fieldType ) )
+				{
+					// bad conversion
+					Warning( "!! ERROR: bad input/output link:\n!! %s(%s,%s) doesn't match type from %s(%s)\n", 
+						STRING(m_iClassname), GetDebugName(), szInputName, 
+						( pCaller != NULL ) ? STRING(pCaller->m_iClassname) : "<null>",
+						( pCaller != NULL ) ? STRING(pCaller->m_iName) : "<null>" );
+					return false;
 				}
 			}
 		}
+
+		// call the input handler, or if there is none just set the value
+		inputfunc_t pfnInput = pDesc->inputFunc;
+
+		if ( pfnInput )
+		{ 
+			// Package the data into a struct for passing to the input handler.
+			inputdata_t data;
+			data.pActivator = pActivator;
+			data.pCaller = pCaller;
+			data.value = Value;
+			data.nOutputID = outputID;
+
+			(this->*pfnInput)( data );
+		}
+		else if ( pDesc->flags & FTYPEDESC_KEY )
+		{
+			// set the value directly
+			Value.SetOther( ((char*)this) + pDesc->fieldOffset[ TD_OFFSET_NORMAL ]);
+		}
+
+		// If this is a manual-networked entity, then mark it dirty.
+		NetworkStateChanged();
+
+		return true;
 	}
 
 	DevMsg( 2, "unhandled input: (%s) -> (%s,%s)\n", szInputName, STRING(m_iClassname), GetDebugName()/*,", from (%s,%s)" STRING(pCaller->m_iClassname), STRING(pCaller->m_iName)*/ );
@@ -4335,6 +4589,12 @@ void CBaseEntity::SetAbsOrigin( const Vector& absOrigin )
 	InvalidatePhysicsRecursive( EFL_DIRTY_ABSTRANSFORM );
 	RemoveEFlags( EFL_DIRTY_ABSTRANSFORM );
 
+	// Parented NPCs are always sight grid candidates
+	if ( ( GetFlags() & FL_NPC ) && !GetMoveParent() )
+	{
+		AI_NoteNPCMoved( this, absOrigin );
+	}
+
 	m_vecAbsOrigin = absOrigin;
 	MatrixSetColumn( absOrigin, 3, m_rgflCoordinateFrame ); 
 
@@ -4493,6 +4753,12 @@ void CBaseEntity::SetLocalOrigin( const Vector& origin )
 {
 	if (m_vecOrigin != origin)
 	{
+		// Unparented, so the local origin is the abs origin
+		if ( ( GetFlags() & FL_NPC ) && !GetMoveParent() )
+		{
+			AI_NoteNPCMoved( this, origin );
+		}
+
 		InvalidatePhysicsRecursive( EFL_DIRTY_ABSTRANSFORM );
 		m_vecOrigin = origin;
 		SetSimulationTime( gpGlobals->curtime );
@@ -4706,7 +4972,7 @@ void CBaseEntity::ModifyOrAppendCriteria( AI_CriteriaSet& set )
 	set.AppendCriteria( "name", GetEntityName().ToCStr() );
 
 	// Append our health
-	set.AppendCriteria( "health", UTIL_VarArgs( "%i", GetHealth() ) );
+	set.AppendCriteria( "health", GetHealth() );
 
 	float healthfrac = 0.0f;
 	if ( GetMaxHealth() > 0 )
@@ -4714,7 +4980,7 @@ void CBaseEntity::ModifyOrAppendCriteria( AI_CriteriaSet& set )
 		healthfrac = (float)GetHealth() / (float)GetMaxHealth();
 	}
 
-	set.AppendCriteria( "healthfrac", UTIL_VarArgs( "%.3f", healthfrac ) );
+	set.AppendCriteria( "healthfrac", healthfrac );
 
 	// Append anything from I/O or keyvalues pairs
 	AppendContextToCriteria( set );
@@ -449,6 +449,7 @@ public:
 	CBaseEntity *NextMovePeer( void );
 
 	void		SetName( string_t newTarget );
+	void		SetTarget( string_t newTarget );
 	void		SetParent( string_t newParent, CBaseEntity *pActivator );
 	
 	// Set the movement parent. Your local origin and angles will become relative to this parent.
@@ -498,6 +499,9 @@ public:
 	void	NetworkStateForceUpdate()					{ m_NetStateMgr.StateChanged(); }
 	void	NetworkStateManualMode( bool activate )		{ m_NetStateMgr.EnableManualMode( activate ); }
 	void	NetworkStateChanged()						{ m_NetStateMgr.StateChanged(); }
+	void	NetworkStateChanged( void *pVar, int nBytes )	{ m_NetStateMgr.VarChanged( (char*)pVar - (char*)this, nBytes ); }
+	// For the encoder, see CNetStateMgr::GetChangedSendProps
+	int		GetChangedSendProps( const SendProp **ppProps, int nMaxProps )	{ return m_NetStateMgr.GetChangedSendProps( GetServerClass(), ppProps, nMaxProps ); }
 	bool	IsUsingNetworkManualMode()					{ return m_NetStateMgr.IsUsingManualMode(); }
 
 	//
@@ -2010,11 +2014,6 @@ inline ICollideable *CBaseEntity::GetCollideable()
 }
 	
 
-inline void CBaseEntity::SetModelName( string_t name )
-{
-	m_ModelName = name;
-}
-
 inline string_t CBaseEntity::GetModelName( void ) const
 {
 	return m_ModelName;
@@ -2107,21 +2106,11 @@ inline const Vector& CBaseEntity::WorldSpaceSurroundingMaxs() const
 	return m_vecAbsMaxs;
 }
 
-inline void CBaseEntity::SetAbsMins( const Vector& mins )
-{
-	m_vecAbsMins = mins;
-}
-
 inline const Vector& CBaseEntity::GetAbsMins( void ) const
 {
 	return m_vecAbsMins;
 }
 
-inline void CBaseEntity::SetAbsMaxs( const Vector& maxs )
-{
-	m_vecAbsMaxs = maxs;
-}
-
 inline const Vector& CBaseEntity::GetAbsMaxs( void ) const
 {
 	return m_vecAbsMaxs;
@@ -151,3 +151,15 @@ void CBaseNetworkable::NetworkStateChanged()
 }
 
 
+void CBaseNetworkable::NetworkStateChanged( void *pVar, int nBytes )
+{
+	m_NetStateMgr.VarChanged( (char*)pVar - (char*)this, nBytes );
+}
+
+
+int CBaseNetworkable::GetChangedSendProps( const SendProp **ppProps, int nMaxProps )
+{
+	return m_NetStateMgr.GetChangedSendProps( GetServerClass(), ppProps, nMaxProps );
+}
+
+
@@ -44,6 +44,11 @@ public:
 	int						entindex() const;
 
 	void NetworkStateChanged();
+	void NetworkStateChanged( void *pVar, int nBytes );
+
+	// Fills in the SendProps touched by network var changes since the last update.
+	// Returns -1 if the whole table needs encoding. See CNetStateMgr::GetChangedSendProps.
+	int GetChangedSendProps( const SendProp **ppProps, int nMaxProps );
 
 
 // IHandleEntity overrides.
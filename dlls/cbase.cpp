@@ -576,10 +576,10 @@ DEFINE_FIXEDSIZE_ALLOCATOR( CEventQueue::PrioritizedEvent_t, 128, CMemoryPool::G
 
 CEventQueue g_EventQueue;
 
-CEventQueue::CEventQueue()
+CEventQueue::CEventQueue() : m_Callers( 0, 0, CallerLessFunc )
 {
-	m_Events.m_flFireTime = -FLT_MAX;
-	m_Events.m_pNext = NULL;
+	m_iNextSequence = 0;
+	m_iListCount = 0;
 
 	Init();
 }
@@ -597,16 +597,43 @@ void CEventQueue::Init( void )
 void CEventQueue::Clear( void )
 {
 	// delete all the events in the queue
-	PrioritizedEvent_t *pe = m_Events.m_pNext;
-	
-	while ( pe != NULL )
+	for ( int i = 0; i < m_Heap.Count(); i++ )
 	{
-		PrioritizedEvent_t *next = pe->m_pNext;
-		delete pe;
-		pe = next;
+		delete m_Heap[i];
 	}
 
-	m_Events.m_pNext = NULL;
+	m_Heap.RemoveAll();
+	m_Callers.RemoveAll();
+	m_iNextSequence = 0;
+}
+
+
+bool CEventQueue::CallerLessFunc( const CallerEvents_t &lhs, const CallerEvents_t &rhs )
+{
+	return ( lhs.m_hCaller < rhs.m_hCaller );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: queue order; events with the same fire time go in the order they were added
+//-----------------------------------------------------------------------------
+bool CEventQueue::FiresBefore( const PrioritizedEvent_t *pLeft, const PrioritizedEvent_t *pRight )
+{
+	if ( pLeft->m_flFireTime != pRight->m_flFireTime )
+		return ( pLeft->m_flFireTime < pRight->m_flFireTime );
+
+	return ( pLeft->m_iSequence < pRight->m_iSequence );
+}
+
+int __cdecl CEventQueue::CompareEvents( const void *pLeft, const void *pRight )
+{
+	const PrioritizedEvent_t *pLeftEvent = *(const PrioritizedEvent_t **)pLeft;
+	const PrioritizedEvent_t *pRightEvent = *(const PrioritizedEvent_t **)pRight;
+
+	if ( FiresBefore( pLeftEvent, pRightEvent ) )
+		return -1;
+	if ( FiresBefore( pRightEvent, pLeftEvent ) )
+		return 1;
+	return 0;
 }
 
 
@@ -657,40 +684,141 @@ void CEventQueue::AddEvent( CBaseEntity *target, const char *action, float fireD
 
 
 //-----------------------------------------------------------------------------
-// Purpose: private function, adds an event into the list
-// Input  : *newEvent - the (already built) event to add
+// Purpose: heap helpers, keep each event's m_iHeapIndex up to date
 //-----------------------------------------------------------------------------
-void CEventQueue::AddEvent( PrioritizedEvent_t *newEvent )
+void CEventQueue::HeapSet( int i, PrioritizedEvent_t *pe )
+{
+	m_Heap[i] = pe;
+	pe->m_iHeapIndex = i;
+}
+
+void CEventQueue::HeapUp( int i )
 {
-	// loop through the actions looking for a place to insert
-	PrioritizedEvent_t *pe;
-	for ( pe = &m_Events; pe->m_pNext != NULL; pe = pe->m_pNext )
+	PrioritizedEvent_t *pe = m_Heap[i];
+	while ( i > 0 )
 	{
-		if ( pe->m_pNext->m_flFireTime > newEvent->m_flFireTime )
-		{
+		int parent = ( i - 1 ) / 2;
+		if ( !FiresBefore( pe, m_Heap[parent] ) )
 			break;
+
+		HeapSet( i, m_Heap[parent] );
+		i = parent;
+	}
+	HeapSet( i, pe );
+}
+
+void CEventQueue::HeapDown( int i )
+{
+	PrioritizedEvent_t *pe = m_Heap[i];
+	int count = m_Heap.Count();
+	while ( 1 )
+	{
+		int child = 2 * i + 1;
+		if ( child >= count )
+			break;
+
+		if ( child + 1 < count && FiresBefore( m_Heap[child + 1], m_Heap[child] ) )
+		{
+			child++;
 		}
+
+		if ( !FiresBefore( m_Heap[child], pe ) )
+			break;
+
+		HeapSet( i, m_Heap[child] );
+		i = child;
 	}
+	HeapSet( i, pe );
+}
 
-	Assert( pe );
+
+//-----------------------------------------------------------------------------
+// Purpose: private function, adds an event into the queue and the caller index
+// Input  : *newEvent - the (already built) event to add
+//-----------------------------------------------------------------------------
+void CEventQueue::AddEvent( PrioritizedEvent_t *newEvent )
+{
+	newEvent->m_iSequence = m_iNextSequence++;
 
 	// insert
-	newEvent->m_pNext = pe->m_pNext;
-	newEvent->m_pPrev = pe;
-	pe->m_pNext = newEvent;
-	if ( newEvent->m_pNext )
+	newEvent->m_iHeapIndex = m_Heap.AddToTail( newEvent );
+	HeapUp( newEvent->m_iHeapIndex );
+
+	// link into the caller's list
+	newEvent->m_iCallerIndex = m_Callers.InvalidIndex();
+	newEvent->m_pNextByCaller = NULL;
+	newEvent->m_pPrevByCaller = NULL;
+
+	if ( newEvent->m_pCaller.IsValid() )
 	{
-		newEvent->m_pNext->m_pPrev = newEvent;
+		CallerEvents_t search;
+		search.m_hCaller = newEvent->m_pCaller.ToInt();
+		search.m_pHead = NULL;
+
+		int iCaller = m_Callers.Find( search );
+		if ( iCaller == m_Callers.InvalidIndex() )
+		{
+			iCaller = m_Callers.Insert( search );
+		}
+
+		CallerEvents_t &callerEvents = m_Callers[iCaller];
+		newEvent->m_iCallerIndex = iCaller;
+		newEvent->m_pNextByCaller = callerEvents.m_pHead;
+		if ( callerEvents.m_pHead )
+		{
+			callerEvents.m_pHead->m_pPrevByCaller = newEvent;
+		}
+		callerEvents.m_pHead = newEvent;
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: takes an event out of the queue and the caller index, doesn't delete it
+//-----------------------------------------------------------------------------
 void CEventQueue::RemoveEvent( PrioritizedEvent_t *pe )
 {
-	Assert( pe->m_pPrev );
-	pe->m_pPrev->m_pNext = pe->m_pNext;
-	if ( pe->m_pNext )
+	int i = pe->m_iHeapIndex;
+	Assert( i >= 0 && i < m_Heap.Count() && m_Heap[i] == pe );
+
+	// fill the hole with the last entry and let it settle
+	int last = m_Heap.Count() - 1;
+	PrioritizedEvent_t *pMoved = m_Heap[last];
+	m_Heap.FastRemove( last );
+
+	if ( i != last )
 	{
-		pe->m_pNext->m_pPrev = pe->m_pPrev;
+		HeapSet( i, pMoved );
+		HeapUp( i );
+		if ( pMoved->m_iHeapIndex == i )
+		{
+			HeapDown( i );
+		}
+	}
+	pe->m_iHeapIndex = -1;
+
+	if ( pe->m_iCallerIndex != m_Callers.InvalidIndex() )
+	{
+		if ( pe->m_pPrevByCaller )
+		{
+			pe->m_pPrevByCaller->m_pNextByCaller = pe->m_pNextByCaller;
+		}
+		else
+		{
+			m_Callers[pe->m_iCallerIndex].m_pHead = pe->m_pNextByCaller;
+		}
+
+		if ( pe->m_pNextByCaller )
+		{
+			pe->m_pNextByCaller->m_pPrevByCaller = pe->m_pPrevByCaller;
+		}
+
+		if ( !m_Callers[pe->m_iCallerIndex].m_pHead )
+		{
+			m_Callers.RemoveAt( pe->m_iCallerIndex );
+		}
+
+		pe->m_iCallerIndex = m_Callers.InvalidIndex();
+		pe->m_pNextByCaller = pe->m_pPrevByCaller = NULL;
 	}
 }
 
@@ -705,10 +833,15 @@ void CEventQueue::ServiceEvents( void )
 		return;
 	}
 
-	PrioritizedEvent_t *pe = m_Events.m_pNext;
-
-	while ( pe != NULL && pe->m_flFireTime <= gpGlobals->curtime )
+	// the head is rechecked after each event to catch any new items added to the queue
+	while ( m_Heap.Count() && m_Heap[0]->m_flFireTime <= gpGlobals->curtime )
 	{
+		PrioritizedEvent_t *pe = m_Heap[0];
+
+		// take the event out before firing it, so inputs that cancel or
+		// clear events can't pull it out from under us
+		RemoveEvent( pe );
+
 		bool targetFound = false;
 
 		// find the targets
@@ -749,8 +882,6 @@ void CEventQueue::ServiceEvents( void )
 				STRING(pe->m_iTargetInput), STRING(pe->m_iTarget), pClass, pName );
 		}
 
-		// remove the event from the list (remembering that the queue may have been added to)
-		RemoveEvent( pe );
 		delete pe;
 
 		//
@@ -763,9 +894,6 @@ void CEventQueue::ServiceEvents( void )
 				break;
 			}
 		}
-
-		// restart the list (to catch any new items have probably been added to the queue)
-		pe = m_Events.m_pNext;	
 	}
 }
 
@@ -782,30 +910,22 @@ void CEventQueue::CancelEvents( CBaseEntity *pCaller )
 	if (!pCaller)
 		return;
 
-	PrioritizedEvent_t *pCur = m_Events.m_pNext;
-
-	while (pCur != NULL)
-	{
-		bool bDelete = false;
-		if (pCur->m_pCaller == pCaller)
-		{
-			// Pointers match; make sure everything else matches.
-			if (!stricmp(STRING(pCur->m_pCaller->GetEntityName()), STRING(pCaller->GetEntityName())) &&
-				!stricmp(pCur->m_pCaller->GetClassname(), pCaller->GetClassname()))
-			{
-				// Found a matching event; delete it from the queue.
-				bDelete = true;
-			}
-		}
+	CallerEvents_t search;
+	search.m_hCaller = pCaller->GetRefEHandle().ToInt();
+	search.m_pHead = NULL;
 
-		PrioritizedEvent_t *pCurSave = pCur;
-		pCur = pCur->m_pNext;
+	int iCaller = m_Callers.Find( search );
+	if ( iCaller == m_Callers.InvalidIndex() )
+		return;
 
-		if (bDelete)
-		{
-			RemoveEvent( pCurSave );
-			delete pCurSave;
-		}
+	// RemoveEvent frees the caller's node along with its last event
+	PrioritizedEvent_t *pCur = m_Callers[iCaller].m_pHead;
+	while ( pCur != NULL )
+	{
+		PrioritizedEvent_t *pNext = pCur->m_pNextByCaller;
+		RemoveEvent( pCur );
+		delete pCur;
+		pCur = pNext;
 	}
 }
 
@@ -841,28 +961,29 @@ typedescription_t CEventQueue::PrioritizedEvent_t::m_SaveData[] =
 	DEFINE_FIELD( CEventQueue::PrioritizedEvent_t, m_iOutputID, FIELD_INTEGER ),
 	DEFINE_CUSTOM_FIELD( CEventQueue::PrioritizedEvent_t, m_VariantValue, variantFuncs ),
 
-//	DEFINE_FIELD( CEventQueue::PrioritizedEvent_t, m_pNext, FIELD_??? ),
-//	DEFINE_FIELD( CEventQueue::PrioritizedEvent_t, m_pPrev, FIELD_??? ),
+//	m_iSequence, m_iHeapIndex and the caller links are rebuilt by AddEvent on restore
 };
 
 
 int CEventQueue::Save( ISave &save )
 {
-	// count the number of items in the queue
-	PrioritizedEvent_t *pe;
-	m_iListCount = 0;
-	for ( pe = m_Events.m_pNext; pe != NULL; pe = pe->m_pNext )
+	// save in firing order, Restore re-adds them in the order read
+	CUtlVector<PrioritizedEvent_t *> events;
+	events.CopyArray( m_Heap.Base(), m_Heap.Count() );
+	if ( events.Count() )
 	{
-		m_iListCount++;
+		qsort( events.Base(), events.Count(), sizeof(PrioritizedEvent_t *), CompareEvents );
 	}
 
-	// save that value out to disk, so we know how many to restore
+	// save the count out to disk, so we know how many to restore
+	m_iListCount = events.Count();
 	if ( !save.WriteFields( "EventQueue", this, NULL, m_SaveData, ARRAYSIZE(m_SaveData) ) )
 		return 0;
 	
 	// cycle through all the events, saving them all
-	for ( pe = m_Events.m_pNext; pe != NULL; pe = pe->m_pNext )
+	for ( int i = 0; i < events.Count(); i++ )
 	{
+		PrioritizedEvent_t *pe = events[i];
 		if ( !save.WriteFields( "PEvent", pe, NULL, pe->m_SaveData, ARRAYSIZE(pe->m_SaveData) ) )
 			return 0;
 	}
@@ -81,10 +81,416 @@ int AimTarget_ListCopy( CBaseEntity *pList[], int listMax )
 	return g_AimManager.ListCopy( pList, listMax );
 }
 
+//-----------------------------------------------------------------------------
+// CEntityStringIndex
+//-----------------------------------------------------------------------------
+CEntityStringIndex::CEntityStringIndex() : m_Chains( 0, 256, ChainLessFunc )
+{
+	for ( int i = 0; i < NUM_ENT_ENTRIES; i++ )
+	{
+		m_Links[i].m_iszKey = NULL_STRING;
+		m_Links[i].m_iChain = m_Chains.InvalidIndex();
+		m_Links[i].m_iPrev = m_Links[i].m_iNext = ENTINDEX_INVALID_SLOT;
+	}
+}
+
+bool CEntityStringIndex::ChainLessFunc( const Chain_t &lhs, const Chain_t &rhs )
+{
+	return ( stricmp( lhs.m_pszKey, rhs.m_pszKey ) < 0 );
+}
+
+void CEntityStringIndex::Insert( int iSlot, string_t iszKey, const unsigned int *pSequence )
+{
+	Assert( m_Links[iSlot].m_iszKey == NULL_STRING );
+	if ( iszKey == NULL_STRING )
+		return;
+
+	Chain_t search;
+	search.m_pszKey = STRING(iszKey);
+	unsigned short iChain = m_Chains.Find( search );
+	if ( iChain == m_Chains.InvalidIndex() )
+	{
+		search.m_iHead = search.m_iTail = ENTINDEX_INVALID_SLOT;
+		iChain = m_Chains.Insert( search );
+	}
+
+	Chain_t &chain = m_Chains[iChain];
+	Link_t &link = m_Links[iSlot];
+	link.m_iszKey = iszKey;
+	link.m_iChain = iChain;
+
+	// Keep the chain in entity list order. Slots are almost always
+	// indexed in the order they were added, so search from the tail.
+	unsigned short iPrev = chain.m_iTail;
+	while ( iPrev != ENTINDEX_INVALID_SLOT && pSequence[iPrev] > pSequence[iSlot] )
+	{
+		iPrev = m_Links[iPrev].m_iPrev;
+	}
+
+	link.m_iPrev = iPrev;
+	if ( iPrev != ENTINDEX_INVALID_SLOT )
+	{
+		link.m_iNext = m_Links[iPrev].m_iNext;
+		m_Links[iPrev].m_iNext = iSlot;
+	}
+	else
+	{
+		link.m_iNext = chain.m_iHead;
+		chain.m_iHead = iSlot;
+		chain.m_pszKey = STRING(iszKey);
+	}
+
+	if ( link.m_iNext != ENTINDEX_INVALID_SLOT )
+	{
+		m_Links[link.m_iNext].m_iPrev = iSlot;
+	}
+	else
+	{
+		chain.m_iTail = iSlot;
+	}
+}
+
+void CEntityStringIndex::Remove( int iSlot )
+{
+	Link_t &link = m_Links[iSlot];
+	if ( link.m_iszKey == NULL_STRING )
+		return;
+
+	Chain_t &chain = m_Chains[link.m_iChain];
+	if ( link.m_iPrev != ENTINDEX_INVALID_SLOT )
+	{
+		m_Links[link.m_iPrev].m_iNext = link.m_iNext;
+	}
+	else
+	{
+		chain.m_iHead = link.m_iNext;
+	}
+
+	if ( link.m_iNext != ENTINDEX_INVALID_SLOT )
+	{
+		m_Links[link.m_iNext].m_iPrev = link.m_iPrev;
+	}
+	else
+	{
+		chain.m_iTail = link.m_iPrev;
+	}
+
+	if ( chain.m_iHead == ENTINDEX_INVALID_SLOT )
+	{
+		m_Chains.RemoveAt( link.m_iChain );
+	}
+	else
+	{
+		// Don't keep pointing at a string owned by the slot that left
+		chain.m_pszKey = STRING( m_Links[chain.m_iHead].m_iszKey );
+	}
+
+	link.m_iszKey = NULL_STRING;
+	link.m_iChain = m_Chains.InvalidIndex();
+	link.m_iPrev = link.m_iNext = ENTINDEX_INVALID_SLOT;
+}
+
+void CEntityStringIndex::Purge()
+{
+	for ( int i = 0; i < NUM_ENT_ENTRIES; i++ )
+	{
+		m_Links[i].m_iszKey = NULL_STRING;
+		m_Links[i].m_iChain = m_Chains.InvalidIndex();
+		m_Links[i].m_iPrev = m_Links[i].m_iNext = ENTINDEX_INVALID_SLOT;
+	}
+	m_Chains.RemoveAll();
+}
+
+int CEntityStringIndex::FindNextInChain( unsigned short iChain, int iStartSlot, const unsigned int *pSequence ) const
+{
+	if ( iStartSlot == ENTINDEX_INVALID_SLOT )
+		return m_Chains[iChain].m_iHead;
+
+	// Common case: continuing an iteration through this chain
+	if ( m_Links[iStartSlot].m_iszKey != NULL_STRING && m_Links[iStartSlot].m_iChain == iChain )
+		return m_Links[iStartSlot].m_iNext;
+
+	unsigned int nStartSequence = pSequence[iStartSlot];
+	unsigned short iSlot = m_Chains[iChain].m_iHead;
+	while ( iSlot != ENTINDEX_INVALID_SLOT && pSequence[iSlot] <= nStartSequence )
+	{
+		iSlot = m_Links[iSlot].m_iNext;
+	}
+	return iSlot;
+}
+
+int CEntityStringIndex::FindNext( int iStartSlot, const char *pszKey, const unsigned int *pSequence ) const
+{
+	Chain_t search;
+	search.m_pszKey = pszKey;
+	unsigned short iChain = m_Chains.Find( search );
+	if ( iChain == m_Chains.InvalidIndex() )
+		return ENTINDEX_INVALID_SLOT;
+
+	return FindNextInChain( iChain, iStartSlot, pSequence );
+}
+
+int CEntityStringIndex::FindNextPrefix( int iStartSlot, const char *pszPrefix, int nPrefixLen, const unsigned int *pSequence ) const
+{
+	// Find the first chain whose key is not less than the prefix;
+	// every key sharing the prefix follows it in order.
+	unsigned short iFirst = m_Chains.InvalidIndex();
+	unsigned short iNode = m_Chains.Root();
+	while ( iNode != m_Chains.InvalidIndex() )
+	{
+		if ( _strnicmp( m_Chains[iNode].m_pszKey, pszPrefix, nPrefixLen ) < 0 )
+		{
+			iNode = m_Chains.RightChild( iNode );
+		}
+		else
+		{
+			iFirst = iNode;
+			iNode = m_Chains.LeftChild( iNode );
+		}
+	}
+
+	// The answer is the earliest match across all the chains in the range
+	int iBest = ENTINDEX_INVALID_SLOT;
+	for ( iNode = iFirst; iNode != m_Chains.InvalidIndex(); iNode = m_Chains.NextInorder( iNode ) )
+	{
+		if ( _strnicmp( m_Chains[iNode].m_pszKey, pszPrefix, nPrefixLen ) != 0 )
+			break;
+
+		int iSlot = FindNextInChain( iNode, iStartSlot, pSequence );
+		if ( iSlot == ENTINDEX_INVALID_SLOT )
+			continue;
+
+		if ( iBest == ENTINDEX_INVALID_SLOT || pSequence[iSlot] < pSequence[iBest] )
+		{
+			iBest = iSlot;
+		}
+	}
+
+	return iBest;
+}
+
+
+//-----------------------------------------------------------------------------
+// CEntitySpatialHash
+//-----------------------------------------------------------------------------
+CEntitySpatialHash::CEntitySpatialHash()
+{
+	memset( m_Cells, 0, sizeof( m_Cells ) );
+	memset( m_QueryStamp, 0, sizeof( m_QueryStamp ) );
+	m_nCurrentStamp = 0;
+}
+
+int CEntitySpatialHash::CellCoord( float flValue )
+{
+	// Clamp so huge query radii can't overflow the cell math
+	flValue = clamp( flValue, -MAX_COORD_INTEGER * 2.0f, MAX_COORD_INTEGER * 2.0f );
+	return (int)floor( flValue * ( 1.0f / ENTITY_HASH_CELL_SIZE ) );
+}
+
+int CEntitySpatialHash::BucketForCell( int x, int y, int z )
+{
+	unsigned int nHash = ( (unsigned int)x * 73856093 ) ^ ( (unsigned int)y * 19349663 ) ^ ( (unsigned int)z * 83492791 );
+	return nHash & ( ENTITY_HASH_BUCKET_COUNT - 1 );
+}
+
+void CEntitySpatialHash::MarkDirty( int iSlot )
+{
+	if ( m_Cells[iSlot].m_bDirty )
+		return;
+
+	m_Cells[iSlot].m_bDirty = true;
+	m_Dirty.AddToTail( iSlot );
+}
+
+void CEntitySpatialHash::Remove( int iSlot )
+{
+	Unlink( iSlot );
+
+	// Any entry left on the dirty list is skipped once the flag is clear
+	m_Cells[iSlot].m_bDirty = false;
+}
+
+void CEntitySpatialHash::Purge()
+{
+	for ( int i = 0; i < ENTITY_HASH_BUCKET_COUNT; i++ )
+	{
+		m_Buckets[i].Purge();
+	}
+	m_Oversize.Purge();
+	m_Dirty.Purge();
+	memset( m_Cells, 0, sizeof( m_Cells ) );
+}
+
+void CEntitySpatialHash::Link( int iSlot, const Vector &vecAbsMins, const Vector &vecAbsMaxs )
+{
+	EntityCells_t &cells = m_Cells[iSlot];
+
+	int i;
+	int mins[3], maxs[3];
+	int nCells = 1;
+	for ( i = 0; i < 3; i++ )
+	{
+		mins[i] = CellCoord( vecAbsMins[i] );
+		maxs[i] = CellCoord( vecAbsMaxs[i] );
+		nCells *= ( maxs[i] - mins[i] + 1 );
+	}
+
+	bool bOversize = ( nCells > ENTITY_HASH_MAX_CELLS );
+	if ( cells.m_bLinked && cells.m_bOversize == bOversize )
+	{
+		// Most moves stay within the same cells
+		if ( bOversize ||
+			( cells.m_Mins[0] == mins[0] && cells.m_Mins[1] == mins[1] && cells.m_Mins[2] == mins[2] &&
+			  cells.m_Maxs[0] == maxs[0] && cells.m_Maxs[1] == maxs[1] && cells.m_Maxs[2] == maxs[2] ) )
+			return;
+	}
+
+	Unlink( iSlot );
+
+	for ( i = 0; i < 3; i++ )
+	{
+		cells.m_Mins[i] = mins[i];
+		cells.m_Maxs[i] = maxs[i];
+	}
+	cells.m_bLinked = true;
+	cells.m_bOversize = bOversize;
+
+	if ( bOversize )
+	{
+		m_Oversize.AddToTail( iSlot );
+		return;
+	}
+
+	for ( int x = mins[0]; x <= maxs[0]; x++ )
+	{
+		for ( int y = mins[1]; y <= maxs[1]; y++ )
+		{
+			for ( int z = mins[2]; z <= maxs[2]; z++ )
+			{
+				m_Buckets[ BucketForCell( x, y, z ) ].AddToTail( iSlot );
+			}
+		}
+	}
+}
+
+void CEntitySpatialHash::Unlink( int iSlot )
+{
+	EntityCells_t &cells = m_Cells[iSlot];
+	if ( !cells.m_bLinked )
+		return;
+
+	cells.m_bLinked = false;
+	if ( cells.m_bOversize )
+	{
+		m_Oversize.FindAndRemove( iSlot );
+		return;
+	}
+
+	// Two cells may share a bucket; the slot was added once per cell so remove it once per cell
+	for ( int x = cells.m_Mins[0]; x <= cells.m_Maxs[0]; x++ )
+	{
+		for ( int y = cells.m_Mins[1]; y <= cells.m_Maxs[1]; y++ )
+		{
+			for ( int z = cells.m_Mins[2]; z <= cells.m_Maxs[2]; z++ )
+			{
+				CUtlVector<unsigned short> &bucket = m_Buckets[ BucketForCell( x, y, z ) ];
+				int i = bucket.Find( iSlot );
+				Assert( i != -1 );
+				if ( i != -1 )
+				{
+					bucket.FastRemove( i );
+				}
+			}
+		}
+	}
+}
+
+void CEntitySpatialHash::Update( const CBaseEntityList *pList )
+{
+	for ( int i = 0; i < m_Dirty.Count(); i++ )
+	{
+		int iSlot = m_Dirty[i];
+		if ( !m_Cells[iSlot].m_bDirty )
+			continue;
+
+		m_Cells[iSlot].m_bDirty = false;
+
+		IServerNetworkable *pNet = (IServerNetworkable*)pList->LookupEntityByNetworkIndex( iSlot );
+		CBaseEntity *pEntity = pNet ? pNet->GetBaseEntity() : NULL;
+		if ( pEntity )
+		{
+			Link( iSlot, pEntity->GetAbsMins(), pEntity->GetAbsMaxs() );
+		}
+		else
+		{
+			Unlink( iSlot );
+		}
+	}
+
+	m_Dirty.RemoveAll();
+}
+
+bool CEntitySpatialHash::QueryBox( const Vector &vecMins, const Vector &vecMaxs, CUtlVector<unsigned short> &slots )
+{
+	int i;
+	int mins[3], maxs[3];
+	int nCells = 1;
+	for ( i = 0; i < 3; i++ )
+	{
+		mins[i] = CellCoord( vecMins[i] );
+		maxs[i] = CellCoord( vecMaxs[i] );
+		nCells *= ( maxs[i] - mins[i] + 1 );
+		if ( nCells > ENTITY_HASH_MAX_QUERY_CELLS )
+			return false;
+	}
+
+	if ( ++m_nCurrentStamp == 0 )
+	{
+		memset( m_QueryStamp, 0, sizeof( m_QueryStamp ) );
+		m_nCurrentStamp = 1;
+	}
+
+	for ( int x = mins[0]; x <= maxs[0]; x++ )
+	{
+		for ( int y = mins[1]; y <= maxs[1]; y++ )
+		{
+			for ( int z = mins[2]; z <= maxs[2]; z++ )
+			{
+				const CUtlVector<unsigned short> &bucket = m_Buckets[ BucketForCell( x, y, z ) ];
+				for ( int j = bucket.Count(); --j >= 0; )
+				{
+					int iSlot = bucket[j];
+					if ( m_QueryStamp[iSlot] != m_nCurrentStamp )
+					{
+						m_QueryStamp[iSlot] = m_nCurrentStamp;
+						slots.AddToTail( iSlot );
+					}
+				}
+			}
+		}
+	}
+
+	for ( i = m_Oversize.Count(); --i >= 0; )
+	{
+		slots.AddToTail( m_Oversize[i] );
+	}
+
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// CGlobalEntityList
+//-----------------------------------------------------------------------------
 CGlobalEntityList::CGlobalEntityList()
 {
 	m_iHighestEnt = m_iNumEnts = 0;
 	m_bClearingEntities = false;
+	m_nNextSequence = 0;
+	memset( m_EntitySequence, 0, sizeof( m_EntitySequence ) );
+	memset( m_bSphereCandidate, 0, sizeof( m_bSphereCandidate ) );
+	m_bSphereValid = false;
+	m_iSphereCursor = 0;
 }
 
 
@@ -176,6 +582,13 @@ void CGlobalEntityList::Clear( void )
 	m_iHighestEnt = 0;
 	m_iNumEnts = 0;
 
+	for ( int i = 0; i < NUM_ENTITY_STRING_INDICES; i++ )
+	{
+		m_StringIndex[i].Purge();
+	}
+	m_SpatialHash.Purge();
+	InvalidateSphereCandidates();
+
 	m_bClearingEntities = false;
 }
 
@@ -255,14 +668,11 @@ bool CGlobalEntityList::IsEntityPtr( void *pTest )
 //-----------------------------------------------------------------------------
 CBaseEntity *CGlobalEntityList::FindEntityByClassname( CBaseEntity *pStartEntity, const char *szName )
 {
-	CBaseEntity *e = pStartEntity;
-	while ( (e = NextEnt(e)) != NULL )
-	{
-		if ( FStrEq( STRING(e->m_iClassname), szName ) )
-			return e;
-	}
+	if ( !szName || szName[0] == 0 )
+		return NULL;
 
-	return NULL;
+	int iSlot = m_StringIndex[ENTINDEX_CLASSNAME].FindNext( StartIndexSlot( pStartEntity ), szName, m_EntitySequence );
+	return EntityFromIndexSlot( iSlot );
 }
 
 
@@ -370,26 +780,17 @@ CBaseEntity *CGlobalEntityList::FindEntityByName( CBaseEntity *pStartEntity, con
 	else
 		wildcard = false;
 
-	CBaseEntity *e = pStartEntity;
-	while ( (e = NextEnt(e)) != NULL )
+	int iSlot;
+	if ( !wildcard )
 	{
-		if ( !e->m_iName )
-			continue;
-
-		if ( !wildcard )
-		{
-			if ( stricmp( STRING(e->m_iName), szName ) == 0 )
-				return e;
-		}
-		else
-		{
-			if ( _strnicmp( STRING(e->m_iName), szName, len ) == 0 )
-				return e;
-		}
-
+		iSlot = m_StringIndex[ENTINDEX_NAME].FindNext( StartIndexSlot( pStartEntity ), szName, m_EntitySequence );
+	}
+	else
+	{
+		iSlot = m_StringIndex[ENTINDEX_NAME].FindNextPrefix( StartIndexSlot( pStartEntity ), szName, len, m_EntitySequence );
 	}
 
-	return NULL;
+	return EntityFromIndexSlot( iSlot );
 }
 
 
@@ -400,13 +801,14 @@ CBaseEntity *CGlobalEntityList::FindEntityByName( CBaseEntity *pStartEntity, con
 //-----------------------------------------------------------------------------
 CBaseEntity *CGlobalEntityList::FindEntityByModel( CBaseEntity *pStartEntity, const char *szModelName )
 {
-	CBaseEntity *e = pStartEntity;
-	while ( (e = NextEnt(e)) != NULL )
-	{
-		if ( !e->edict() || !e->GetModelName() )
-			continue;
+	if ( !szModelName || szModelName[0] == 0 )
+		return NULL;
 
-		if ( FStrEq( STRING(e->GetModelName()), szModelName ) )
+	int iSlot = StartIndexSlot( pStartEntity );
+	while ( (iSlot = m_StringIndex[ENTINDEX_MODEL].FindNext( iSlot, szModelName, m_EntitySequence )) != ENTINDEX_INVALID_SLOT )
+	{
+		CBaseEntity *e = EntityFromIndexSlot( iSlot );
+		if ( e->edict() )
 			return e;
 	}
 
@@ -422,61 +824,227 @@ CBaseEntity *CGlobalEntityList::FindEntityByModel( CBaseEntity *pStartEntity, co
 // FIXME: obsolete, remove
 CBaseEntity	*CGlobalEntityList::FindEntityByTarget( CBaseEntity *pStartEntity, const char *szName )
 {
-	CBaseEntity *e = pStartEntity;
-	while ( (e = NextEnt(e)) != NULL )
+	if ( !szName || szName[0] == 0 )
+		return NULL;
+
+	int iSlot = m_StringIndex[ENTINDEX_TARGET].FindNext( StartIndexSlot( pStartEntity ), szName, m_EntitySequence );
+	return EntityFromIndexSlot( iSlot );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns true if the entity's abs box touches the sphere
+//-----------------------------------------------------------------------------
+static inline bool IsEntityInSphere( CBaseEntity *pEntity, const Vector &vecCenter, float flRadiusSqr )
+{
+	if ( !pEntity->edict() )
+		return false;
+
+	const Vector &vecAbsMins = pEntity->GetAbsMins();
+	const Vector &vecAbsMaxs = pEntity->GetAbsMaxs();
+
+	float eorg;
+	float distSquared = 0;
+	for ( int j = 0; j < 3 && distSquared <= flRadiusSqr; j++ )
 	{
-		if ( !e->m_target )
-			continue;
+		if ( vecCenter[j] < vecAbsMins[j] )
+			eorg = vecCenter[j] - vecAbsMins[j];
+		else if ( vecCenter[j] > vecAbsMaxs[j] )
+			eorg = vecCenter[j] - vecAbsMaxs[j];
+		else
+			eorg = 0;
 
-		if ( FStrEq( STRING(e->m_target), szName ) )
-			return e;
+		distSquared += eorg * eorg;
 	}
 
-	return NULL;
+	return ( distSquared <= flRadiusSqr );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Collects the slots the spatial hash says may touch the sphere.
+//			Returns false if the sphere is too big for the hash to help.
+//-----------------------------------------------------------------------------
+bool CGlobalEntityList::GatherSphereCandidates( const Vector &vecCenter, float flRadius, CUtlVector<unsigned short> &slots )
+{
+	m_SpatialHash.Update( this );
+
+	Vector vecExtents( flRadius, flRadius, flRadius );
+	return m_SpatialHash.QueryBox( vecCenter - vecExtents, vecCenter + vecExtents, slots );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Makes the cached sphere candidates match the query, re-gathering
+//			only when the query, the tick or the entities in it changed.
+//			Returns false if the sphere is too big for the hash to help.
+//-----------------------------------------------------------------------------
+bool CGlobalEntityList::UpdateSphereCandidates( const Vector &vecCenter, float flRadius )
+{
+	if ( m_bSphereValid && m_nSphereTick == gpGlobals->tickcount &&
+		m_flSphereRadius == flRadius && m_vecSphereCenter == vecCenter )
+		return true;
+
+	InvalidateSphereCandidates();
+	if ( !GatherSphereCandidates( vecCenter, flRadius, m_SphereCandidates ) )
+	{
+		m_SphereCandidates.RemoveAll();
+		return false;
+	}
+
+	// Sort into entity list order so iteration can resume where it left off
+	int i;
+	for ( i = 1; i < m_SphereCandidates.Count(); i++ )
+	{
+		unsigned short iSlot = m_SphereCandidates[i];
+		int j = i;
+		while ( j > 0 && m_EntitySequence[ m_SphereCandidates[j-1] ] > m_EntitySequence[iSlot] )
+		{
+			m_SphereCandidates[j] = m_SphereCandidates[j-1];
+			j--;
+		}
+		m_SphereCandidates[j] = iSlot;
+	}
+
+	for ( i = 0; i < m_SphereCandidates.Count(); i++ )
+	{
+		m_bSphereCandidate[ m_SphereCandidates[i] ] = true;
+	}
+
+	m_vecSphereCenter = vecCenter;
+	m_flSphereRadius = flRadius;
+	m_nSphereTick = gpGlobals->tickcount;
+	m_iSphereCursor = 0;
+	m_bSphereValid = true;
+	return true;
+}
+
+
+void CGlobalEntityList::InvalidateSphereCandidates()
+{
+	for ( int i = 0; i < m_SphereCandidates.Count(); i++ )
+	{
+		m_bSphereCandidate[ m_SphereCandidates[i] ] = false;
+	}
+	m_SphereCandidates.RemoveAll();
+	m_bSphereValid = false;
 }
 
 
 //-----------------------------------------------------------------------------
 // Purpose: Used to iterate all the entities within a sphere.
+//			Prefer FindEntitiesInSphere when visiting every hit.
 // Input  : pStartEntity - 
 //			vecCenter - 
 //			flRadius - 
 //-----------------------------------------------------------------------------
 CBaseEntity *CGlobalEntityList::FindEntityInSphere( CBaseEntity *pStartEntity, const Vector &vecCenter, float flRadius )
 {
-	CBaseEntity *ent = NextEnt( pStartEntity );
-	float	eorg;
-	float	distSquared;
+	float flRadiusSqr = flRadius * flRadius;
 
-	flRadius *= flRadius;
-
-	// iterate through all objects, returning those whos bounding boxes are within the radius
-	for ( ; ent != NULL; ent = NextEnt(ent) )
+	if ( !UpdateSphereCandidates( vecCenter, flRadius ) )
 	{
-		if ( !ent->edict() )
-			continue;
-		CBaseEntity *v = ent;
+		// iterate through all objects, returning those whos bounding boxes are within the radius
+		for ( CBaseEntity *ent = NextEnt( pStartEntity ); ent != NULL; ent = NextEnt(ent) )
+		{
+			if ( IsEntityInSphere( ent, vecCenter, flRadiusSqr ) )
+				return ent;
+		}
+
+		// nothing found
+		return NULL;
+	}
+
+	// Keep iteration in entity list order: resume after the start entity
+	int iStartSlot = StartIndexSlot( pStartEntity );
+	unsigned int nStartSequence = ( iStartSlot != ENTINDEX_INVALID_SLOT ) ? m_EntitySequence[iStartSlot] : 0;
 
-		distSquared = 0;
-		for ( int j = 0; j < 3 && distSquared <= flRadius; j++ )
+	int i = m_iSphereCursor;
+	if ( i == 0 || i > m_SphereCandidates.Count() || m_SphereCandidates[i-1] != iStartSlot )
+	{
+		// Not continuing the last walk, binary search for the first candidate after the start
+		int lo = 0, hi = m_SphereCandidates.Count();
+		while ( lo < hi )
 		{
-			if ( vecCenter[j] < v->GetAbsMins()[j] )
-				eorg = vecCenter[j] - v->GetAbsMins()[j];
-			else if ( vecCenter[j] > v->GetAbsMaxs()[j] )
-				eorg = vecCenter[j] - v->GetAbsMaxs()[j];
+			int mid = ( lo + hi ) / 2;
+			if ( m_EntitySequence[ m_SphereCandidates[mid] ] <= nStartSequence )
+				lo = mid + 1;
 			else
-				eorg = 0;
-
-			distSquared += eorg * eorg;
+				hi = mid;
 		}
-		if (distSquared > flRadius)
+		i = lo;
+	}
+
+	for ( ; i < m_SphereCandidates.Count(); i++ )
+	{
+		int iSlot = m_SphereCandidates[i];
+
+		// Removed since the gather
+		if ( !m_bSphereCandidate[iSlot] )
+			continue;
+
+		CBaseEntity *ent = EntityFromIndexSlot( iSlot );
+		if ( !IsEntityInSphere( ent, vecCenter, flRadiusSqr ) )
 			continue;
 
+		m_iSphereCursor = i + 1;
 		return ent;
 	}
 
-	// nothing found
-	return NULL; 
+	m_iSphereCursor = i;
+	return NULL;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds every entity whose bounding box is within a sphere.
+// Input  : list - Receives the entities, in entity list order.
+//			vecCenter - 
+//			flRadius - 
+// Output : Number of entities added to the list.
+//-----------------------------------------------------------------------------
+int CGlobalEntityList::FindEntitiesInSphere( CUtlVector<CBaseEntity *> &list, const Vector &vecCenter, float flRadius )
+{
+	float flRadiusSqr = flRadius * flRadius;
+	int nStart = list.Count();
+
+	CUtlVector<unsigned short> slots;
+	if ( !GatherSphereCandidates( vecCenter, flRadius, slots ) )
+	{
+		for ( CBaseEntity *ent = FirstEnt(); ent != NULL; ent = NextEnt(ent) )
+		{
+			if ( IsEntityInSphere( ent, vecCenter, flRadiusSqr ) )
+			{
+				list.AddToTail( ent );
+			}
+		}
+		return list.Count() - nStart;
+	}
+
+	// Keep only the hits, sorted into entity list order. Hit counts are small.
+	int i;
+	int nHits = 0;
+	for ( i = 0; i < slots.Count(); i++ )
+	{
+		if ( !IsEntityInSphere( EntityFromIndexSlot( slots[i] ), vecCenter, flRadiusSqr ) )
+			continue;
+
+		unsigned short iSlot = slots[i];
+		int j = nHits++;
+		while ( j > 0 && m_EntitySequence[ slots[j-1] ] > m_EntitySequence[iSlot] )
+		{
+			slots[j] = slots[j-1];
+			j--;
+		}
+		slots[j] = iSlot;
+	}
+
+	for ( i = 0; i < nHits; i++ )
+	{
+		list.AddToTail( EntityFromIndexSlot( slots[i] ) );
+	}
+
+	return nHits;
 }
 
 
@@ -733,7 +1301,8 @@ CBaseEntity *CGlobalEntityList::FindEntityClassNearestFacing( const Vector &orig
 	CBaseEntity *ent = NULL;
 	CBaseEntity *best_ent = NULL;
 
-	while ( (ent = NextEnt(ent)) != NULL )
+	// Only entities of the class can match, so walk the classname index
+	while ( (ent = FindEntityByClassname( ent, classname )) != NULL )
 	{
 		// FIXME: why is this skipping pointsize entities?
 		if (ent->IsPointSized() )
@@ -799,6 +1368,79 @@ CBaseEntity *CGlobalEntityList::FindEntityNearestFacing( const Vector &origin, c
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Moves an entity's slot to the index chain for its current value
+//-----------------------------------------------------------------------------
+void CGlobalEntityList::UpdateStringIndex( int iSlot, EntityStringIndex_t index, string_t iszValue )
+{
+	CEntityStringIndex &stringIndex = m_StringIndex[index];
+	if ( stringIndex.GetIndexedKey( iSlot ) == iszValue )
+		return;
+
+	stringIndex.Remove( iSlot );
+	stringIndex.Insert( iSlot, iszValue, m_EntitySequence );
+}
+
+
+void CGlobalEntityList::MarkSpatialDirty( CBaseEntity *pEntity )
+{
+	// Not in the list yet, OnAddEntity will pick it up
+	CBaseHandle hEnt = pEntity->GetRefEHandle();
+	if ( hEnt == INVALID_EHANDLE_INDEX )
+		return;
+
+	int iSlot = hEnt.GetEntryIndex();
+	m_SpatialHash.MarkDirty( iSlot );
+
+	// Candidates are re-tested against the sphere as they're visited, so only an
+	// entity outside the gathered set can invalidate it by moving in
+	if ( m_bSphereValid && !m_bSphereCandidate[iSlot] )
+	{
+		InvalidateSphereCandidates();
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Brings the lookup indices up to date with the entity's strings
+//-----------------------------------------------------------------------------
+void CGlobalEntityList::ReindexEntity( CBaseEntity *pEntity )
+{
+	// Not in the list yet, OnAddEntity will pick it up
+	CBaseHandle hEnt = pEntity->GetRefEHandle();
+	if ( hEnt == INVALID_EHANDLE_INDEX )
+		return;
+
+	int iSlot = hEnt.GetEntryIndex();
+	UpdateStringIndex( iSlot, ENTINDEX_NAME, pEntity->m_iName );
+	UpdateStringIndex( iSlot, ENTINDEX_CLASSNAME, pEntity->m_iClassname );
+	UpdateStringIndex( iSlot, ENTINDEX_MODEL, pEntity->GetModelName() );
+	UpdateStringIndex( iSlot, ENTINDEX_TARGET, pEntity->m_target );
+}
+
+
+CBaseEntity *CGlobalEntityList::EntityFromIndexSlot( int iSlot ) const
+{
+	if ( iSlot == ENTINDEX_INVALID_SLOT )
+		return NULL;
+
+	IServerNetworkable *pNet = (IServerNetworkable*)LookupEntityByNetworkIndex( iSlot );
+	Assert( pNet );
+	return pNet->GetBaseEntity();
+}
+
+
+int CGlobalEntityList::StartIndexSlot( CBaseEntity *pStartEntity ) const
+{
+	if ( !pStartEntity )
+		return ENTINDEX_INVALID_SLOT;
+
+	CBaseHandle hEnt = pStartEntity->GetRefEHandle();
+	Assert( hEnt != INVALID_EHANDLE_INDEX );
+	return hEnt.GetEntryIndex();
+}
+
+
 void CGlobalEntityList::OnAddEntity( IHandleEntity *pEnt, CBaseHandle handle )
 {
 	int i = handle.GetEntryIndex();
@@ -808,11 +1450,21 @@ void CGlobalEntityList::OnAddEntity( IHandleEntity *pEnt, CBaseHandle handle )
 	if ( i > m_iHighestEnt )
 		m_iHighestEnt = i;
 
+	// Slots are appended to the entity list, so a running counter gives their order
+	m_EntitySequence[i] = ++m_nNextSequence;
+
 	// If it's a CBaseEntity, notify the listeners.
 	IServerNetworkable *pNet = (IServerNetworkable*)pEnt;
 	Assert( pNet == dynamic_cast< IServerNetworkable* >( pEnt ) );
 
 	CBaseEntity *pBaseEnt = pNet->GetBaseEntity();
+	if ( pBaseEnt )
+	{
+		ReindexEntity( pBaseEnt );
+		m_SpatialHash.MarkDirty( i );
+		InvalidateSphereCandidates();
+	}
+
 	for ( i = m_entityListeners.Count()-1; i >= 0; i-- )
 	{
 		m_entityListeners[i]->OnEntityCreated( pBaseEnt );
@@ -838,6 +1490,16 @@ void CGlobalEntityList::OnRemoveEntity( IHandleEntity *pEnt, CBaseHandle handle
 	}
 #endif
 
+	int iSlot = handle.GetEntryIndex();
+	for ( int i = 0; i < NUM_ENTITY_STRING_INDICES; i++ )
+	{
+		m_StringIndex[i].Remove( iSlot );
+	}
+	m_SpatialHash.Remove( iSlot );
+
+	// Skipped by the sphere walk from now on
+	m_bSphereCandidate[iSlot] = false;
+
 	m_iNumEnts--;
 }
 
@@ -16,9 +16,127 @@
 #endif
 
 #include "baseentity.h"
+#include "utlrbtree.h"
 
 
 class IEntityListener;
+
+//-----------------------------------------------------------------------------
+// The string fields of CBaseEntity that the global entity list keeps indexed
+//-----------------------------------------------------------------------------
+enum EntityStringIndex_t
+{
+	ENTINDEX_NAME = 0,		// m_iName
+	ENTINDEX_CLASSNAME,		// m_iClassname
+	ENTINDEX_MODEL,			// m_ModelName
+	ENTINDEX_TARGET,		// m_target
+
+	NUM_ENTITY_STRING_INDICES
+};
+
+#define ENTINDEX_INVALID_SLOT	0xFFFF
+
+//-----------------------------------------------------------------------------
+// Purpose: Maps one string field of every entity to the entity list slots
+//			that currently hold that value.  Each distinct (caseless) string
+//			owns a chain of slots kept in entity list order, and the strings
+//			are kept sorted so a trailing wildcard search walks a prefix range.
+//-----------------------------------------------------------------------------
+class CEntityStringIndex
+{
+public:
+	CEntityStringIndex();
+
+	// Links/unlinks a slot.  pSequence gives the entity list order of each slot.
+	void		Insert( int iSlot, string_t iszKey, const unsigned int *pSequence );
+	void		Remove( int iSlot );
+	void		Purge();
+
+	// The value the slot was indexed under, NULL_STRING if it isn't indexed
+	string_t	GetIndexedKey( int iSlot ) const	{ return m_Links[iSlot].m_iszKey; }
+
+	// Returns the first matching slot after iStartSlot in entity list order
+	// (ENTINDEX_INVALID_SLOT starts a new search), ENTINDEX_INVALID_SLOT if none.
+	int			FindNext( int iStartSlot, const char *pszKey, const unsigned int *pSequence ) const;
+	int			FindNextPrefix( int iStartSlot, const char *pszPrefix, int nPrefixLen, const unsigned int *pSequence ) const;
+
+private:
+	struct Chain_t
+	{
+		const char		*m_pszKey;	// points at the head's string, all chain members compare equal
+		unsigned short	m_iHead;
+		unsigned short	m_iTail;
+	};
+
+	struct Link_t
+	{
+		string_t		m_iszKey;
+		unsigned short	m_iChain;
+		unsigned short	m_iPrev;
+		unsigned short	m_iNext;
+	};
+
+	static bool ChainLessFunc( const Chain_t &lhs, const Chain_t &rhs );
+
+	int			FindNextInChain( unsigned short iChain, int iStartSlot, const unsigned int *pSequence ) const;
+
+	CUtlRBTree< Chain_t, unsigned short >	m_Chains;
+	Link_t									m_Links[NUM_ENT_ENTRIES];
+};
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Uniform grid broadphase over entity abs bounds used by the sphere
+//			queries.  Grid cells are hashed into a fixed bucket array; entities
+//			are relinked lazily, right before the next query after their abs
+//			bounds changed.
+//-----------------------------------------------------------------------------
+#define ENTITY_HASH_CELL_SIZE		256
+#define ENTITY_HASH_BUCKET_COUNT	4096	// must be a power of two
+#define ENTITY_HASH_MAX_CELLS		64		// entities touching more cells than this live on the oversize list
+#define ENTITY_HASH_MAX_QUERY_CELLS	512		// queries touching more cells than this scan every entity
+
+class CEntitySpatialHash
+{
+public:
+	CEntitySpatialHash();
+
+	// Flags the slot to be relinked before the next query
+	void		MarkDirty( int iSlot );
+	void		Remove( int iSlot );
+	void		Purge();
+
+	// Relinks every dirty slot.  Entity list supplies the current bounds.
+	void		Update( const CBaseEntityList *pList );
+
+	// Adds the slots whose bounds overlap the box to pSlots (each slot once).
+	// Returns false if the box is too large for the grid to help.
+	bool		QueryBox( const Vector &vecMins, const Vector &vecMaxs, CUtlVector<unsigned short> &slots );
+
+private:
+	struct EntityCells_t
+	{
+		short	m_Mins[3];
+		short	m_Maxs[3];
+		bool	m_bLinked;
+		bool	m_bOversize;
+		bool	m_bDirty;
+	};
+
+	static int	CellCoord( float flValue );
+	static int	BucketForCell( int x, int y, int z );
+	void		Link( int iSlot, const Vector &vecAbsMins, const Vector &vecAbsMaxs );
+	void		Unlink( int iSlot );
+
+	CUtlVector<unsigned short>	m_Buckets[ENTITY_HASH_BUCKET_COUNT];
+	CUtlVector<unsigned short>	m_Oversize;
+	CUtlVector<unsigned short>	m_Dirty;
+	EntityCells_t				m_Cells[NUM_ENT_ENTRIES];
+	unsigned int				m_QueryStamp[NUM_ENT_ENTRIES];
+	unsigned int				m_nCurrentStamp;
+};
+
+
 //-----------------------------------------------------------------------------
 // Purpose: a global list of all the entities in the game.  All iteration through
 //			entities is done through this object.
@@ -33,6 +151,24 @@ private:
 	bool m_bClearingEntities;
 	CUtlVector<IEntityListener *>	m_entityListeners;
 
+	// Name/classname/model/target lookups
+	CEntityStringIndex	m_StringIndex[NUM_ENTITY_STRING_INDICES];
+	unsigned int		m_EntitySequence[NUM_ENT_ENTRIES];	// order of each slot in the entity list
+	unsigned int		m_nNextSequence;
+
+	// Sphere queries
+	CEntitySpatialHash	m_SpatialHash;
+
+	// FindEntityInSphere keeps the last query's candidates, in entity list order,
+	// so a FindEntityInSphere loop gathers once instead of once per step
+	CUtlVector<unsigned short>	m_SphereCandidates;
+	bool				m_bSphereCandidate[NUM_ENT_ENTRIES];
+	Vector				m_vecSphereCenter;
+	float				m_flSphereRadius;
+	int					m_nSphereTick;
+	int					m_iSphereCursor;		// index after the last hit returned
+	bool				m_bSphereValid;
+
 public:
 	IServerNetworkable* GetServerNetworkable( CBaseHandle hEnt ) const;
 	CBaseNetworkable* GetBaseNetworkable( CBaseHandle hEnt ) const;
@@ -61,6 +197,13 @@ public:
 
 	// entity is about to be removed, notify the listeners
 	void NotifyRemoveEntity( CBaseHandle hEnt );
+
+	// Must be called whenever an entity's name, classname, model name or target changes
+	void ReindexEntity( CBaseEntity *pEntity );
+
+	// Must be called whenever an entity's abs bounds change
+	void MarkSpatialDirty( CBaseEntity *pEntity );
+
 	// iteration functions
 
 	// returns the next entity after pCurrentEnt;  if pCurrentEnt is NULL, return the first entity
@@ -89,6 +232,7 @@ public:
 		return FindEntityByName( pStartEntity, STRING(iszName), pActivator );
 	}
 	CBaseEntity *FindEntityInSphere( CBaseEntity *pStartEntity, const Vector &vecCenter, float flRadius );
+	int			 FindEntitiesInSphere( CUtlVector<CBaseEntity *> &list, const Vector &vecCenter, float flRadius );
 	CBaseEntity *FindEntityByTarget( CBaseEntity *pStartEntity, const char *szName );
 	CBaseEntity *FindEntityByModel( CBaseEntity *pStartEntity, const char *szModelName );
 
@@ -114,6 +258,13 @@ protected:
 	virtual void OnAddEntity( IHandleEntity *pEnt, CBaseHandle handle );
 	virtual void OnRemoveEntity( IHandleEntity *pEnt, CBaseHandle handle );
 
+private:
+	void UpdateStringIndex( int iSlot, EntityStringIndex_t index, string_t iszValue );
+	CBaseEntity *EntityFromIndexSlot( int iSlot ) const;
+	int StartIndexSlot( CBaseEntity *pStartEntity ) const;
+	bool GatherSphereCandidates( const Vector &vecCenter, float flRadius, CUtlVector<unsigned short> &slots );
+	bool UpdateSphereCandidates( const Vector &vecCenter, float flRadius );
+	void InvalidateSphereCandidates();
 };
 
 extern CGlobalEntityList gEntList;
@@ -15,6 +15,8 @@
 #endif
 
 #include "mempool.h"
+#include "utlvector.h"
+#include "utlrbtree.h"
 
 class CEventQueue
 {
@@ -55,19 +57,43 @@ private:
 
 		variant_t m_VariantValue;	// variable-type parameter
 
-		PrioritizedEvent_t *m_pNext;
-		PrioritizedEvent_t *m_pPrev;
+		unsigned int m_iSequence;	// order added, breaks ties between equal fire times
+		int m_iHeapIndex;			// position in CEventQueue::m_Heap
+
+		// other events from the same caller, for CancelEvents
+		int m_iCallerIndex;			// node in CEventQueue::m_Callers, or invalid if no caller
+		PrioritizedEvent_t *m_pNextByCaller;
+		PrioritizedEvent_t *m_pPrevByCaller;
 
 		static typedescription_t m_SaveData[];
 
 		DECLARE_FIXEDSIZE_ALLOCATOR( PrioritizedEvent_t );
 	};
 
+	struct CallerEvents_t
+	{
+		int m_hCaller;						// EHANDLE::ToInt() of the caller
+		PrioritizedEvent_t *m_pHead;
+	};
+
+	static bool CallerLessFunc( const CallerEvents_t &lhs, const CallerEvents_t &rhs );
+	static bool FiresBefore( const PrioritizedEvent_t *pLeft, const PrioritizedEvent_t *pRight );
+	static int __cdecl CompareEvents( const void *pLeft, const void *pRight );
+
 	void AddEvent( PrioritizedEvent_t *event );
 	void RemoveEvent( PrioritizedEvent_t *pe );
 
+	void HeapSet( int i, PrioritizedEvent_t *pe );
+	void HeapUp( int i );
+	void HeapDown( int i );
+
 	static typedescription_t m_SaveData[];
-	PrioritizedEvent_t m_Events;
+
+	// binary min-heap on (m_flFireTime, m_iSequence)
+	CUtlVector<PrioritizedEvent_t *> m_Heap;
+	CUtlRBTree<CallerEvents_t, int> m_Callers;
+	unsigned int m_iNextSequence;
+
 	int m_iListCount;
 };
 
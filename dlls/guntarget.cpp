@@ -177,7 +177,7 @@ void CGunTarget::Wait( void )
 		
 	m_flWait = pTarget->GetDelay();
 
-	m_target = pTarget->m_target;
+	SetTarget( pTarget->m_target );
 	SetMoveDone( &CGunTarget::Next );
 	if (m_flWait != 0)
 	{// -1 wait will wait forever!		
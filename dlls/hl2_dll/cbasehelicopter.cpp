@@ -372,8 +372,11 @@ void CBaseHelicopter::DoRotorPhysicsPush( Vector &vecRotorOrigin, float flAltitu
 	// Find the lightest physics entity below us and add it to our list to push around
 	CBaseEntity *pLightestEntity = NULL;
 	float flLightestMass = 9999;
-	while ((pEntity = gEntList.FindEntityInSphere(pEntity, vecPhysicsOrigin, BASECHOPPER_WASH_RADIUS )) != NULL)
+	CUtlVector<CBaseEntity *> nearbyEntities;
+	gEntList.FindEntitiesInSphere( nearbyEntities, vecPhysicsOrigin, BASECHOPPER_WASH_RADIUS );
+	for ( int iNearby = 0; iNearby < nearbyEntities.Count(); iNearby++ )
 	{
+		pEntity = nearbyEntities[iNearby];
 		if ( pEntity->GetMoveType() == MOVETYPE_VPHYSICS || (pEntity->VPhysicsGetObject() && !pEntity->IsPlayer()) ) 
 		{
 			// Make sure it's not already in our wash
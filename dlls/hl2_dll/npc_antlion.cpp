@@ -1308,8 +1308,11 @@ int CNPC_Antlion::SelectSchedule( void )
 			Vector		soundOrg = m_vecHeardSound;
 
 			//Find all entities within that sphere
-			while ( ( pTarget = gEntList.FindEntityInSphere( pTarget, soundOrg, bugbait_radius.GetInt() ) ) != NULL )
+			CUtlVector<CBaseEntity *> targets;
+			gEntList.FindEntitiesInSphere( targets, soundOrg, bugbait_radius.GetInt() );
+			for ( int i = 0; i < targets.Count(); i++ )
 			{
+				pTarget = targets[i];
 				CAI_BaseNPC *pNPC = dynamic_cast<CAI_BaseNPC*>((CBaseEntity*)pTarget);
 
 				if ( pNPC == NULL )
@@ -350,12 +350,13 @@ int CWeaponSMG1::WeaponRangeAttack2Condition( float flDot, float flDist )
 	// ---------------------------------------------------------------------
 	// Are any friendlies near the intended grenade impact area?
 	// ---------------------------------------------------------------------
-	CBaseEntity *pTarget = NULL;
+	CUtlVector<CBaseEntity *> targets;
+	gEntList.FindEntitiesInSphere( targets, vecTarget, COMBINE_MIN_GRENADE_CLEAR_DIST );
 
-	while ( ( pTarget = gEntList.FindEntityInSphere( pTarget, vecTarget, COMBINE_MIN_GRENADE_CLEAR_DIST ) ) != NULL )
+	for ( int i = 0; i < targets.Count(); i++ )
 	{
 		//Check to see if the default relationship is hatred, and if so intensify that
-		if ( npcOwner->IRelationType( pTarget ) == D_LI )
+		if ( npcOwner->IRelationType( targets[i] ) == D_LI )
 		{
 			// crap, I might blow my own guy up. Don't throw a grenade and don't check again for a while.
 			m_flNextGrenadeCheck = gpGlobals->curtime + 1; // one full second.
@@ -64,7 +64,7 @@ void CWorldItem::Spawn( void )
 	}
 	else
 	{
-		pEntity->m_target = m_target;
+		pEntity->SetTarget( m_target );
 		pEntity->SetName( GetEntityName() );
 		pEntity->ClearSpawnFlags();
 		pEntity->AddSpawnFlags( m_spawnflags );
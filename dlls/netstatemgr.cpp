@@ -9,6 +9,320 @@
 #include "netstatemgr.h"
 #include "tier0/dbg.h"
 #include "util.h"
+#include "dt_send.h"
+#include "server_class.h"
+#include "sendproxy.h"
+#include "utlhashmap.h"
+#include "tier0/fasttimer.h"
+
+
+bool g_bNetTrackPropChanges = false;
+
+static void NetTrackPropChangesChanged( ConVar *var, char const *pOldString )
+{
+	// Entities changed while it was off weren't tracked, but they're all
+	//  flagged as wholly changed until their next reset.
+	g_bNetTrackPropChanges = var->GetBool();
+}
+
+ConVar net_trackpropchanges( "net_trackpropchanges", "0", 0, "Record which network vars change so the SendProps they touch can be resolved (nothing in the engine asks yet)", NetTrackPropChangesChanged );
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Proxies whose output depends only on the variable they're given.
+//  Anything else (the tick-relative time proxies, handle lookups, props that
+//  work their value out from the entity) can change without its variable
+//  changing, so it goes out with every change.
+//-----------------------------------------------------------------------------
+static bool IsVarOnlyProxy( SendVarProxyFn fn )
+{
+	return	fn == SendProxy_FloatToFloat ||
+			fn == SendProxy_VectorToVector ||
+			fn == SendProxy_AngleToFloat ||
+			fn == SendProxy_QAngles ||
+			fn == SendProxy_Int8ToInt32 ||
+			fn == SendProxy_Int16ToInt32 ||
+			fn == SendProxy_Int32ToInt32 ||
+			fn == SendProxy_StringToString ||
+			fn == SendProxy_Color32ToInt;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Maps byte ranges within an entity to the SendProps that read them,
+//  built once per ServerClass by flattening its SendTable.
+//-----------------------------------------------------------------------------
+class CSendPropOffsetMap
+{
+public:
+	CSendPropOffsetMap( ServerClass *pClass );
+
+	// Appends the props overlapping [nStart,nEnd) that aren't in ppProps yet.
+	// Returns false if that would go past nMaxProps.
+	bool	AddPropsInRange( int nStart, int nEnd, const SendProp **ppProps, int &nProps, int nMaxProps ) const;
+	// Same for the props that go out with any change
+	bool	AddAlwaysChangedProps( const SendProp **ppProps, int &nProps, int nMaxProps ) const;
+
+	int		GetNumProps() const				{ return m_nProps; }
+	int		GetNumAlwaysChanged() const		{ return m_AlwaysChanged.Count(); }
+	// Offset of the named prop's variable, or -1
+	int		FindPropOffset( const char *pName ) const;
+
+private:
+	struct PropRange_t
+	{
+		int				m_nStart;
+		int				m_nEnd;
+		const SendProp	*m_pProp;
+	};
+
+	static int __cdecl PropRangeCompare( const void *p0, const void *p1 );
+	static bool	AddProp( const SendProp *pProp, const SendProp **ppProps, int &nProps, int nMaxProps );
+
+	void	GatherExcludes( SendTable *pTable );
+	bool	IsExcluded( SendTable *pTable, const SendProp *pProp ) const;
+	void	AddTable( SendTable *pTable, int nBaseOffset, bool bOpaque );
+
+	// Sorted by m_nStart
+	CUtlVector< PropRange_t >		m_Ranges;
+	// Longest range, bounds how far back a lookup has to look
+	int								m_nMaxRange;
+	// Props whose data we can't place in the entity
+	CUtlVector< const SendProp * >	m_AlwaysChanged;
+	CUtlVector< const SendProp * >	m_Excludes;
+	int								m_nProps;
+};
+
+
+CSendPropOffsetMap::CSendPropOffsetMap( ServerClass *pClass )
+{
+	m_nMaxRange = 0;
+	m_nProps = 0;
+
+	GatherExcludes( pClass->m_pTable );
+	AddTable( pClass->m_pTable, 0, false );
+
+	if ( m_Ranges.Count() > 1 )
+	{
+		qsort( m_Ranges.Base(), m_Ranges.Count(), sizeof( PropRange_t ), PropRangeCompare );
+	}
+}
+
+
+int __cdecl CSendPropOffsetMap::PropRangeCompare( const void *p0, const void *p1 )
+{
+	return ((const PropRange_t *)p0)->m_nStart - ((const PropRange_t *)p1)->m_nStart;
+}
+
+
+void CSendPropOffsetMap::GatherExcludes( SendTable *pTable )
+{
+	for ( int i = 0; i < pTable->GetNumProps(); i++ )
+	{
+		SendProp *pProp = pTable->GetProp( i );
+		if ( pProp->IsExcludeProp() )
+		{
+			m_Excludes.AddToTail( pProp );
+		}
+		else if ( pProp->GetType() == DPT_DataTable )
+		{
+			GatherExcludes( pProp->GetDataTable() );
+		}
+	}
+}
+
+
+bool CSendPropOffsetMap::IsExcluded( SendTable *pTable, const SendProp *pProp ) const
+{
+	for ( int i = 0; i < m_Excludes.Count(); i++ )
+	{
+		const SendProp *pExclude = m_Excludes[i];
+		if ( !Q_stricmp( pExclude->GetExcludeDTName(), pTable->GetName() ) &&
+			!Q_stricmp( pExclude->GetName(), pProp->GetName() ) )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+void CSendPropOffsetMap::AddTable( SendTable *pTable, int nBaseOffset, bool bOpaque )
+{
+	for ( int i = 0; i < pTable->GetNumProps(); i++ )
+	{
+		SendProp *pProp = pTable->GetProp( i );
+		if ( pProp->IsExcludeProp() || pProp->IsInsideArray() || IsExcluded( pTable, pProp ) )
+			continue;
+
+		if ( pProp->GetType() == DPT_DataTable )
+		{
+			// Datatable proxies hand back the data they're given (the custom ones just
+			//  choose recipients), except the pointer proxy whose data lives elsewhere.
+			bool bSubOpaque = bOpaque || ( pProp->GetDataTableProxyFn() == SendProxy_DataTablePtrToDataTable );
+			AddTable( pProp->GetDataTable(), nBaseOffset + pProp->GetOffset(), bSubOpaque );
+			continue;
+		}
+
+		m_nProps++;
+
+		PropRange_t range;
+		range.m_pProp = pProp;
+		range.m_nStart = nBaseOffset + pProp->GetOffset();
+		range.m_nEnd = range.m_nStart + 1;
+
+		bool bPlaced = !bOpaque;
+		if ( pProp->GetType() == DPT_Array )
+		{
+			// The element template always comes right before its array
+			const SendProp *pElement = pProp->GetArrayProp();
+			if ( !pElement && i > 0 )
+			{
+				pElement = pTable->GetProp( i - 1 );
+			}
+
+			int nBytes = pProp->GetNumElements() * pProp->GetElementStride();
+			if ( pElement && nBytes > 0 && IsVarOnlyProxy( pElement->GetProxyFn() ) )
+			{
+				range.m_nStart = nBaseOffset + pElement->GetOffset();
+				range.m_nEnd = range.m_nStart + nBytes;
+			}
+			else
+			{
+				bPlaced = false;
+			}
+		}
+		else if ( !IsVarOnlyProxy( pProp->GetProxyFn() ) )
+		{
+			// m_flAnimTime and m_flSimulationTime go out relative to the tickbase,
+			//  "movetype" and friends have no variable of their own, etc.
+			bPlaced = false;
+		}
+
+		if ( !bPlaced )
+		{
+			m_AlwaysChanged.AddToTail( pProp );
+			continue;
+		}
+
+		m_Ranges.AddToTail( range );
+		m_nMaxRange = max( m_nMaxRange, range.m_nEnd - range.m_nStart );
+	}
+}
+
+
+bool CSendPropOffsetMap::AddProp( const SendProp *pProp, const SendProp **ppProps, int &nProps, int nMaxProps )
+{
+	// Two changed ranges can land in the same array
+	for ( int i = 0; i < nProps; i++ )
+	{
+		if ( ppProps[i] == pProp )
+			return true;
+	}
+
+	if ( nProps >= nMaxProps )
+		return false;
+
+	ppProps[ nProps++ ] = pProp;
+	return true;
+}
+
+
+bool CSendPropOffsetMap::AddPropsInRange( int nStart, int nEnd, const SendProp **ppProps, int &nProps, int nMaxProps ) const
+{
+	// Find the first range starting at or after nEnd, then walk back over
+	//  everything that could still reach nStart.
+	int lo = 0;
+	int hi = m_Ranges.Count();
+	while ( lo < hi )
+	{
+		int mid = ( lo + hi ) >> 1;
+		if ( m_Ranges[mid].m_nStart < nEnd )
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	for ( int i = lo - 1; i >= 0 && m_Ranges[i].m_nStart + m_nMaxRange > nStart; i-- )
+	{
+		if ( m_Ranges[i].m_nEnd <= nStart )
+			continue;
+
+		if ( !AddProp( m_Ranges[i].m_pProp, ppProps, nProps, nMaxProps ) )
+			return false;
+	}
+
+	return true;
+}
+
+
+bool CSendPropOffsetMap::AddAlwaysChangedProps( const SendProp **ppProps, int &nProps, int nMaxProps ) const
+{
+	for ( int i = 0; i < m_AlwaysChanged.Count(); i++ )
+	{
+		if ( !AddProp( m_AlwaysChanged[i], ppProps, nProps, nMaxProps ) )
+			return false;
+	}
+	return true;
+}
+
+
+int CSendPropOffsetMap::FindPropOffset( const char *pName ) const
+{
+	for ( int i = 0; i < m_Ranges.Count(); i++ )
+	{
+		if ( !Q_stricmp( m_Ranges[i].m_pProp->GetName(), pName ) )
+			return m_Ranges[i].m_nStart;
+	}
+	return -1;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Offset maps by ServerClass, built on first use. ServerClasses are
+//  static so the maps live until the DLL unloads.
+//-----------------------------------------------------------------------------
+class CSendPropOffsetMaps
+{
+public:
+	~CSendPropOffsetMaps()
+	{
+		for ( int i = 0; i < m_Maps.MaxElement(); i++ )
+		{
+			if ( m_Maps.IsValidIndex( i ) )
+			{
+				delete m_Maps[i];
+			}
+		}
+		m_Maps.Purge();
+	}
+
+	CSendPropOffsetMap *Find( ServerClass *pClass ) const
+	{
+		int i = m_Maps.Find( pClass );
+		return ( i != m_Maps.InvalidIndex() ) ? m_Maps[i] : NULL;
+	}
+
+	CSendPropOffsetMap *FindOrCreate( ServerClass *pClass )
+	{
+		int i = m_Maps.Find( pClass );
+		if ( i == m_Maps.InvalidIndex() )
+		{
+			i = m_Maps.Insert( pClass, new CSendPropOffsetMap( pClass ) );
+		}
+		return m_Maps[i];
+	}
+
+private:
+	CUtlHashMap< ServerClass *, CSendPropOffsetMap * > m_Maps;
+};
+
+static CSendPropOffsetMaps s_SendPropOffsetMaps;
+
 
 
 CNetStateMgr::CNetStateMgr()
@@ -18,6 +332,60 @@ CNetStateMgr::CNetStateMgr()
 	m_bUsingManualMode = false;
 	m_NSUpdateInterval = 0;
 	m_NSUpdateCounter = 0;
+
+	// Nothing has been sent yet
+	m_bAllChanged = true;
+	m_nChangedVars = 0;
+	m_pChangedVars = NULL;
+}
+
+
+CNetStateMgr::~CNetStateMgr()
+{
+	delete [] m_pChangedVars;
+}
+
+
+void CNetStateMgr::TrackVarChange( int nOffset, int nBytes )
+{
+	if ( nOffset < 0 )
+	{
+		// Not inside the entity
+		m_bAllChanged = true;
+		return;
+	}
+
+	if ( !m_pChangedVars )
+	{
+		m_pChangedVars = new ChangedVar_t[ NETSTATE_MAX_TRACKED_CHANGES ];
+	}
+
+	int nEnd = nOffset + nBytes;
+
+	// Fold into a range it touches; the same variable is often set more than once
+	//  a frame and array elements tend to change together.
+	for ( int i = 0; i < m_nChangedVars; i++ )
+	{
+		ChangedVar_t &var = m_pChangedVars[ i ];
+		if ( nOffset <= var.m_nEnd && nEnd >= var.m_nStart )
+		{
+			if ( nOffset < var.m_nStart )
+				var.m_nStart = nOffset;
+			if ( nEnd > var.m_nEnd )
+				var.m_nEnd = nEnd;
+			return;
+		}
+	}
+
+	if ( m_nChangedVars >= NETSTATE_MAX_TRACKED_CHANGES )
+	{
+		m_bAllChanged = true;
+		return;
+	}
+
+	m_pChangedVars[ m_nChangedVars ].m_nStart = nOffset;
+	m_pChangedVars[ m_nChangedVars ].m_nEnd = nEnd;
+	m_nChangedVars++;
 }
 
 
@@ -82,5 +450,154 @@ void CNetStateMgr::ResetStateChanges()
 {
 	m_bTimerElapsed = false;
 	m_bChanged = false;
+	m_bAllChanged = false;
+	m_nChangedVars = 0;
+}
+
+
+int CNetStateMgr::GetChangedSendProps( ServerClass *pClass, const SendProp **ppProps, int nMaxProps ) const
+{
+	// Without network vars nobody tells us what changed
+	if ( !g_bUseNetworkVars || !g_bNetTrackPropChanges || m_bAllChanged || !pClass )
+		return -1;
+
+	if ( !m_bChanged )
+		return 0;
+
+	CSendPropOffsetMap *pMap = s_SendPropOffsetMaps.FindOrCreate( pClass );
+
+	// Ranges that match no prop are variables this class doesn't send
+	int nProps = 0;
+	for ( int i = 0; i < m_nChangedVars; i++ )
+	{
+		if ( !pMap->AddPropsInRange( m_pChangedVars[i].m_nStart, m_pChangedVars[i].m_nEnd, ppProps, nProps, nMaxProps ) )
+			return -1;
+	}
+
+	if ( !pMap->AddAlwaysChangedProps( ppProps, nProps, nMaxProps ) )
+		return -1;
+
+	return nProps;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Times turning network var changes into SendProps for NPC and player
+//  classes, and shows how much of each table a typical change touches.
+//-----------------------------------------------------------------------------
+CON_COMMAND( net_propchange_bench, "Time resolving network var changes to SendProps: net_propchange_bench [serverclass] [iterations]" )
+{
+	static const char *s_pDefaultClasses[] =
+	{
+		"CBasePlayer",
+		"CHL2_Player",
+		"CAI_BaseNPC",
+		"CNPC_Barney",
+		"CNPC_CombineGuard",
+		"CNPC_Strider",
+	};
+
+	// What an animating NPC typically changes in a tick
+	static const char *s_pTickVars[] =
+	{
+		"m_flAnimTime",
+		"m_flSimulationTime",
+		"m_vecOrigin",
+		"m_angRotation[0]",
+		"m_angRotation[1]",
+		"m_angRotation[2]",
+		"m_flCycle",
+		"m_flPlaybackRate",
+		"m_nSequence",
+	};
+
+	int nIterations = ( engine->Cmd_Argc() > 2 ) ? atoi( engine->Cmd_Argv( 2 ) ) : 10000;
+	if ( nIterations < 1 )
+	{
+		nIterations = 1;
+	}
+
+	if ( !g_bUseNetworkVars )
+	{
+		Msg( "net_propchange_bench: network vars are off, every change encodes the full table\n" );
+		return;
+	}
+
+	// The bench's own managers need tracking whatever the ConVar says
+	bool bWasTracking = g_bNetTrackPropChanges;
+	g_bNetTrackPropChanges = true;
+
+	const SendProp *pProps[ MAX_DATATABLE_PROPS ];
+	CFastTimer timer;
+
+	for ( ServerClass *pClass = g_pServerClassHead; pClass; pClass = pClass->m_pNext )
+	{
+		bool bWanted = false;
+		if ( engine->Cmd_Argc() > 1 )
+		{
+			bWanted = !Q_stricmp( pClass->GetName(), engine->Cmd_Argv( 1 ) );
+		}
+		else
+		{
+			for ( int i = 0; i < ARRAYSIZE( s_pDefaultClasses ); i++ )
+			{
+				bWanted = bWanted || !Q_stricmp( pClass->GetName(), s_pDefaultClasses[i] );
+			}
+		}
+
+		if ( !bWanted )
+			continue;
+
+		bool bCached = ( s_SendPropOffsetMaps.Find( pClass ) != NULL );
+		timer.Start();
+		CSendPropOffsetMap *pMap = s_SendPropOffsetMaps.FindOrCreate( pClass );
+		timer.End();
+		float flBuildMs = timer.GetDuration().GetMillisecondsF();
+
+		CNetStateMgr animTime;
+		animTime.ResetStateChanges();
+		int nOffset = pMap->FindPropOffset( "m_flAnimTime" );
+		if ( nOffset >= 0 )
+		{
+			animTime.VarChanged( nOffset, sizeof( float ) );
+		}
+
+		CNetStateMgr tick;
+		tick.ResetStateChanges();
+		for ( int i = 0; i < ARRAYSIZE( s_pTickVars ); i++ )
+		{
+			nOffset = pMap->FindPropOffset( s_pTickVars[i] );
+			if ( nOffset >= 0 )
+			{
+				tick.VarChanged( nOffset, 1 );
+			}
+		}
+
+		int nAnimTimeProps = 0;
+		timer.Start();
+		for ( int i = 0; i < nIterations; i++ )
+		{
+			nAnimTimeProps = animTime.GetChangedSendProps( pClass, pProps, ARRAYSIZE( pProps ) );
+		}
+		timer.End();
+		float flAnimTimeUs = timer.GetDuration().GetMicrosecondsF() / nIterations;
+
+		int nTickProps = 0;
+		timer.Start();
+		for ( int i = 0; i < nIterations; i++ )
+		{
+			nTickProps = tick.GetChangedSendProps( pClass, pProps, ARRAYSIZE( pProps ) );
+		}
+		timer.End();
+		float flTickUs = timer.GetDuration().GetMicrosecondsF() / nIterations;
+
+		Msg( "%-20s %4d props (%d sent with any change), map %s %.3f ms\n",
+			pClass->GetName(), pMap->GetNumProps(), pMap->GetNumAlwaysChanged(),
+			bCached ? "cached" : "built in", flBuildMs );
+		Msg( "    m_flAnimTime only: %4d props to encode, %.3f us\n", nAnimTimeProps, flAnimTimeUs );
+		Msg( "    typical NPC tick:  %4d props to encode, %.3f us\n", nTickProps, flTickUs );
+	}
+
+	g_bNetTrackPropChanges = bWasTracking;
 }
 
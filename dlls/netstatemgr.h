@@ -18,12 +18,25 @@
 #define AUTOUPDATE_MAX_TIME_LENGTH	5.0	// maximum of 5 seconds between autoupdates
 #define AUTOUPDATE_FREQ_SCALE		(65535.0f / AUTOUPDATE_MAX_TIME_LENGTH)
 
+// Distinct ranges of network vars tracked between updates. Past this the whole
+// entity is treated as changed.
+#define NETSTATE_MAX_TRACKED_CHANGES	16
+
+// Mirrors net_trackpropchanges. Nothing in the engine asks for the changed props
+// yet, so by default VarChanged() just flags the whole entity, as StateChanged() does.
+extern bool g_bNetTrackPropChanges;
+
+
+class SendProp;
+class ServerClass;
+
 
 class CNetStateMgr
 {
 public:
 					
 					CNetStateMgr();
+					~CNetStateMgr();
 	
 	// This is useful for entities that don't change frequently or that the client
 	// doesn't need updates on very often. If you use this mode, the server will only try to
@@ -57,11 +70,35 @@ public:
 	// entity is using an update interval, it will return a change next frame.
 	void			StateChanged( bool bForceUpdate = false );
 
+	// Called by the network var wrappers (through NetworkStateChanged( pVar, nBytes ))
+	// with the byte range of the variable that changed, relative to the entity.
+	// Only recorded while net_trackpropchanges is on.
+	void			VarChanged( int nOffset, int nBytes );
+
+	// Fills in the SendProps of pClass that cover the variables changed since the
+	// last ResetStateChanges, so the encoder can skip the rest of the table.
+	// Returns -1 if every prop must be encoded (NetworkStateChanged() was called
+	// without a variable, too many changes, more than nMaxProps props, etc).
+	int				GetChangedSendProps( ServerClass *pClass, const SendProp **ppProps, int nMaxProps ) const;
+
 private:
+	struct ChangedVar_t
+	{
+		int			m_nStart;
+		int			m_nEnd;
+	};
+
 	bool			m_bUsingManualMode;
 	bool			m_bChanged;
 	bool			m_bTimerElapsed;
 
+	void			TrackVarChange( int nOffset, int nBytes );
+
+	// Set when a change can't be pinned to a variable
+	bool			m_bAllChanged;
+	int				m_nChangedVars;
+	ChangedVar_t	*m_pChangedVars;	// NETSTATE_MAX_TRACKED_CHANGES, allocated the first time tracking is used
+
 	// Counters for SetUpdateInterval.
 	unsigned short	m_NSUpdateInterval;	// Real value is m_AutoUpdateFrequency * AUTOUPDATE_FREQ_SCALE
 	unsigned short	m_NSUpdateCounter;	// Counts down to zero. When zero, it triggers an auto update.
@@ -81,10 +118,27 @@ inline bool CNetStateMgr::IsUsingManualMode()
 inline void CNetStateMgr::StateChanged( bool bForceUpdate )
 {
 	m_bChanged = true;
+	m_bAllChanged = true;
 	
 	if ( bForceUpdate )
 		m_NSUpdateCounter = 0;
 }
 
+inline void CNetStateMgr::VarChanged( int nOffset, int nBytes )
+{
+	m_bChanged = true;
+
+	if ( m_bAllChanged )
+		return;
+
+	if ( !g_bNetTrackPropChanges )
+	{
+		m_bAllChanged = true;
+		return;
+	}
+
+	TrackVarChange( nOffset, nBytes );
+}
+
 
 #endif // NETSTATEMGR_H
@@ -73,7 +73,7 @@ void CPathCorner::Spawn( void )
 //-----------------------------------------------------------------------------
 void CPathCorner::InputSetNextPathCorner( inputdata_t &inputdata )
 {
-	m_target = inputdata.value.StringID();
+	SetTarget( inputdata.value.StringID() );
 }
 
 
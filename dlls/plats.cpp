@@ -824,7 +824,7 @@ void CFuncTrain::Use( CBaseEntity *pActivator, CBaseEntity *pCaller, USE_TYPE us
 		// Pop back to last target if it's available
 		if ( m_hEnemy )
 		{
-			m_target = m_hEnemy->GetEntityName();
+			SetTarget( m_hEnemy->GetEntityName() );
 		}
 
 		SetNextThink( TICK_NEVER_THINK );
@@ -913,7 +913,7 @@ void CFuncTrain::Next( void )
 	// Save last target in case we need to find it again
 	m_iszLastTarget = m_target;
 
-	m_target = pTarg->m_target;
+	SetTarget( pTarg->m_target );
 	m_flWait = pTarg->GetDelay();
 
 	// If our target has a speed, take it
@@ -1001,7 +1001,7 @@ void CFuncTrain::SetupTarget( void )
 		}
 		
 		// Keep track of this since path corners change our target for us
-		m_target = pTarg->m_target;
+		SetTarget( pTarg->m_target );
 		m_hCurrentTarget = pTarg;
 	}
 }
@@ -1063,7 +1063,7 @@ void CFuncTrain::OnRestore( void )
 	if ( GetAbsVelocity() != vec3_origin )
 	{
 		// Continue moving to the same target
-		m_target = m_iszLastTarget;
+		SetTarget( m_iszLastTarget );
 	}
 
 	SetupTarget();
@@ -1118,7 +1118,7 @@ void CFuncTrain::Stop( void )
 		// Pop back to last target if it's available
 		if ( m_hEnemy )
 		{
-			m_target = m_hEnemy->GetEntityName();
+			SetTarget( m_hEnemy->GetEntityName() );
 		}
 
 		SetNextThink( TICK_NEVER_THINK );
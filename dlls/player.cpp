@@ -6500,14 +6500,14 @@ void CBasePlayer::ModifyOrAppendPlayerCriteria( AI_CriteriaSet& set )
 		return;
 
 	// Append our health
-	set.AppendCriteria( "playerhealth", UTIL_VarArgs( "%i", player->GetHealth() ) );
+	set.AppendCriteria( "playerhealth", player->GetHealth() );
 	float healthfrac = 0.0f;
 	if ( player->GetMaxHealth() > 0 )
 	{
 		healthfrac = (float)player->GetHealth() / (float)player->GetMaxHealth();
 	}
 
-	set.AppendCriteria( "playerhealthfrac", UTIL_VarArgs( "%.3f", healthfrac ) );
+	set.AppendCriteria( "playerhealthfrac", healthfrac );
 
 	CBaseCombatWeapon *weapon = player->GetActiveWeapon();
 	if ( weapon )
@@ -6522,7 +6522,7 @@ void CBasePlayer::ModifyOrAppendPlayerCriteria( AI_CriteriaSet& set )
 	// Append current activity name
 	set.AppendCriteria( "playeractivity", CAI_BaseNPC::GetActivityName( player->GetActivity() ) );
 
-	set.AppendCriteria( "playerspeed", UTIL_VarArgs( "%.3f", player->GetAbsVelocity().Length() ) );
+	set.AppendCriteria( "playerspeed", player->GetAbsVelocity().Length() );
 
 	player->AppendContextToCriteria( set, "player" );
 }
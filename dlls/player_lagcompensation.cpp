@@ -14,6 +14,7 @@ static ConVar sv_unlag("sv_unlag", "1", FCVAR_SERVER );
 static ConVar sv_maxunlag("sv_maxunlag"	, "0.5", FCVAR_NONE );
 static ConVar sv_unlagpush("sv_unlagpush"	, "0.0", FCVAR_NONE );
 static ConVar sv_unlagsamples("sv_unlagsamples", "1", FCVAR_NONE );
+static ConVar sv_unlag_fov("sv_unlag_fov", "360", FCVAR_NONE, "Only players whose recent movement falls within this many degrees of the shooter's aim are rewound (360 rewinds everyone; narrower cones ignore spread and punch)" );
 
 #define LC_NONE				0
 #define LC_ALIVE			(1<<0)
@@ -28,6 +29,9 @@ static ConVar sv_unlagsamples("sv_unlagsamples", "1", FCVAR_NONE );
 #define LAG_COMPENSATION_ERROR_EPS_SQR ( 4.0f * 4.0f )
 // Only keep 1 second of data
 #define LAG_COMPENSATION_DATA_TIME	1.0f
+// Records kept per player, one per frame. Must be a power of two; servers running
+// faster than this many frames a second keep less than LAG_COMPENSATION_DATA_TIME
+#define LAG_COMPENSATION_MAX_RECORDS	256
 
 //-----------------------------------------------------------------------------
 // Purpose: 
@@ -38,6 +42,7 @@ public:
 	LagRecord()
 	{
 		m_nPlayerIndex = 0;
+		m_flRecordTime = 0.0f;
 		m_fFlags = 0;
 		m_vecOrigin.Init();
 		m_vecAngles.Init();
@@ -48,6 +53,7 @@ public:
 	LagRecord( const LagRecord& src )
 	{
 		m_nPlayerIndex = src.m_nPlayerIndex;
+		m_flRecordTime = src.m_flRecordTime;
 		m_fFlags = src.m_fFlags;
 		m_vecOrigin = src.m_vecOrigin;
 		m_vecAngles = src.m_vecAngles;
@@ -59,6 +65,8 @@ public:
 	bool					m_bActive;
 	// Which player this belongs to
 	int						m_nPlayerIndex;
+	// Timestamp record was created (at end of frame?)
+	float					m_flRecordTime;
 	// Did player die this frame
 	int						m_fFlags;
 
@@ -74,31 +82,223 @@ public:
 };
 
 //-----------------------------------------------------------------------------
-// Purpose: 
+// Purpose: Smallest of a value over a sliding window of records, kept as a
+//			queue of candidates in increasing order. Each record is pushed and
+//			popped at most once, so it costs O(1) a frame however long the
+//			window is.
 //-----------------------------------------------------------------------------
-class LagCompensationContext
+class CLagCompensationWindowMin
 {
 public:
-	LagCompensationContext()
-	{ 
-		m_flRecordTime = 0.0f;
-		memset( m_Records, 0, sizeof( m_Records ) );
+	CLagCompensationWindowMin()
+	{
+		Clear();
 	}
-	LagCompensationContext( const LagCompensationContext& src )
+
+	void Clear()
 	{
-		m_flRecordTime = src.m_flRecordTime;
-		int i;
-		for ( i = 0; i < MAX_CLIENTS; i++ )
+		m_iFront = m_iBack = 0;
+	}
+
+	bool IsEmpty() const
+	{
+		return m_iFront == m_iBack;
+	}
+
+	float Get() const
+	{
+		Assert( !IsEmpty() );
+		return m_Values[ m_iFront & ( LAG_COMPENSATION_MAX_RECORDS - 1 ) ];
+	}
+
+	// Serials must increase; drop expired records first so there's room
+	void Push( int serial, float value )
+	{
+		// Anything at least this big is older, so it can never be the smallest again
+		while ( !IsEmpty() && m_Values[ ( m_iBack - 1 ) & ( LAG_COMPENSATION_MAX_RECORDS - 1 ) ] >= value )
 		{
-			m_Records[ i ] = src.m_Records[ i ];
+			m_iBack--;
 		}
+
+		Assert( m_iBack - m_iFront < LAG_COMPENSATION_MAX_RECORDS );
+		m_Serials[ m_iBack & ( LAG_COMPENSATION_MAX_RECORDS - 1 ) ] = serial;
+		m_Values[ m_iBack & ( LAG_COMPENSATION_MAX_RECORDS - 1 ) ] = value;
+		m_iBack++;
 	}
-	// Timestamp record was created (at end of frame?)
-	float			m_flRecordTime;
-	LagRecord		m_Records[ MAX_CLIENTS ];	
+
+	void Expire( int oldestSerial )
+	{
+		while ( !IsEmpty() && m_Serials[ m_iFront & ( LAG_COMPENSATION_MAX_RECORDS - 1 ) ] < oldestSerial )
+		{
+			m_iFront++;
+		}
+	}
+
+private:
+	int				m_Serials[ LAG_COMPENSATION_MAX_RECORDS ];
+	float			m_Values[ LAG_COMPENSATION_MAX_RECORDS ];
+	unsigned int	m_iFront;
+	unsigned int	m_iBack;
 };
 
+//-----------------------------------------------------------------------------
+// Purpose: Fixed size ring of one player's records, newest first. Every slot
+//			gets a record each frame, inactive if no player was there, so a
+//			track covers the same frames as every other track.
+//-----------------------------------------------------------------------------
+class CLagCompensationTrack
+{
+public:
+	CLagCompensationTrack()
+	{
+		Clear();
+	}
+
+	void Clear()
+	{
+		m_iHead = 0;
+		m_nCount = 0;
+		m_nSerial = 0;
+		m_bHasBounds = false;
+
+		for ( int i = 0; i < 3; i++ )
+		{
+			m_SweptMins[i].Clear();
+			m_NegSweptMaxs[i].Clear();
+		}
+	}
+
+	int Count() const
+	{
+		return m_nCount;
+	}
+
+	// Age 0 is the newest record
+	const LagRecord &Get( int age ) const
+	{
+		Assert( age >= 0 && age < m_nCount );
+		return m_Records[ ( m_iHead - age ) & ( LAG_COMPENSATION_MAX_RECORDS - 1 ) ];
+	}
+
+	// Overwrites the oldest record once the ring is full
+	LagRecord &AddRecord()
+	{
+		m_nSerial++;
+		m_iHead = ( m_iHead + 1 ) & ( LAG_COMPENSATION_MAX_RECORDS - 1 );
+		if ( m_nCount < LAG_COMPENSATION_MAX_RECORDS )
+		{
+			m_nCount++;
+		}
+		return m_Records[ m_iHead ];
+	}
+
+	void			Decay( float deadtime );
+	// Call once the record from AddRecord() is filled in
+	void			UpdateSweptBounds();
+	bool			FindSpan( float targettime, int *newer, int *older ) const;
+
+	// World bounds of every active record in the track
+	bool			m_bHasBounds;
+	Vector			m_vecSweptMins;
+	Vector			m_vecSweptMaxs;
+
+private:
+	LagRecord		m_Records[ LAG_COMPENSATION_MAX_RECORDS ];
+	int				m_iHead;
+	int				m_nCount;
+	int				m_nSerial;		// of the newest record, counting every record ever added
+
+	// Per axis; the maxs are kept negated so both are minimums
+	CLagCompensationWindowMin	m_SweptMins[3];
+	CLagCompensationWindowMin	m_NegSweptMaxs[3];
+};
+
+void CLagCompensationTrack::Decay( float deadtime )
+{
+	while ( m_nCount && Get( m_nCount - 1 ).m_flRecordTime < deadtime )
+	{
+		m_nCount--;
+	}
+}
+
+void CLagCompensationTrack::UpdateSweptBounds()
+{
+	// Records decayed or overwritten since the last frame drop out first
+	int oldestSerial = m_nSerial - m_nCount + 1;
+	const LagRecord &record = Get( 0 );
+
+	int i;
+	for ( i = 0; i < 3; i++ )
+	{
+		m_SweptMins[i].Expire( oldestSerial );
+		m_NegSweptMaxs[i].Expire( oldestSerial );
+
+		if ( record.m_bActive )
+		{
+			m_SweptMins[i].Push( m_nSerial, record.m_vecOrigin[i] + record.m_vecMins[i] );
+			m_NegSweptMaxs[i].Push( m_nSerial, -( record.m_vecOrigin[i] + record.m_vecMaxs[i] ) );
+		}
+	}
+
+	m_bHasBounds = !m_SweptMins[0].IsEmpty();
+	if ( !m_bHasBounds )
+		return;
+
+	for ( i = 0; i < 3; i++ )
+	{
+		m_vecSweptMins[i] = m_SweptMins[i].Get();
+		m_vecSweptMaxs[i] = -m_NegSweptMaxs[i].Get();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Binary search for the pair of records either side of targettime.
+//			Times before the oldest record use the two oldest, times after the
+//			newest use the two newest.
+//-----------------------------------------------------------------------------
+bool CLagCompensationTrack::FindSpan( float targettime, int *newer, int *older ) const
+{
+	Assert( older && newer );
+	*newer = -1;
+	*older = -1;
+
+	if ( m_nCount < 2 )
+		return false;
+
+	if ( targettime >= Get( 0 ).m_flRecordTime )
+	{
+		*newer = 0;
+		*older = 1;
+		return true;
+	}
+
+	if ( targettime < Get( m_nCount - 1 ).m_flRecordTime )
+	{
+		*newer = m_nCount - 2;
+		*older = m_nCount - 1;
+		return true;
+	}
+
+	// Find the newest record at or before targettime; record 0 is after it
+	int lo = 1;
+	int hi = m_nCount - 1;
+	while ( lo < hi )
+	{
+		int mid = ( lo + hi ) / 2;
+		if ( Get( mid ).m_flRecordTime <= targettime )
+		{
+			hi = mid;
+		}
+		else
+		{
+			lo = mid + 1;
+		}
+	}
 
+	*newer = lo - 1;
+	*older = lo;
+	return true;
+}
 
 //-----------------------------------------------------------------------------
 // Purpose: 
@@ -109,12 +309,12 @@ public:
 	// IServerSystem stuff
 	virtual void Shutdown()
 	{
-		m_Data.Purge();
+		ClearHistory();
 	}
 
 	virtual void LevelShutdownPostEntity()
 	{
-		m_Data.RemoveAll();
+		ClearHistory();
 	}
 
 	// called after entities think
@@ -126,13 +326,19 @@ public:
 	void			StartLagCompensation( CBasePlayer *player, CUserCmd *cmd );
 	void			FinishLagCompensation( CBasePlayer *player );
 
+	void			ReportStats( void );
+
 private:
 	float			GetLatency( CBasePlayer *player );
-	void			DecayStaleContextData( void );
+	void			ClearHistory( void );
 
-	bool			FindSpanningContexts( float targettime, int *context1, int *context2 );
+	CLagCompensationTrack	m_Tracks[ MAX_CLIENTS ];
 
-	CUtlVector< LagCompensationContext >	m_Data;
+	// Totals since the last sv_unlag_stats
+	int				m_nStatCommands;
+	int				m_nStatConsidered;
+	int				m_nStatCulled;
+	int				m_nStatRewound;
 
 	// Scratchpad for determining what needs to be restored
 	unsigned int	restorebits;
@@ -152,6 +358,11 @@ private:
 static CLagCompensationManager g_LagCompensationManager;
 ILagCompensationManager *lagcompensation = &g_LagCompensationManager;
 
+CON_COMMAND( sv_unlag_stats, "Report lag compensation rewinds per command since the last report" )
+{
+	g_LagCompensationManager.ReportStats();
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : *player - 
@@ -168,90 +379,97 @@ float CLagCompensationManager::GetLatency ( CBasePlayer *player )
 	return ping;
 }
 
-void CLagCompensationManager::DecayStaleContextData( void )
+void CLagCompensationManager::ClearHistory( void )
 {
-	float deadtime = gpGlobals->realtime - LAG_COMPENSATION_DATA_TIME;
-
-	int c = m_Data.Size();
 	int i;
-	for ( i = c - 1; i >= 0; i-- )
+	for ( i = 0; i < MAX_CLIENTS; i++ )
 	{
-		LagCompensationContext *context = &m_Data[ i ];
-		if ( context->m_flRecordTime >= deadtime )
-			continue;
-
-		m_Data.Remove( i );
+		m_Tracks[ i ].Clear();
 	}
 }
 
+void CLagCompensationManager::ReportStats( void )
+{
+	float commands = max( m_nStatCommands, 1 );
+
+	Msg( "Lag compensation: %d commands, per command %.2f players considered, %.2f culled by aim, %.2f rewound\n",
+		m_nStatCommands,
+		m_nStatConsidered / commands,
+		m_nStatCulled / commands,
+		m_nStatRewound / commands );
+
+	m_nStatCommands = 0;
+	m_nStatConsidered = 0;
+	m_nStatCulled = 0;
+	m_nStatRewound = 0;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Called once per frame after all entities have had a chance to think
 //-----------------------------------------------------------------------------
 void CLagCompensationManager::FrameUpdatePostEntityThink()
 {
-	DecayStaleContextData();
-
-	LagCompensationContext context;
-	context.m_flRecordTime = gpGlobals->realtime;
+	float deadtime = gpGlobals->realtime - LAG_COMPENSATION_DATA_TIME;
 
-	// Iterate all active players
+	// Iterate all player slots
 	int i;
 	for ( i = 1; i <= gpGlobals->maxClients; i++ )
 	{
-		CBasePlayer *pPlayer = ToBasePlayer( UTIL_PlayerByIndex( i ) );
-		if ( !pPlayer )
-			continue;
+		CLagCompensationTrack *track = &m_Tracks[ i - 1 ];
+		track->Decay( deadtime );
 
-		LagRecord *record = &context.m_Records[ i - 1 ];
-		record->m_bActive = true;
-		record->m_nPlayerIndex = pPlayer->entindex();
+		LagRecord *record = &track->AddRecord();
+		record->m_flRecordTime = gpGlobals->realtime;
+		record->m_nPlayerIndex = i;
 		record->m_fFlags = 0;
-		if ( pPlayer->IsAlive() )
+
+		CBasePlayer *pPlayer = ToBasePlayer( UTIL_PlayerByIndex( i ) );
+		if ( !pPlayer )
 		{
-			record->m_fFlags |= LC_ALIVE;
+			record->m_bActive = false;
+		}
+		else
+		{
+			record->m_bActive = true;
+			if ( pPlayer->IsAlive() )
+			{
+				record->m_fFlags |= LC_ALIVE;
+			}
+			record->m_vecAngles			= pPlayer->GetLocalAngles();
+			record->m_vecOrigin			= pPlayer->GetLocalOrigin();
+			record->m_vecMaxs			= pPlayer->WorldAlignMaxs();
+			record->m_vecMins			= pPlayer->WorldAlignMins();
 		}
-		record->m_vecAngles			= pPlayer->GetLocalAngles();
-		record->m_vecOrigin			= pPlayer->GetLocalOrigin();
-		record->m_vecMaxs			= pPlayer->WorldAlignMaxs();
-		record->m_vecMins			= pPlayer->WorldAlignMins();
-	}
 
-	m_Data.AddToHead( context );
+		track->UpdateSweptBounds();
+	}
 }
 
-bool CLagCompensationManager::FindSpanningContexts( float targettime, int *newer, int *older )
+//-----------------------------------------------------------------------------
+// Purpose: Can a shot from eye along forward, give or take the cone, pass
+//			through the box?  Tests the box's bounding sphere, so errs on
+//			the side of rewinding.
+//-----------------------------------------------------------------------------
+static bool BoundsInFiringCone( const Vector &mins, const Vector &maxs, const Vector &eye, const Vector &forward, float cosCone, float sinCone )
 {
-	Assert( older && newer );
-	*newer = -1;
-	*older = -1;
+	Vector center = ( mins + maxs ) * 0.5f;
+	float radius = ( maxs - center ).Length();
 
-	int count = m_Data.Size();
-	if ( count < 2 )
-		return false;
-
-	int i;
-	int j;
-	for ( i = 0; i < count - 1; i++ )
-	{
-		j = i + 1;
+	Vector toCenter = center - eye;
+	float dist = VectorNormalize( toCenter );
+	if ( dist <= radius )
+		return true;
 
-		// New items are pushed onto front of stack
-		LagCompensationContext *c1, *c2;
-		c1 = &m_Data[ i ]; // newer
-		c2 = &m_Data[ j ]; // older
+	// Widen the cone by the angle the sphere covers as seen from the eye
+	float sinBounds = radius / dist;
+	float cosBounds = sqrt( 1.0f - sinBounds * sinBounds );
+	float cosTotal = cosCone * cosBounds - sinCone * sinBounds;
 
-		if ( targettime >= c2->m_flRecordTime && 
-			 targettime <= c1->m_flRecordTime )
-		{
-			*newer = i;
-			*older = j;
-			return true;
-		}
-	}
+	// Half angles past 90 degrees together take in everything
+	if ( cosCone * sinBounds + sinCone * cosBounds < 0.0f )
+		return true;
 
-	*newer = count - 2;
-	*older = count - 1;
-	return true;
+	return ( DotProduct( forward, toCenter ) >= cosTotal );
 }
 
 //-----------------------------------------------------------------------------
@@ -284,10 +502,10 @@ static void InterpolateAngles( float frac, const QAngle& src, const QAngle& dest
 // Called during player movement to set up/restore after lag compensation
 void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCmd *cmd )
 {
-	// Assume no players need to be restored
+	// Assume no players need to be restored. Only slots with their restorebits
+	// set are ever read back, so restoreData itself needn't be cleared.
 	restorebits = 0UL;
 	m_bNeedToRestore = false;
-	memset( restoreData, 0, sizeof( restoreData ) );
 
 	// Player not wanting lag compensation
 	if ( !cmd->lag_compensation )
@@ -339,19 +557,18 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 	// Cap target to present time, of course
 	targettime = min( realtime, targettime );
 
-	int newer = -1;
-	int older = -1;
+	m_nStatCommands++;
 
-	if ( !FindSpanningContexts( targettime, &newer, &older ) )
-	{
-		return;
-	}
+	// Aim of the shot this command may fire
+	Vector eye = player->EyePosition();
+	Vector forward;
+	AngleVectors( cmd->viewangles, &forward );
 
-	// Couldn't find suitable span!!!
-	if ( newer == -1 || older == -1 )
-	{
-		return;
-	}
+	float fov = clamp( sv_unlag_fov.GetFloat(), 0.0f, 360.0f );
+	bool bCullByAim = ( fov < 360.0f );
+	float coneHalfAngle = DEG2RAD( fov * 0.5f );
+	float cosCone = cos( coneHalfAngle );
+	float sinCone = sin( coneHalfAngle );
 
 	// Iterate all active players
 	int i;
@@ -370,8 +587,28 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 		}
 
 		int index = pPlayer->entindex() - 1;
+		CLagCompensationTrack *track = &m_Tracks[ index ];
+
+		m_nStatConsidered++;
+
+		int newer = -1;
+		int older = -1;
 
-		// Walk context looking for any invalidating event
+		// Couldn't find suitable span!!!
+		if ( !track->FindSpan( targettime, &newer, &older ) )
+		{
+			continue;
+		}
+
+		// Skip anyone who hasn't been anywhere near the line of fire
+		if ( !track->m_bHasBounds ||
+			 ( bCullByAim && !BoundsInFiringCone( track->m_vecSweptMins, track->m_vecSweptMaxs, eye, forward, cosCone, sinCone ) ) )
+		{
+			m_nStatCulled++;
+			continue;
+		}
+
+		// Walk history looking for any invalidating event
 		Vector prevOrigin;
 		prevOrigin.Init();
 		bool wasAlive = true;
@@ -380,10 +617,7 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 
 		for ( int j = 0; j <= older; j++ )
 		{
-			LagCompensationContext *context = &m_Data[ j ];
-			Assert( context );
-
-			LagRecord *record = &context->m_Records[ index ];
+			const LagRecord *record = &track->Get( j );
 
 			if ( !record->m_bActive )
 			{
@@ -419,21 +653,15 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 			continue;
 
 		// Okay, interpolate data
-		LagCompensationContext *newcontext, *oldcontext;
-		
-		newcontext = &m_Data[ newer ];
-		oldcontext = &m_Data[ older ];
+		const LagRecord *newrecord, *oldrecord;
 
-		LagRecord *newrecord, *oldrecord;
-
-		newrecord = &newcontext->m_Records[ index ];
-		oldrecord = &oldcontext->m_Records[ index ];
-		Assert( oldrecord && newrecord );
+		newrecord = &track->Get( newer );
+		oldrecord = &track->Get( older );
 
 		float frac = 1.0f;
-		if ( oldcontext->m_flRecordTime != newcontext->m_flRecordTime )
+		if ( oldrecord->m_flRecordTime != newrecord->m_flRecordTime )
 		{
-			frac = ( targettime - oldcontext->m_flRecordTime ) / ( newcontext->m_flRecordTime - oldcontext->m_flRecordTime );
+			frac = ( targettime - oldrecord->m_flRecordTime ) / ( newrecord->m_flRecordTime - oldrecord->m_flRecordTime );
 			frac = clamp( frac, 0.0f, 1.0f );
 		}
 
@@ -492,6 +720,8 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 			continue;
 		}
 
+		m_nStatRewound++;
+
 		restorebits |= (1<<index);
 		m_bNeedToRestore = true;
 		restore->m_bActive = true;
@@ -231,13 +231,13 @@ void CPointAngleSensor::InputSetTargetEntity(inputdata_t &inputdata)
 {
 	if ((inputdata.value.String() == NULL) || (inputdata.value.StringID() == NULL_STRING) || (inputdata.value.String()[0] == '\0'))
 	{
-		m_target = NULL_STRING;
+		SetTarget( NULL_STRING );
 		m_hTargetEntity = NULL;
 		SetNextThink( TICK_NEVER_THINK );
 	}
 	else
 	{
-		m_target = AllocPooledString(inputdata.value.String());
+		SetTarget( AllocPooledString(inputdata.value.String()) );
 		m_hTargetEntity = gEntList.FindEntityByName(NULL, m_target, inputdata.pActivator);
 		SetNextThink( gpGlobals->curtime );
 	}
@@ -20,6 +20,9 @@
 #include "engine/IEngineSound.h"
 #include "ai_navigator.h"
 #include "saverestore_utlvector.h"
+#include "utlbuffer.h"
+#include "utldict.h"
+#include "igamesystem.h"
 
 
 
@@ -1553,16 +1556,115 @@ void CSceneTokenProcessor::SetBuffer( char *buffer )
 
 static CSceneTokenProcessor g_TokenProcessor;
 
-CChoreoScene *CSceneEntity::LoadScene( const char *filename )
+//-----------------------------------------------------------------------------
+// Purpose: Compiled scenes, shared by every scene entity playing the same
+//  file. A .vcd is parsed once per level; each entity then rebuilds its own
+//  scene (and playback state) from the compiled form, with flex samples read
+//  in place instead of copied.
+//-----------------------------------------------------------------------------
+class CSceneCache : public CAutoGameSystem
 {
+public:
+	CSceneCache() : m_Scenes( true )
+	{
+	}
+
+	CUtlBuffer	*FindOrCompile( const char *filename );
+	void		Purge();
+	void		ReportStats();
+
+	// Scene entities are gone by now, and nothing points into the cache
+	virtual void LevelShutdownPostEntity()
+	{
+		Purge();
+	}
+
+private:
+	CUtlDict< CUtlBuffer *, int >	m_Scenes;
+};
+
+static CSceneCache g_SceneCache;
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+// Input  : *filename - 
+// Output : CUtlBuffer - NULL if the file couldn't be loaded
+//-----------------------------------------------------------------------------
+CUtlBuffer *CSceneCache::FindOrCompile( const char *filename )
+{
+	int idx = m_Scenes.Find( filename );
+	if ( idx != m_Scenes.InvalidIndex() )
+		return m_Scenes[ idx ];
+
 	// Load the file
 	// FIXME:  use shared file system
 	char *buffer = (char *)engine->COM_LoadFile( filename, 2, NULL );
 	if ( !buffer )
 		return NULL;
 
+	CChoreoScene scene( NULL );
 	g_TokenProcessor.SetBuffer( buffer );
-	CChoreoScene *scene = ChoreoLoadScene( &m_SceneCallback, &g_TokenProcessor, Scene_Printf );
+	scene.ParseFromBuffer( &g_TokenProcessor );
+	engine->FreeFile( (byte *)buffer );
+
+	CUtlBuffer *compiled = new CUtlBuffer;
+	if ( !scene.SaveToBinaryBuffer( *compiled ) )
+	{
+		Warning( "CSceneCache:  couldn't compile %s\n", filename );
+		delete compiled;
+		return NULL;
+	}
+
+	m_Scenes.Insert( filename, compiled );
+	return compiled;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CSceneCache::Purge()
+{
+	for ( int i = m_Scenes.First(); i != m_Scenes.InvalidIndex(); i = m_Scenes.Next( i ) )
+	{
+		delete m_Scenes[ i ];
+	}
+	m_Scenes.RemoveAll();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CSceneCache::ReportStats()
+{
+	int bytes = 0;
+	for ( int i = m_Scenes.First(); i != m_Scenes.InvalidIndex(); i = m_Scenes.Next( i ) )
+	{
+		Msg( "  %6d bytes  %s\n", m_Scenes[ i ]->TellPut(), m_Scenes.GetElementName( i ) );
+		bytes += m_Scenes[ i ]->TellPut();
+	}
+	Msg( "%d compiled scenes, %d bytes\n", m_Scenes.Count(), bytes );
+}
+
+CON_COMMAND( scene_cache_stats, "List the compiled scenes shared by scene entities" )
+{
+	g_SceneCache.ReportStats();
+}
+
+CChoreoScene *CSceneEntity::LoadScene( const char *filename )
+{
+	CUtlBuffer *compiled = g_SceneCache.FindOrCompile( filename );
+	if ( !compiled )
+		return NULL;
+
+	// Read through a view of our own, the cached buffer is never touched
+	CUtlBuffer buf( compiled->Base(), compiled->TellPut() );
+	buf.SeekPut( CUtlBuffer::SEEK_HEAD, compiled->TellPut() );
+
+	CChoreoScene *scene = ChoreoLoadSceneFromBinary( &m_SceneCallback, buf, Scene_Printf );
+	if ( !scene )
+	{
+		Warning( "CSceneEntity:  bad compiled scene %s\n", filename );
+	}
 	return scene;
 }
 
@@ -1683,7 +1683,7 @@ void CAI_ChangeTarget::InputActivate( inputdata_t &inputdata )
 
 	while ((pTarget = gEntList.FindEntityByName( pTarget, m_target, inputdata.pActivator )) != NULL)
 	{
-		pTarget->m_target = m_iszNewTarget;
+		pTarget->SetTarget( m_iszNewTarget );
 		CAI_BaseNPC *pNPC = pTarget->MyNPCPointer( );
 		if (pNPC)
 		{
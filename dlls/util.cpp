@@ -27,6 +27,12 @@
 #include "iservervehicle.h"
 #include "te_effect_dispatch.h"
 #include "utldict.h"
+#include "utlmap.h"
+#include "utlhashmap.h"
+#include "mempool.h"
+#include "utlbuffer.h"
+#include "KeyValues.h"
+#include "tier0/fasttimer.h"
 #include "studio.h" // VXP: Am I doing this right?
 #include "movevars_shared.h" // VXP
 
@@ -61,6 +67,7 @@ public:
 	virtual void InstallFactory( IEntityFactory *pFactory, const char *pClassName );
 	virtual IServerNetworkable *Create( const char *pClassName );
 	virtual void Destroy( const char *pClassName, IServerNetworkable *pNetworkable );
+	virtual void GetFactoryNames( CUtlVector<const char *> &names );
 
 private:
 	IEntityFactory *FindFactory( const char *pClassName );
@@ -141,6 +148,18 @@ void CEntityFactoryDictionary::Destroy( const char *pClassName, IServerNetworkab
 }
 
 
+//-----------------------------------------------------------------------------
+// Lists the installed factories
+//-----------------------------------------------------------------------------
+void CEntityFactoryDictionary::GetFactoryNames( CUtlVector<const char *> &names )
+{
+	for ( unsigned short i = m_Factories.First(); i != m_Factories.InvalidIndex(); i = m_Factories.Next( i ) )
+	{
+		names.AddToTail( m_Factories.GetElementName( i ) );
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 // class CFlaggedEntitiesEnum
 //-----------------------------------------------------------------------------
@@ -1512,7 +1531,7 @@ public:
 	bool AddOrMarkPrecached( const char *pClassname );
 
 private:
-	CUtlSymbolTable		m_list;
+	CUtlHashSymbolTable	m_list;
 };
 
 void CPrecacheOtherList::LevelInitPreEntity()
@@ -1532,7 +1551,7 @@ void CPrecacheOtherList::LevelShutdownPostEntity()
 //-----------------------------------------------------------------------------
 bool CPrecacheOtherList::AddOrMarkPrecached( const char *pClassname )
 {
-	CUtlSymbol sym = m_list.Find( pClassname );
+	CUtlHashSymbol sym = m_list.Find( pClassname );
 	if ( sym.IsValid() )
 		return false;
 
@@ -2351,3 +2370,384 @@ AngularImpulse WorldToLocalRotation( const VMatrix &localToWorld, const Vector &
 
 	return ang;
 }
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Lets the server's KeyValues use and write .kvc binary caches
+//-----------------------------------------------------------------------------
+static void KeyValuesCacheChanged( ConVar *var, char const *pOldString )
+{
+	KeyValues::SetBinaryCacheMode( var->GetInt() >= 1, var->GetInt() >= 2 );
+}
+
+ConVar keyvalues_cache( "keyvalues_cache", "0", 0, "KeyValues binary caches: 0 = always parse text, 1 = load current .kvc files, 2 = also write them", KeyValuesCacheChanged );
+
+//-----------------------------------------------------------------------------
+// Purpose: Where the server's KeyValues memory has come from
+//-----------------------------------------------------------------------------
+CON_COMMAND( keyvalues_memstats, "Report KeyValues allocations in the server" )
+{
+	const KeyValuesAllocStats_t &stats = KeyValues::GetAllocStats();
+	Msg( "KeyValues allocations since startup:\n" );
+	Msg( "  pool:  %d keys, %d heap strings\n", stats.nPoolKeys, stats.nHeapStrings );
+	Msg( "  arena: %d keys, %d strings\n", stats.nArenaKeys, stats.nArenaStrings );
+	Msg( "Live arenas: %d, %d blocks, %d of %d KB used\n", stats.nArenas, stats.nArenaBlocks, 
+		stats.nArenaBytesUsed / 1024, stats.nArenaBytesReserved / 1024 );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Times parsing and key lookups on a KeyValues document made of a few
+//			large sections, with the child index on and off
+//-----------------------------------------------------------------------------
+#define KEYVALUES_BENCH_SECTIONS	8
+#define KEYVALUES_BENCH_KEYS		512
+#define KEYVALUES_BENCH_PASSES		16
+
+static void KeyValuesBenchRun( const char *pDocument, char szKeys[][16], bool bIndexed, float &flParseMs, float &flLookupMs, int &nFound )
+{
+	bool bWasEnabled = KeyValues::IsChildIndexEnabled();
+	KeyValues::EnableChildIndex( bIndexed );
+
+	CFastTimer timer;
+	timer.Start();
+	KeyValues *pRoot = new KeyValues( "keyvalues_bench" );
+	pRoot->LoadFromBuffer( "keyvalues_bench", pDocument );
+	timer.End();
+	flParseMs = timer.GetDuration().GetMillisecondsF();
+
+	// Half the reads go through GetString() on numeric keys, which used to
+	// rewrite the key as a string every time. The tree stays in this module,
+	// so the lookups can use the child index.
+	nFound = 0;
+	timer.Start();
+	KeyValues::BeginChildIndexScope();
+	for ( int pass = 0; pass < KEYVALUES_BENCH_PASSES; pass++ )
+	{
+		for ( KeyValues *pSection = pRoot->GetFirstSubKey(); pSection; pSection = pSection->GetNextKey() )
+		{
+			for ( int i = 0; i < KEYVALUES_BENCH_KEYS; i++ )
+			{
+				if ( i & 1 )
+				{
+					nFound += ( pSection->GetInt( szKeys[i], -1 ) != -1 );
+				}
+				else
+				{
+					nFound += ( *pSection->GetString( szKeys[i] ) != 0 );
+				}
+			}
+
+			nFound -= ( pSection->FindKey( "missing" ) != NULL );
+		}
+	}
+	KeyValues::EndChildIndexScope();
+	timer.End();
+	flLookupMs = timer.GetDuration().GetMillisecondsF();
+
+	pRoot->deleteThis();
+	KeyValues::EnableChildIndex( bWasEnabled );
+}
+
+CON_COMMAND( keyvalues_bench, "Time parsing and looking up keys in a synthetic KeyValues document" )
+{
+	char (*szKeys)[16] = new char[KEYVALUES_BENCH_KEYS][16];
+	for ( int i = 0; i < KEYVALUES_BENCH_KEYS; i++ )
+	{
+		Q_snprintf( szKeys[i], sizeof(szKeys[i]), "key%d", i );
+	}
+
+	CUtlBuffer buf( 0, 0, true );
+	buf.Printf( "\"keyvalues_bench\"\n{\n" );
+	for ( int section = 0; section < KEYVALUES_BENCH_SECTIONS; section++ )
+	{
+		buf.Printf( "\t\"section%d\"\n\t{\n", section );
+		for ( int i = 0; i < KEYVALUES_BENCH_KEYS; i++ )
+		{
+			switch ( i % 3 )
+			{
+			case 0:
+				buf.Printf( "\t\t\"%s\"\t\"%d\"\n", szKeys[i], i );
+				break;
+			case 1:
+				buf.Printf( "\t\t\"%s\"\t\"%d.5\"\n", szKeys[i], i );
+				break;
+			default:
+				buf.Printf( "\t\t\"%s\"\t\"value%d\"\n", szKeys[i], i );
+				break;
+			}
+		}
+		buf.Printf( "\t}\n" );
+	}
+	buf.Printf( "}\n" );
+	buf.PutChar( 0 );
+
+	float flLinearParseMs, flLinearLookupMs, flIndexedParseMs, flIndexedLookupMs;
+	int nLinearFound, nIndexedFound;
+	KeyValuesBenchRun( (const char *)buf.Base(), szKeys, false, flLinearParseMs, flLinearLookupMs, nLinearFound );
+	KeyValuesBenchRun( (const char *)buf.Base(), szKeys, true, flIndexedParseMs, flIndexedLookupMs, nIndexedFound );
+
+	// Same document parsed into an arena tree
+	KeyValuesAllocStats_t before = KeyValues::GetAllocStats();
+	CFastTimer timer;
+	timer.Start();
+	KeyValues *pArena = new KeyValues( "keyvalues_bench" );
+	pArena->UseArenaAllocator();
+	pArena->LoadFromBuffer( "keyvalues_bench", (const char *)buf.Base() );
+	timer.End();
+	float flArenaParseMs = timer.GetDuration().GetMillisecondsF();
+	KeyValuesAllocStats_t after = KeyValues::GetAllocStats();
+
+	timer.Start();
+	pArena->deleteThis();
+	timer.End();
+	float flArenaFreeMs = timer.GetDuration().GetMillisecondsF();
+
+	// Same document through the binary cache format
+	CRC32_t crc;
+	CRC32_Init( &crc );
+	CRC32_ProcessBuffer( &crc, buf.Base(), buf.TellPut() );
+	CRC32_Final( &crc );
+
+	KeyValues *pText = new KeyValues( "keyvalues_bench" );
+	pText->LoadFromBuffer( "keyvalues_bench", (const char *)buf.Base() );
+	CUtlBuffer binary( 0, 0, false );
+	pText->SaveToBinaryBuffer( binary, crc, buf.TellPut() );
+	pText->deleteThis();
+
+	timer.Start();
+	KeyValues *pBinary = new KeyValues( "keyvalues_bench" );
+	bool bBinaryOK = pBinary->LoadFromBinaryBuffer( "keyvalues_bench", binary.Base(), binary.TellPut(), crc, buf.TellPut() );
+	timer.End();
+	pBinary->deleteThis();
+
+	int nLookups = KEYVALUES_BENCH_PASSES * KEYVALUES_BENCH_SECTIONS * ( KEYVALUES_BENCH_KEYS + 1 );
+	Msg( "keyvalues_bench: %d sections of %d keys, %d lookups\n", KEYVALUES_BENCH_SECTIONS, KEYVALUES_BENCH_KEYS, nLookups );
+	Msg( "  linear:  parse %.2fms, lookup %.2fms (%d found)\n", flLinearParseMs, flLinearLookupMs, nLinearFound );
+	Msg( "  indexed: parse %.2fms, lookup %.2fms (%d found)\n", flIndexedParseMs, flIndexedLookupMs, nIndexedFound );
+	Msg( "  arena:   parse %.2fms, free %.2fms, %d blocks (%d KB) for %d keys and %d strings\n", flArenaParseMs, flArenaFreeMs,
+		after.nArenaBlocks - before.nArenaBlocks, ( after.nArenaBytesReserved - before.nArenaBytesReserved ) / 1024,
+		after.nArenaKeys - before.nArenaKeys, after.nArenaStrings - before.nArenaStrings );
+	Msg( "  binary:  load %.2fms from %d bytes (text %d bytes)%s\n", timer.GetDuration().GetMillisecondsF(), 
+		binary.TellPut(), buf.TellPut(), bBinaryOK ? "" : ", FAILED" );
+
+	delete [] szKeys;
+}
+
+
+//-----------------------------------------------------------------------------
+// CUtlHashMap test and benchmark
+//-----------------------------------------------------------------------------
+
+#ifdef _DEBUG
+
+CON_COMMAND( test_utlhashmap, "Tests the class CUtlHashMap" )
+{
+	CUtlHashMap<int, int> map;
+	Assert( map.Count() == 0 );
+	Assert( map.Find( 1 ) == map.InvalidIndex() );
+
+	int i;
+	for ( i = 0; i < 1000; i++ )
+	{
+		map.Insert( i * 7, i );
+	}
+	Assert( map.Count() == 1000 );
+
+	// inserting an existing key leaves the element alone
+	int idx = map.Insert( 7, 100 );
+	Assert( map.Count() == 1000 );
+	Assert( map[idx] == 1 );
+
+	map.InsertOrReplace( 7, 100 );
+	Assert( map[map.Find( 7 )] == 100 );
+
+	// indices survive removing other elements; 21 is kept, 14 is removed
+	int idx21 = map.Find( 21 );
+	for ( i = 0; i < 1000; i += 2 )
+	{
+		Assert( map.Remove( i * 7 ) );
+	}
+	Assert( map.Count() == 500 );
+	Assert( !map.Remove( 0 ) );
+	Assert( map.Find( 14 ) == map.InvalidIndex() );
+	Assert( map.Find( 21 ) == idx21 );
+	Assert( map.Key( idx21 ) == 21 && map[idx21] == 3 );
+
+	int nCount = 0;
+	for ( i = map.First(); i != map.InvalidIndex(); i = map.Next( i ) )
+	{
+		Assert( ( map.Key( i ) / 7 ) & 1 );
+		nCount++;
+	}
+	Assert( nCount == 500 );
+
+	map.Compact();
+	for ( i = 1; i < 1000; i += 2 )
+	{
+		Assert( map.Find( i * 7 ) != map.InvalidIndex() );
+	}
+
+	map.RemoveAll();
+	Assert( map.Count() == 0 && map.First() == map.InvalidIndex() );
+
+	CUtlHashMap<const char *, int, CUtlHashStringCaseless, CUtlEqualStringCaseless> names;
+	names.Insert( "Test", 1 );
+	names.Insert( "test2", 2 );
+	Assert( names.Find( "TEST" ) != names.InvalidIndex() );
+	Assert( names.Find( "Test2" ) != names.InvalidIndex() );
+	Assert( names.Find( "test3" ) == names.InvalidIndex() );
+
+	CUtlHashSet<int> set;
+	set.Insert( 5 );
+	Assert( set.HasElement( 5 ) && !set.HasElement( 6 ) );
+
+	Msg("Pass.");
+}
+
+#endif
+
+#define HASHMAP_BENCH_KEYS		30000
+#define HASHMAP_BENCH_PASSES	10
+
+static bool HashMapBenchLessFunc( const int &lhs, const int &rhs )
+{
+	return lhs < rhs;
+}
+
+CON_COMMAND( utlhashmap_bench, "Time CUtlHashMap against CUtlMap and CUtlDict" )
+{
+	int *pKeys = new int[HASHMAP_BENCH_KEYS];
+	char (*szNames)[24] = new char[HASHMAP_BENCH_KEYS][24];
+
+	unsigned int nSeed = 12345;
+	int i, pass, nFound;
+	for ( i = 0; i < HASHMAP_BENCH_KEYS; i++ )
+	{
+		nSeed = nSeed * 1103515245 + 12345;
+		pKeys[i] = (int)( nSeed >> 1 );
+		Q_snprintf( szNames[i], sizeof(szNames[i]), "npc_entity_%d", i );
+	}
+
+	CFastTimer timer;
+
+	// int keys
+	CUtlMap<int, int> intMap( 0, 0, HashMapBenchLessFunc );
+	timer.Start();
+	for ( i = 0; i < HASHMAP_BENCH_KEYS; i++ )
+	{
+		intMap.Insert( pKeys[i], i );
+	}
+	timer.End();
+	float flMapInsertMs = timer.GetDuration().GetMillisecondsF();
+
+	nFound = 0;
+	timer.Start();
+	for ( pass = 0; pass < HASHMAP_BENCH_PASSES; pass++ )
+	{
+		for ( i = 0; i < HASHMAP_BENCH_KEYS; i++ )
+		{
+			nFound += ( intMap.Find( pKeys[i] ) != intMap.InvalidIndex() );
+			nFound -= ( intMap.Find( pKeys[i] + 1 ) != intMap.InvalidIndex() );
+		}
+	}
+	timer.End();
+	float flMapFindMs = timer.GetDuration().GetMillisecondsF();
+	int nMapFound = nFound;
+
+	CUtlHashMap<int, int> intHash;
+	timer.Start();
+	for ( i = 0; i < HASHMAP_BENCH_KEYS; i++ )
+	{
+		intHash.Insert( pKeys[i], i );
+	}
+	timer.End();
+	float flHashInsertMs = timer.GetDuration().GetMillisecondsF();
+
+	nFound = 0;
+	timer.Start();
+	for ( pass = 0; pass < HASHMAP_BENCH_PASSES; pass++ )
+	{
+		for ( i = 0; i < HASHMAP_BENCH_KEYS; i++ )
+		{
+			nFound += ( intHash.Find( pKeys[i] ) != intHash.InvalidIndex() );
+			nFound -= ( intHash.Find( pKeys[i] + 1 ) != intHash.InvalidIndex() );
+		}
+	}
+	timer.End();
+	float flHashFindMs = timer.GetDuration().GetMillisecondsF();
+	int nHashFound = nFound;
+
+	// string keys
+	CUtlDict<int, unsigned short> dict( true );
+	timer.Start();
+	for ( i = 0; i < HASHMAP_BENCH_KEYS; i++ )
+	{
+		dict.Insert( szNames[i], i );
+	}
+	timer.End();
+	float flDictInsertMs = timer.GetDuration().GetMillisecondsF();
+
+	nFound = 0;
+	timer.Start();
+	for ( pass = 0; pass < HASHMAP_BENCH_PASSES; pass++ )
+	{
+		for ( i = 0; i < HASHMAP_BENCH_KEYS; i++ )
+		{
+			nFound += ( dict.Find( szNames[i] ) != dict.InvalidIndex() );
+		}
+	}
+	timer.End();
+	float flDictFindMs = timer.GetDuration().GetMillisecondsF();
+	int nDictFound = nFound;
+
+	CUtlHashMap<const char *, int, CUtlHashStringCaseless, CUtlEqualStringCaseless> nameHash;
+	timer.Start();
+	for ( i = 0; i < HASHMAP_BENCH_KEYS; i++ )
+	{
+		nameHash.Insert( szNames[i], i );
+	}
+	timer.End();
+	float flNameInsertMs = timer.GetDuration().GetMillisecondsF();
+
+	nFound = 0;
+	timer.Start();
+	for ( pass = 0; pass < HASHMAP_BENCH_PASSES; pass++ )
+	{
+		for ( i = 0; i < HASHMAP_BENCH_KEYS; i++ )
+		{
+			nFound += ( nameHash.Find( szNames[i] ) != nameHash.InvalidIndex() );
+		}
+	}
+	timer.End();
+	float flNameFindMs = timer.GetDuration().GetMillisecondsF();
+	int nNameFound = nFound;
+
+	Msg( "utlhashmap_bench: %d keys, %d lookup passes\n", HASHMAP_BENCH_KEYS, HASHMAP_BENCH_PASSES );
+	Msg( "  int    CUtlMap:     insert %.2fms, find %.2fms (%d)\n", flMapInsertMs, flMapFindMs, nMapFound );
+	Msg( "  int    CUtlHashMap: insert %.2fms, find %.2fms (%d)\n", flHashInsertMs, flHashFindMs, nHashFound );
+	Msg( "  string CUtlDict:    insert %.2fms, find %.2fms (%d)\n", flDictInsertMs, flDictFindMs, nDictFound );
+	Msg( "  string CUtlHashMap: insert %.2fms, find %.2fms (%d)\n", flNameInsertMs, flNameFindMs, nNameFound );
+
+	delete [] pKeys;
+	delete [] szNames;
+}
+
+
+CON_COMMAND( mempool_stats, "Report the thread safe memory pools in the server" )
+{
+	int nPools = 0;
+	for ( CMemoryPoolMT *pPool = CMemoryPoolMT::GetFirstPool(); pPool; pPool = pPool->GetNextPool() )
+	{
+		MemoryPoolStats_t stats;
+		pPool->GetStats( stats );
+		Msg( "%-32s %4d bytes: %6d in use (peak %6d), %6d cached in %d threads, %6d total in %d blobs\n", 
+			pPool->GetName(), stats.nBlockSize, stats.nBlocksInUse, stats.nPeakInUse, 
+			stats.nBlocksCached, stats.nThreadCaches, stats.nBlocksTotal, stats.nBlobs );
+		nPools++;
+	}
+
+	if ( !nPools )
+	{
+		Msg( "No thread safe memory pools\n" );
+	}
+}
@@ -91,6 +91,9 @@ public:
 	virtual void InstallFactory( IEntityFactory *pFactory, const char *pClassName ) = 0;
 	virtual IServerNetworkable *Create( const char *pClassName ) = 0;
 	virtual void Destroy( const char *pClassName, IServerNetworkable *pNetworkable ) = 0;
+
+	// Adds the name of every installed factory to names
+	virtual void GetFactoryNames( CUtlVector<const char *> &names ) = 0;
 };
 
 IEntityFactoryDictionary *EntityFactoryDictionary();
@@ -561,7 +561,7 @@ bool CSoundEmitterSystemBase::GetParametersForSound( const char *soundname, CSou
 	params.soundname[ 0 ] = 0;
 	if ( params.count >= 1 )
 	{
-		CUtlSymbol sym = internal->soundnames[ random->RandomInt( 0, params.count - 1 ) ];
+		CUtlHashSymbol sym = internal->soundnames[ random->RandomInt( 0, params.count - 1 ) ];
 
 		Q_strncpy( params.soundname, m_Waves.String( sym ), sizeof( params.soundname ) );
 	}
@@ -629,7 +629,7 @@ bool CSoundEmitterSystemBase::InitSoundInternalParameters( const char *soundname
 		}
 		else if ( !Q_strcasecmp( pKey->GetName(), "wave" ) )
 		{
-			CUtlSymbol sym = m_Waves.AddString( pKey->GetString() );
+			CUtlHashSymbol sym = m_Waves.AddString( pKey->GetString() );
 			params.soundnames.AddToTail( sym );
 		}
 		else if ( !Q_strcasecmp( pKey->GetName(), "rndwave" ) )
@@ -637,7 +637,7 @@ bool CSoundEmitterSystemBase::InitSoundInternalParameters( const char *soundname
 			KeyValues *pWaves = pKey->GetFirstSubKey();
 			while ( pWaves )
 			{
-				CUtlSymbol sym = m_Waves.AddString( pWaves->GetString() );
+				CUtlHashSymbol sym = m_Waves.AddString( pWaves->GetString() );
 				params.soundnames.AddToTail( sym );
 
 				pWaves = pWaves->GetNextKey();
@@ -828,7 +828,7 @@ int CSoundEmitterSystemBase::CheckForMissingWavFiles( bool verbose )
 		int waveCount = internal->soundnames.Count();
 		for ( int wave = 0; wave < waveCount; wave++ )
 		{
-			CUtlSymbol sym = internal->soundnames[ wave ];
+			CUtlHashSymbol sym = internal->soundnames[ wave ];
 			const char *name = m_Waves.String( sym );
 			if ( !name || !name[ 0 ] )
 			{
@@ -1030,7 +1030,7 @@ const char *CSoundEmitterSystemBase::GetSourceFileForSound( int index ) const
 	return m_SoundKeyValues[ scriptindex ].filename;
 }
 
-const char *CSoundEmitterSystemBase::GetWaveName( CUtlSymbol& sym )
+const char *CSoundEmitterSystemBase::GetWaveName( CUtlHashSymbol& sym )
 {
 	return m_Waves.String( sym );
 }
@@ -1302,9 +1302,9 @@ void CSoundEmitterSystemBase::SaveChangesToSoundScript( int scriptindex )
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : *name - 
-// Output : CUtlSymbol
+// Output : CUtlHashSymbol
 //-----------------------------------------------------------------------------
-CUtlSymbol CSoundEmitterSystemBase::AddWaveName( const char *name )
+CUtlHashSymbol CSoundEmitterSystemBase::AddWaveName( const char *name )
 {
 	return m_Waves.AddString( name );
 }
@@ -179,7 +179,7 @@ public:
 		bool			play_to_owner_only;
 		bool			precache;
 
-		CUtlVector< CUtlSymbol >	soundnames;
+		CUtlVector< CUtlHashSymbol >	soundnames;
 		// Internal use, for warning about missing .wav files
 		bool			had_missing_wave_files;
 
@@ -225,8 +225,8 @@ public:
 
 	const char *GetSoundName( int index );
 	bool	GetParametersForSound( const char *soundname, CSoundParameters& params );
-	const char *GetWaveName( CUtlSymbol& sym );
-	CUtlSymbol	AddWaveName( const char *name );
+	const char *GetWaveName( CUtlHashSymbol& sym );
+	CUtlHashSymbol	AddWaveName( const char *name );
 
 	soundlevel_t LookupSoundLevel( const char *soundname );
 	const char *GetWavFileForSound( const char *soundname );
@@ -284,7 +284,7 @@ private:
 
 	CUtlVector< CSoundScriptFile >			m_SoundKeyValues;
 
-	CUtlSymbolTable		m_Waves;
+	CUtlHashSymbolTable	m_Waves;
 };
 
 #endif // SOUNDEMITTERSYSTEMBASE_H
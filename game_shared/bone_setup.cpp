@@ -12,6 +12,7 @@
 #include "tier0/vprof.h"
 
 #include "engine/ISharedModelCache.h"
+#include "utlhashmap.h"
 
 #include "tier0/memdbgon.h"
 
@@ -2615,22 +2616,42 @@ float Studio_GetPoseParameter( const studiohdr_t *pStudioHdr, int iParameter, fl
 // Hit Testing code:
 // 
 //
-struct bonecache_t
-{
-	int				bone;
-	matrix3x4_t		matrix;
-	bonecache_t		*pnext;
-};
 
-struct studiocache_t
+// Everything a cached setup depends on. The matrices are stored in world
+// space, so a hit has to match the position and animation time exactly.
+// Compared and hashed as raw bytes, so it must have no padding, and MakeKey
+// folds -0 into 0 so equal floats have equal bytes.
+struct studiocachekey_t
 {
 	studiohdr_t		*pStudioHdr;
 	int				sequence;
 	float			animtime;
 	QAngle			angles;
 	Vector			origin;
-	int				boneMask;
-	bonecache_t		*bones;	// points to a linked list of matrix transforms for each bone
+};
+
+class CStudioCacheKeyEqual
+{
+public:
+	bool operator()( const studiocachekey_t &lhs, const studiocachekey_t &rhs ) const
+	{
+		return !memcmp( &lhs, &rhs, sizeof(studiocachekey_t) );
+	}
+};
+
+struct studiocache_t
+{
+	studiocachekey_t	key;
+	int					boneMask;		// union of the masks of every setup stored here
+	int					hashIndex;		// in the cache's key map, or -1 if the entry is free
+
+	// indexed by bone; bones outside boneMask are left invalid
+	CUtlVector< matrix3x4_t >	bones;
+	CUtlVector< unsigned char >	boneValid;
+
+	// LRU list, most recently used first
+	studiocache_t		*pPrev;
+	studiocache_t		*pNext;
 	
 	// FIXME:  Cache controllers and poseparameters, too???
 //	float			controllers[ MAXSTUDIOBONECTRLS ];
@@ -2643,91 +2664,161 @@ struct studiocache_t
 class CStudioBoneCache
 {
 public:
-	// must be power of 2 or change the cache code
 	enum
 	{
-		BONE_CACHE_SIZE = 512,
-		MODEL_CACHE_SIZE = 16,
+		MIN_MODEL_CACHE_SIZE = 16,
+		MAX_MODEL_CACHE_SIZE = 4096,
 	};
 
 	CStudioBoneCache()
 	{
-		studiomodelstart = 0;
-
-		bonefreelist = studiobonecache;
-
-		memset( studiobonecache, 0, sizeof(studiobonecache) );
-
-		memset( studiomodelcache, 0, sizeof(studiomodelcache) );
+		m_pHead = m_pTail = NULL;
+		m_nHits = m_nMisses = m_nEvictions = 0;
+		EnsureCapacity( MIN_MODEL_CACHE_SIZE );
+	}
 
-		for ( int i = 0; i < BONE_CACHE_SIZE; i++ )
+	~CStudioBoneCache()
+	{
+		for ( int i = 0; i < m_Entries.Count(); i++ )
 		{
-			studiobonecache[i].pnext = &studiobonecache[i+1];
+			delete m_Entries[i];
 		}
-
-		studiobonecache[BONE_CACHE_SIZE-1].pnext = NULL;
 	}
 
+	void EnsureCapacity( int nEntries );
+	void GetStats( bonecachestats_t &stats ) const;
+
 	inline void BoneCacheFree( studiocache_t *pcache );
-	inline void BoneCacheFreeLRU( void );
 	matrix3x4_t *Studio_LookupCachedBone( studiocache_t *pCache, int iBone );
 	void Studio_LinkHitboxCache( matrix3x4_t **bones, studiocache_t *pcache, studiohdr_t *pStudioHdr, mstudiohitboxset_t *set );
 	studiocache_t *Studio_GetBoneCache( studiohdr_t *pStudioHdr, int sequence, float animtime, const QAngle& angles, const Vector& origin, int boneMask );
 	studiocache_t *Studio_SetBoneCache( studiohdr_t *pStudioHdr, int sequence, float animtime, const QAngle& angles, const Vector& origin, int boneMask, matrix3x4_t *bonetoworld );
 
 private:
-
-	bonecache_t *bonefreelist;
-	bonecache_t	studiobonecache[BONE_CACHE_SIZE];
-	studiocache_t studiomodelcache[MODEL_CACHE_SIZE];
-	int studiomodelstart;
+	typedef CUtlHashMap< studiocachekey_t, studiocache_t *, CUtlHashDefault<studiocachekey_t>, CStudioCacheKeyEqual > CStudioCacheMap;
+
+	static void MakeKey( studiocachekey_t &key, studiohdr_t *pStudioHdr, int sequence, float animtime, const QAngle& angles, const Vector& origin );
+	void Unlink( studiocache_t *pcache );
+	void LinkHead( studiocache_t *pcache );
+	void LinkTail( studiocache_t *pcache );
+
+	// entries are allocated one at a time so pointers handed out stay put
+	CUtlVector< studiocache_t * >	m_Entries;
+	CStudioCacheMap					m_KeyMap;
+	studiocache_t					*m_pHead;
+	studiocache_t					*m_pTail;
+
+	int m_nHits;
+	int m_nMisses;
+	int m_nEvictions;
 };
 
 // Construct a singleton
 static CStudioBoneCache g_StudioBoneCache;
 
-void CStudioBoneCache::BoneCacheFree( studiocache_t *pcache )
+static inline float CacheKeyFloat( float flValue )
+{
+	return ( flValue == 0.0f ) ? 0.0f : flValue;
+}
+
+void CStudioBoneCache::MakeKey( studiocachekey_t &key, studiohdr_t *pStudioHdr, int sequence, float animtime, const QAngle& angles, const Vector& origin )
 {
-	bonecache_t *pbone = pcache->bones;
-	bonecache_t *pnext;
+	key.pStudioHdr = pStudioHdr;
+	key.sequence = sequence;
+	key.animtime = CacheKeyFloat( animtime );
+	key.angles.Init( CacheKeyFloat( angles.x ), CacheKeyFloat( angles.y ), CacheKeyFloat( angles.z ) );
+	key.origin.Init( CacheKeyFloat( origin.x ), CacheKeyFloat( origin.y ), CacheKeyFloat( origin.z ) );
+}
 
-	while ( pbone )
+void CStudioBoneCache::Unlink( studiocache_t *pcache )
+{
+	if ( pcache->pPrev )
+		pcache->pPrev->pNext = pcache->pNext;
+	else
+		m_pHead = pcache->pNext;
+
+	if ( pcache->pNext )
+		pcache->pNext->pPrev = pcache->pPrev;
+	else
+		m_pTail = pcache->pPrev;
+
+	pcache->pPrev = pcache->pNext = NULL;
+}
+
+void CStudioBoneCache::LinkHead( studiocache_t *pcache )
+{
+	pcache->pPrev = NULL;
+	pcache->pNext = m_pHead;
+	if ( m_pHead )
+		m_pHead->pPrev = pcache;
+	else
+		m_pTail = pcache;
+	m_pHead = pcache;
+}
+
+void CStudioBoneCache::LinkTail( studiocache_t *pcache )
+{
+	pcache->pNext = NULL;
+	pcache->pPrev = m_pTail;
+	if ( m_pTail )
+		m_pTail->pNext = pcache;
+	else
+		m_pHead = pcache;
+	m_pTail = pcache;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Grows the cache to hold at least nEntries setups. New entries go
+//			at the LRU end, so they're used before anything valid is evicted.
+//-----------------------------------------------------------------------------
+void CStudioBoneCache::EnsureCapacity( int nEntries )
+{
+	nEntries = clamp( nEntries, (int)MIN_MODEL_CACHE_SIZE, (int)MAX_MODEL_CACHE_SIZE );
+	if ( nEntries <= m_Entries.Count() )
+		return;
+
+	m_KeyMap.EnsureCapacity( nEntries );
+	while ( m_Entries.Count() < nEntries )
 	{
-		pnext = pbone->pnext;
-		pbone->pnext = bonefreelist;
-		bonefreelist = pbone;
-		pbone = pnext;
+		studiocache_t *pcache = new studiocache_t;
+		memset( &pcache->key, 0, sizeof(pcache->key) );
+		pcache->boneMask = 0;
+		pcache->hashIndex = -1;
+		m_Entries.AddToTail( pcache );
+		LinkTail( pcache );
 	}
-	pcache->pStudioHdr = NULL;
-	pcache->bones = NULL;
 }
 
-void CStudioBoneCache::BoneCacheFreeLRU( void )
+void CStudioBoneCache::GetStats( bonecachestats_t &stats ) const
+{
+	stats.nEntries = m_Entries.Count();
+	stats.nUsed = m_KeyMap.Count();
+	stats.nHits = m_nHits;
+	stats.nMisses = m_nMisses;
+	stats.nEvictions = m_nEvictions;
+}
+
+void CStudioBoneCache::BoneCacheFree( studiocache_t *pcache )
 {
-	for ( int i = studiomodelstart+1; i != studiomodelstart; i++ )
+	if ( pcache->hashIndex != -1 )
 	{
-		i &= (MODEL_CACHE_SIZE-1);
-		BoneCacheFree( studiomodelcache + i );
-		
-		if ( bonefreelist )
-			return;
+		m_KeyMap.RemoveAt( pcache->hashIndex );
+		pcache->hashIndex = -1;
 	}
+	pcache->key.pStudioHdr = NULL;
+	pcache->boneMask = 0;
+
+	// reuse it first
+	Unlink( pcache );
+	LinkTail( pcache );
 }
 
 matrix3x4_t *CStudioBoneCache::Studio_LookupCachedBone( studiocache_t *pCache, int iBone )
 {
-	bonecache_t *pbone = pCache->bones;
+	if ( iBone < 0 || iBone >= pCache->boneValid.Count() || !pCache->boneValid[iBone] )
+		return NULL;
 
-	// FIXME: linear search.  This done much?
-	while ( pbone )
-	{
-		if (pbone->bone == iBone)
-			return &pbone->matrix;
-		if (pbone->bone > iBone)
-			return NULL;
-		pbone = pbone->pnext;
-	}
-	return NULL;
+	return &pCache->bones[iBone];
 }
 
 void CStudioBoneCache::Studio_LinkHitboxCache( matrix3x4_t **bones, studiocache_t *pcache, studiohdr_t *pStudioHdr, mstudiohitboxset_t *set )
@@ -2742,74 +2833,76 @@ void CStudioBoneCache::Studio_LinkHitboxCache( matrix3x4_t **bones, studiocache_
 studiocache_t *CStudioBoneCache::Studio_GetBoneCache( studiohdr_t *pStudioHdr, int sequence, float animtime, const QAngle& angles, const Vector& origin, int boneMask )
 {
 	// check for a cache hit
-	int i = studiomodelstart;
-	do
-	{
-		studiocache_t *pcache = studiomodelcache + i;
-		if ( pcache->pStudioHdr == pStudioHdr &&
-			pcache->sequence == sequence &&
-			pcache->animtime == animtime &&
-			pcache->angles == angles &&
-			pcache->origin == origin && 
-			(pcache->boneMask & boneMask) == boneMask )
+	studiocachekey_t key;
+	MakeKey( key, pStudioHdr, sequence, animtime, angles, origin );
+
+	int i = m_KeyMap.Find( key );
+	if ( i != m_KeyMap.InvalidIndex() )
+	{
+		studiocache_t *pcache = m_KeyMap[i];
+		if ( (pcache->boneMask & boneMask) == boneMask )
 		{
+			m_nHits++;
+			Unlink( pcache );
+			LinkHead( pcache );
 			return pcache;
 		}
-		i = (i-1)&(MODEL_CACHE_SIZE-1);
-	} while ( i != studiomodelstart );
+	}
 
+	m_nMisses++;
 	return NULL;
 }
 
 studiocache_t *CStudioBoneCache::Studio_SetBoneCache( studiohdr_t *pStudioHdr, int sequence, float animtime, const QAngle& angles, const Vector& origin, int boneMask, matrix3x4_t *bonetoworld )
 {
-	// Get the LRU model entry and reuse it
-	studiomodelstart = (studiomodelstart+1)&(MODEL_CACHE_SIZE-1);
-	studiocache_t *pcache = studiomodelcache + studiomodelstart;
-	BoneCacheFree( pcache );
-
-	pcache->pStudioHdr = pStudioHdr;
-	pcache->sequence = sequence;
-	pcache->animtime = animtime;
-	pcache->angles = angles;
-	pcache->origin = origin;
-	pcache->boneMask = boneMask;
-	pcache->bones = NULL;
+	studiocachekey_t key;
+	MakeKey( key, pStudioHdr, sequence, animtime, angles, origin );
 
-	bonecache_t *plast = NULL;
-	for ( int i = 0; i < pStudioHdr->numbones; i++ )
+	// The same pose set up for other bones just adds to the existing entry,
+	// otherwise take the LRU entry and reuse it
+	studiocache_t *pcache;
+	int i = m_KeyMap.Find( key );
+	if ( i != m_KeyMap.InvalidIndex() )
 	{
-		// 
-		if (!(pStudioHdr->pBone(i)->flags & boneMask))
+		pcache = m_KeyMap[i];
+	}
+	else
+	{
+		pcache = m_pTail;
+		if ( pcache->hashIndex != -1 )
 		{
-			// FIXME: temporary hack, if no flags set, assume it's a old version
-			if (pStudioHdr->pBone(0)->flags & BONE_USED_MASK)
-			{
-				continue;
-			}
+			m_nEvictions++;
+			m_KeyMap.RemoveAt( pcache->hashIndex );
 		}
 
-		// make sure there's a free bone for this box
-		if ( !bonefreelist )
-		{
-			BoneCacheFreeLRU();
-		}
-		bonecache_t *pbone = bonefreelist;
-		bonefreelist = bonefreelist->pnext;
-		if ( pcache->bones == NULL )
-		{
-			pcache->bones = pbone;
-		}
-		else
-		{
-			plast->pnext = pbone;
-		}
+		pcache->key = key;
+		pcache->boneMask = 0;
+		pcache->hashIndex = m_KeyMap.Insert( key, pcache );
+		pcache->boneValid.RemoveAll();
+	}
+
+	Unlink( pcache );
+	LinkHead( pcache );
 
-		pbone->bone = i;
-		MatrixCopy( bonetoworld[i], pbone->matrix ); 
-		plast = pbone;
+	if ( pcache->boneValid.Count() != pStudioHdr->numbones )
+	{
+		pcache->bones.SetSize( pStudioHdr->numbones );
+		pcache->boneValid.SetSize( pStudioHdr->numbones );
+		memset( pcache->boneValid.Base(), 0, pStudioHdr->numbones );
+	}
+	pcache->boneMask |= boneMask;
+
+	// FIXME: temporary hack, if no flags set, assume it's a old version
+	bool bAllBones = ( pStudioHdr->numbones > 0 ) && !( pStudioHdr->pBone(0)->flags & BONE_USED_MASK );
+
+	for ( int iBone = 0; iBone < pStudioHdr->numbones; iBone++ )
+	{
+		if ( !bAllBones && !(pStudioHdr->pBone(iBone)->flags & boneMask) )
+			continue;
+
+		MatrixCopy( bonetoworld[iBone], pcache->bones[iBone] ); 
+		pcache->boneValid[iBone] = 1;
 	}
-	plast->pnext = NULL;
 	return pcache;
 }
 
@@ -2862,6 +2955,34 @@ void Studio_InvalidateBoneCache( studiocache_t *pcache )
 	g_StudioBoneCache.BoneCacheFree( pcache );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Makes room for at least this many cached setups, normally one per
+//			animating entity. The cache never shrinks.
+//-----------------------------------------------------------------------------
+void Studio_EnsureBoneCacheCapacity( int nEntries )
+{
+	g_StudioBoneCache.EnsureCapacity( nEntries );
+}
+
+void Studio_GetBoneCacheStats( bonecachestats_t &stats )
+{
+	g_StudioBoneCache.GetStats( stats );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Prints the cache stats; backs the server and client console commands
+//-----------------------------------------------------------------------------
+void Studio_ReportBoneCacheStats( int nAnimatingEntities )
+{
+	bonecachestats_t stats;
+	Studio_GetBoneCacheStats( stats );
+
+	int nLookups = stats.nHits + stats.nMisses;
+	Msg( "bone cache: %d of %d entries used, %d animating entities\n", stats.nUsed, stats.nEntries, nAnimatingEntities );
+	Msg( "  %d hits, %d misses (%.1f%% hit), %d evictions\n", stats.nHits, stats.nMisses, 
+		nLookups ? 100.0f * stats.nHits / nLookups : 0.0f, stats.nEvictions );
+}
+
 
 #pragma warning (disable : 4701)
 
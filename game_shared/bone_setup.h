@@ -270,6 +270,19 @@ studiocache_t *Studio_GetBoneCache( studiohdr_t *pStudioHdr, int sequence, float
 studiocache_t *Studio_SetBoneCache( studiohdr_t *pStudioHdr, int sequence, float animtime, const QAngle& angles, const Vector& origin, int boneMask, matrix3x4_t *bonetoworld );
 // removes this cache entry from the valid cache list
 void Studio_InvalidateBoneCache( studiocache_t *pcache );
+// grows the cache to hold this many setups, normally one per animating entity
+void Studio_EnsureBoneCacheCapacity( int nEntries );
+
+struct bonecachestats_t
+{
+	int		nEntries;
+	int		nUsed;
+	int		nHits;
+	int		nMisses;
+	int		nEvictions;
+};
+void Studio_GetBoneCacheStats( bonecachestats_t &stats );
+void Studio_ReportBoneCacheStats( int nAnimatingEntities );
 
 
 matrix3x4_t *Studio_LookupCachedBone( studiocache_t *pCache, int iBone );
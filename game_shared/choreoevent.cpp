@@ -234,6 +234,8 @@ CFlexAnimationTrack::CFlexAnimationTrack( CChoreoEvent *event )
 	m_bCombo			= false;
 	m_nFlexControllerIndex[ 0 ] = m_nFlexControllerIndex[ 1 ] = -1;
 	m_nFlexControllerIndexRaw[ 0 ] = m_nFlexControllerIndexRaw[ 1 ] = -1;
+	m_pSharedSamples[ 0 ] = m_pSharedSamples[ 1 ] = NULL;
+	m_nSharedSamples[ 0 ] = m_nSharedSamples[ 1 ] = 0;
 
 	// base track has range, combo is always 0..1
 	m_flMin = 0.0f;
@@ -254,7 +256,16 @@ CFlexAnimationTrack::CFlexAnimationTrack( const CFlexAnimationTrack* src )
 
 	for ( int t = 0; t < 2; t++ )
 	{
+		m_pSharedSamples[ t ] = NULL;
+		m_nSharedSamples[ t ] = 0;
+
 		m_Samples[ t ].Purge();
+		if ( src->m_pSharedSamples[ t ] )
+		{
+			m_Samples[ t ].AddMultipleToTail( src->m_nSharedSamples[ t ], src->m_pSharedSamples[ t ] );
+			continue;
+		}
+
 		for ( int i = 0 ;i < src->m_Samples[ t ].Size(); i++ )
 		{
 			CExpressionSample s = src->m_Samples[ t ][ i ];
@@ -302,10 +313,43 @@ void CFlexAnimationTrack::Clear( void )
 {
 	for ( int t = 0; t < 2; t++ )
 	{
+		m_pSharedSamples[ t ] = NULL;
+		m_nSharedSamples[ t ] = 0;
 		m_Samples[ t ].RemoveAll();
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: 
+// Input  : type - 
+//			*samples - 
+//			count - 
+//-----------------------------------------------------------------------------
+void CFlexAnimationTrack::SetSharedSamples( int type, const CExpressionSample *samples, int count )
+{
+	Assert( type == 0 || type == 1 );
+
+	m_Samples[ type ].Purge();
+	m_pSharedSamples[ type ] = count > 0 ? samples : NULL;
+	m_nSharedSamples[ type ] = count > 0 ? count : 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+// Input  : type - 
+//-----------------------------------------------------------------------------
+void CFlexAnimationTrack::UnshareSamples( int type )
+{
+	if ( !m_pSharedSamples[ type ] )
+		return;
+
+	m_Samples[ type ].RemoveAll();
+	m_Samples[ type ].AddMultipleToTail( m_nSharedSamples[ type ], m_pSharedSamples[ type ] );
+
+	m_pSharedSamples[ type ] = NULL;
+	m_nSharedSamples[ type ] = 0;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : index - 
@@ -314,6 +358,7 @@ void CFlexAnimationTrack::RemoveSample( int index, int type /*=0*/ )
 {
 	Assert( type == 0 || type == 1 );
 
+	UnshareSamples( type );
 	m_Samples[ type ].Remove( index );
 }
 
@@ -345,6 +390,9 @@ int CFlexAnimationTrack::GetNumSamples( int type /*=0*/ )
 {
 	Assert( type == 0 || type == 1 );
 
+	if ( m_pSharedSamples[ type ] )
+		return m_nSharedSamples[ type ];
+
 	return m_Samples[ type ].Size();
 }
 
@@ -359,6 +407,11 @@ CExpressionSample *CFlexAnimationTrack::GetSample( int index, int type /*=0*/ )
 
 	if ( index < 0 || index >= GetNumSamples( type ) )
 		return NULL;
+
+	// Shared samples are only read at runtime, tools always own theirs
+	if ( m_pSharedSamples[ type ] )
+		return const_cast< CExpressionSample * >( &m_pSharedSamples[ type ][ index ] );
+
 	return &m_Samples[ type ][ index ];
 }
 
@@ -609,6 +662,7 @@ void CFlexAnimationTrack::AddSample( float time, float value, int type /*=0*/ )
 	sample.value = value;
 	sample.selected = false;
 
+	UnshareSamples( type );
 	m_Samples[ type ].AddToTail( sample );
 	
 	Resort( type );
@@ -621,6 +675,8 @@ void CFlexAnimationTrack::Resort( int type /*=0*/ )
 {
 	Assert( type == 0 || type == 1 );
 
+	UnshareSamples( type );
+
 	for ( int i = 0; i < m_Samples[ type ].Size(); i++ )
 	{
 		for ( int j = i + 1; j < m_Samples[ type ].Size(); j++ )
@@ -768,6 +824,8 @@ void CFlexAnimationTrack::RemoveOutOfRangeSamples( int type )
 	Assert( m_pEvent->HasEndTime() );
 	float duration = m_pEvent->GetDuration();
 
+	UnshareSamples( type );
+
 	int c = m_Samples[ type ].Size();
 	for ( int i = c-1; i >= 0; i-- )
 	{
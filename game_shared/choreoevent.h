@@ -162,10 +162,17 @@ public:
 	float				GetSampleIntensity( float time );
 	float				GetBalanceIntensity( float time );
 
+	// Uses samples owned by someone else (a compiled scene) in place of a
+	//  copy. They must outlive the track, which copies them before changing them.
+	void				SetSharedSamples( int type, const CExpressionSample *samples, int count );
+
 private:
 	// remove any samples after endtime
 	void				RemoveOutOfRangeSamples( int type );
 
+	// copies shared samples into m_Samples so they can be changed
+	void				UnshareSamples( int type );
+
 	// returns scaled value for absolute time per mag/balance
 	float				GetIntensityInternal( float time, int type );
 
@@ -186,6 +193,9 @@ private:
 	// 0 == magnitude
 	// 1 == left/right
 	CUtlVector< CExpressionSample > m_Samples[ 2 ];
+	// used instead of m_Samples when set
+	const CExpressionSample *m_pSharedSamples[ 2 ];
+	int					m_nSharedSamples[ 2 ];
 	int					m_nFlexControllerIndex[ 2 ];
 	int					m_nFlexControllerIndexRaw[ 2 ];
 
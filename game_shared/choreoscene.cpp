@@ -24,7 +24,7 @@
 #include "iscenetokenprocessor.h"
 #include "utlbuffer.h"
 #include "filesystem.h"
-#include "utlrbtree.h"
+#include "utlsymbol.h"
 #include "mathlib.h"
 #include "vstdlib/strtools.h"
 
@@ -35,6 +35,19 @@ extern IFileSystem *filesystem;
 // Let scene linger for 1/4 second so blends can finish
 #define SCENE_LINGER_TIME 0.25f
 
+// Compiled scenes
+#define SCENE_BINARY_ID			(('D'<<24)+('C'<<16)+('V'<<8)+'B')
+#define SCENE_BINARY_VERSION	1
+
+// event flags in a compiled scene
+#define SCENE_BINARY_RESUMECONDITION	(1<<0)
+#define SCENE_BINARY_FIXEDLENGTH		(1<<1)
+#define SCENE_BINARY_USESTAG			(1<<2)
+
+// flex track flags in a compiled scene
+#define SCENE_BINARY_TRACKACTIVE		(1<<0)
+#define SCENE_BINARY_TRACKCOMBO			(1<<1)
+
 //-----------------------------------------------------------------------------
 // Purpose: Debug printout
 // Input  : level - 
@@ -91,6 +104,27 @@ CChoreoScene *ChoreoLoadScene( 	IChoreoEventCallback *callback,
 	return scene;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Creates scene from its compiled form
+// Input  : &buf - must outlive the scene
+//			*pfn - 
+// Output : CChoreoScene
+//-----------------------------------------------------------------------------
+CChoreoScene *ChoreoLoadSceneFromBinary( IChoreoEventCallback *callback, 
+	CUtlBuffer& buf,
+	void ( *pfn ) ( const char *fmt, ... ) )
+{
+	CChoreoScene *scene = new CChoreoScene( callback );
+	Assert( scene );
+	if ( !scene->RestoreFromBinaryBuffer( buf ) )
+	{
+		delete scene;
+		return NULL;
+	}
+	scene->SetPrintFunc( pfn );
+	return scene;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -222,6 +256,12 @@ void CChoreoScene::Init( IChoreoEventCallback *callback )
 	m_flLatestTime		= 0.0f;
 	m_nActiveEvents = 0;
 
+	m_ActiveEvents.RemoveAll();
+	m_nTimelineCursor = 0;
+	m_bTimelineForward = true;
+	m_bTimelineDirty = true;
+	m_bTimelineSeek = true;
+
 	m_pIChoreoEventCallback = callback;
 
 	m_bSubScene = false;
@@ -370,6 +410,7 @@ CChoreoEvent *CChoreoScene::AllocEvent( void )
 	CChoreoEvent *e = new CChoreoEvent( this );
 	Assert( e );
 	m_Events.AddToTail( e );
+	m_bTimelineDirty = true;
 	return e;
 }
 
@@ -1264,6 +1305,405 @@ bool CChoreoScene::ParseFromBuffer( ISceneTokenProcessor *tokenizer )
 	return true;
 }
 
+//-----------------------------------------------------------------------------
+// Compiled scenes
+//-----------------------------------------------------------------------------
+
+static void PutSceneString( CUtlBuffer& buf, CUtlHashSymbolTable& strings, const char *string )
+{
+	UtlHashSymId_t id = strings.AddString( string ? string : "" );
+	Assert( id < 65536 );
+	buf.PutUnsignedShort( (unsigned short)id );
+}
+
+static const char *GetSceneString( CUtlBuffer& buf, const CUtlVector< const char * >& strings )
+{
+	int id = buf.GetUnsignedShort();
+	if ( id >= strings.Count() )
+		return "";
+
+	return strings[ id ];
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes the scene as loaded, after tags have been reconciled
+// Input  : &buf - 
+// Output : Returns true on success, false on failure.
+//-----------------------------------------------------------------------------
+bool CChoreoScene::SaveToBinaryBuffer( CUtlBuffer& buf )
+{
+	Assert( !buf.IsText() );
+
+	// The body is built first so that the string table can lead the file
+	CUtlHashSymbolTable strings( 0, 256 );
+	CUtlBuffer body;
+
+	int i, j, t;
+
+	PutSceneString( body, strings, m_szMapname );
+	body.PutInt( m_nSceneFPS );
+	body.PutUnsignedChar( m_bUseFrameSnap ? 1 : 0 );
+	body.PutInt( m_SceneRamp.Count() );
+	for ( i = 0; i < m_SceneRamp.Count(); i++ )
+	{
+		body.PutFloat( m_SceneRamp[ i ].time );
+		body.PutFloat( m_SceneRamp[ i ].value );
+	}
+
+	body.PutInt( m_TimeZoomLookup.Count() );
+	for ( i = m_TimeZoomLookup.First(); i != m_TimeZoomLookup.InvalidIndex(); i = m_TimeZoomLookup.Next( i ) )
+	{
+		PutSceneString( body, strings, m_TimeZoomLookup.GetElementName( i ) );
+		body.PutInt( m_TimeZoomLookup[ i ] );
+	}
+
+	body.PutInt( m_Actors.Count() );
+	for ( i = 0; i < m_Actors.Count(); i++ )
+	{
+		CChoreoActor *a = m_Actors[ i ];
+		PutSceneString( body, strings, a->GetName() );
+		PutSceneString( body, strings, a->GetFacePoserModelName() );
+		body.PutUnsignedChar( a->GetActive() ? 1 : 0 );
+	}
+
+	// In scene order, which is also the order each actor lists its channels in
+	body.PutInt( m_Channels.Count() );
+	for ( i = 0; i < m_Channels.Count(); i++ )
+	{
+		CChoreoChannel *c = m_Channels[ i ];
+		PutSceneString( body, strings, c->GetName() );
+		body.PutUnsignedChar( c->GetActive() ? 1 : 0 );
+		body.PutShort( (short)FindActorIndex( c->GetActor() ) );
+	}
+
+	// Likewise for events and their channels
+	body.PutInt( m_Events.Count() );
+	for ( i = 0; i < m_Events.Count(); i++ )
+	{
+		CChoreoEvent *e = m_Events[ i ];
+
+		body.PutUnsignedChar( (unsigned char)e->GetType() );
+		PutSceneString( body, strings, e->GetName() );
+		PutSceneString( body, strings, e->GetParameters() );
+		PutSceneString( body, strings, e->GetParameters2() );
+		body.PutFloat( e->GetStartTime() );
+		body.PutFloat( e->GetEndTime() );
+
+		int flags = 0;
+		if ( e->IsResumeCondition() )
+			flags |= SCENE_BINARY_RESUMECONDITION;
+		if ( e->IsFixedLength() )
+			flags |= SCENE_BINARY_FIXEDLENGTH;
+		if ( e->IsUsingRelativeTag() )
+			flags |= SCENE_BINARY_USESTAG;
+		body.PutUnsignedChar( (unsigned char)flags );
+
+		if ( e->IsUsingRelativeTag() )
+		{
+			PutSceneString( body, strings, e->GetRelativeTagName() );
+			PutSceneString( body, strings, e->GetRelativeWavName() );
+		}
+
+		float duration = 0.0f;
+		if ( !e->GetGestureSequenceDuration( duration ) )
+		{
+			duration = 0.0f;
+		}
+		body.PutFloat( duration );
+		body.PutInt( e->GetPitch() );
+		body.PutInt( e->GetYaw() );
+		body.PutInt( e->GetType() == CChoreoEvent::LOOP ? e->GetLoopCount() : -1 );
+
+		body.PutShort( (short)FindActorIndex( e->GetActor() ) );
+		body.PutShort( e->GetChannel() ? (short)GetChannelIndex( e->GetChannel() ) : -1 );
+
+		body.PutInt( e->GetRampCount() );
+		for ( j = 0; j < e->GetRampCount(); j++ )
+		{
+			body.PutFloat( e->GetRamp( j )->time );
+			body.PutFloat( e->GetRamp( j )->value );
+		}
+
+		body.PutInt( e->GetNumRelativeTags() );
+		for ( j = 0; j < e->GetNumRelativeTags(); j++ )
+		{
+			CEventRelativeTag *tag = e->GetRelativeTag( j );
+			PutSceneString( body, strings, tag->GetName() );
+			body.PutFloat( tag->GetPercentage() );
+		}
+
+		body.PutInt( e->GetNumTimingTags() );
+		for ( j = 0; j < e->GetNumTimingTags(); j++ )
+		{
+			CFlexTimingTag *tag = e->GetTimingTag( j );
+			PutSceneString( body, strings, tag->GetName() );
+			body.PutFloat( tag->GetPercentage() );
+			body.PutUnsignedChar( tag->GetLocked() ? 1 : 0 );
+		}
+
+		for ( t = 0; t < CChoreoEvent::NUM_ABS_TAG_TYPES; t++ )
+		{
+			CChoreoEvent::AbsTagType type = (CChoreoEvent::AbsTagType)t;
+			body.PutInt( e->GetNumAbsoluteTags( type ) );
+			for ( j = 0; j < e->GetNumAbsoluteTags( type ); j++ )
+			{
+				CEventAbsoluteTag *tag = e->GetAbsoluteTag( type, j );
+				PutSceneString( body, strings, tag->GetName() );
+				body.PutFloat( tag->GetTime() );
+			}
+		}
+
+		body.PutInt( e->GetNumFlexAnimationTracks() );
+		for ( j = 0; j < e->GetNumFlexAnimationTracks(); j++ )
+		{
+			CFlexAnimationTrack *track = e->GetFlexAnimationTrack( j );
+			PutSceneString( body, strings, track->GetFlexControllerName() );
+
+			int trackflags = 0;
+			if ( track->IsTrackActive() )
+				trackflags |= SCENE_BINARY_TRACKACTIVE;
+			if ( track->IsComboType() )
+				trackflags |= SCENE_BINARY_TRACKCOMBO;
+			body.PutUnsignedChar( (unsigned char)trackflags );
+			body.PutFloat( track->GetMin( 0 ) );
+			body.PutFloat( track->GetMax( 0 ) );
+
+			// Samples are stored as the structures themselves, aligned, so a
+			//  restored track can point straight at them
+			for ( t = 0; t < ( track->IsComboType() ? 2 : 1 ); t++ )
+			{
+				int count = track->GetNumSamples( t );
+				body.PutInt( count );
+				while ( body.TellPut() & 3 )
+				{
+					body.PutUnsignedChar( 0 );
+				}
+
+				for ( int k = 0; k < count; k++ )
+				{
+					CExpressionSample sample;
+					memset( &sample, 0, sizeof( sample ) );
+					sample.time = track->GetSample( k, t )->time;
+					sample.value = track->GetSample( k, t )->value;
+					body.Put( &sample, sizeof( sample ) );
+				}
+			}
+		}
+	}
+
+	if ( !body.IsValid() )
+		return false;
+
+	buf.PutInt( SCENE_BINARY_ID );
+	buf.PutInt( SCENE_BINARY_VERSION );
+	buf.PutInt( strings.Count() );
+	for ( i = 0; i < strings.Count(); i++ )
+	{
+		buf.PutString( strings.String( i ) );
+	}
+
+	// Keep the body's sample alignment
+	while ( buf.TellPut() & 3 )
+	{
+		buf.PutUnsignedChar( 0 );
+	}
+	buf.Put( body.Base(), body.TellPut() );
+
+	return buf.IsValid();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Rebuilds a scene written by SaveToBinaryBuffer. Tags are already
+//  reconciled, and flex tracks are pointed at the samples in the buffer.
+// Input  : &buf - 
+// Output : Returns true on success, false on failure.
+//-----------------------------------------------------------------------------
+bool CChoreoScene::RestoreFromBinaryBuffer( CUtlBuffer& buf )
+{
+	Assert( !buf.IsText() );
+	Assert( !m_Events.Count() && !m_Actors.Count() && !m_Channels.Count() );
+
+	if ( buf.GetInt() != SCENE_BINARY_ID || buf.GetInt() != SCENE_BINARY_VERSION )
+		return false;
+
+	int i, j, t, count;
+
+	// Strings are used straight out of the buffer
+	CUtlVector< const char * > strings;
+	count = buf.GetInt();
+	strings.EnsureCapacity( count );
+	for ( i = 0; i < count && buf.IsValid(); i++ )
+	{
+		const char *string = (const char *)buf.PeekGet();
+		int len = Q_strlen( string ) + 1;
+		if ( buf.TellGet() + len > buf.TellPut() )
+			return false;
+
+		strings.AddToTail( string );
+		buf.SeekGet( CUtlBuffer::SEEK_CURRENT, len );
+	}
+
+	while ( buf.TellGet() & 3 )
+	{
+		buf.GetUnsignedChar();
+	}
+
+	SetMapname( GetSceneString( buf, strings ) );
+	m_nSceneFPS = buf.GetInt();
+	m_bUseFrameSnap = buf.GetUnsignedChar() ? true : false;
+
+	count = buf.GetInt();
+	for ( i = 0; i < count && buf.IsValid(); i++ )
+	{
+		float time = buf.GetFloat();
+		float value = buf.GetFloat();
+		AddSceneRamp( time, value, false );
+	}
+
+	count = buf.GetInt();
+	for ( i = 0; i < count && buf.IsValid(); i++ )
+	{
+		const char *tool = GetSceneString( buf, strings );
+		SetTimeZoom( tool, buf.GetInt() );
+	}
+
+	count = buf.GetInt();
+	for ( i = 0; i < count && buf.IsValid(); i++ )
+	{
+		CChoreoActor *a = AllocActor();
+		a->SetName( GetSceneString( buf, strings ) );
+		a->SetFacePoserModelName( GetSceneString( buf, strings ) );
+		a->SetActive( buf.GetUnsignedChar() ? true : false );
+	}
+
+	count = buf.GetInt();
+	for ( i = 0; i < count && buf.IsValid(); i++ )
+	{
+		CChoreoChannel *c = AllocChannel();
+		c->SetName( GetSceneString( buf, strings ) );
+		c->SetActive( buf.GetUnsignedChar() ? true : false );
+
+		int actor = buf.GetShort();
+		if ( actor >= 0 && actor < m_Actors.Count() )
+		{
+			m_Actors[ actor ]->AddChannel( c );
+			c->SetActor( m_Actors[ actor ] );
+		}
+	}
+
+	count = buf.GetInt();
+	for ( i = 0; i < count && buf.IsValid(); i++ )
+	{
+		CChoreoEvent *e = AllocEvent();
+
+		e->SetType( (CChoreoEvent::EVENTTYPE)buf.GetUnsignedChar() );
+		e->SetName( GetSceneString( buf, strings ) );
+		e->SetParameters( GetSceneString( buf, strings ) );
+		e->SetParameters2( GetSceneString( buf, strings ) );
+
+		// No tracks yet, so changing the end time has nothing to resort
+		float starttime = buf.GetFloat();
+		float endtime = buf.GetFloat();
+		e->SetStartTime( starttime );
+		e->SetEndTime( endtime );
+
+		int flags = buf.GetUnsignedChar();
+		e->SetResumeCondition( ( flags & SCENE_BINARY_RESUMECONDITION ) ? true : false );
+		e->SetFixedLength( ( flags & SCENE_BINARY_FIXEDLENGTH ) ? true : false );
+		if ( flags & SCENE_BINARY_USESTAG )
+		{
+			const char *tagname = GetSceneString( buf, strings );
+			const char *wavname = GetSceneString( buf, strings );
+			e->SetUsingRelativeTag( true, tagname, wavname );
+		}
+
+		e->SetGestureSequenceDuration( buf.GetFloat() );
+		e->SetPitch( buf.GetInt() );
+		e->SetYaw( buf.GetInt() );
+		int loops = buf.GetInt();
+		if ( e->GetType() == CChoreoEvent::LOOP )
+		{
+			e->SetLoopCount( loops );
+		}
+
+		int actor = buf.GetShort();
+		int channel = buf.GetShort();
+		if ( actor >= 0 && actor < m_Actors.Count() )
+		{
+			e->SetActor( m_Actors[ actor ] );
+		}
+		if ( channel >= 0 && channel < m_Channels.Count() )
+		{
+			m_Channels[ channel ]->AddEvent( e );
+			e->SetChannel( m_Channels[ channel ] );
+		}
+
+		int samples = buf.GetInt();
+		for ( j = 0; j < samples && buf.IsValid(); j++ )
+		{
+			float time = buf.GetFloat();
+			float value = buf.GetFloat();
+			e->AddRamp( time, value, false );
+		}
+
+		int tags = buf.GetInt();
+		for ( j = 0; j < tags && buf.IsValid(); j++ )
+		{
+			const char *name = GetSceneString( buf, strings );
+			e->AddRelativeTag( name, buf.GetFloat() );
+		}
+
+		tags = buf.GetInt();
+		for ( j = 0; j < tags && buf.IsValid(); j++ )
+		{
+			const char *name = GetSceneString( buf, strings );
+			float percentage = buf.GetFloat();
+			bool locked = buf.GetUnsignedChar() ? true : false;
+			e->AddTimingTag( name, percentage, locked );
+		}
+
+		for ( t = 0; t < CChoreoEvent::NUM_ABS_TAG_TYPES; t++ )
+		{
+			tags = buf.GetInt();
+			for ( j = 0; j < tags && buf.IsValid(); j++ )
+			{
+				const char *name = GetSceneString( buf, strings );
+				e->AddAbsoluteTag( (CChoreoEvent::AbsTagType)t, name, buf.GetFloat() );
+			}
+		}
+
+		int tracks = buf.GetInt();
+		for ( j = 0; j < tracks && buf.IsValid(); j++ )
+		{
+			CFlexAnimationTrack *track = e->AddTrack( GetSceneString( buf, strings ) );
+
+			int trackflags = buf.GetUnsignedChar();
+			track->SetTrackActive( ( trackflags & SCENE_BINARY_TRACKACTIVE ) ? true : false );
+			track->SetComboType( ( trackflags & SCENE_BINARY_TRACKCOMBO ) ? true : false );
+			track->SetMin( buf.GetFloat() );
+			track->SetMax( buf.GetFloat() );
+
+			for ( t = 0; t < ( track->IsComboType() ? 2 : 1 ); t++ )
+			{
+				samples = buf.GetInt();
+				while ( buf.TellGet() & 3 )
+				{
+					buf.GetUnsignedChar();
+				}
+
+				int size = samples * sizeof( CExpressionSample );
+				if ( samples < 0 || buf.TellGet() + size > buf.TellPut() )
+					return false;
+
+				track->SetSharedSamples( t, (const CExpressionSample *)buf.PeekGet(), samples );
+				buf.SeekGet( CUtlBuffer::SEEK_CURRENT, size );
+			}
+		}
+	}
+
+	return buf.IsValid();
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Output : float
@@ -1831,6 +2271,9 @@ void CChoreoScene::ResetSimulation( bool forward /*= true*/, float starttime /*=
 
 	m_flStartTime = starttime;
 	m_flEndTime = endtime;
+
+	// Tools may have moved events since the last run
+	m_bTimelineDirty = true;
 }
 
 //-----------------------------------------------------------------------------
@@ -2100,6 +2543,142 @@ bool CChoreoScene::EventLess( const CChoreoScene::ActiveList &al0, const CChoreo
 	return ( index0 < index1 );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Widest span over which EventThink could act on the event, in either
+//  playback direction
+//-----------------------------------------------------------------------------
+void CChoreoScene::GetEventTimelineSpan( CChoreoEvent *e, float& starttime, float& endtime )
+{
+	starttime = e->GetStartTime();
+	endtime = e->HasEndTime() ? e->GetEndTime() : starttime;
+
+	if ( e->GetType() == CChoreoEvent::SPEAK )
+	{
+		starttime -= m_flSoundSystemLatency;
+		endtime += m_flSoundSystemLatency;
+	}
+}
+
+int __cdecl CChoreoScene::TimelineStartCompare( const void *p0, const void *p1 )
+{
+	const TimelineEntry_t *t0 = (const TimelineEntry_t *)p0;
+	const TimelineEntry_t *t1 = (const TimelineEntry_t *)p1;
+
+	if ( t0->time != t1->time )
+		return ( t0->time < t1->time ) ? -1 : 1;
+	return t0->event - t1->event;
+}
+
+int __cdecl CChoreoScene::TimelineEndCompare( const void *p0, const void *p1 )
+{
+	const TimelineEntry_t *t0 = (const TimelineEntry_t *)p0;
+	const TimelineEntry_t *t1 = (const TimelineEntry_t *)p1;
+
+	if ( t0->time != t1->time )
+		return ( t0->time > t1->time ) ? -1 : 1;
+	return t0->event - t1->event;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Sorts the events by start and end time so Think can walk them
+//-----------------------------------------------------------------------------
+void CChoreoScene::BuildTimeline( void )
+{
+	int c = m_Events.Count();
+
+	m_EventsByStart.SetSize( c );
+	m_EventsByEnd.SetSize( c );
+
+	for ( int i = 0; i < c; i++ )
+	{
+		float starttime, endtime;
+		GetEventTimelineSpan( m_Events[ i ], starttime, endtime );
+
+		m_EventsByStart[ i ].time = starttime;
+		m_EventsByStart[ i ].event = i;
+		m_EventsByEnd[ i ].time = endtime;
+		m_EventsByEnd[ i ].event = i;
+	}
+
+	if ( c > 1 )
+	{
+		qsort( m_EventsByStart.Base(), c, sizeof( TimelineEntry_t ), TimelineStartCompare );
+		qsort( m_EventsByEnd.Base(), c, sizeof( TimelineEntry_t ), TimelineEndCompare );
+	}
+
+	// Indices in the active set may be stale now
+	m_ActiveEvents.RemoveAll();
+
+	m_bTimelineDirty = false;
+	m_bTimelineSeek = true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Rebuilds the active set for playback from time t.  Anything still
+//  processing stays active so it gets its stop, plus anything whose span
+//  covers t.  The cursor is left on the first event the playhead hasn't reached.
+//-----------------------------------------------------------------------------
+void CChoreoScene::SeekTimeline( float t, bool forward )
+{
+	int i;
+	int c = m_Events.Count();
+
+	m_ActiveEvents.RemoveAll();
+	for ( i = 0; i < c; i++ )
+	{
+		CChoreoEvent *e = m_Events[ i ];
+		if ( !e )
+			continue;
+
+		float starttime, endtime;
+		GetEventTimelineSpan( e, starttime, endtime );
+
+		if ( e->IsProcessing() || ( starttime <= t && endtime >= t ) )
+		{
+			m_ActiveEvents.AddToTail( i );
+		}
+	}
+
+	m_nTimelineCursor = 0;
+	if ( forward )
+	{
+		while ( m_nTimelineCursor < m_EventsByStart.Count() && 
+			m_EventsByStart[ m_nTimelineCursor ].time <= t )
+		{
+			m_nTimelineCursor++;
+		}
+	}
+	else
+	{
+		while ( m_nTimelineCursor < m_EventsByEnd.Count() && 
+			m_EventsByEnd[ m_nTimelineCursor ].time >= t )
+		{
+			m_nTimelineCursor++;
+		}
+	}
+
+	m_bTimelineForward = forward;
+	m_bTimelineSeek = false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Adds an event to the active set, keeping it in m_Events order so
+//  dispatch order among equal events matches the scene file
+// Input  : event - index into m_Events
+//-----------------------------------------------------------------------------
+void CChoreoScene::AddActiveEvent( int event )
+{
+	int i = m_ActiveEvents.Count();
+	while ( i > 0 && m_ActiveEvents[ i - 1 ] >= event )
+	{
+		if ( m_ActiveEvents[ i - 1 ] == event )
+			return;
+		i--;
+	}
+
+	m_ActiveEvents.InsertBefore( i, event );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : dt - 
@@ -2112,15 +2691,42 @@ void CChoreoScene::Think( float curtime )
 
 	bool playing_forward = ( dt >= 0.0f ) ? true : false;
 
+	if ( m_bTimelineDirty )
+	{
+		BuildTimeline();
+	}
+
+	if ( m_bTimelineSeek || playing_forward != m_bTimelineForward )
+	{
+		SeekTimeline( m_flCurrentTime, playing_forward );
+	}
+
+	// Pull in events the playhead reaches this frame
+	if ( playing_forward )
+	{
+		while ( m_nTimelineCursor < m_EventsByStart.Count() && 
+			m_EventsByStart[ m_nTimelineCursor ].time <= curtime )
+		{
+			AddActiveEvent( m_EventsByStart[ m_nTimelineCursor++ ].event );
+		}
+	}
+	else
+	{
+		while ( m_nTimelineCursor < m_EventsByEnd.Count() && 
+			m_EventsByEnd[ m_nTimelineCursor ].time >= curtime )
+		{
+			AddActiveEvent( m_EventsByEnd[ m_nTimelineCursor++ ].event );
+		}
+	}
+
 	m_nActiveEvents = 0;
 
-	CUtlRBTree< ActiveList, int > pending(0,0,EventLess);
+	m_PendingEvents.RemoveAll();
 
-	// Iterate through all events in the scene
 	int i;
-	for ( i = 0; i < m_Events.Size(); i++ )
+	for ( i = 0; i < m_ActiveEvents.Count(); i++ )
 	{
-		e = m_Events[ i ];
+		e = m_Events[ m_ActiveEvents[ i ] ];
 		if ( !e )
 			continue;
 
@@ -2129,23 +2735,27 @@ void CChoreoScene::Think( float curtime )
 
 		if ( disposition != PROCESSING_TYPE_IGNORE )
 		{
-
 			ActiveList entry;
 
 			entry.e		= e;
 			entry.pt	= disposition;
 
-			pending.Insert( entry );
+			// Insertion sort, only a handful of events change state in a frame
+			int slot = m_PendingEvents.Count();
+			while ( slot > 0 && EventLess( entry, m_PendingEvents[ slot - 1 ] ) )
+			{
+				slot--;
+			}
+			m_PendingEvents.InsertBefore( slot, entry );
 		}
 	}
 
 	// Events are sorted start time and then by channel and actor slot or by name if those aren't equal
 	bool dump = false;
 
-	i = pending.FirstInorder();
-	while ( i != pending.InvalidIndex() )
+	for ( i = 0; i < m_PendingEvents.Count(); i++ )
 	{
-		ActiveList *entry = &pending[ i ];
+		ActiveList *entry = &m_PendingEvents[ i ];
 
 		Assert( entry->e );
 
@@ -2179,8 +2789,32 @@ void CChoreoScene::Think( float curtime )
 			entry->e->StopProcessing( m_pIChoreoEventCallback, this, m_flCurrentTime );
 			break;
 		}
+	}
 
-		i = pending.NextInorder( i );
+	// Retire events the playhead has moved past; a dispatch that looped the
+	//  scene or edited it will reseed the active set next frame anyway
+	if ( !m_bTimelineDirty )
+	{
+		for ( i = m_ActiveEvents.Count() - 1; i >= 0; i-- )
+		{
+			e = m_Events[ m_ActiveEvents[ i ] ];
+			if ( !e )
+			{
+				m_ActiveEvents.Remove( i );
+				continue;
+			}
+
+			if ( e->IsProcessing() )
+				continue;
+
+			float starttime, endtime;
+			GetEventTimelineSpan( e, starttime, endtime );
+
+			if ( playing_forward ? ( endtime < curtime ) : ( starttime > curtime ) )
+			{
+				m_ActiveEvents.Remove( i );
+			}
+		}
 	}
 
 	if ( dump )
@@ -2213,6 +2847,7 @@ float CChoreoScene::GetTime( void )
 void CChoreoScene::LoopToTime( float t )
 {
 	m_flCurrentTime = t;
+	m_bTimelineSeek = true;
 }
 
 //-----------------------------------------------------------------------------
@@ -2373,6 +3008,8 @@ void CChoreoScene::DestroyEvent( CChoreoEvent *event )
 		}
 	}
 
+	m_bTimelineDirty = true;
+
 	delete event;
 }
 
@@ -2389,6 +3026,7 @@ void CChoreoScene::SetSoundFileStartupLatency( float time )
 {
 	Assert( time >= 0 );
 	m_flSoundSystemLatency = time;
+	m_bTimelineDirty = true;
 }
 
 //-----------------------------------------------------------------------------
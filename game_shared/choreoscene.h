@@ -52,6 +52,12 @@ public:
 	// Saving
 	bool			SaveToFile( const char *filename );
 
+	// Compiled form: a string table followed by flat arrays of actors, channels
+	//  and events. A scene restored from it reads its flex samples in place, so
+	//  the buffer has to outlive the scene.
+	bool			SaveToBinaryBuffer( CUtlBuffer& buf );
+	bool			RestoreFromBinaryBuffer( CUtlBuffer& buf );
+
 	static void		FileSaveFlexAnimationTrack( CUtlBuffer& buf, int level, CFlexAnimationTrack *track );
 	static void		FileSaveFlexAnimations( CUtlBuffer& buf, int level, CChoreoEvent *e );
 	static void		FileSaveRamp( CUtlBuffer& buf, int level, CChoreoEvent *e );
@@ -200,6 +206,21 @@ private:
 
 	static bool EventLess( const CChoreoScene::ActiveList &al0, const CChoreoScene::ActiveList &al1 );
 
+	// Index into m_Events, keyed by one edge of the event's span
+	struct TimelineEntry_t
+	{
+		float				time;
+		int					event;
+	};
+
+	static int __cdecl TimelineStartCompare( const void *p0, const void *p1 );
+	static int __cdecl TimelineEndCompare( const void *p0, const void *p1 );
+
+	void			GetEventTimelineSpan( CChoreoEvent *e, float& starttime, float& endtime );
+	void			BuildTimeline( void );
+	void			SeekTimeline( float t, bool forward );
+	void			AddActiveEvent( int event );
+
 	int				EventThink( CChoreoEvent *e, 
 						float frame_start_time, 
 						float frame_end_time,
@@ -258,6 +279,23 @@ private:
 	// These are just pointers, the actual objects are in m_Events
 	CUtlVector < CChoreoEvent * >	m_PauseEvents;
 
+	// Think only visits events the playhead has reached and not yet left behind.
+	//  Events are sorted by start time for forward playback, and by end time
+	//  (latest first) for backward playback; the cursor walks whichever list
+	//  matches the current direction.
+	CUtlVector < TimelineEntry_t >	m_EventsByStart;
+	CUtlVector < TimelineEntry_t >	m_EventsByEnd;
+	// Indices into m_Events, kept in ascending order
+	CUtlVector < int >				m_ActiveEvents;
+	// Scratch list reused by Think to order event dispatch
+	CUtlVector < ActiveList >		m_PendingEvents;
+	int				m_nTimelineCursor;
+	bool			m_bTimelineForward;
+	// m_Events or the sound latency changed, rebuild the sorted lists
+	bool			m_bTimelineDirty;
+	// Playhead jumped, reseed the cursor and active set
+	bool			m_bTimelineSeek;
+
 	// Current simulation time
 	float			m_flCurrentTime;
 
@@ -305,4 +343,9 @@ CChoreoScene *ChoreoLoadScene(
 	ISceneTokenProcessor *tokenizer,
 	void ( *pfn ) ( const char *fmt, ... ) );
 
+CChoreoScene *ChoreoLoadSceneFromBinary( 
+	IChoreoEventCallback *callback, 
+	CUtlBuffer& buf,
+	void ( *pfn ) ( const char *fmt, ... ) );
+
 #endif // CHOREOSCENE_H
@@ -42,12 +42,12 @@ private:
 	{
 		DecalListEntry()
 		{
-			name			= UTL_INVAL_SYMBOL;
+			name			= UTL_INVAL_HASH_SYMBOL;
 			precache_index	= -1;
 			weight			= 1.0f;
 		}
 
-		CUtlSymbol	name;
+		CUtlHashSymbol	name;
 		int			precache_index;
 		float		weight;
 	};
@@ -86,7 +86,7 @@ private:
 
 	CUtlVector< DecalListEntry >	m_AllDecals;
 	CUtlDict< DecalEntry, int >		m_Decals;
-	CUtlSymbolTable					m_DecalFileNames;
+	CUtlHashSymbolTable				m_DecalFileNames;
 	CUtlDict< int, int >			m_GameMaterialTranslation;
 };
 
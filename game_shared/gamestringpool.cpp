@@ -10,6 +10,9 @@
 #include "stringpool.h"
 #include "igamesystem.h"
 #include "gamestringpool.h"
+#include "utlsymbol.h"
+#include "utlrbtree.h"
+#include "tier0/fasttimer.h"
 
 //-----------------------------------------------------------------------------
 // Purpose: The actual storage for pooled per-level strings
@@ -48,3 +51,145 @@ string_t FindPooledString( const char *pszValue )
 {
 	return MAKE_STRING( g_GameStringPool.Find( pszValue ) );
 }
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Times the hashed symbol table and string pool against the tree
+//			based versions, using the strings the current level has pooled
+//-----------------------------------------------------------------------------
+#define STRINGPOOL_BENCH_PASSES 20
+
+static bool StringPoolBenchLessFunc( const char * const &lhs, const char * const &rhs )
+{	
+	return ( strcmpi(lhs, rhs) < 0 );
+}
+
+CON_COMMAND( stringpool_bench, "Time the tree and hash symbol tables on the current level's pooled strings" )
+{
+	CUtlVector<const char *> strings;
+	g_GameStringPool.GetStrings( strings );
+
+	int nStrings = strings.Count();
+	if ( nStrings == 0 )
+	{
+		Msg( "stringpool_bench: no pooled strings, load a level first\n" );
+		return;
+	}
+	if ( nStrings > 65535 )
+	{
+		// the tree versions use 16 bit indices
+		nStrings = 65535;
+	}
+
+	CFastTimer timer;
+	int i, pass, nFound;
+
+	// Symbol tables
+	CUtlSymbolTable treeTable( 0, 32, true );
+	timer.Start();
+	for ( i = 0; i < nStrings; i++ )
+	{
+		treeTable.AddString( strings[i] );
+	}
+	timer.End();
+	float flTreeAddMs = timer.GetDuration().GetMillisecondsF();
+
+	nFound = 0;
+	timer.Start();
+	for ( pass = 0; pass < STRINGPOOL_BENCH_PASSES; pass++ )
+	{
+		for ( i = 0; i < nStrings; i++ )
+		{
+			if ( treeTable.Find( strings[i] ).IsValid() )
+				nFound++;
+		}
+	}
+	timer.End();
+	float flTreeFindMs = timer.GetDuration().GetMillisecondsF();
+	int nTreeFound = nFound;
+
+	CUtlHashSymbolTable hashTable( 0, 32, true );
+	timer.Start();
+	for ( i = 0; i < nStrings; i++ )
+	{
+		hashTable.AddString( strings[i] );
+	}
+	timer.End();
+	float flHashAddMs = timer.GetDuration().GetMillisecondsF();
+
+	nFound = 0;
+	timer.Start();
+	for ( pass = 0; pass < STRINGPOOL_BENCH_PASSES; pass++ )
+	{
+		for ( i = 0; i < nStrings; i++ )
+		{
+			if ( hashTable.Find( strings[i] ).IsValid() )
+				nFound++;
+		}
+	}
+	timer.End();
+	float flHashFindMs = timer.GetDuration().GetMillisecondsF();
+	int nHashFound = nFound;
+
+	// String pools: the tree the pool used to be built on, then the pool itself
+	CUtlRBTree<const char *, unsigned short> treePool( 256, 0, StringPoolBenchLessFunc );
+	timer.Start();
+	for ( i = 0; i < nStrings; i++ )
+	{
+		if ( treePool.Find( strings[i] ) == treePool.InvalidIndex() )
+		{
+			treePool.Insert( strdup( strings[i] ) );
+		}
+	}
+	timer.End();
+	float flTreePoolAddMs = timer.GetDuration().GetMillisecondsF();
+
+	nFound = 0;
+	timer.Start();
+	for ( pass = 0; pass < STRINGPOOL_BENCH_PASSES; pass++ )
+	{
+		for ( i = 0; i < nStrings; i++ )
+		{
+			if ( treePool.Find( strings[i] ) != treePool.InvalidIndex() )
+				nFound++;
+		}
+	}
+	timer.End();
+	float flTreePoolFindMs = timer.GetDuration().GetMillisecondsF();
+	int nTreePoolFound = nFound;
+
+	for ( i = treePool.FirstInorder(); i != treePool.InvalidIndex(); i = treePool.NextInorder( i ) )
+	{
+		free( (void *)treePool[i] );
+	}
+	treePool.RemoveAll();
+
+	CStringPool hashPool;
+	timer.Start();
+	for ( i = 0; i < nStrings; i++ )
+	{
+		hashPool.Allocate( strings[i] );
+	}
+	timer.End();
+	float flHashPoolAddMs = timer.GetDuration().GetMillisecondsF();
+
+	nFound = 0;
+	timer.Start();
+	for ( pass = 0; pass < STRINGPOOL_BENCH_PASSES; pass++ )
+	{
+		for ( i = 0; i < nStrings; i++ )
+		{
+			if ( hashPool.Find( strings[i] ) )
+				nFound++;
+		}
+	}
+	timer.End();
+	float flHashPoolFindMs = timer.GetDuration().GetMillisecondsF();
+	int nHashPoolFound = nFound;
+
+	Msg( "stringpool_bench: %d strings, %d lookup passes\n", nStrings, STRINGPOOL_BENCH_PASSES );
+	Msg( "  symbol table  tree: add %.3f ms, find %.3f ms (%d found)\n", flTreeAddMs, flTreeFindMs, nTreeFound );
+	Msg( "  symbol table  hash: add %.3f ms, find %.3f ms (%d found)\n", flHashAddMs, flHashFindMs, nHashFound );
+	Msg( "  string pool   tree: add %.3f ms, find %.3f ms (%d found)\n", flTreePoolAddMs, flTreePoolFindMs, nTreePoolFound );
+	Msg( "  string pool   hash: add %.3f ms, find %.3f ms (%d found)\n", flHashPoolAddMs, flHashPoolFindMs, nHashPoolFound );
+}
@@ -1215,6 +1215,313 @@ void CPredictionCopy::TransferData_R( int chaincount, datamap_t *dmap )
 
 static int g_nChainCount = 1;
 
+//-----------------------------------------------------------------------------
+// Copy plans
+//
+// A plain copy (no error checking, describing or watching) of a datamap always
+// moves the same bytes, so the first one compiles the field walk down to a list
+// of memcpy runs, coalesced where fields are adjacent on both sides, plus the
+// few fields that can't be done as a fixed block.
+//-----------------------------------------------------------------------------
+
+static ConVar pcopyplans( "pcopyplans", "1", 0, "Use precompiled copy plans for plain prediction copies." );
+
+struct predcopyrun_t
+{
+	int				destOffset;
+	int				srcOffset;
+	int				size;
+};
+
+enum
+{
+	PCS_STRING = 0,			// Null terminated, only copy what's used
+	PCS_EMBEDDED_PTR,		// Embedded struct reached through a pointer on one side
+};
+
+struct predcopyspecial_t
+{
+	int				type;
+	int				destOffset;
+	int				srcOffset;
+	bool			derefDest;
+	bool			derefSrc;
+	predcopyplan_t	*pSubPlan;
+};
+
+struct predcopyplan_t
+{
+	int				nType;
+	int				nDestOffsetIndex;
+	int				nSrcOffsetIndex;
+
+	CUtlVector< predcopyrun_t >		runs;
+	CUtlVector< predcopyspecial_t >	specials;
+
+	predcopyplan_t	*pNext;
+};
+
+static void AddCopyRun( predcopyplan_t *pPlan, int destOffset, int srcOffset, int size )
+{
+	if ( size <= 0 )
+		return;
+
+	predcopyrun_t run;
+	run.destOffset = destOffset;
+	run.srcOffset = srcOffset;
+	run.size = size;
+	pPlan->runs.AddToTail( run );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Mirrors CPredictionCopy::CopyFields, recording what it would copy
+//			instead of copying it. destBase/srcBase are the offsets of any
+//			embedded structs stored inline.
+//-----------------------------------------------------------------------------
+static void CompileCopyFields( predcopyplan_t *pPlan, int chain_count, typedescription_t *pFields, int fieldCount, int destBase, int srcBase )
+{
+	for ( int i = 0; i < fieldCount; i++ )
+	{
+		typedescription_t *pField = &pFields[ i ];
+		int flags = pField->flags;
+
+		// Mark any subchains first
+		if ( pField->override_field != NULL )
+		{
+			pField->override_field->override_count = chain_count;
+		}
+
+		// Skip this field?
+		if ( pField->override_count == chain_count )
+		{
+			continue;
+		}
+
+		// Always recurse into embeddeds
+		if ( pField->fieldType != FIELD_EMBEDDED )
+		{
+			if ( flags & FTYPEDESC_PRIVATE )
+				continue;
+
+			if ( pPlan->nType == PC_NON_NETWORKED_ONLY && ( flags & FTYPEDESC_INSENDTABLE ) )
+				continue;
+
+			if ( pPlan->nType == PC_NETWORKED_ONLY && !( flags & FTYPEDESC_INSENDTABLE ) )
+				continue;
+		}
+
+		int destOffset = destBase + pField->fieldOffset[ pPlan->nDestOffsetIndex ];
+		int srcOffset = srcBase + pField->fieldOffset[ pPlan->nSrcOffsetIndex ];
+		int fieldSize = pField->fieldSize;
+
+		switch( pField->fieldType )
+		{
+		case FIELD_EMBEDDED:
+			{
+				bool derefSrc = ( flags & FTYPEDESC_PTR ) && ( pPlan->nSrcOffsetIndex == PC_DATA_NORMAL );
+				bool derefDest = ( flags & FTYPEDESC_PTR ) && ( pPlan->nDestOffsetIndex == PC_DATA_NORMAL );
+
+				if ( !derefSrc && !derefDest )
+				{
+					CompileCopyFields( pPlan, chain_count, pField->td->dataDesc, pField->td->dataNumFields, destOffset, srcOffset );
+					break;
+				}
+
+				predcopyplan_t *pSubPlan = new predcopyplan_t;
+				pSubPlan->nType = pPlan->nType;
+				pSubPlan->nDestOffsetIndex = pPlan->nDestOffsetIndex;
+				pSubPlan->nSrcOffsetIndex = pPlan->nSrcOffsetIndex;
+				pSubPlan->pNext = NULL;
+				CompileCopyFields( pSubPlan, chain_count, pField->td->dataDesc, pField->td->dataNumFields, 0, 0 );
+
+				predcopyspecial_t special;
+				special.type = PCS_EMBEDDED_PTR;
+				special.destOffset = destOffset;
+				special.srcOffset = srcOffset;
+				special.derefDest = derefDest;
+				special.derefSrc = derefSrc;
+				special.pSubPlan = pSubPlan;
+				pPlan->specials.AddToTail( special );
+			}
+			break;
+		case FIELD_FLOAT:
+			AddCopyRun( pPlan, destOffset, srcOffset, sizeof( float ) * fieldSize );
+			break;
+		case FIELD_STRING:
+			{
+				predcopyspecial_t special;
+				special.type = PCS_STRING;
+				special.destOffset = destOffset;
+				special.srcOffset = srcOffset;
+				special.derefDest = false;
+				special.derefSrc = false;
+				special.pSubPlan = NULL;
+				pPlan->specials.AddToTail( special );
+			}
+			break;
+		case FIELD_VECTOR:
+			AddCopyRun( pPlan, destOffset, srcOffset, sizeof( Vector ) * fieldSize );
+			break;
+		case FIELD_QUATERNION:
+			AddCopyRun( pPlan, destOffset, srcOffset, sizeof( Quaternion ) * fieldSize );
+			break;
+		case FIELD_COLOR32:
+			AddCopyRun( pPlan, destOffset, srcOffset, 4 * fieldSize );
+			break;
+		case FIELD_BOOLEAN:
+			AddCopyRun( pPlan, destOffset, srcOffset, sizeof( bool ) * fieldSize );
+			break;
+		case FIELD_INTEGER:
+			AddCopyRun( pPlan, destOffset, srcOffset, sizeof( int ) * fieldSize );
+			break;
+		case FIELD_SHORT:
+			AddCopyRun( pPlan, destOffset, srcOffset, sizeof( short ) * fieldSize );
+			break;
+		case FIELD_CHARACTER:
+			AddCopyRun( pPlan, destOffset, srcOffset, fieldSize );
+			break;
+		case FIELD_EHANDLE:
+			// Handles are a plain index/serial number, so they copy as bytes
+			AddCopyRun( pPlan, destOffset, srcOffset, sizeof( EHANDLE ) * fieldSize );
+			break;
+		case FIELD_VOID:
+			break;
+		default:
+			// Not valid in prediction tables; CopyFields asserts on these
+			Assert( 0 );
+			break;
+		}
+	}
+}
+
+static int __cdecl CompareCopyRuns( const void *pLeft, const void *pRight )
+{
+	return ( ((const predcopyrun_t *)pLeft)->srcOffset - ((const predcopyrun_t *)pRight)->srcOffset );
+}
+
+static void CoalesceCopyRuns( predcopyplan_t *pPlan )
+{
+	CUtlVector< predcopyrun_t > &runs = pPlan->runs;
+	if ( !runs.Count() )
+		return;
+
+	qsort( runs.Base(), runs.Count(), sizeof( predcopyrun_t ), CompareCopyRuns );
+
+	int nOut = 0;
+	for ( int i = 1; i < runs.Count(); i++ )
+	{
+		predcopyrun_t &last = runs[ nOut ];
+		const predcopyrun_t &next = runs[ i ];
+
+		if ( next.srcOffset == last.srcOffset + last.size &&
+			 next.destOffset == last.destOffset + last.size )
+		{
+			last.size += next.size;
+		}
+		else
+		{
+			runs[ ++nOut ] = next;
+		}
+	}
+
+	runs.RemoveMultiple( nOut + 1, runs.Count() - ( nOut + 1 ) );
+
+	for ( int j = 0; j < pPlan->specials.Count(); j++ )
+	{
+		if ( pPlan->specials[ j ].pSubPlan )
+		{
+			CoalesceCopyRuns( pPlan->specials[ j ].pSubPlan );
+		}
+	}
+}
+
+static predcopyplan_t *FindCopyPlan( datamap_t *dmap, int type, int destOffsetIndex, int srcOffsetIndex )
+{
+	predcopyplan_t *pPlan;
+	for ( pPlan = dmap->predCopyPlans; pPlan; pPlan = pPlan->pNext )
+	{
+		if ( pPlan->nType == type &&
+			 pPlan->nDestOffsetIndex == destOffsetIndex &&
+			 pPlan->nSrcOffsetIndex == srcOffsetIndex )
+		{
+			return pPlan;
+		}
+	}
+
+	pPlan = new predcopyplan_t;
+	pPlan->nType = type;
+	pPlan->nDestOffsetIndex = destOffsetIndex;
+	pPlan->nSrcOffsetIndex = srcOffsetIndex;
+
+	// Walk the chain the way TransferData_R does so overrides resolve the same way
+	int chain_count = ++g_nChainCount;
+	for ( datamap_t *pMap = dmap; pMap; pMap = pMap->baseMap )
+	{
+		CompileCopyFields( pPlan, chain_count, pMap->dataDesc, pMap->dataNumFields, 0, 0 );
+	}
+
+	CoalesceCopyRuns( pPlan );
+
+	pPlan->pNext = dmap->predCopyPlans;
+	dmap->predCopyPlans = pPlan;
+	return pPlan;
+}
+
+static void RunCopyPlan( const predcopyplan_t *pPlan, char *pDest, const char *pSrc )
+{
+	int i;
+	for ( i = 0; i < pPlan->runs.Count(); i++ )
+	{
+		const predcopyrun_t &run = pPlan->runs[ i ];
+		memcpy( pDest + run.destOffset, pSrc + run.srcOffset, run.size );
+	}
+
+	for ( i = 0; i < pPlan->specials.Count(); i++ )
+	{
+		const predcopyspecial_t &special = pPlan->specials[ i ];
+
+		char *pOutputData = pDest + special.destOffset;
+		const char *pInputData = pSrc + special.srcOffset;
+
+		switch ( special.type )
+		{
+		case PCS_STRING:
+			memcpy( pOutputData, pInputData, Q_strlen( pInputData ) + 1 );
+			break;
+		case PCS_EMBEDDED_PTR:
+			if ( special.derefDest )
+			{
+				pOutputData = *((char **)pOutputData);
+			}
+			if ( special.derefSrc )
+			{
+				pInputData = *((const char **)pInputData);
+			}
+			RunCopyPlan( special.pSubPlan, pOutputData, pInputData );
+			break;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Plans only cover plain copies; anything that compares, reports,
+//			describes or watches fields walks the datamap
+//-----------------------------------------------------------------------------
+bool CPredictionCopy::CanUseCopyPlan( datamap_t *dmap )
+{
+	if ( !pcopyplans.GetBool() )
+		return false;
+
+	if ( !m_bPerformCopy || m_bErrorCheck || m_bReportErrors || m_bDescribeFields || m_FieldCompareFunc || m_pWatchField )
+		return false;
+
+	// Packed offsets have to exist before they can be baked in
+	if ( ( m_nDestOffsetIndex == TD_OFFSET_PACKED || m_nSrcOffsetIndex == TD_OFFSET_PACKED ) && !dmap->packed_offsets_computed )
+		return false;
+
+	return true;
+}
+
 static typedescription_t *FindFieldByName_R( const char *fieldname, datamap_t *dmap )
 {
 	int c = dmap->dataNumFields;
@@ -1366,6 +1673,13 @@ int CPredictionCopy::TransferData( const char *operation, int entindex, datamap_
 	
 	DetermineWatchField( operation, entindex, dmap );
 
+	if ( CanUseCopyPlan( dmap ) )
+	{
+		predcopyplan_t *pPlan = FindCopyPlan( dmap, m_nType, m_nDestOffsetIndex, m_nSrcOffsetIndex );
+		RunCopyPlan( pPlan, (char *)m_pDest, (const char *)m_pSrc );
+		return m_nErrorCount;
+	}
+
 	TransferData_R( g_nChainCount, dmap );
 
 	return m_nErrorCount;
@@ -84,6 +84,8 @@ public:
 private:
 	void	TransferData_R( int chaincount, datamap_t *dmap );
 
+	bool	CanUseCopyPlan( datamap_t *dmap );
+
 	void	DetermineWatchField( const char *operation, int entindex,  datamap_t *dmap );
 	void	DumpWatchField( typedescription_t *field );
 	void	WatchMsg( const char *fmt, ... );
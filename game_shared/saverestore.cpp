@@ -33,6 +33,8 @@
 
 #endif
 
+#include "tier0/fasttimer.h"
+
 #define MAX_ENTITYARRAY 64
 #define ZERO_TIME ((FLT_MAX*-0.5))
 // A bit arbitrary, but unlikely to collide with any saved games...
@@ -163,7 +165,8 @@ void *UTIL_FunctionFromName( datamap_t *pMap, const char *pName )
 
 CSave::CSave( CSaveRestoreData *pdata )
  :	m_pData(pdata),
-	m_pGameInfo( pdata )
+	m_pGameInfo( pdata ),
+	m_bEntityIndexMapBuilt( false )
 {
 	m_BlockStartStack.EnsureCapacity( 32 );
 
@@ -918,6 +921,61 @@ int	CSave::EntityIndex( const edict_t *pentLookup )
 }
 
 
+//-------------------------------------
+
+static inline unsigned int HashEntityPointer( const void *pEntity )
+{
+	unsigned int key = (unsigned int)( (size_t)pEntity >> 4 );
+	key ^= key >> 16;
+	key *= 0x85ebca6b;
+	key ^= key >> 13;
+	return key;
+}
+
+//-------------------------------------
+
+void CSave::BuildEntityIndexMap()
+{
+	m_bEntityIndexMapBuilt = true;
+	m_EntityIndexMap.RemoveAll();
+
+	int nEntities = m_pGameInfo->NumEntities();
+	if ( !nEntities )
+		return;
+
+	// Keep the load under a half
+	int nSlots = 16;
+	while ( nSlots < nEntities * 2 )
+	{
+		nSlots <<= 1;
+	}
+
+	m_EntityIndexMap.SetCount( nSlots );
+	memset( m_EntityIndexMap.Base(), 0, nSlots * sizeof(EntityIndexSlot_t) );
+
+	int nMask = nSlots - 1;
+	for ( int i = 0; i < nEntities; i++ )
+	{
+		entitytable_t *pTable = m_pGameInfo->GetEntityInfo( i );
+		const CBaseEntity *pEntity = pTable->hEnt;
+		if ( !pEntity )
+			continue;
+
+		// First entry for an entity wins, as with the old linear search
+		int slot = HashEntityPointer( pEntity ) & nMask;
+		while ( m_EntityIndexMap[slot].pEntity && m_EntityIndexMap[slot].pEntity != pEntity )
+		{
+			slot = ( slot + 1 ) & nMask;
+		}
+
+		if ( !m_EntityIndexMap[slot].pEntity )
+		{
+			m_EntityIndexMap[slot].pEntity = pEntity;
+			m_EntityIndexMap[slot].id = pTable->id;
+		}
+	}
+}
+
 //-------------------------------------
 
 int	CSave::EntityIndex( const CBaseEntity *pEntity )
@@ -925,14 +983,22 @@ int	CSave::EntityIndex( const CBaseEntity *pEntity )
 	if ( !m_pGameInfo || pEntity == NULL )
 		return -1;
 
-	int i;
-	entitytable_t *pTable;
+	// The entity table is fixed once saving starts
+	if ( !m_bEntityIndexMapBuilt )
+	{
+		BuildEntityIndexMap();
+	}
 
-	for ( i = 0; i < m_pGameInfo->NumEntities(); i++ )
+	if ( !m_EntityIndexMap.Count() )
+		return -1;
+
+	int nMask = m_EntityIndexMap.Count() - 1;
+	int slot = HashEntityPointer( pEntity ) & nMask;
+	while ( m_EntityIndexMap[slot].pEntity )
 	{
-		pTable = m_pGameInfo->GetEntityInfo( i );
-		if ( pTable->hEnt == pEntity )
-			return pTable->id;
+		if ( m_EntityIndexMap[slot].pEntity == pEntity )
+			return m_EntityIndexMap[slot].id;
+		slot = ( slot + 1 ) & nMask;
 	}
 	return -1;
 }
@@ -1408,23 +1474,149 @@ bool CRestore::ShouldReadField( typedescription_t *pField )
 
 //-------------------------------------
 
+//-----------------------------------------------------------------------------
+// Field name hashes for restore, built the first time a field table is read
+// and keyed on the table's address.  Only tables of at least
+// FIELD_NAME_HASH_MIN_FIELDS fields are hashed: those are all static datadescs
+// that live as long as the module.  The small tables built on the stack (e.g.,
+// by the CUtlVector save/restore ops) are searched linearly, which is as fast
+// at that size and keeps a reused stack address from matching a stale entry.
+//-----------------------------------------------------------------------------
+
+#define FIELD_NAME_HASH_MIN_FIELDS	8
+
+struct FieldNameHash_t
+{
+	const typedescription_t *pFields;
+	int		fieldCount;
+	int		nMask;
+	short	*pSlots;		// index into pFields, -1 if empty
+};
+
+static CUtlRBTree<FieldNameHash_t *, int> g_FieldNameHashes;
+
+static bool FieldNameHashLessFunc( FieldNameHash_t * const &lhs, FieldNameHash_t * const &rhs )
+{
+	if ( lhs->pFields != rhs->pFields )
+		return ( lhs->pFields < rhs->pFields );
+	return ( lhs->fieldCount < rhs->fieldCount );
+}
+
+static unsigned int HashFieldName( const char *pszName )
+{
+	unsigned int hash = 0;
+	while ( *pszName )
+	{
+		hash = ( hash * 31 ) + tolower( (unsigned char)*pszName++ );
+	}
+	return hash;
+}
+
+static FieldNameHash_t *FindFieldNameHash( typedescription_t *pFields, int fieldCount )
+{
+	Assert( fieldCount >= FIELD_NAME_HASH_MIN_FIELDS );
+
+	if ( !g_FieldNameHashes.Count() )
+	{
+		g_FieldNameHashes.SetLessFunc( FieldNameHashLessFunc );
+	}
+
+	FieldNameHash_t search;
+	search.pFields = pFields;
+	search.fieldCount = fieldCount;
+
+	int i = g_FieldNameHashes.Find( &search );
+	if ( i != g_FieldNameHashes.InvalidIndex() )
+		return g_FieldNameHashes[i];
+
+	FieldNameHash_t *pHash = new FieldNameHash_t;
+	pHash->pFields = pFields;
+	pHash->fieldCount = fieldCount;
+
+	int nSlots = 8;
+	while ( nSlots < fieldCount * 2 )
+	{
+		nSlots <<= 1;
+	}
+	pHash->nMask = nSlots - 1;
+	pHash->pSlots = new short[nSlots];
+	memset( pHash->pSlots, 0xff, nSlots * sizeof(short) );
+
+	// Earlier fields win on duplicate names
+	for ( int iField = 0; iField < fieldCount; iField++ )
+	{
+		const char *pszName = pFields[iField].fieldName;
+		if ( !pszName )
+			continue;
+
+		int slot = HashFieldName( pszName ) & pHash->nMask;
+		while ( pHash->pSlots[slot] != -1 && stricmp( pFields[pHash->pSlots[slot]].fieldName, pszName ) != 0 )
+		{
+			slot = ( slot + 1 ) & pHash->nMask;
+		}
+
+		if ( pHash->pSlots[slot] == -1 )
+		{
+			pHash->pSlots[slot] = iField;
+		}
+	}
+
+	g_FieldNameHashes.Insert( pHash );
+	return pHash;
+}
+
+//-------------------------------------
+
 typedescription_t *CRestore::FindField( const char *pszFieldName, typedescription_t *pFields, int fieldCount, int *pCookie )
 {
 	int &fieldNumber = *pCookie;
-	if ( pszFieldName )
+	if ( pszFieldName && fieldCount )
 	{
-		typedescription_t *pTest;
-		
-		for ( int i = 0; i < fieldCount; i++ )
+		// Most data is read in the order it was written, so try the next field first
+		typedescription_t *pTest = &pFields[fieldNumber];
+		if ( pTest->fieldName && stricmp( pTest->fieldName, pszFieldName ) == 0 )
 		{
-			pTest = &pFields[fieldNumber];
-			
 			++fieldNumber;
 			if ( fieldNumber == fieldCount )
 				fieldNumber = 0;
-			
-			if ( stricmp( pTest->fieldName, pszFieldName ) == 0 )
-				return pTest;
+			return pTest;
+		}
+
+		if ( fieldCount < FIELD_NAME_HASH_MIN_FIELDS )
+		{
+			for ( int i = 1; i < fieldCount; i++ )
+			{
+				++fieldNumber;
+				if ( fieldNumber == fieldCount )
+					fieldNumber = 0;
+
+				pTest = &pFields[fieldNumber];
+				if ( pTest->fieldName && stricmp( pTest->fieldName, pszFieldName ) == 0 )
+				{
+					++fieldNumber;
+					if ( fieldNumber == fieldCount )
+						fieldNumber = 0;
+					return pTest;
+				}
+			}
+
+			fieldNumber = 0;
+			return NULL;
+		}
+
+		FieldNameHash_t *pHash = FindFieldNameHash( pFields, fieldCount );
+		int slot = HashFieldName( pszFieldName ) & pHash->nMask;
+		while ( pHash->pSlots[slot] != -1 )
+		{
+			int iField = pHash->pSlots[slot];
+			if ( stricmp( pFields[iField].fieldName, pszFieldName ) == 0 )
+			{
+				fieldNumber = iField + 1;
+				if ( fieldNumber == fieldCount )
+					fieldNumber = 0;
+				return &pFields[iField];
+			}
+			slot = ( slot + 1 ) & pHash->nMask;
 		}
 	}
 
@@ -1825,6 +2017,14 @@ CBaseEntity *CRestore::EntityFromIndex( int entityIndex )
 	int i;
 	entitytable_t *pTable;
 
+	// Ids are handed out in table order, so the entry is almost always right where it should be
+	if ( entityIndex < m_pGameInfo->NumEntities() )
+	{
+		pTable = m_pGameInfo->GetEntityInfo( entityIndex );
+		if ( pTable->id == entityIndex )
+			return pTable->hEnt;
+	}
+
 	for ( i = 0; i < m_pGameInfo->NumEntities(); i++ )
 	{
 		pTable = m_pGameInfo->GetEntityInfo( i );
@@ -3053,3 +3253,142 @@ int CreateEntityTransitionList( CSaveRestoreData *pSaveData, int levelMask )
 	return movedCount;
 }
 #endif
+
+//-----------------------------------------------------------------------------
+// Purpose: Times a save and restore of the whole entity list, padded out with
+//			logical entities that point at each other to a large level's worth
+//-----------------------------------------------------------------------------
+#if !defined( CLIENT_DLL )
+
+#define SAVERESTORE_BENCH_ENTITIES		4000
+#define SAVERESTORE_BENCH_BUFFER_SIZE	( 32 * 1024 * 1024 )
+#define SAVERESTORE_BENCH_TOKENS		0xFFFF
+
+CON_COMMAND( save_restore_bench, "Time a save and restore of a synthetic 4000 entity level" )
+{
+	// Pad the level out with entities that only exist on the server
+	CUtlVector<CBaseEntity *> synthetic;
+	while ( gEntList.NumberOfEntities() < SAVERESTORE_BENCH_ENTITIES )
+	{
+		CBaseEntity *pEnt = CreateEntityByName( "logic_case" );
+		if ( !pEnt )
+			break;
+
+		DispatchSpawn( pEnt );
+		if ( synthetic.Count() )
+		{
+			pEnt->SetOwnerEntity( synthetic[ random->RandomInt( 0, synthetic.Count() - 1 ) ] );
+		}
+		synthetic.AddToTail( pEnt );
+	}
+
+	int nEntities = gEntList.NumberOfEntities();
+	entitytable_t *pEntityTable = new entitytable_t[nEntities];
+	char *pBuffer = new char[SAVERESTORE_BENCH_BUFFER_SIZE];
+	char **pTokens = new char *[SAVERESTORE_BENCH_TOKENS];
+	memset( pTokens, 0, SAVERESTORE_BENCH_TOKENS * sizeof(char *) );
+
+	CSaveRestoreData *pSaveData = new CSaveRestoreData;
+	pSaveData->Init( pBuffer, SAVERESTORE_BENCH_BUFFER_SIZE );
+	pSaveData->InitSymbolTable( pTokens, SAVERESTORE_BENCH_TOKENS );
+	pSaveData->InitEntityTable( pEntityTable, nEntities );
+
+	// Same table SaveInitEntities() builds
+	CBaseEntity *pEnt = NULL;
+	int i = 0;
+	while ( (pEnt = gEntList.NextEnt( pEnt )) != NULL && i < nEntities )
+	{
+		entitytable_t *pEntInfo = pSaveData->GetEntityInfo( i );
+		pEntInfo->id = i;
+		pEntInfo->hEnt = pEnt;
+		pEntInfo->flags = 0;
+		i++;
+	}
+
+	CFastTimer timer;
+
+	// Save everything
+	timer.Start();
+	CSave saveHelper( pSaveData );
+	for ( i = 0; i < nEntities; i++ )
+	{
+		entitytable_t *pEntInfo = pSaveData->GetEntityInfo( i );
+		pEntInfo->location = saveHelper.GetWritePos();
+		pEntInfo->size = 0;
+
+		pEnt = pEntInfo->hEnt;
+		if ( pEnt && !( pEnt->ObjectCaps() & FCAP_DONT_SAVE ) )
+		{
+			pEnt->Save( saveHelper );
+			pEntInfo->size = saveHelper.GetWritePos() - pEntInfo->location;
+		}
+	}
+	timer.End();
+	float flSaveMs = timer.GetDuration().GetMillisecondsF();
+	int nSaveBytes = saveHelper.GetWritePos();
+
+	// Every entity once through the old linear scan, for comparison
+	timer.Start();
+	int nFound = 0;
+	for ( i = 0; i < nEntities; i++ )
+	{
+		CBaseEntity *pLookup = pSaveData->GetEntityInfo( i )->hEnt;
+		for ( int j = 0; j < nEntities; j++ )
+		{
+			if ( pSaveData->GetEntityInfo( j )->hEnt == pLookup )
+			{
+				nFound++;
+				break;
+			}
+		}
+	}
+	timer.End();
+	float flLinearMs = timer.GetDuration().GetMillisecondsF();
+
+	timer.Start();
+	for ( i = 0; i < nEntities; i++ )
+	{
+		if ( saveHelper.EntityIndex( pSaveData->GetEntityInfo( i )->hEnt ) != -1 )
+		{
+			nFound++;
+		}
+	}
+	timer.End();
+	float flHashedMs = timer.GetDuration().GetMillisecondsF();
+
+	// Restore only the synthetic entities; restoring the real ones in place isn't safe
+	timer.Start();
+	CRestore restoreHelper( pSaveData );
+	int nRestored = 0;
+	for ( i = 0; i < nEntities; i++ )
+	{
+		entitytable_t *pEntInfo = pSaveData->GetEntityInfo( i );
+		pEnt = pEntInfo->hEnt;
+		if ( !pEnt || !pEntInfo->size || synthetic.Find( pEnt ) == -1 )
+			continue;
+
+		restoreHelper.SetReadPos( pEntInfo->location );
+		pEnt->Restore( restoreHelper );
+		nRestored++;
+	}
+	timer.End();
+	float flRestoreMs = timer.GetDuration().GetMillisecondsF();
+
+	Msg( "Saved %d entities (%d synthetic) in %.2fms, %d bytes\n", nEntities, synthetic.Count(), flSaveMs, nSaveBytes );
+	Msg( "Entity index lookups: linear %.2fms, hashed %.2fms (%d found)\n", flLinearMs, flHashedMs, nFound );
+	Msg( "Restored %d entities in %.2fms\n", nRestored, flRestoreMs );
+
+	pSaveData->DetachSymbolTable();
+	pSaveData->DetachEntityTable();
+	delete pSaveData;
+	delete [] pTokens;
+	delete [] pBuffer;
+	delete [] pEntityTable;
+
+	for ( i = 0; i < synthetic.Count(); i++ )
+	{
+		UTIL_Remove( synthetic[i] );
+	}
+}
+
+#endif
@@ -163,10 +163,21 @@ private:
 	
 	bool			WriteGameField( const char *pname, void *pData, datamap_t *pRootMap, typedescription_t *pField );
 	int				EntityIndex( const edict_t *pentLookup );
+	void			BuildEntityIndexMap();
 	
 	//---------------------------------
 	
 	CUtlVector<int> m_BlockStartStack;
+
+	// Open addressed map of entity pointer to entity table id, built on first lookup
+	struct EntityIndexSlot_t
+	{
+		const CBaseEntity	*pEntity;
+		int					id;
+	};
+
+	CUtlVector<EntityIndexSlot_t> m_EntityIndexMap;
+	bool			m_bEntityIndexMapBuilt;
 	
 	// Stream data
 	CSaveRestoreSegment *m_pData;
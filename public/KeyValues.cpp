@@ -21,6 +21,9 @@
 #include "tier0/mem.h"
 #include "utlvector.h"
 #include "utlbuffer.h"
+#include "utlmap.h"
+#include "utlhashmap.h"
+#include "checksum_crc.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include <tier0/memdbgon.h>
@@ -29,6 +32,316 @@ static char * s_LastFileLoadingFrom = "unknown"; // just needed for error messag
 
 #define KEYVALUES_TOKEN_SIZE	1024
 
+#define KEYVALUES_INDEX_THRESHOLD	16		// children walked before a node builds its index
+#define KEYVALUES_INDEX_MIN_SIZE	32
+
+//-----------------------------------------------------------------------------
+// Purpose: Open addressed table of a node's children keyed on name symbol.
+//			Only the first child with a given name goes in, since that's the
+//			one a walk of the list would find.
+//-----------------------------------------------------------------------------
+struct KeyValuesIndex_t
+{
+	int			nMask;			// table size - 1
+	int			nCount;			// distinct names in the table
+	int			nGeneration;	// s_nKeyValuesGeneration when built
+	KeyValues	*pFirst;		// first child when built
+	KeyValues	*pTail;			// last child in the list as of the last update
+	KeyValues	**ppSlots;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: State this module keeps for a key outside of the key itself. Other
+//			modules create and read KeyValues built against the same header,
+//			and the pooled allocations in vstdlib are sized for it, so the
+//			class layout can't grow. Entries are keyed on the key's address.
+//
+//			A key deleted by another module leaves its entry behind; keys
+//			constructed here clear any entry at their address, and each
+//			entry records enough to tell when it no longer matches its key.
+//-----------------------------------------------------------------------------
+struct KeyValuesSideData_t
+{
+	KeyValuesIndex_t	*pIndex;		// symbol->child lookup, built lazily for large child lists inside an index scope
+
+	// GetString()/GetWString() conversions of values of another type, and the
+	// type and value (or string pointer) each was made from
+	char			*pString;
+	int				nStringType;
+	const void		*pStringFrom;
+	wchar_t			*pWString;
+	int				nWStringType;
+	const void		*pWStringFrom;
+};
+
+typedef CUtlHashMap< const KeyValues *, KeyValuesSideData_t > KeyValuesSideTable_t;
+
+static KeyValuesSideTable_t &KeyValuesSideTable()
+{
+	// keys can be made during static construction
+	static KeyValuesSideTable_t s_SideTable;
+	return s_SideTable;
+}
+
+static KeyValuesSideData_t *FindSideData( const KeyValues *pKey, bool bCreate )
+{
+	KeyValuesSideTable_t &table = KeyValuesSideTable();
+	int i = table.Find( pKey );
+	if ( i == table.InvalidIndex() )
+	{
+		if ( !bCreate )
+			return NULL;
+
+		KeyValuesSideData_t data;
+		Q_memset( &data, 0, sizeof(data) );
+		i = table.Insert( pKey, data );
+	}
+
+	return &table[i];
+}
+
+static void FreeSideData( const KeyValues *pKey )
+{
+	KeyValuesSideTable_t &table = KeyValuesSideTable();
+	int i = table.Find( pKey );
+	if ( i == table.InvalidIndex() )
+		return;
+
+	KeyValuesSideData_t &data = table[i];
+	if ( data.pIndex )
+	{
+		delete [] data.pIndex->ppSlots;
+		delete data.pIndex;
+	}
+	delete [] data.pString;
+	delete [] data.pWString;
+
+	table.RemoveAt( i );
+}
+
+static bool s_bKeyValuesIndexEnabled = true;
+
+// Indexes hold raw child pointers, so they only live inside a scope where no
+// other module touches the tree; these are the keys that built one
+static int s_nKeyValuesIndexScopes = 0;
+static CUtlVector< const KeyValues * > s_KeyValuesIndexed;
+
+static inline bool UseChildIndex()
+{
+	return s_bKeyValuesIndexEnabled && s_nKeyValuesIndexScopes > 0;
+}
+
+// Renaming a node or relinking it through SetNextKey() can't tell its parent;
+// bumping this makes every index rebuild itself on next use instead
+static int s_nKeyValuesGeneration = 0;
+
+static inline unsigned int HashKeySymbol( int keySymbol )
+{
+	unsigned int hash = (unsigned int)keySymbol * 0x9E3779B1;
+	return hash ^ ( hash >> 16 );
+}
+
+//-----------------------------------------------------------------------------
+// Binary cache image: header, name table offsets, nodes, string data.
+// Nodes are in pre-order: each top level key, then its children, each of
+// them followed by their own children.
+//-----------------------------------------------------------------------------
+#define KEYVALUES_CACHE_ID			(('1'<<24)+('C'<<16)+('V'<<8)+'K')
+#define KEYVALUES_CACHE_VERSION		1
+#define KEYVALUES_CACHE_EXTENSION	".kvc"
+
+struct KeyValuesCacheHeader_t
+{
+	int				id;
+	int				version;
+	unsigned int	sourceCRC;		// of the text the keys were parsed from
+	int				sourceSize;
+	int				numNames;
+	int				numNodes;
+	int				numTopLevel;
+	int				stringDataSize;
+};
+
+struct KeyValuesCacheNode_t
+{
+	int		name;			// index into the name table
+	int		value;			// offset into the string data, -1 for none
+	int		type;			// KeyValues::types_t
+	int		numChildren;
+	union
+	{
+		int		iValue;
+		float	flValue;
+	};
+};
+
+static bool KeySymbolLessFunc( const int &lhs, const int &rhs )
+{
+	return lhs < rhs;
+}
+
+struct KeyValuesCacheBuilder_t
+{
+	KeyValuesCacheBuilder_t() : names( 0, 0, KeySymbolLessFunc ), strings( 1024, 0, false )
+	{
+	}
+
+	int AddString( const char *pString )
+	{
+		int offset = strings.TellPut();
+		strings.Put( pString, Q_strlen( pString ) + 1 );
+		return offset;
+	}
+
+	int AddName( int keySymbol )
+	{
+		int i = names.Find( keySymbol );
+		if ( i != names.InvalidIndex() )
+			return names[i];
+
+		int name = nameOffsets.AddToTail( AddString( KeyValuesSystem()->GetStringForSymbol( keySymbol ) ) );
+		names.Insert( keySymbol, name );
+		return name;
+	}
+
+	CUtlMap< int, int, int >			names;		// key symbol -> name table index
+	CUtlVector< int >					nameOffsets;
+	CUtlVector< KeyValuesCacheNode_t >	nodes;
+	CUtlBuffer							strings;
+};
+
+struct KeyValuesCacheReader_t
+{
+	const KeyValuesCacheNode_t	*pNodes;
+	const char					*pStrings;
+	CUtlVector< int >			symbols;	// name table index -> key symbol
+	int							iNode;		// next node to read
+};
+
+// Off by default: with no .kvc files around, every load would pay for a CRC
+// and a failed open. Each module turns them on through its own ConVar.
+static bool s_bReadBinaryCache = false;
+static bool s_bWriteBinaryCache = false;
+
+//-----------------------------------------------------------------------------
+// Arena: a chain of large blocks that keys and strings are carved out of
+// front to back. Nothing is given back until the root goes away.
+//-----------------------------------------------------------------------------
+#define KEYVALUES_ARENA_BLOCK_SIZE	( 16 * 1024 )
+#define KEYVALUES_ARENA_ALIGN		8
+
+struct KeyValuesArenaBlock_t
+{
+	KeyValuesArenaBlock_t	*pNext;
+	int						nSize;		// bytes of data in the block
+	int						nUsed;
+};
+
+#define KEYVALUES_ARENA_HEADER_SIZE	( ( sizeof( KeyValuesArenaBlock_t ) + KEYVALUES_ARENA_ALIGN - 1 ) & ~( KEYVALUES_ARENA_ALIGN - 1 ) )
+
+struct KeyValuesArena_t
+{
+	const KeyValues			*pOwner;	// the root, which itself isn't in the arena
+	KeyValuesArenaBlock_t	*pBlocks;	// the one being filled is first
+	int						nBlockSize;
+};
+
+static KeyValuesAllocStats_t s_KeyValuesAllocStats;
+
+// Arenas are tracked here rather than in the keys, which keep the layout other
+// modules see. Arena trees are for parsing files this module reads and throws
+// away; nothing in one may be handed to another module, whose deleteThis would
+// give the keys back to the KeyValuesSystem pool.
+static CUtlVector< KeyValuesArena_t * > s_KeyValuesArenas;
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the arena a key is the root of, or was carved out of
+//-----------------------------------------------------------------------------
+static KeyValuesArena_t *FindArena( const KeyValues *pKey )
+{
+	for ( int i = s_KeyValuesArenas.Count(); --i >= 0; )
+	{
+		KeyValuesArena_t *pArena = s_KeyValuesArenas[i];
+		if ( pArena->pOwner == pKey )
+			return pArena;
+
+		for ( KeyValuesArenaBlock_t *pBlock = pArena->pBlocks; pBlock != NULL; pBlock = pBlock->pNext )
+		{
+			const char *pData = (const char *)pBlock + KEYVALUES_ARENA_HEADER_SIZE;
+			if ( (const char *)pKey >= pData && (const char *)pKey < pData + pBlock->nUsed )
+				return pArena;
+		}
+	}
+
+	return NULL;
+}
+
+static void *ArenaAlloc( KeyValuesArena_t *pArena, int nSize )
+{
+	nSize = ( nSize + KEYVALUES_ARENA_ALIGN - 1 ) & ~( KEYVALUES_ARENA_ALIGN - 1 );
+
+	KeyValuesArenaBlock_t *pBlock = pArena->pBlocks;
+	if ( !pBlock || pBlock->nUsed + nSize > pBlock->nSize )
+	{
+		// Anything too big to share a block gets one to itself, behind the
+		// block being filled so the space left in that isn't wasted
+		bool bDedicated = nSize > pArena->nBlockSize / 4;
+		int nBlockSize = bDedicated ? nSize : pArena->nBlockSize;
+
+		KeyValuesArenaBlock_t *pNew = (KeyValuesArenaBlock_t *)new char[KEYVALUES_ARENA_HEADER_SIZE + nBlockSize];
+		pNew->nSize = nBlockSize;
+		pNew->nUsed = 0;
+		if ( bDedicated && pBlock )
+		{
+			pNew->pNext = pBlock->pNext;
+			pBlock->pNext = pNew;
+		}
+		else
+		{
+			pNew->pNext = pBlock;
+			pArena->pBlocks = pNew;
+		}
+
+		s_KeyValuesAllocStats.nArenaBlocks++;
+		s_KeyValuesAllocStats.nArenaBytesReserved += nBlockSize;
+		pBlock = pNew;
+	}
+
+	void *pMem = (char *)pBlock + KEYVALUES_ARENA_HEADER_SIZE + pBlock->nUsed;
+	pBlock->nUsed += nSize;
+	s_KeyValuesAllocStats.nArenaBytesUsed += nSize;
+	return pMem;
+}
+
+static void ArenaFreeBlocks( KeyValuesArena_t *pArena )
+{
+	KeyValuesArenaBlock_t *pNext;
+	for ( KeyValuesArenaBlock_t *pBlock = pArena->pBlocks; pBlock != NULL; pBlock = pNext )
+	{
+		pNext = pBlock->pNext;
+
+		s_KeyValuesAllocStats.nArenaBlocks--;
+		s_KeyValuesAllocStats.nArenaBytesReserved -= pBlock->nSize;
+		s_KeyValuesAllocStats.nArenaBytesUsed -= pBlock->nUsed;
+		delete [] (char *)pBlock;
+	}
+
+	pArena->pBlocks = NULL;
+}
+
+static CRC32_t KeyValuesSourceCRC( const char *pBuffer, int nSize, bool bEscapeSequences )
+{
+	CRC32_t crc;
+	CRC32_Init( &crc );
+	CRC32_ProcessBuffer( &crc, (void *)pBuffer, nSize );
+
+	// the same text parses differently with escape sequences on
+	unsigned char escape = bEscapeSequences ? 1 : 0;
+	CRC32_ProcessBuffer( &crc, &escape, sizeof(escape) );
+	CRC32_Final( &crc );
+	return crc;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Constructor
 //-----------------------------------------------------------------------------
@@ -90,6 +403,16 @@ KeyValues::KeyValues( const char *setName, const char *firstKey, int firstValue,
 	SetInt( secondKey, secondValue );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Constructor for keys whose name has already been turned into a symbol
+//-----------------------------------------------------------------------------
+KeyValues::KeyValues( int keySymbol, bool bUsesEscapeSequences )
+{
+	Init();
+	m_iKeyName = keySymbol;
+	m_bHasEscapeSequences = bUsesEscapeSequences;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Initialize member variables
 //-----------------------------------------------------------------------------
@@ -107,6 +430,10 @@ void KeyValues::Init()
 	m_pValue = NULL;
 	
 	m_bHasEscapeSequences = false;
+
+	// drops our index and conversions, including any left at this address
+	// by a key another module deleted
+	FreeSideData( this );
 }
 
 //-----------------------------------------------------------------------------
@@ -115,6 +442,15 @@ void KeyValues::Init()
 KeyValues::~KeyValues()
 {
 	RemoveEverything();
+
+	KeyValuesArena_t *pArena = FindArena( this );
+	if ( pArena && pArena->pOwner == this )
+	{
+		// RemoveEverything() has already let go of the blocks
+		s_KeyValuesArenas.FindAndRemove( pArena );
+		delete pArena;
+		s_KeyValuesAllocStats.nArenas--;
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -128,19 +464,113 @@ void KeyValues::RemoveEverything()
 	{
 		datNext = dat->m_pPeer;
 		dat->m_pPeer = NULL;
-		delete dat;
+		DestroyKey( dat );
 	}
 
 	for ( dat = m_pPeer; dat && dat != this; dat = datNext )
 	{
 		datNext = dat->m_pPeer;
 		dat->m_pPeer = NULL;
-		delete dat;
+		DestroyKey( dat );
+	}
+
+	// An arena root's tree is all gone now, so its memory can go too. Keys
+	// in an arena stay in it: their own memory came from there.
+	KeyValuesArena_t *pArena = FindArena( this );
+	if ( pArena && pArena->pOwner == this )
+	{
+		ArenaFreeBlocks( pArena );
 	}
 
 	Init();	// reset all values
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Deletes a key; arena keys are only destructed, since their memory
+//			goes back when the arena does
+//-----------------------------------------------------------------------------
+void KeyValues::DestroyKey( KeyValues *dat )
+{
+	KeyValuesArena_t *pArena = FindArena( dat );
+	if ( pArena && pArena->pOwner != dat )
+	{
+		dat->~KeyValues();
+	}
+	else
+	{
+		delete dat;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Makes this key an arena root
+//-----------------------------------------------------------------------------
+void KeyValues::UseArenaAllocator( int nBlockSize )
+{
+	// anything already allocated would be freed the wrong way
+	bool bInArena = FindArena( this ) != NULL;
+	Assert( !m_pSub && !m_sValue && !m_wsValue && !bInArena );
+	if ( m_pSub || m_sValue || m_wsValue || bInArena )
+		return;
+
+	KeyValuesArena_t *pArena = new KeyValuesArena_t;
+	pArena->pOwner = this;
+	pArena->pBlocks = NULL;
+	pArena->nBlockSize = nBlockSize > 0 ? nBlockSize : KEYVALUES_ARENA_BLOCK_SIZE;
+	s_KeyValuesArenas.AddToTail( pArena );
+	s_KeyValuesAllocStats.nArenas++;
+}
+
+const KeyValuesAllocStats_t &KeyValues::GetAllocStats()
+{
+	return s_KeyValuesAllocStats;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Value strings, from the arena if the key is in one
+//-----------------------------------------------------------------------------
+char *KeyValues::AllocString( int nChars )
+{
+	KeyValuesArena_t *pArena = FindArena( this );
+	if ( pArena )
+	{
+		s_KeyValuesAllocStats.nArenaStrings++;
+		return (char *)ArenaAlloc( pArena, nChars );
+	}
+
+	s_KeyValuesAllocStats.nHeapStrings++;
+	return new char[nChars];
+}
+
+wchar_t *KeyValues::AllocWString( int nChars )
+{
+	KeyValuesArena_t *pArena = FindArena( this );
+	if ( pArena )
+	{
+		s_KeyValuesAllocStats.nArenaStrings++;
+		return (wchar_t *)ArenaAlloc( pArena, nChars * sizeof( wchar_t ) );
+	}
+
+	s_KeyValuesAllocStats.nHeapStrings++;
+	return new wchar_t[nChars];
+}
+
+void KeyValues::FreeString( char *pString )
+{
+	if ( pString && !FindArena( this ) )
+	{
+		delete [] pString;
+	}
+}
+
+void KeyValues::FreeWString( wchar_t *pString )
+{
+	if ( pString && !FindArena( this ) )
+	{
+		delete [] pString;
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : *f - 
@@ -396,7 +826,33 @@ bool KeyValues::LoadFromFile( IBaseFileSystem *filesystem, const char *resourceN
 
 	filesystem->Close( f );	// close file after reading
 
-	bool retOK = LoadFromBuffer( resourceName, buffer, filesystem );
+	// #include'd files would need their own CRCs, so those are always parsed
+	bool bUseCache = ( s_bReadBinaryCache || s_bWriteBinaryCache ) && !Q_strstr( buffer, "#include" );
+	bool bWasEmpty = !m_pSub && !m_pPeer && m_iDataType == TYPE_NONE;
+
+	CRC32_t crc = 0;
+	char szCacheName[ 512 ];
+	if ( bUseCache )
+	{
+		crc = KeyValuesSourceCRC( buffer, fileSize, m_bHasEscapeSequences );
+		Q_snprintf( szCacheName, sizeof( szCacheName ), "%s%s", resourceName, KEYVALUES_CACHE_EXTENSION );
+	}
+
+	bool retOK;
+	if ( bUseCache && s_bReadBinaryCache && LoadBinaryCache( filesystem, szCacheName, pathID, crc, fileSize ) )
+	{
+		retOK = true;
+	}
+	else
+	{
+		retOK = LoadFromBuffer( resourceName, buffer, filesystem );
+
+		// only cache what came from this file alone
+		if ( retOK && bUseCache && s_bWriteBinaryCache && bWasEmpty )
+		{
+			WriteBinaryCache( filesystem, szCacheName, pathID, crc, fileSize );
+		}
+	}
 
 	MemFreeScratch();
 
@@ -455,6 +911,311 @@ bool KeyValues::SaveToFile( IBaseFileSystem *filesystem, const char *resourceNam
 	return true;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Turns the binary cache on or off for LoadFromFile()
+//-----------------------------------------------------------------------------
+void KeyValues::SetBinaryCacheMode( bool bRead, bool bWrite )
+{
+	s_bReadBinaryCache = bRead;
+	s_bWriteBinaryCache = bWrite;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads a binary cache file in one go and loads it if it's current
+//-----------------------------------------------------------------------------
+bool KeyValues::LoadBinaryCache( IBaseFileSystem *filesystem, const char *cacheName, const char *pathID, CRC32_t sourceCRC, int nSourceSize )
+{
+	FileHandle_t f = filesystem->Open( cacheName, "rb", pathID );
+	if ( !f )
+		return false;
+
+	int nSize = filesystem->Size( f );
+	if ( nSize < (int)sizeof( KeyValuesCacheHeader_t ) )
+	{
+		filesystem->Close( f );
+		return false;
+	}
+
+	// check the header before pulling the rest in
+	KeyValuesCacheHeader_t header;
+	bool bCurrent = filesystem->Read( &header, sizeof( header ), f ) == (int)sizeof( header ) &&
+		header.id == KEYVALUES_CACHE_ID && header.version == KEYVALUES_CACHE_VERSION &&
+		header.sourceCRC == sourceCRC && header.sourceSize == nSourceSize;
+
+	bool retOK = false;
+	if ( bCurrent )
+	{
+		char *pCache = new char[nSize];
+		Q_memcpy( pCache, &header, sizeof( header ) );
+
+		int nRemaining = nSize - sizeof( header );
+		if ( filesystem->Read( pCache + sizeof( header ), nRemaining, f ) == nRemaining )
+		{
+			retOK = LoadFromBinaryBuffer( cacheName, pCache, nSize, sourceCRC, nSourceSize );
+		}
+
+		delete [] pCache;
+	}
+
+	filesystem->Close( f );
+	return retOK;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes the binary cache for a file that's just been parsed
+//-----------------------------------------------------------------------------
+void KeyValues::WriteBinaryCache( IBaseFileSystem *filesystem, const char *cacheName, const char *pathID, CRC32_t sourceCRC, int nSourceSize )
+{
+	CUtlBuffer buf( 0, 0, false );
+	if ( !SaveToBinaryBuffer( buf, sourceCRC, nSourceSize ) )
+		return;
+
+	// the cache is an optimization, so a read-only path isn't an error
+	FileHandle_t f = filesystem->Open( cacheName, "wb", pathID );
+	if ( !f )
+		return;
+
+	filesystem->Write( buf.Base(), buf.TellPut(), f );
+	filesystem->Close( f );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Builds the binary image of this key and its peers
+//-----------------------------------------------------------------------------
+bool KeyValues::SaveToBinaryBuffer( CUtlBuffer &buf, CRC32_t sourceCRC, int nSourceSize )
+{
+	KeyValuesCacheBuilder_t builder;
+
+	int numTopLevel = 0;
+	for ( KeyValues *dat = this; dat != NULL; dat = dat->m_pPeer )
+	{
+		if ( !dat->RecursiveSaveToBinary( builder ) )
+			return false;
+
+		numTopLevel++;
+	}
+
+	KeyValuesCacheHeader_t header;
+	header.id = KEYVALUES_CACHE_ID;
+	header.version = KEYVALUES_CACHE_VERSION;
+	header.sourceCRC = sourceCRC;
+	header.sourceSize = nSourceSize;
+	header.numNames = builder.nameOffsets.Count();
+	header.numNodes = builder.nodes.Count();
+	header.numTopLevel = numTopLevel;
+	header.stringDataSize = builder.strings.TellPut();
+
+	buf.Put( &header, sizeof( header ) );
+	if ( header.numNames )
+	{
+		buf.Put( builder.nameOffsets.Base(), header.numNames * sizeof( int ) );
+	}
+	buf.Put( builder.nodes.Base(), header.numNodes * sizeof( KeyValuesCacheNode_t ) );
+	buf.Put( builder.strings.Base(), header.stringDataSize );
+	return true;
+}
+
+bool KeyValues::RecursiveSaveToBinary( KeyValuesCacheBuilder_t &builder )
+{
+	int iNode = builder.nodes.AddToTail();
+	KeyValuesCacheNode_t *pNode = &builder.nodes[iNode];
+	pNode->name = builder.AddName( m_iKeyName );
+	pNode->value = -1;
+	pNode->type = m_iDataType;
+	pNode->numChildren = 0;
+	pNode->iValue = 0;
+
+	switch ( m_iDataType )
+	{
+	case TYPE_NONE:
+		break;
+	case TYPE_INT:
+		pNode->iValue = m_iValue;
+		break;
+	case TYPE_FLOAT:
+		pNode->flValue = m_flValue;
+		break;
+	case TYPE_STRING:
+		break;
+	default:
+		// pointers and colors don't come out of text, and wide strings never stay wide
+		return false;
+	}
+
+	// the parser keeps the text of numbers too
+	if ( m_sValue )
+	{
+		int value = builder.AddString( m_sValue );
+		builder.nodes[iNode].value = value;
+	}
+
+	int numChildren = 0;
+	for ( KeyValues *dat = m_pSub; dat != NULL; dat = dat->m_pPeer )
+	{
+		if ( !dat->RecursiveSaveToBinary( builder ) )
+			return false;
+
+		numChildren++;
+	}
+
+	// AddToTail may have moved the array
+	builder.nodes[iNode].numChildren = numChildren;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Loads keys from a binary image, exactly as LoadFromBuffer() would
+//			have from the text it was made from. The whole image is checked
+//			before anything is created, so a bad one changes nothing.
+//-----------------------------------------------------------------------------
+bool KeyValues::LoadFromBinaryBuffer( char const *resourceName, const void *pBuffer, int nSize, CRC32_t sourceCRC, int nSourceSize )
+{
+	if ( nSize < (int)sizeof( KeyValuesCacheHeader_t ) )
+		return false;
+
+	const KeyValuesCacheHeader_t *pHeader = (const KeyValuesCacheHeader_t *)pBuffer;
+	if ( pHeader->id != KEYVALUES_CACHE_ID || pHeader->version != KEYVALUES_CACHE_VERSION ||
+		pHeader->sourceCRC != sourceCRC || pHeader->sourceSize != nSourceSize )
+	{
+		return false;
+	}
+
+	if ( pHeader->numNames < 0 || pHeader->numNodes <= 0 || pHeader->numTopLevel <= 0 || pHeader->stringDataSize <= 0 )
+		return false;
+
+	if ( nSize != (int)( sizeof( KeyValuesCacheHeader_t ) + pHeader->numNames * sizeof( int ) + 
+		pHeader->numNodes * sizeof( KeyValuesCacheNode_t ) ) + pHeader->stringDataSize )
+	{
+		DevMsg( "KeyValues::LoadFromBinaryBuffer: %s is truncated\n", resourceName );
+		return false;
+	}
+
+	const int *pNameOffsets = (const int *)( pHeader + 1 );
+	const KeyValuesCacheNode_t *pNodes = (const KeyValuesCacheNode_t *)( pNameOffsets + pHeader->numNames );
+	const char *pStrings = (const char *)( pNodes + pHeader->numNodes );
+
+	// every string has to end inside the string data
+	if ( pStrings[pHeader->stringDataSize - 1] != 0 )
+		return false;
+
+	int i;
+	for ( i = 0; i < pHeader->numNames; i++ )
+	{
+		if ( pNameOffsets[i] < 0 || pNameOffsets[i] >= pHeader->stringDataSize )
+			return false;
+	}
+
+	// the child counts have to describe exactly numNodes nodes under numTopLevel roots
+	int nPending = pHeader->numTopLevel;
+	for ( i = 0; i < pHeader->numNodes; i++ )
+	{
+		const KeyValuesCacheNode_t *pNode = &pNodes[i];
+		if ( nPending <= 0 || pNode->numChildren < 0 )
+			return false;
+
+		if ( pNode->name < 0 || pNode->name >= pHeader->numNames )
+			return false;
+
+		if ( pNode->value < -1 || pNode->value >= pHeader->stringDataSize )
+			return false;
+
+		if ( pNode->type != TYPE_NONE && pNode->type != TYPE_STRING && 
+			pNode->type != TYPE_INT && pNode->type != TYPE_FLOAT )
+		{
+			return false;
+		}
+
+		nPending += pNode->numChildren - 1;
+	}
+
+	if ( nPending != 0 )
+	{
+		DevMsg( "KeyValues::LoadFromBinaryBuffer: %s has a bad node list\n", resourceName );
+		return false;
+	}
+
+	// one symbol lookup per distinct name instead of one per key
+	KeyValuesCacheReader_t reader;
+	reader.pNodes = pNodes;
+	reader.pStrings = pStrings;
+	reader.iNode = 0;
+	reader.symbols.EnsureCapacity( pHeader->numNames );
+	for ( i = 0; i < pHeader->numNames; i++ )
+	{
+		reader.symbols.AddToTail( KeyValuesSystem()->GetSymbolForString( pStrings + pNameOffsets[i] ) );
+	}
+
+	// same shape LoadFromBuffer() builds: the first key is us, the rest become our peers
+	KeyValues *pPreviousKey = NULL;
+	for ( i = 0; i < pHeader->numTopLevel; i++ )
+	{
+		KeyValues *pCurrentKey = this;
+		int name = reader.symbols[ pNodes[reader.iNode].name ];
+		if ( pPreviousKey )
+		{
+			pCurrentKey = new KeyValues( name, m_bHasEscapeSequences );
+			pPreviousKey->m_pPeer = pCurrentKey;
+		}
+		else
+		{
+			m_iKeyName = name;
+		}
+
+		pCurrentKey->RecursiveLoadFromBinary( reader );
+		pPreviousKey = pCurrentKey;
+	}
+
+	return true;
+}
+
+void KeyValues::RecursiveLoadFromBinary( KeyValuesCacheReader_t &reader )
+{
+	const KeyValuesCacheNode_t *pNode = &reader.pNodes[reader.iNode++];
+
+	if ( pNode->value != -1 )
+	{
+		FreeString( m_sValue );
+
+		const char *value = reader.pStrings + pNode->value;
+		int len = Q_strlen( value );
+		m_sValue = AllocString( len+1 );
+		Q_memcpy( m_sValue, value, len+1 );
+	}
+
+	if ( pNode->type != TYPE_NONE )
+	{
+		m_iDataType = (types_t)pNode->type;
+		m_iValue = pNode->iValue;
+	}
+
+	if ( !pNode->numChildren )
+		return;
+
+	// append after whatever we already had, as the parser does
+	KeyValues *pTail = m_pSub;
+	while ( pTail && pTail->m_pPeer )
+	{
+		pTail = pTail->m_pPeer;
+	}
+
+	for ( int i = 0; i < pNode->numChildren; i++ )
+	{
+		KeyValues *dat = NewSubKey( reader.symbols[ reader.pNodes[reader.iNode].name ] );
+		dat->m_bHasEscapeSequences = m_bHasEscapeSequences;
+		if ( pTail )
+		{
+			pTail->m_pPeer = dat;
+		}
+		else
+		{
+			m_pSub = dat;
+		}
+		pTail = dat;
+
+		dat->RecursiveLoadFromBinary( reader );
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Write out a set of indenting
 //-----------------------------------------------------------------------------
@@ -617,10 +1378,15 @@ void KeyValues::RecursiveSaveToFile( IBaseFileSystem *filesystem, FileHandle_t f
 //-----------------------------------------------------------------------------
 KeyValues *KeyValues::FindKey(int keySymbol)
 {
+	// short lists are walked; the index takes over for long ones
+	int nWalked = 0;
 	for (KeyValues *dat = m_pSub; dat != NULL; dat = dat->m_pPeer)
 	{
 		if (dat->m_iKeyName == keySymbol)
 			return dat;
+
+		if ( ++nWalked >= KEYVALUES_INDEX_THRESHOLD && UseChildIndex() )
+			return FindIndexedChild( keySymbol, NULL );
 	}
 
 	return NULL;
@@ -656,7 +1422,9 @@ KeyValues *KeyValues::FindKey(const char *keyName, bool bCreate)
 
 	KeyValues *lastItem = NULL;
 	KeyValues *dat;
+	KeyValuesIndex_t *pIndex = NULL;
 	// find the searchStr in the current peer list
+	int nWalked = 0;
 	for (dat = m_pSub; dat != NULL; dat = dat->m_pPeer)
 	{
 		lastItem = dat;	// record the last item looked at (for if we need to append to the end of the list)
@@ -666,6 +1434,15 @@ KeyValues *KeyValues::FindKey(const char *keyName, bool bCreate)
 		{
 			break;
 		}
+
+		if ( ++nWalked >= KEYVALUES_INDEX_THRESHOLD && UseChildIndex() )
+		{
+			// long list; the index also knows where it ends
+			pIndex = GetChildIndex();
+			dat = FindIndexedChild( iSearchStr, pIndex );
+			lastItem = pIndex->pTail;
+			break;
+		}
 	}
 
 	if ( !dat && m_pChain )
@@ -679,7 +1456,7 @@ KeyValues *KeyValues::FindKey(const char *keyName, bool bCreate)
 		if (bCreate)
 		{
 			// we need to create a new key
-			dat = new KeyValues( searchStr );
+			dat = NewSubKey( iSearchStr );
 //			Assert(dat != NULL);
 
 			// insert new key at end of list
@@ -693,6 +1470,11 @@ KeyValues *KeyValues::FindKey(const char *keyName, bool bCreate)
 			}
 			dat->m_pPeer = NULL;
 
+			if ( pIndex )
+			{
+				IndexAppendedChild( pIndex, dat );
+			}
+
 			// a key graduates to be a submsg as soon as it's m_pSub is set
 			// this should be the only place m_pSub is set
 			m_iDataType = TYPE_NONE;
@@ -746,7 +1528,7 @@ KeyValues *KeyValues::CreateNewKey()
 KeyValues* KeyValues::CreateKey( const char *keyName )
 {
 	// key wasn't found so just create a new one
-	KeyValues* dat = new KeyValues( keyName );
+	KeyValues* dat = NewSubKey( KeyValuesSystem()->GetSymbolForString( keyName ) );
 
 	dat->UsesEscapeSequences( m_bHasEscapeSequences ); // use same format as parent does
 	
@@ -757,18 +1539,204 @@ KeyValues* KeyValues::CreateKey( const char *keyName )
 	}
 	else
 	{
+		// parsing a big section appends to it over and over, so past a
+		// short walk the index supplies the end of the list
+		KeyValuesIndex_t *pIndex = NULL;
+		int nWalked = 1;
 		KeyValues *pTempDat = m_pSub;
-		while ( pTempDat->GetNextKey() != NULL )
+		while ( pTempDat->m_pPeer != NULL )
 		{
-			pTempDat = pTempDat->GetNextKey();
+			if ( nWalked >= KEYVALUES_INDEX_THRESHOLD && UseChildIndex() )
+			{
+				pIndex = GetChildIndex();
+				pTempDat = pIndex->pTail;
+				break;
+			}
+
+			pTempDat = pTempDat->m_pPeer;
+			nWalked++;
 		}
 
-		pTempDat->SetNextKey( dat );
+		pTempDat->m_pPeer = dat;
+
+		if ( pIndex )
+		{
+			IndexAppendedChild( pIndex, dat );
+		}
 	}
 
 	return dat;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Returns the index of our children, (re)building it if the list
+//			changed behind its back
+//-----------------------------------------------------------------------------
+KeyValuesIndex_t *KeyValues::GetChildIndex()
+{
+	KeyValuesSideData_t *pData = FindSideData( this, true );
+	KeyValuesIndex_t *pIndex = pData->pIndex;
+	if ( !pIndex )
+	{
+		pIndex = pData->pIndex = new KeyValuesIndex_t;
+		pIndex->nMask = -1;
+		pIndex->ppSlots = NULL;
+		BuildChildIndex( pIndex );
+		s_KeyValuesIndexed.AddToTail( this );
+	}
+	else if ( pIndex->nGeneration != s_nKeyValuesGeneration || pIndex->pFirst != m_pSub ||
+		!pIndex->pTail || pIndex->pTail->m_pPeer )
+	{
+		// relinked, renamed, or something was linked on past the tail directly
+		BuildChildIndex( pIndex );
+	}
+
+	return pIndex;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Looks up a child through the index
+//-----------------------------------------------------------------------------
+KeyValues *KeyValues::FindIndexedChild( int keySymbol, KeyValuesIndex_t *pIndex )
+{
+	if ( !pIndex )
+	{
+		pIndex = GetChildIndex();
+	}
+
+	unsigned int slot = HashKeySymbol( keySymbol ) & pIndex->nMask;
+	KeyValues *dat;
+	while ( ( dat = pIndex->ppSlots[slot] ) != NULL )
+	{
+		if ( dat->m_iKeyName == keySymbol )
+			return dat;
+
+		slot = ( slot + 1 ) & pIndex->nMask;
+	}
+
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: (Re)builds the index from the child list
+//-----------------------------------------------------------------------------
+void KeyValues::BuildChildIndex( KeyValuesIndex_t *pIndex )
+{
+	int nChildren = 0;
+	KeyValues *dat;
+	for ( dat = m_pSub; dat != NULL; dat = dat->m_pPeer )
+	{
+		nChildren++;
+	}
+
+	// keep the table at most half full
+	int nSize = KEYVALUES_INDEX_MIN_SIZE;
+	while ( nSize < nChildren * 2 )
+	{
+		nSize <<= 1;
+	}
+
+	if ( pIndex->nMask + 1 != nSize )
+	{
+		delete [] pIndex->ppSlots;
+		pIndex->ppSlots = new KeyValues *[nSize];
+		pIndex->nMask = nSize - 1;
+	}
+
+	Q_memset( pIndex->ppSlots, 0, nSize * sizeof(KeyValues *) );
+	pIndex->nCount = 0;
+	pIndex->nGeneration = s_nKeyValuesGeneration;
+	pIndex->pFirst = m_pSub;
+	pIndex->pTail = NULL;
+
+	for ( dat = m_pSub; dat != NULL; dat = dat->m_pPeer )
+	{
+		IndexAppendedChild( pIndex, dat );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Adds a child that has just been linked onto the end of the list
+//-----------------------------------------------------------------------------
+void KeyValues::IndexAppendedChild( KeyValuesIndex_t *pIndex, KeyValues *pChild )
+{
+	pIndex->pTail = pChild;
+
+	if ( ( pIndex->nCount + 1 ) * 2 > pIndex->nMask + 1 )
+	{
+		// the child is already in the list, so a rebuild picks it up
+		BuildChildIndex( pIndex );
+		return;
+	}
+
+	unsigned int slot = HashKeySymbol( pChild->m_iKeyName ) & pIndex->nMask;
+	KeyValues *dat;
+	while ( ( dat = pIndex->ppSlots[slot] ) != NULL )
+	{
+		// an earlier child with this name shadows it
+		if ( dat->m_iKeyName == pChild->m_iKeyName )
+			return;
+
+		slot = ( slot + 1 ) & pIndex->nMask;
+	}
+
+	pIndex->ppSlots[slot] = pChild;
+	pIndex->nCount++;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Child indexes are only built and used between these; the last
+//			End drops every index built since the first Begin
+//-----------------------------------------------------------------------------
+void KeyValues::BeginChildIndexScope()
+{
+	s_nKeyValuesIndexScopes++;
+}
+
+void KeyValues::EndChildIndexScope()
+{
+	Assert( s_nKeyValuesIndexScopes > 0 );
+	if ( --s_nKeyValuesIndexScopes > 0 )
+		return;
+
+	KeyValuesSideTable_t &table = KeyValuesSideTable();
+	for ( int i = 0; i < s_KeyValuesIndexed.Count(); i++ )
+	{
+		// keys freed in the meantime took their entry with them
+		int iData = table.Find( s_KeyValuesIndexed[i] );
+		if ( iData == table.InvalidIndex() )
+			continue;
+
+		KeyValuesSideData_t &data = table[iData];
+		if ( data.pIndex )
+		{
+			delete [] data.pIndex->ppSlots;
+			delete data.pIndex;
+			data.pIndex = NULL;
+		}
+
+		if ( !data.pString && !data.pWString )
+		{
+			table.RemoveAt( iData );
+		}
+	}
+
+	s_KeyValuesIndexed.RemoveAll();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Turns the child index on or off for every node
+//-----------------------------------------------------------------------------
+void KeyValues::EnableChildIndex( bool bEnable )
+{
+	s_bKeyValuesIndexEnabled = bEnable;
+}
+
+bool KeyValues::IsChildIndexEnabled()
+{
+	return s_bKeyValuesIndexEnabled;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Remove a subkey from the list
 //-----------------------------------------------------------------------------
@@ -799,6 +1767,9 @@ void KeyValues::RemoveSubKey(KeyValues *subKey)
 	}
 
 	subKey->m_pPeer = NULL;
+
+	// cheaper to rebuild the index later than to unpick the shadowed names now
+	FreeSideData( this );
 }
 
 
@@ -825,6 +1796,9 @@ KeyValues *KeyValues::GetNextKey()
 void KeyValues::SetNextKey( KeyValues *pDat )
 {
 	m_pPeer = pDat;
+
+	// our parent's index, if it has one, may no longer match its list
+	s_nKeyValuesGeneration++;
 }
 
 KeyValues* KeyValues::GetFirstTrueSubKey()
@@ -932,27 +1906,41 @@ const char *KeyValues::GetString( const char *keyName, const char *defaultValue
 	KeyValues *dat = FindKey( keyName, false );
 	if ( dat )
 	{
-		// convert the data to string form then return it
+		// convert the data to string form then return it; the conversion is
+		// kept aside so the key keeps its type
+		const char *pValue = dat->m_sValue;
 		char buf[64];
 		switch ( dat->m_iDataType )
 		{
 		case TYPE_FLOAT:
-			Q_snprintf( buf, 64, "%f", dat->m_flValue );
-			SetString( keyName, buf );
+			pValue = dat->FindConvertedString();
+			if ( !pValue )
+			{
+				Q_snprintf( buf, 64, "%f", dat->m_flValue );
+				pValue = dat->CacheString( buf );
+			}
 			break;
 		case TYPE_INT:
 		case TYPE_PTR:
-			Q_snprintf( buf, 64, "%d", dat->m_iValue );
-			SetString( keyName, buf );
+			pValue = dat->FindConvertedString();
+			if ( !pValue )
+			{
+				Q_snprintf( buf, 64, "%d", dat->m_iValue );
+				pValue = dat->CacheString( buf );
+			}
 			break;
 		case TYPE_WSTRING:
 		{
-			// convert the string to char *, set it for future use, and return it
+			pValue = dat->FindConvertedString();
+			if ( pValue )
+				break;
+
+			// convert the string to char *, keep it for future use, and return it
 			static char buf[512];
 			int result = ::WideCharToMultiByte(CP_UTF8, 0, dat->m_wsValue, -1, buf, 512, NULL, NULL);
 			if ( result )
 			{
-				SetString( keyName, buf );
+				pValue = dat->CacheString( buf );
 			}
 			else
 			{
@@ -966,7 +1954,7 @@ const char *KeyValues::GetString( const char *keyName, const char *defaultValue
 			return defaultValue;
 		};
 		
-		return dat->m_sValue;
+		return pValue;
 	}
 	return defaultValue;
 }
@@ -976,27 +1964,40 @@ const wchar_t *KeyValues::GetWString( const char *keyName, const wchar_t *defaul
 	KeyValues *dat = FindKey( keyName, false );
 	if ( dat )
 	{
+		const wchar_t *pValue = dat->m_wsValue;
 		wchar_t wbuf[64];
 		switch ( dat->m_iDataType )
 		{
 		case TYPE_FLOAT:
-			swprintf(wbuf, L"%f", dat->m_flValue);
-			SetWString( keyName, wbuf);
+			pValue = dat->FindConvertedWString();
+			if ( !pValue )
+			{
+				swprintf(wbuf, L"%f", dat->m_flValue);
+				pValue = dat->CacheWString( wbuf );
+			}
 			break;
 		case TYPE_INT:
 		case TYPE_PTR:
-			swprintf( wbuf, L"%d", dat->m_iValue );
-			SetWString( keyName, wbuf );
+			pValue = dat->FindConvertedWString();
+			if ( !pValue )
+			{
+				swprintf( wbuf, L"%d", dat->m_iValue );
+				pValue = dat->CacheWString( wbuf );
+			}
 			break;
 		case TYPE_WSTRING:
 			break;
 		case TYPE_STRING:
 		{
+			pValue = dat->FindConvertedWString();
+			if ( pValue )
+				break;
+
 			static wchar_t wbuftemp[512]; // convert to wide	
 			int result = ::MultiByteToWideChar(CP_UTF8, 0, dat->m_sValue, -1, wbuftemp, 512);
 			if ( result )
 			{
-				SetWString( keyName, wbuftemp);
+				pValue = dat->CacheWString( wbuftemp );
 			}
 			else
 			{
@@ -1008,11 +2009,86 @@ const wchar_t *KeyValues::GetWString( const char *keyName, const wchar_t *defaul
 			return defaultValue;
 		};
 		
-		return (const wchar_t* )dat->m_wsValue;
+		return pValue;
 	}
 	return defaultValue;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: What a converted value was made from: the string for string keys,
+//			the raw value for the rest
+//-----------------------------------------------------------------------------
+const void *KeyValues::GetConversionSource()
+{
+	switch ( m_iDataType )
+	{
+	case TYPE_STRING:
+		return m_sValue;
+	case TYPE_WSTRING:
+		return m_wsValue;
+	default:
+		return m_pValue;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the string form of a non-string value made by an earlier
+//			GetString(), if the value hasn't changed since
+//-----------------------------------------------------------------------------
+const char *KeyValues::FindConvertedString()
+{
+	KeyValuesSideData_t *pData = FindSideData( this, false );
+	if ( !pData || !pData->pString )
+		return NULL;
+
+	if ( pData->nStringType != m_iDataType || pData->pStringFrom != GetConversionSource() )
+		return NULL;
+
+	return pData->pString;
+}
+
+const wchar_t *KeyValues::FindConvertedWString()
+{
+	KeyValuesSideData_t *pData = FindSideData( this, false );
+	if ( !pData || !pData->pWString )
+		return NULL;
+
+	if ( pData->nWStringType != m_iDataType || pData->pWStringFrom != GetConversionSource() )
+		return NULL;
+
+	return pData->pWString;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Keeps the string form of a non-string value without changing the
+//			value or its type
+//-----------------------------------------------------------------------------
+const char *KeyValues::CacheString( const char *pValue )
+{
+	KeyValuesSideData_t *pData = FindSideData( this, true );
+	delete [] pData->pString;
+
+	int len = Q_strlen( pValue );
+	pData->pString = new char[len + 1];
+	Q_memcpy( pData->pString, pValue, len+1 );
+	pData->nStringType = m_iDataType;
+	pData->pStringFrom = GetConversionSource();
+	return pData->pString;
+}
+
+const wchar_t *KeyValues::CacheWString( const wchar_t *pValue )
+{
+	KeyValuesSideData_t *pData = FindSideData( this, true );
+	delete [] pData->pWString;
+
+	int len = wcslen( pValue );
+	pData->pWString = new wchar_t[len + 1];
+	Q_memcpy( pData->pWString, pValue, (len+1) * sizeof(wchar_t) );
+	pData->nWStringType = m_iDataType;
+	pData->pWStringFrom = GetConversionSource();
+	return pData->pWString;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Gets a color
 //-----------------------------------------------------------------------------
@@ -1078,11 +2154,15 @@ void KeyValues::SetString( const char *keyName, const char *value )
 	if ( dat )
 	{
 		// delete the old value
-		delete [] dat->m_sValue;
+		dat->FreeString( dat->m_sValue );
 		// make sure we're not storing the WSTRING  - as we're converting over to STRING
-		delete [] dat->m_wsValue;
+		dat->FreeWString( dat->m_wsValue );
 		dat->m_wsValue = NULL;
 
+		// a new string can land where the old one was, so a conversion of
+		// the old one can't be told apart by its pointer
+		FreeSideData( dat );
+
 		if (!value)
 		{
 			// ensure a valid value
@@ -1091,7 +2171,7 @@ void KeyValues::SetString( const char *keyName, const char *value )
 
 		// allocate memory for the new value and copy it in
 		int len = Q_strlen( value );
-		dat->m_sValue = new char[len + 1];
+		dat->m_sValue = dat->AllocString( len + 1 );
 		Q_memcpy( dat->m_sValue, value, len+1 );
 
 		dat->m_iDataType = TYPE_STRING;
@@ -1108,10 +2188,11 @@ void KeyValues::SetWString( const char *keyName, const wchar_t *value )
 	if ( dat )
 	{
 		// delete the old value
-		delete[] dat->m_wsValue;
+		dat->FreeWString( dat->m_wsValue );
 		// make sure we're not storing the STRING  - as we're converting over to WSTRING
-		delete [] dat->m_sValue;
+		dat->FreeString( dat->m_sValue );
 		dat->m_sValue = NULL;
+		FreeSideData( dat );
 
 		if (!value)
 		{
@@ -1121,7 +2202,7 @@ void KeyValues::SetWString( const char *keyName, const wchar_t *value )
 
 		// allocate memory for the new value and copy it in
 		int len = wcslen( value );
-		dat->m_wsValue = new wchar_t[len + 1];
+		dat->m_wsValue = dat->AllocWString( len + 1 );
 		Q_memcpy( dat->m_wsValue, value, (len+1) * sizeof(wchar_t) );
 
 		dat->m_iDataType = TYPE_WSTRING;
@@ -1158,6 +2239,12 @@ void KeyValues::SetFloat( const char *keyName, float value )
 
 void KeyValues::SetName( const char * setName )
 {
+	if ( m_iKeyName != INVALID_KEY_SYMBOL )
+	{
+		// renamed, so our parent's index may file us under the old name
+		s_nKeyValuesGeneration++;
+	}
+
 	m_iKeyName = KeyValuesSystem()->GetSymbolForString( setName );
 }
 
@@ -1192,20 +2279,20 @@ void KeyValues::RecursiveCopyKeyValues( KeyValues& src )
 		case TYPE_STRING:
 			if( src.m_sValue )
 			{
-				m_sValue = new char[Q_strlen(src.m_sValue) + 1];
+				m_sValue = AllocString( Q_strlen(src.m_sValue) + 1 );
 				Q_strcpy( m_sValue, src.m_sValue );
 			}
 			break;
 		case TYPE_INT:
 			m_iValue = src.m_iValue;
 			Q_snprintf( buf,sizeof(buf), "%d", m_iValue );
-			m_sValue = new char[strlen(buf) + 1];
+			m_sValue = AllocString( strlen(buf) + 1 );
 			Q_strcpy( m_sValue, buf );
 			break;
 		case TYPE_FLOAT:
 			m_flValue = src.m_flValue;
 			Q_snprintf( buf,sizeof(buf), "%f", m_flValue );
-			m_sValue = new char[strlen(buf) + 1];
+			m_sValue = AllocString( strlen(buf) + 1 );
 			Q_strcpy( m_sValue, buf );
 			break;
 		case TYPE_PTR:
@@ -1248,14 +2335,23 @@ void KeyValues::RecursiveCopyKeyValues( KeyValues& src )
 	// Handle the immediate child
 	if( src.m_pSub )
 	{
-		m_pSub = new KeyValues( NULL );
+		m_pSub = NewSubKey( src.m_pSub->m_iKeyName );
 		m_pSub->RecursiveCopyKeyValues( *src.m_pSub );
 	}
 
 	// Handle the immediate peer
 	if( src.m_pPeer )
 	{
-		m_pPeer = new KeyValues( NULL );
+		// peers share our arena, unless we're its root
+		KeyValuesArena_t *pArena = FindArena( this );
+		if ( pArena && pArena->pOwner != this )
+		{
+			m_pPeer = NewSubKey( src.m_pPeer->m_iKeyName );
+		}
+		else
+		{
+			m_pPeer = new KeyValues( src.m_pPeer->m_iKeyName, false );
+		}
 		m_pPeer->RecursiveCopyKeyValues( *src.m_pPeer );
 	}
 }
@@ -1284,7 +2380,7 @@ KeyValues *KeyValues::MakeCopy( void )
 			{
 				int len = Q_strlen( m_sValue );
 				Assert( !newKeyValue->m_sValue );
-				newKeyValue->m_sValue = new char[len + 1];
+				newKeyValue->m_sValue = newKeyValue->AllocString( len + 1 );
 				Q_memcpy( newKeyValue->m_sValue, m_sValue, len+1 );
 			}
 		}
@@ -1294,7 +2390,7 @@ KeyValues *KeyValues::MakeCopy( void )
 			if ( m_wsValue )
 			{
 				int len = wcslen( m_wsValue );
-				newKeyValue->m_wsValue = new wchar_t[len+1];
+				newKeyValue->m_wsValue = newKeyValue->AllocWString( len+1 );
 				Q_memcpy( newKeyValue->m_wsValue, m_wsValue, (len+1)*sizeof(wchar_t));
 			}
 		}
@@ -1366,8 +2462,12 @@ bool KeyValues::IsEmpty(const char *keyName)
 //-----------------------------------------------------------------------------
 void KeyValues::Clear( void )
 {
-	delete m_pSub;
+	if ( m_pSub )
+	{
+		DestroyKey( m_pSub );
+	}
 	m_pSub = NULL;
+	FreeSideData( this );
 	m_iDataType = TYPE_NONE;
 }
 
@@ -1388,7 +2488,7 @@ KeyValues::types_t KeyValues::GetDataType(const char *keyName)
 //-----------------------------------------------------------------------------
 void KeyValues::deleteThis()
 {
-	delete this;
+	DestroyKey( this );
 }
 
 //-----------------------------------------------------------------------------
@@ -1486,6 +2586,10 @@ bool KeyValues::LoadFromBuffer( char const *resourceName, const char *pBuffer, I
 	KeyValues *pCurrentKey = this;
 	CUtlVector< KeyValues * > includedKeys;
 	bool wasQuoted;
+
+	// big sections are appended to one key at a time; the index keeps
+	// finding the end of the list from being a walk each time
+	BeginChildIndexScope();
 	
 	while ( true )
 	{
@@ -1547,6 +2651,8 @@ bool KeyValues::LoadFromBuffer( char const *resourceName, const char *pBuffer, I
 
 	AppendIncludedKeys( includedKeys );
 
+	EndChildIndexScope();
+
 	return true;
 }
 
@@ -1611,11 +2717,11 @@ void KeyValues::RecursiveLoadFromBuffer( char const *resourceName, char **pfile
 		{
 			if (dat->m_sValue)
 			{
-				delete[] dat->m_sValue;
+				dat->FreeString( dat->m_sValue );
 			}
 
 			int len = Q_strlen( value );
-			dat->m_sValue = new char[len+1];
+			dat->m_sValue = dat->AllocString( len+1 );
 			Q_memcpy( dat->m_sValue, value, len+1 );
 
 			// Here, let's determine if we got a float or an int....
@@ -1655,14 +2761,41 @@ void KeyValues::RecursiveLoadFromBuffer( char const *resourceName, char **pfile
 //-----------------------------------------------------------------------------
 void *KeyValues::operator new( unsigned int iAllocSize )
 {
+	s_KeyValuesAllocStats.nPoolKeys++;
 	return KeyValuesSystem()->AllocKeyValuesMemory(iAllocSize);
 }
 
 void *KeyValues::operator new( unsigned int iAllocSize, int nBlockUse, const char *pFileName, int nLine )
 {
+	s_KeyValuesAllocStats.nPoolKeys++;
 	return KeyValuesSystem()->AllocKeyValuesMemory(iAllocSize);
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: construct in memory that's already been found (arena keys)
+//-----------------------------------------------------------------------------
+void *KeyValues::operator new( unsigned int iAllocSize, void *pMem )
+{
+	return pMem;
+}
+
+void KeyValues::operator delete( void *pMem, void *pPlace )
+{
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Creates a key to go under this one, out of our arena if we're in one
+//-----------------------------------------------------------------------------
+KeyValues *KeyValues::NewSubKey( int keySymbol )
+{
+	KeyValuesArena_t *pArena = FindArena( this );
+	if ( !pArena )
+		return new KeyValues( keySymbol, false );
+
+	s_KeyValuesAllocStats.nArenaKeys++;
+	return new ( ArenaAlloc( pArena, sizeof( KeyValues ) ) ) KeyValues( keySymbol, false );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: deallocator
 //-----------------------------------------------------------------------------
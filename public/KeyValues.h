@@ -28,10 +28,32 @@
 #endif
 
 #include "utlvector.h"
+#include "checksum_crc.h"
 
 class IBaseFileSystem;
 class CUtlBuffer;
 class Color;
+struct KeyValuesIndex_t;
+struct KeyValuesCacheBuilder_t;
+struct KeyValuesCacheReader_t;
+
+//-----------------------------------------------------------------------------
+// Purpose: Where KeyValues memory has come from, across every tree in this module
+//-----------------------------------------------------------------------------
+struct KeyValuesAllocStats_t
+{
+	// running totals
+	int		nPoolKeys;				// keys allocated from the KeyValuesSystem pool
+	int		nHeapStrings;			// values allocated on the heap
+	int		nArenaKeys;				// keys carved out of an arena
+	int		nArenaStrings;			// values carved out of an arena
+
+	// current
+	int		nArenas;				// arenas alive now
+	int		nArenaBlocks;			// blocks those arenas hold
+	int		nArenaBytesReserved;	// bytes in those blocks
+	int		nArenaBytesUsed;		// bytes handed out from them
+};
 typedef void * FileHandle_t;
 
 //-----------------------------------------------------------------------------
@@ -82,6 +104,15 @@ public:
 	// Read from a buffer...  Note that the buffer must be null terminated
 	bool LoadFromBuffer( char const *resourceName, const char *pBuffer, IBaseFileSystem* pFileSystem = NULL, const char *pPathID = NULL );
 
+	// Binary image of this key and its peers (a name table and a flat node array), tagged with
+	// the CRC and size of the text they were parsed from. Only string/int/float values can be saved.
+	bool SaveToBinaryBuffer( CUtlBuffer &buf, CRC32_t sourceCRC, int nSourceSize );
+	bool LoadFromBinaryBuffer( char const *resourceName, const void *pBuffer, int nSize, CRC32_t sourceCRC, int nSourceSize );
+
+	// LoadFromFile() loads <resourceName>.kvc instead of parsing when its CRC matches the text,
+	// and writes it after parsing when bWrite is set. Defaults to off.
+	static void SetBinaryCacheMode( bool bRead, bool bWrite );
+
 	// Find a keyValue, create it if it is not found.
 	// Set bCreate to true to create the key if it doesn't already exist (which ensures a valid pointer will be returned)
 	KeyValues *FindKey(const char *keyName, bool bCreate = false);
@@ -130,7 +161,17 @@ public:
 	// Memory allocation (optimized)
 	void *operator new( unsigned int iAllocSize );
 	void *operator new( unsigned int iAllocSize, int nBlockUse, const char *pFileName, int nLine );
+	void *operator new( unsigned int iAllocSize, void *pMem );
 	void operator delete( void *pMem );
+	void operator delete( void *pMem, void *pPlace );
+
+	// Makes this (empty) key the root of an arena: every key created under it, and every value
+	// string in the tree, comes out of large blocks that are freed in one go with the root.
+	// Only for files that are loaded, read and deleted by the module that loaded them: keys
+	// from an arena tree must not be kept after the root is deleted, and must never be passed
+	// to another module. Hand on a MakeCopy() instead, which is allocated normally.
+	void UseArenaAllocator( int nBlockSize = 0 );
+	static const KeyValuesAllocStats_t &GetAllocStats();
 	KeyValues& operator=( KeyValues& src );
 
 	// Adds a chain... if we don't find stuff in this keyvalue, we'll look
@@ -145,6 +186,18 @@ public:
 	// Clear out all subkeys, and the current value
 	void Clear( void );
 
+	// Nodes with many children build a symbol->child index on first lookup,
+	// but only inside a child index scope; the indexes are dropped when the
+	// outermost scope ends. Another module can unlink and free keys without
+	// this one hearing of it, so don't pass the tree to another module inside
+	// a scope. Parsing opens one of its own.
+	static void BeginChildIndexScope();
+	static void EndChildIndexScope();
+
+	// off falls back to walking the child list (for timing comparisons)
+	static void EnableChildIndex( bool bEnable );
+	static bool IsChildIndexEnabled();
+
 	// Data type
 	enum types_t
 	{
@@ -163,11 +216,20 @@ public:
 
 private:
 	KeyValues( KeyValues& );	// prevent copy constructor being used
+	KeyValues( int keySymbol, bool bUsesEscapeSequences );	// name already looked up
 
 	// prevent delete being called except through deleteThis()
 	~KeyValues();
 
 	KeyValues* CreateKey( const char *keyName );
+
+	// Every key and value allocation goes through these so arena trees are handled
+	KeyValues *NewSubKey( int keySymbol );
+	static void DestroyKey( KeyValues *dat );
+	char *AllocString( int nChars );
+	wchar_t *AllocWString( int nChars );
+	void FreeString( char *pString );
+	void FreeWString( wchar_t *pString );
 	
 	void RecursiveCopyKeyValues( KeyValues& src );
 	void RemoveEverything();
@@ -186,6 +248,24 @@ private:
 	void WriteIndents( IBaseFileSystem *filesystem, FileHandle_t f, int indentLevel );
 	void WriteIndents( CUtlBuffer& buf, int indentLevel );
 
+	// Binary cache
+	bool RecursiveSaveToBinary( KeyValuesCacheBuilder_t &builder );
+	void RecursiveLoadFromBinary( KeyValuesCacheReader_t &reader );
+	bool LoadBinaryCache( IBaseFileSystem *filesystem, const char *cacheName, const char *pathID, CRC32_t sourceCRC, int nSourceSize );
+	void WriteBinaryCache( IBaseFileSystem *filesystem, const char *cacheName, const char *pathID, CRC32_t sourceCRC, int nSourceSize );
+
+	// Child index and the GetString()/GetWString() conversions of typed values. Both are
+	// kept in a table in KeyValues.cpp rather than in the object, so the layout stays fixed
+	KeyValuesIndex_t *GetChildIndex();
+	KeyValues *FindIndexedChild( int keySymbol, KeyValuesIndex_t *pIndex );
+	void BuildChildIndex( KeyValuesIndex_t *pIndex );
+	void IndexAppendedChild( KeyValuesIndex_t *pIndex, KeyValues *pChild );
+	const void *GetConversionSource();
+	const char *FindConvertedString();
+	const wchar_t *FindConvertedWString();
+	const char *CacheString( const char *pValue );
+	const wchar_t *CacheWString( const wchar_t *pValue );
+
 	int m_iKeyName;	// keyname is a symbol defined in KeyValuesSystem
 
 	// we clean up these
@@ -243,6 +243,9 @@ struct typedescription_t
 // Purpose: stores the list of objects in the hierarchy
 //			used to iterate through an object's data descriptions
 //-----------------------------------------------------------------------------
+struct inputdispatch_t;
+struct predcopyplan_t;
+
 struct datamap_t
 {
 	typedescription_t	*dataDesc;
@@ -255,6 +258,11 @@ struct datamap_t
 	bool				packed_offsets_computed;
 	int					packed_size;
 
+	// Server-side input name lookup for the whole chain, built on first use
+	inputdispatch_t		*inputDispatch;
+	// Compiled CPredictionCopy transfers for the whole chain, one per copy type
+	predcopyplan_t		*predCopyPlans;
+
 #if defined( _DEBUG )
 	bool				bValidityChecked;
 #endif // _DEBUG
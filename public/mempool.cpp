@@ -15,10 +15,18 @@
 #include <memory.h>
 #include "tier0/dbg.h"
 #include <ctype.h>
+#ifdef _WIN32
+#include <windows.h>
+#elif _LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include "tier0/memdbgon.h"
 
 #undef max
 #define max(x,y) (((x)>(y)) ? (x) : (y))
+#undef min
+#define min(x,y) (((x)<(y)) ? (x) : (y))
 
 MemoryPoolReportFunc_t CMemoryPool::g_ReportFunc = 0;
 
@@ -277,3 +285,514 @@ void CMemoryPool::Free( void *memBlock )
 
 
 
+
+
+//-----------------------------------------------------------------------------
+// Atomic helpers for CMemoryPoolMT
+//-----------------------------------------------------------------------------
+#ifdef _WIN32
+
+static inline bool PoolCompareExchange( volatile long *pDest, long nComperand, long nExchange )
+{
+	bool bResult;
+	__asm
+	{
+		mov ecx, pDest
+		mov eax, nComperand
+		mov edx, nExchange
+		lock cmpxchg [ecx], edx
+		sete bResult
+	}
+	return bResult;
+}
+
+static inline bool PoolCompareExchange64( volatile uint64 *pDest, uint64 nComperand, uint64 nExchange )
+{
+	bool bResult;
+	__asm
+	{
+		lea esi, nComperand
+		lea edi, nExchange
+		mov eax, [esi]
+		mov edx, [esi+4]
+		mov ebx, [edi]
+		mov ecx, [edi+4]
+		mov esi, pDest
+		lock cmpxchg8b [esi]
+		sete bResult
+	}
+	return bResult;
+}
+
+static inline long PoolAtomicAdd( volatile long *pDest, long nAmount )
+{
+	return InterlockedExchangeAdd( (long *)pDest, nAmount ) + nAmount;
+}
+
+static inline void PoolYield()
+{
+	Sleep( 0 );
+}
+
+#elif _LINUX
+
+static inline bool PoolCompareExchange( volatile long *pDest, long nComperand, long nExchange )
+{
+	return __sync_bool_compare_and_swap( pDest, nComperand, nExchange );
+}
+
+static inline bool PoolCompareExchange64( volatile uint64 *pDest, uint64 nComperand, uint64 nExchange )
+{
+	return __sync_bool_compare_and_swap( pDest, nComperand, nExchange );
+}
+
+static inline long PoolAtomicAdd( volatile long *pDest, long nAmount )
+{
+	return __sync_add_and_fetch( pDest, nAmount );
+}
+
+static inline void PoolYield()
+{
+	sched_yield();
+}
+
+#endif
+
+// m_FreeBatches, split into the first batch and the ABA tag
+union PoolBatchHead_t
+{
+	uint64				m_nValue;
+	struct
+	{
+		void			*m_pBatch;
+		unsigned int	m_nTag;
+	} m_Head;
+};
+
+// Free blocks are chained through their first word. The first block of a
+// batch on the shared list also holds the next batch in its second word.
+#define NEXT_BLOCK( _p )	( ((void **)(_p))[0] )
+#define NEXT_BATCH( _p )	( ((void **)(_p))[1] )
+
+// Blocks moved between a thread cache and the shared list at a time
+#define POOL_BATCH_SIZE		32
+
+#define POOL_POISON_BYTE	0xDD
+
+CMemoryPoolMT *CMemoryPoolMT::s_pFirstPool = NULL;
+
+//-----------------------------------------------------------------------------
+// Purpose: Constructor
+//-----------------------------------------------------------------------------
+CMemoryPoolMT::CMemoryPoolMT( int blockSize, int numElements, int alignment, const char *pName, bool poison )
+{
+	Assert( sizeof(PoolBatchHead_t) == sizeof(uint64) );
+	Assert( alignment > 0 && ( alignment & ( alignment - 1 ) ) == 0 );
+
+	if ( alignment < sizeof(void*) )
+	{
+		alignment = sizeof(void*);
+	}
+
+	// room for the block and batch links, rounded up to the alignment
+	m_BlockSize = max( blockSize, 2 * (int)sizeof(void*) );
+	m_BlockSize = ( m_BlockSize + alignment - 1 ) & ~( alignment - 1 );
+	m_BlocksPerBlob = max( numElements, POOL_BATCH_SIZE );
+	m_Alignment = alignment;
+	m_bPoison = poison;
+	m_pName = pName ? pName : "unnamed";
+
+	m_FreeBatches = 0;
+	m_pBlobs = NULL;
+	m_GrowLock = 0;
+	m_NumBlobs = 0;
+	m_BlocksTotal = 0;
+	m_BlocksOut = 0;
+	m_PeakOut = 0;
+	m_pCaches = NULL;
+
+#ifdef _WIN32
+	m_TlsIndex = TlsAlloc();
+	m_bHasTls = ( m_TlsIndex != TLS_OUT_OF_INDEXES );
+#elif _LINUX
+	pthread_key_t key;
+	m_bHasTls = ( pthread_key_create( &key, NULL ) == 0 );
+	m_TlsIndex = key;
+#endif
+
+	// pools are static objects, so this runs before any other threads exist
+	m_pNextPool = s_pFirstPool;
+	s_pFirstPool = this;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Frees every blob; nothing may use the pool during or after this
+//-----------------------------------------------------------------------------
+CMemoryPoolMT::~CMemoryPoolMT()
+{
+	MemoryPoolStats_t stats;
+	GetStats( stats );
+	if ( stats.nBlocksInUse > 0 && CMemoryPool::g_ReportFunc )
+	{
+		CMemoryPool::g_ReportFunc( "Memory leak: %s pool blocks left in memory: %d\n", m_pName, stats.nBlocksInUse );
+	}
+
+	ThreadCache_t *pNextCache;
+	for ( ThreadCache_t *pCache = m_pCaches; pCache; pCache = pNextCache )
+	{
+		pNextCache = pCache->m_pNext;
+		free( pCache );
+	}
+
+	CBlob *pNextBlob;
+	for ( CBlob *pBlob = m_pBlobs; pBlob; pBlob = pNextBlob )
+	{
+		pNextBlob = pBlob->m_pNext;
+		free( pBlob );
+	}
+
+	if ( m_bHasTls )
+	{
+#ifdef _WIN32
+		TlsFree( m_TlsIndex );
+#elif _LINUX
+		pthread_key_delete( (pthread_key_t)m_TlsIndex );
+#endif
+	}
+
+	for ( CMemoryPoolMT **ppPool = &s_pFirstPool; *ppPool; ppPool = &(*ppPool)->m_pNextPool )
+	{
+		if ( *ppPool == this )
+		{
+			*ppPool = m_pNextPool;
+			break;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds or makes the calling thread's cache. NULL if this pool
+//			couldn't get a TLS slot, in which case every call goes to the
+//			shared list.
+//-----------------------------------------------------------------------------
+CMemoryPoolMT::ThreadCache_t *CMemoryPoolMT::GetThreadCache()
+{
+	if ( !m_bHasTls )
+		return NULL;
+
+#ifdef _WIN32
+	ThreadCache_t *pCache = (ThreadCache_t *)TlsGetValue( m_TlsIndex );
+#elif _LINUX
+	ThreadCache_t *pCache = (ThreadCache_t *)pthread_getspecific( (pthread_key_t)m_TlsIndex );
+#endif
+	if ( pCache )
+		return pCache;
+
+	pCache = (ThreadCache_t *)malloc( sizeof(ThreadCache_t) );
+	if ( !pCache )
+		return NULL;
+
+	pCache->m_pFree = NULL;
+	pCache->m_nFree = 0;
+
+	// caches are only freed with the pool, so a plain push is safe
+	do
+	{
+		pCache->m_pNext = m_pCaches;
+	} while ( !PoolCompareExchange( (volatile long *)&m_pCaches, (long)pCache->m_pNext, (long)pCache ) );
+
+#ifdef _WIN32
+	TlsSetValue( m_TlsIndex, pCache );
+#elif _LINUX
+	pthread_setspecific( (pthread_key_t)m_TlsIndex, pCache );
+#endif
+	return pCache;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Takes a batch off the shared list, growing the pool if it's empty
+//-----------------------------------------------------------------------------
+void *CMemoryPoolMT::PopBatch( int &nBlocks )
+{
+	PoolBatchHead_t oldHead, newHead;
+	for (;;)
+	{
+		// a torn read here just makes the compare-exchange fail
+		oldHead.m_nValue = m_FreeBatches;
+		if ( !oldHead.m_Head.m_pBatch )
+		{
+			if ( !AddNewBlob() )
+				return NULL;
+			continue;
+		}
+
+		// the batch may be popped and written to by another thread before
+		// this reads it, but blobs are never freed while the pool is alive,
+		// and the tag makes the exchange fail in that case
+		newHead.m_Head.m_pBatch = NEXT_BATCH( oldHead.m_Head.m_pBatch );
+		newHead.m_Head.m_nTag = oldHead.m_Head.m_nTag + 1;
+		if ( PoolCompareExchange64( &m_FreeBatches, oldHead.m_nValue, newHead.m_nValue ) )
+			break;
+	}
+
+	void *pBatch = oldHead.m_Head.m_pBatch;
+	nBlocks = 0;
+	for ( void *pBlock = pBatch; pBlock; pBlock = NEXT_BLOCK( pBlock ) )
+	{
+		nBlocks++;
+	}
+
+	long nOut = PoolAtomicAdd( &m_BlocksOut, nBlocks );
+	long nPeak = m_PeakOut;
+	while ( nOut > nPeak && !PoolCompareExchange( &m_PeakOut, nPeak, nOut ) )
+	{
+		nPeak = m_PeakOut;
+	}
+
+	return pBatch;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Puts a NULL terminated chain of blocks on the shared list
+//-----------------------------------------------------------------------------
+void CMemoryPoolMT::PushBatch( void *pBatch )
+{
+	int nBlocks = 0;
+	for ( void *pBlock = pBatch; pBlock; pBlock = NEXT_BLOCK( pBlock ) )
+	{
+		nBlocks++;
+	}
+	PoolAtomicAdd( &m_BlocksOut, -nBlocks );
+
+	PoolBatchHead_t oldHead, newHead;
+	do
+	{
+		oldHead.m_nValue = m_FreeBatches;
+		NEXT_BATCH( pBatch ) = oldHead.m_Head.m_pBatch;
+		newHead.m_Head.m_pBatch = pBatch;
+		newHead.m_Head.m_nTag = oldHead.m_Head.m_nTag;
+	} while ( !PoolCompareExchange64( &m_FreeBatches, oldHead.m_nValue, newHead.m_nValue ) );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Allocates a blob and puts its blocks on the shared list. Only one
+//			thread grows the pool at a time; the others wait for it and
+//			then retry the shared list.
+//-----------------------------------------------------------------------------
+bool CMemoryPoolMT::AddNewBlob()
+{
+	while ( !PoolCompareExchange( &m_GrowLock, 0, 1 ) )
+	{
+		PoolYield();
+	}
+
+	PoolBatchHead_t head;
+	head.m_nValue = m_FreeBatches;
+	if ( head.m_Head.m_pBatch )
+	{
+		// someone else grew it while we waited
+		m_GrowLock = 0;
+		return true;
+	}
+
+	int blobSize = m_BlockSize * m_BlocksPerBlob;
+	CBlob *pBlob = (CBlob*)malloc( sizeof(CBlob) + m_Alignment + blobSize );
+	if ( !pBlob )
+	{
+		Assert( !"CMemoryPoolMT::AddNewBlob: ran out of memory" );
+		m_GrowLock = 0;
+		return false;
+	}
+
+	pBlob->m_NumBytes = blobSize;
+	pBlob->m_pNext = m_pBlobs;
+	m_pBlobs = pBlob;
+	m_NumBlobs++;
+
+	char *pData = (char *)( pBlob + 1 );
+	pData = (char *)( ( (unsigned long)pData + m_Alignment - 1 ) & ~( m_Alignment - 1 ) );
+
+	if ( m_bPoison )
+	{
+		memset( pData, POOL_POISON_BYTE, blobSize );
+	}
+
+	// the new blocks start out counted as in use, PushBatch takes them back off
+	PoolAtomicAdd( &m_BlocksTotal, m_BlocksPerBlob );
+	PoolAtomicAdd( &m_BlocksOut, m_BlocksPerBlob );
+
+	for ( int nFirst = 0; nFirst < m_BlocksPerBlob; nFirst += POOL_BATCH_SIZE )
+	{
+		int nLast = min( nFirst + POOL_BATCH_SIZE, m_BlocksPerBlob ) - 1;
+		for ( int i = nFirst; i < nLast; i++ )
+		{
+			NEXT_BLOCK( pData + i * m_BlockSize ) = pData + ( i + 1 ) * m_BlockSize;
+		}
+		NEXT_BLOCK( pData + nLast * m_BlockSize ) = NULL;
+
+		PushBatch( pData + nFirst * m_BlockSize );
+	}
+
+	m_GrowLock = 0;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Debug poisoning
+//-----------------------------------------------------------------------------
+void CMemoryPoolMT::PoisonBlock( void *pMem )
+{
+	memset( pMem, POOL_POISON_BYTE, m_BlockSize );
+}
+
+void CMemoryPoolMT::CheckPoison( void *pMem )
+{
+	// the link words were written by the pool itself
+	unsigned char *pByte = (unsigned char *)pMem + 2 * sizeof(void*);
+	unsigned char *pEnd = (unsigned char *)pMem + m_BlockSize;
+	for ( ; pByte < pEnd; pByte++ )
+	{
+		if ( *pByte != POOL_POISON_BYTE )
+		{
+			if ( CMemoryPool::g_ReportFunc )
+			{
+				CMemoryPool::g_ReportFunc( "%s pool: block %p was written to after it was freed\n", m_pName, pMem );
+			}
+			Assert( !"CMemoryPoolMT::Alloc: block written to after free" );
+			break;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Allocs a single block of memory from the pool.
+//-----------------------------------------------------------------------------
+void* CMemoryPoolMT::Alloc()
+{
+	return Alloc( m_BlockSize );
+}
+
+void *CMemoryPoolMT::Alloc( unsigned int amount )
+{
+	if ( amount > (unsigned int)m_BlockSize )
+		return NULL;
+
+	void *pBlock;
+	int nBlocks;
+
+	ThreadCache_t *pCache = GetThreadCache();
+	if ( pCache )
+	{
+		if ( !pCache->m_pFree )
+		{
+			pCache->m_pFree = PopBatch( nBlocks );
+			if ( !pCache->m_pFree )
+				return NULL;
+			pCache->m_nFree = nBlocks;
+		}
+
+		pBlock = pCache->m_pFree;
+		pCache->m_pFree = NEXT_BLOCK( pBlock );
+		pCache->m_nFree--;
+	}
+	else
+	{
+		// no cache; take one block and put the rest of the batch back
+		pBlock = PopBatch( nBlocks );
+		if ( !pBlock )
+			return NULL;
+
+		if ( NEXT_BLOCK( pBlock ) )
+		{
+			PushBatch( NEXT_BLOCK( pBlock ) );
+		}
+	}
+
+	if ( m_bPoison )
+	{
+		CheckPoison( pBlock );
+	}
+
+	return pBlock;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Frees a block of memory
+//-----------------------------------------------------------------------------
+void CMemoryPoolMT::Free( void *pMem )
+{
+	if ( !pMem )
+		return;
+
+	if ( m_bPoison )
+	{
+		PoisonBlock( pMem );
+	}
+
+	ThreadCache_t *pCache = GetThreadCache();
+	if ( !pCache )
+	{
+		NEXT_BLOCK( pMem ) = NULL;
+		PushBatch( pMem );
+		return;
+	}
+
+	NEXT_BLOCK( pMem ) = pCache->m_pFree;
+	pCache->m_pFree = pMem;
+	pCache->m_nFree++;
+
+	// keep a batch around for the next allocations, give the next one back
+	if ( pCache->m_nFree >= 2 * POOL_BATCH_SIZE )
+	{
+		void *pLast = pCache->m_pFree;
+		for ( int i = 1; i < POOL_BATCH_SIZE; i++ )
+		{
+			pLast = NEXT_BLOCK( pLast );
+		}
+
+		void *pBatch = NEXT_BLOCK( pLast );
+		NEXT_BLOCK( pLast ) = NULL;
+		
+		void *pSpill = pCache->m_pFree;
+		pCache->m_pFree = pBatch;
+		pCache->m_nFree -= POOL_BATCH_SIZE;
+		PushBatch( pSpill );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Empties the calling thread's cache into the shared list
+//-----------------------------------------------------------------------------
+void CMemoryPoolMT::FlushThreadCache()
+{
+	ThreadCache_t *pCache = GetThreadCache();
+	if ( !pCache || !pCache->m_pFree )
+		return;
+
+	void *pFree = pCache->m_pFree;
+	pCache->m_pFree = NULL;
+	pCache->m_nFree = 0;
+	PushBatch( pFree );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Snapshot of the pool's counters. Other threads may be using the
+//			pool, so the numbers are only as exact as that allows.
+//-----------------------------------------------------------------------------
+void CMemoryPoolMT::GetStats( MemoryPoolStats_t &stats ) const
+{
+	stats.nBlockSize = m_BlockSize;
+	stats.nBlobs = m_NumBlobs;
+	stats.nBlocksTotal = m_BlocksTotal;
+	stats.nPeakInUse = m_PeakOut;
+	stats.nBlocksCached = 0;
+	stats.nThreadCaches = 0;
+
+	for ( ThreadCache_t *pCache = m_pCaches; pCache; pCache = pCache->m_pNext )
+	{
+		stats.nBlocksCached += pCache->m_nFree;
+		stats.nThreadCaches++;
+	}
+
+	stats.nBlocksInUse = m_BlocksOut - stats.nBlocksCached;
+}
@@ -25,6 +25,7 @@
 
 
 #include "utlmemory.h"
+#include "tier0/platform.h"
 
 
 //-----------------------------------------------------------------------------
@@ -90,6 +91,100 @@ private:
 	unsigned short	m_NumBlobs;
 
 	static MemoryPoolReportFunc_t g_ReportFunc;
+
+	// shares the error report func
+	friend class CMemoryPoolMT;
+};
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Thread safe pool allocator. Each thread allocates from and frees
+//			to its own cache of blocks; caches refill from and spill to a
+//			lock free shared list a batch at a time, so threads only touch
+//			shared state once every few dozen allocations.
+//-----------------------------------------------------------------------------
+
+struct MemoryPoolStats_t
+{
+	int		nBlockSize;			// after rounding up for alignment
+	int		nBlobs;
+	int		nBlocksTotal;		// blocks carved out of blobs
+	int		nBlocksInUse;		// handed out and not freed yet
+	int		nBlocksCached;		// free, but held in some thread's cache
+	int		nPeakInUse;			// high water of blocks held outside the shared list
+	int		nThreadCaches;
+};
+
+class CMemoryPoolMT
+{
+public:
+	// alignment must be a power of two. poisoning fills freed blocks with
+	// 0xDD and checks them again on allocation, to catch writes after free
+				CMemoryPoolMT( int blockSize, int numElements, int alignment = 8, const char *pName = NULL, bool poison = false );
+				~CMemoryPoolMT();
+
+	void*		Alloc();
+	void*		Alloc( unsigned int amount );
+	void		Free( void *pMem );
+
+	// Hands the calling thread's cached blocks back to the shared list.
+	// Worker threads should call this before they exit.
+	void		FlushThreadCache();
+
+	void		GetStats( MemoryPoolStats_t &stats ) const;
+	const char	*GetName() const	{ return m_pName; }
+
+	// All the thread safe pools in this module
+	static CMemoryPoolMT	*GetFirstPool()			{ return s_pFirstPool; }
+	CMemoryPoolMT			*GetNextPool() const	{ return m_pNextPool; }
+
+private:
+	class CBlob
+	{
+	public:
+		CBlob	*m_pNext;
+		int		m_NumBytes;
+	};
+
+	struct ThreadCache_t
+	{
+		void			*m_pFree;		// chained through the first word of each block
+		int				m_nFree;
+		ThreadCache_t	*m_pNext;		// every cache for this pool
+	};
+
+	ThreadCache_t	*GetThreadCache();
+	void		*PopBatch( int &nBlocks );
+	void		PushBatch( void *pBatch );
+	bool		AddNewBlob();
+	void		PoisonBlock( void *pMem );
+	void		CheckPoison( void *pMem );
+
+private:
+	int				m_BlockSize;
+	int				m_BlocksPerBlob;
+	int				m_Alignment;
+	bool			m_bPoison;
+	const char		*m_pName;
+
+	// Shared list of batches. Low word is the first batch, high word a tag
+	// bumped by every pop, so compare-exchange can't be fooled by a batch
+	// that was popped and pushed back in between (ABA)
+	volatile uint64	m_FreeBatches;
+
+	CBlob			*m_pBlobs;
+	volatile long	m_GrowLock;
+	int				m_NumBlobs;
+	volatile long	m_BlocksTotal;
+	volatile long	m_BlocksOut;		// blocks not in the shared list
+	volatile long	m_PeakOut;
+
+	ThreadCache_t * volatile m_pCaches;
+	unsigned long	m_TlsIndex;
+	bool			m_bHasTls;
+
+	CMemoryPoolMT	*m_pNextPool;
+	static CMemoryPoolMT *s_pFirstPool;
 };
 
 
@@ -169,4 +264,21 @@ void CClassMemoryPool<T>::Free(T *pMem)
 #define DEFINE_FIXEDSIZE_ALLOCATOR_EXTERNAL( _class, _allocator )				\
    CMemoryPool*   _class::s_pAllocator = _allocator
 
+
+//-----------------------------------------------------------------------------
+// Same as DECLARE_FIXEDSIZE_ALLOCATOR, for classes that are allocated and
+// freed from more than one thread
+//-----------------------------------------------------------------------------
+#define DECLARE_FIXEDSIZE_ALLOCATOR_MT( _class )								\
+   public:																		\
+      inline void* operator new( size_t size ) { return s_Allocator.Alloc(size); }   \
+      inline void* operator new( size_t size, int nBlockUse, const char *pFileName, int nLine ) { return s_Allocator.Alloc(size); }   \
+      inline void  operator delete( void* p ) { s_Allocator.Free(p); }		\
+      inline void  operator delete( void* p, int nBlockUse, const char *pFileName, int nLine ) { s_Allocator.Free(p); }   \
+  private:																		\
+      static   CMemoryPoolMT   s_Allocator
+    
+#define DEFINE_FIXEDSIZE_ALLOCATOR_MT( _class, _initsize )						\
+   CMemoryPoolMT   _class::s_Allocator(sizeof(_class), _initsize, 8, #_class)
+
 #endif // MEMPOOL_H
@@ -102,6 +102,10 @@ inline int InternalCheckDeclareClass( const char *pClassName, const char *pClass
 
 // All classes that contain CNetworkVars need a NetworkStateChanged() function. If the class is not an entity,
 // it needs to forward the call to the entity it's in. These macros can help.
+//
+// The network vars themselves call NetworkStateChanged( void *pVar, int nBytes ) with the address and size
+// of the variable that changed, so the entity can tell which SendProps need encoding. Classes that define
+// NetworkStateChanged() need that overload too.
 	
 	// These macros setup an entity pointer in your class. Use IMPLEMENT_NETWORKVAR_CHAIN before you do
 	// anything inside the class itself.
@@ -118,7 +122,8 @@ inline int InternalCheckDeclareClass( const char *pClassName, const char *pClass
 
 	#define DECLARE_NETWORKVAR_CHAIN() \
 		CAutoInitEntPtr __m_pChainEntity; \
-		void NetworkStateChanged() { if ( g_bUseNetworkVars ) __m_pChainEntity.m_pEnt->NetworkStateChanged(); }
+		void NetworkStateChanged() { if ( g_bUseNetworkVars ) __m_pChainEntity.m_pEnt->NetworkStateChanged(); } \
+		void NetworkStateChanged( void *pVar, int nBytes ) { if ( g_bUseNetworkVars ) __m_pChainEntity.m_pEnt->NetworkStateChanged( pVar, nBytes ); }
 
 	#define IMPLEMENT_NETWORKVAR_CHAIN( varName ) \
 		(varName)->__m_pChainEntity.m_pEnt = this;
@@ -133,10 +138,18 @@ static inline void DispatchNetworkStateChanged( T *pObj )
 		pObj->NetworkStateChanged();
 }
 
+template< class T >
+static inline void DispatchNetworkStateChanged( T *pObj, void *pVar, int nBytes )
+{
+	if ( g_bUseNetworkVars )
+		pObj->NetworkStateChanged( pVar, nBytes );
+}
+
 #define DECLARE_EMBEDDED_NETWORKVAR() \
 	template <typename T> friend int ServerClassInit(T *);	\
 	template <typename T> friend int ClientClassInit(T *); \
-	virtual void NetworkStateChanged() {}
+	virtual void NetworkStateChanged() {} \
+	virtual void NetworkStateChanged( void *pVar, int nBytes ) {}
 
 #define CNetworkVarEmbedded( type, name ) \
 	class NetworkVar_##name; \
@@ -151,6 +164,10 @@ static inline void DispatchNetworkStateChanged( T *pObj )
 		{ \
 			DispatchNetworkStateChanged( (ThisClass_##name*)( ((char*)this) - GetOffset_##name() ) ); \
 		} \
+		virtual void NetworkStateChanged( void *pVar, int nBytes ) \
+		{ \
+			DispatchNetworkStateChanged( (ThisClass_##name*)( ((char*)this) - GetOffset_##name() ), pVar, nBytes ); \
+		} \
 	}; \
 	NetworkVar_##name name; 
 
@@ -487,24 +504,24 @@ private:
 // but a derived class does. Then, the entity is only flagged as changed when the variable is changed in
 // an entity that wants to transmit the variable.
 	#define CNetworkVarForDerived( type, name ) \
-		virtual void NetworkStateChanged_##name() {} \
+		virtual void NetworkStateChanged_##name( void *pVar, int nBytes ) {} \
 		NETWORK_VAR_START( type, name ) \
 		NETWORK_VAR_END( type, name, CNetworkVarBase, NetworkStateChanged_##name )
 
 	#define CNetworkVectorForDerived( name ) \
-		virtual void NetworkStateChanged_##name() {} \
+		virtual void NetworkStateChanged_##name( void *pVar, int nBytes ) {} \
 		CNetworkVectorInternal( Vector, name, NetworkStateChanged_##name )
 		
 	#define CNetworkHandleForDerived( type, name ) \
-		virtual void NetworkStateChanged_##name() {} \
+		virtual void NetworkStateChanged_##name( void *pVar, int nBytes ) {} \
 		CNetworkHandleInternal( type, name, NetworkStateChanged_##name )
 		
 	#define CNetworkArrayForDerived( type, name, count ) \
-		virtual void NetworkStateChanged_##name() {} \
+		virtual void NetworkStateChanged_##name( void *pVar, int nBytes ) {} \
 		CNetworkArrayInternal( type, name, count, NetworkStateChanged_##name )
 		
 	#define IMPLEMENT_NETWORK_VAR_FOR_DERIVED( name ) \
-		virtual void NetworkStateChanged_##name() { if ( g_bUseNetworkVars ) NetworkStateChanged(); }
+		virtual void NetworkStateChanged_##name( void *pVar, int nBytes ) { if ( g_bUseNetworkVars ) NetworkStateChanged( pVar, nBytes ); }
 
 
 // Vectors + some convenient helper functions.
@@ -539,7 +556,7 @@ private:
 	protected: \
 		void NetworkStateChanged() \
 		{ \
-			if ( g_bUseNetworkVars ) ((ThisClass*)(((char*)this) - MyOffsetOf(ThisClass,name)))->NetworkStateChanged(); \
+			if ( g_bUseNetworkVars ) ((ThisClass*)(((char*)this) - MyOffsetOf(ThisClass,name)))->NetworkStateChanged( m_Value, length ); \
 		} \
 	private: \
 		char m_Value[length]; \
@@ -561,14 +578,14 @@ private:
 		template <typename T> friend int ServerClassInit(T *);	\
 		const type& operator[]( int i ) const { return Get( i ); } \
 		const type& Get( int i ) const { Assert( i >= 0 && i < count ); return m_Value[i]; } \
-		type& GetForModify( int i ) { NetworkStateChanged(); Assert( i >= 0 && i < count ); return m_Value[i]; } \
+		type& GetForModify( int i ) { Assert( i >= 0 && i < count ); NetworkStateChanged( &m_Value[i] ); return m_Value[i]; } \
 		void Set( int i, const type &val ) { Assert( i >= 0 && i < count ); m_Value[i] = val; } \
 		const type* Base() const { return m_Value; } \
 		int Count() const { return count; } \
 	protected: \
-		void NetworkStateChanged() \
+		void NetworkStateChanged( type *pElement ) \
 		{ \
-			if ( g_bUseNetworkVars ) ((ThisClass*)(((char*)this) - MyOffsetOf(ThisClass,name)))->stateChangedFn(); \
+			if ( g_bUseNetworkVars ) ((ThisClass*)(((char*)this) - MyOffsetOf(ThisClass,name)))->stateChangedFn( pElement, sizeof( type ) ); \
 		} \
 		type m_Value[count]; \
 	}; \
@@ -592,7 +609,7 @@ private:
 #define NETWORK_VAR_END( type, name, base, stateChangedFn ) \
 		static void NetworkStateChanged( void *ptr ) \
 		{ \
-			if ( g_bUseNetworkVars ) ((ThisClass*)(((char*)ptr) - MyOffsetOf(ThisClass,name)))->stateChangedFn(); \
+			if ( g_bUseNetworkVars ) ((ThisClass*)(((char*)ptr) - MyOffsetOf(ThisClass,name)))->stateChangedFn( ptr, sizeof( base< type, NetworkVar_##name > ) ); \
 		} \
 	}; \
 	base< type, NetworkVar_##name > name;
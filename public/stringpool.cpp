@@ -12,68 +12,143 @@
 #include "convar.h"
 #include "tier0/dbg.h"
 #include "stringpool.h"
+#include "utlsymbol.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
+#define STRINGPOOL_MIN_SLOTS	256
+#define STRINGPOOL_BLOCK_SIZE	( 16 * 1024 )
+
 //-----------------------------------------------------------------------------
-// Purpose: Comparison function for string sorted associative data structures
 //-----------------------------------------------------------------------------
 
-bool StrLess( const char * const &pszLeft, const char * const &pszRight )
+CStringPool::CStringPool()
+  : m_nCount( 0 ), m_nBlockUsed( STRINGPOOL_BLOCK_SIZE )
 {
-	return ( strcmpi( pszLeft, pszRight) < 0 );
 }
 
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 
-CStringPool::CStringPool()
-  : m_Strings( 32, 256, StrLess )
+CStringPool::~CStringPool()
 {
+	FreeAll();
 }
 
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 
-CStringPool::~CStringPool()
+unsigned int CStringPool::Count() const
 {
-	FreeAll();
+	return m_nCount;
 }
 
 //-----------------------------------------------------------------------------
+// Purpose: Returns the slot holding the string, or the empty slot it would go in
 //-----------------------------------------------------------------------------
+int CStringPool::FindSlot( const char *pszValue, unsigned int nHash ) const
+{
+	int nMask = m_Slots.Count() - 1;
+	if ( nMask < 0 )
+		return -1;
 
-unsigned int CStringPool::Count() const
+	int i = nHash & nMask;
+	while ( m_Slots[i].pszString )
+	{
+		if ( m_Slots[i].nHash == nHash && !strcmpi( m_Slots[i].pszString, pszValue ) )
+			break;
+
+		i = ( i + 1 ) & nMask;
+	}
+
+	return i;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Doubles the slots, reusing the hashes they already hold
+//-----------------------------------------------------------------------------
+void CStringPool::GrowSlots()
 {
-	return m_Strings.Count();
+	int nOldSlots = m_Slots.Count();
+	int nNewSlots = nOldSlots ? nOldSlots * 2 : STRINGPOOL_MIN_SLOTS;
+
+	CUtlVector<PoolSlot_t> oldSlots;
+	oldSlots.CopyArray( m_Slots.Base(), nOldSlots );
+
+	m_Slots.SetSize( nNewSlots );
+	memset( m_Slots.Base(), 0, nNewSlots * sizeof(PoolSlot_t) );
+
+	int nMask = nNewSlots - 1;
+	for ( int i = 0; i < nOldSlots; i++ )
+	{
+		if ( !oldSlots[i].pszString )
+			continue;
+
+		int j = oldSlots[i].nHash & nMask;
+		while ( m_Slots[j].pszString )
+		{
+			j = ( j + 1 ) & nMask;
+		}
+		m_Slots[j] = oldSlots[i];
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Carves room for a string out of the current block
+//-----------------------------------------------------------------------------
+char *CStringPool::AllocStringMemory( int nLength )
+{
+	// long strings get a block to themselves
+	if ( nLength > STRINGPOOL_BLOCK_SIZE / 4 )
+	{
+		char *pBlock = new char[nLength];
+		m_Blocks.AddToHead( pBlock );
+		return pBlock;
+	}
+
+	if ( m_nBlockUsed + nLength > STRINGPOOL_BLOCK_SIZE )
+	{
+		m_Blocks.AddToTail( new char[STRINGPOOL_BLOCK_SIZE] );
+		m_nBlockUsed = 0;
+	}
+
+	char *pszNew = m_Blocks[m_Blocks.Count() - 1] + m_nBlockUsed;
+	m_nBlockUsed += nLength;
+	return pszNew;
 }
 
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 const char * CStringPool::Find( const char *pszValue )
 {
-	unsigned short i = m_Strings.Find(pszValue);
-	if ( m_Strings.IsValidIndex(i) )
-		return m_Strings[i];
+	int i = FindSlot( pszValue, CUtlHashSymbolTable::HashString( pszValue, true ) );
+	if ( i < 0 )
+		return NULL;
 
-	return NULL;
+	return m_Slots[i].pszString;
 }
 
 const char * CStringPool::Allocate( const char *pszValue )
 {
-	char	*pszNew;
-
-	unsigned short i 	= m_Strings.Find(pszValue);
-	bool		   bNew = (i == m_Strings.InvalidIndex());
+	// make room first so the slot found below stays put
+	if ( ( m_nCount + 1 ) * 2 > (unsigned int)m_Slots.Count() )
+	{
+		GrowSlots();
+	}
 
-	if ( !bNew )
-		return m_Strings[i];
+	unsigned int nHash = CUtlHashSymbolTable::HashString( pszValue, true );
+	int i = FindSlot( pszValue, nHash );
+	if ( m_Slots[i].pszString )
+		return m_Slots[i].pszString;
 
-	pszNew = strdup( pszValue );
+	int nLength = strlen( pszValue ) + 1;
+	char *pszNew = AllocStringMemory( nLength );
+	memcpy( pszNew, pszValue, nLength );
 
-	if ( bNew )
-		m_Strings.Insert( pszNew );
+	m_Slots[i].nHash = nHash;
+	m_Slots[i].pszString = pszNew;
+	m_nCount++;
 
 	return pszNew;
 }
@@ -83,13 +158,29 @@ const char * CStringPool::Allocate( const char *pszValue )
 
 void CStringPool::FreeAll()
 {
-	unsigned short i = m_Strings.FirstInorder();
-	while ( i != m_Strings.InvalidIndex() )
+	for ( int i = 0; i < m_Blocks.Count(); i++ )
+	{
+		delete [] m_Blocks[i];
+	}
+	m_Blocks.RemoveAll();
+	m_nBlockUsed = STRINGPOOL_BLOCK_SIZE;
+
+	m_Slots.RemoveAll();
+	m_nCount = 0;
+}
+
+//-----------------------------------------------------------------------------
+//-----------------------------------------------------------------------------
+
+void CStringPool::GetStrings( CUtlVector<const char *> &strings ) const
+{
+	for ( int i = 0; i < m_Slots.Count(); i++ )
 	{
-		free( (void *)m_Strings[i] );
-		i = m_Strings.NextInorder(i);
+		if ( m_Slots[i].pszString )
+		{
+			strings.AddToTail( m_Slots[i].pszString );
+		}
 	}
-	m_Strings.RemoveAll();
 }
 
 //-----------------------------------------------------------------------------
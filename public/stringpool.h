@@ -8,7 +8,7 @@
 #ifndef STRINGPOOL_H
 #define STRINGPOOL_H
 
-#include "utlrbtree.h"
+#include "utlvector.h"
 
 #if defined( _WIN32 )
 #pragma once
@@ -16,7 +16,9 @@
 
 //-----------------------------------------------------------------------------
 // Purpose: Allocates memory for strings, checking for duplicates first,
-//			reusing exising strings if duplicate found.
+//			reusing exising strings if duplicate found. Lookups are case
+//			insensitive and go through an open addressed hash table; the
+//			strings are packed into large blocks that never move.
 //-----------------------------------------------------------------------------
 
 class CStringPool
@@ -33,10 +35,27 @@ public:
 	// searches for a string already in the pool
 	const char * CStringPool::Find( const char *pszValue );
 
-private:
-	typedef CUtlRBTree<const char *, unsigned short> CStrSet;
+	// appends every string in the pool
+	void GetStrings( CUtlVector<const char *> &strings ) const;
 
-	CStrSet m_Strings;
+private:
+	struct PoolSlot_t
+	{
+		unsigned int	nHash;
+		const char		*pszString;		// NULL when the slot is empty
+	};
+
+	int FindSlot( const char *pszValue, unsigned int nHash ) const;
+	void GrowSlots();
+	char *AllocStringMemory( int nLength );
+
+	// power of two sized, kept at most half full
+	CUtlVector<PoolSlot_t> m_Slots;
+	unsigned int m_nCount;
+
+	// string storage
+	CUtlVector<char *> m_Blocks;
+	int m_nBlockUsed;
 };
 
 #endif // STRINGPOOL_H
@@ -0,0 +1,526 @@
+//=========== (C) Copyright 2002 Valve, L.L.C. All rights reserved. ===========
+//
+// The copyright to the contents herein is the property of Valve, L.L.C.
+// The contents may be used and/or copied only with the written permission of
+// Valve, L.L.C., or in accordance with the terms and conditions stipulated in
+// the agreement/contract under which the contents have been supplied.
+//
+// Purpose: Unordered associative containers built on open addressing.
+//
+// $Header: $
+// $NoKeywords: $
+//=============================================================================
+
+#ifndef UTLHASHMAP_H
+#define UTLHASHMAP_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include <string.h>
+#include <ctype.h>
+#include "tier0/dbg.h"
+#include "utlmemory.h"
+
+
+//-----------------------------------------------------------------------------
+// Hash and equality functors
+//-----------------------------------------------------------------------------
+
+// FNV-1a over raw bytes
+inline unsigned int HashBytes( const void *pData, int nBytes )
+{
+	const unsigned char *p = (const unsigned char *)pData;
+	unsigned int nHash = 2166136261u;
+	for ( int i = 0; i < nBytes; i++ )
+	{
+		nHash = ( nHash ^ p[i] ) * 16777619u;
+	}
+	return nHash;
+}
+
+// Hashes the bytes of the key; fine for ints, pointers and padding free structs
+template <typename K>
+class CUtlHashDefault
+{
+public:
+	unsigned int operator()( const K &key ) const	{ return HashBytes( &key, sizeof(K) ); }
+};
+
+template <typename K>
+class CUtlEqualDefault
+{
+public:
+	bool operator()( const K &lhs, const K &rhs ) const	{ return ( lhs == rhs ); }
+};
+
+// For const char * keys. The map doesn't copy the strings, so they must
+// outlive it (pooled strings, symbol table strings, literals)
+class CUtlHashString
+{
+public:
+	unsigned int operator()( const char * const &pString ) const
+	{
+		unsigned int nHash = 2166136261u;
+		for ( const char *p = pString; *p; p++ )
+		{
+			nHash = ( nHash ^ (unsigned char)*p ) * 16777619u;
+		}
+		return nHash;
+	}
+};
+
+class CUtlEqualString
+{
+public:
+	bool operator()( const char * const &lhs, const char * const &rhs ) const	{ return !strcmp( lhs, rhs ); }
+};
+
+class CUtlHashStringCaseless
+{
+public:
+	unsigned int operator()( const char * const &pString ) const
+	{
+		unsigned int nHash = 2166136261u;
+		for ( const char *p = pString; *p; p++ )
+		{
+			nHash = ( nHash ^ (unsigned char)tolower( (unsigned char)*p ) ) * 16777619u;
+		}
+		return nHash;
+	}
+};
+
+class CUtlEqualStringCaseless
+{
+public:
+	bool operator()( const char * const &lhs, const char * const &rhs ) const	{ return !stricmp( lhs, rhs ); }
+};
+
+
+//-----------------------------------------------------------------------------
+//
+// Purpose:	An unordered associative container. Use in place of CUtlMap or
+//			CUtlDict for keyed lookups that don't need ordering.
+//
+//			Elements live in a CUtlMemory array and keep their index until
+//			they are removed, so indices can be held onto and First()/Next()
+//			iteration is unaffected by inserting or removing other elements.
+//			Lookups go through a separate power of two table of (hash, index)
+//			buckets, probed linearly with robin hood placement so no probe
+//			runs long. Each bucket holds the full hash of its key, so keys
+//			are only compared when the hashes match, and growing the table
+//			never rehashes a key.
+//
+//			Like CUtlMemory, elements are moved with realloc when the array
+//			grows, so K and T must not point into themselves.
+//			Note this class is not thread safe
+//
+
+template <typename K, typename T, typename H = CUtlHashDefault<K>, typename E = CUtlEqualDefault<K> >
+class CUtlHashMap
+{
+public:
+	typedef K KeyType_t;
+	typedef T ElemType_t;
+	typedef int IndexType_t;
+
+	// constructor, destructor
+	// Left at growSize = 0, the memory will first allocate 1 element and double in size
+	// at each increment. initSize elements can be inserted before anything is allocated.
+	CUtlHashMap( int growSize = 0, int initSize = 0 )
+	 : m_Nodes( growSize, 0 )
+	{
+		m_pBuckets = NULL;
+		m_nBucketMask = -1;
+		m_nCount = 0;
+		m_nMaxNode = 0;
+		m_nFirstFree = InvalidIndex();
+
+		if ( initSize > 0 )
+		{
+			EnsureCapacity( initSize );
+		}
+	}
+
+	~CUtlHashMap()
+	{
+		Purge();
+	}
+
+	// gets particular elements
+	ElemType_t &		Element( IndexType_t i )			{ Assert( IsValidIndex( i ) ); return m_Nodes[i].elem; }
+	const ElemType_t &	Element( IndexType_t i ) const		{ Assert( IsValidIndex( i ) ); return m_Nodes[i].elem; }
+	ElemType_t &		operator[]( IndexType_t i )			{ Assert( IsValidIndex( i ) ); return m_Nodes[i].elem; }
+	const ElemType_t &	operator[]( IndexType_t i ) const	{ Assert( IsValidIndex( i ) ); return m_Nodes[i].elem; }
+	const KeyType_t &	Key( IndexType_t i ) const			{ Assert( IsValidIndex( i ) ); return m_Nodes[i].key; }
+
+	// Num elements
+	unsigned int Count() const								{ return m_nCount; }
+
+	// Max "size" of the node array, for looping over all indices
+	IndexType_t  MaxElement() const							{ return m_nMaxNode; }
+
+	// Checks if a node is valid and in the map
+	bool  IsValidIndex( IndexType_t i ) const
+	{
+		return ( i >= 0 ) && ( i < m_nMaxNode ) && ( m_Nodes[i].next == NODE_IN_USE );
+	}
+
+	// Invalid index
+	static IndexType_t InvalidIndex()						{ return -1; }
+
+	// Makes sure nCount elements fit without reallocating
+	void EnsureCapacity( int nCount )
+	{
+		m_Nodes.EnsureCapacity( nCount );
+
+		int nBuckets = MIN_BUCKETS;
+		while ( nCount * 5 > nBuckets * 4 )
+		{
+			nBuckets *= 2;
+		}
+
+		if ( nBuckets > m_nBucketMask + 1 )
+		{
+			Rehash( nBuckets );
+		}
+	}
+
+	// Shrinks the bucket table to the fewest buckets that hold the current
+	// elements. Element storage is only released by Purge().
+	void Compact()
+	{
+		if ( m_nCount == 0 )
+		{
+			Purge();
+			return;
+		}
+
+		int nBuckets = MIN_BUCKETS;
+		while ( m_nCount * 5 > (unsigned int)nBuckets * 4 )
+		{
+			nBuckets *= 2;
+		}
+
+		if ( nBuckets < m_nBucketMask + 1 )
+		{
+			Rehash( nBuckets );
+		}
+	}
+
+	// Inserts the key if it isn't already in the map. Returns the index of
+	// the element with that key either way; an existing element is untouched.
+	IndexType_t  Insert( const KeyType_t &key, const ElemType_t &insert )
+	{
+		unsigned int nHash = m_Hash( key );
+		IndexType_t i = FindNode( key, nHash );
+		if ( i != InvalidIndex() )
+			return i;
+
+		i = AllocNode( key, nHash );
+		CopyConstruct( &m_Nodes[i].elem, insert );
+		return i;
+	}
+
+	// Same, default constructing the element
+	IndexType_t  Insert( const KeyType_t &key )
+	{
+		unsigned int nHash = m_Hash( key );
+		IndexType_t i = FindNode( key, nHash );
+		if ( i != InvalidIndex() )
+			return i;
+
+		i = AllocNode( key, nHash );
+		Construct( &m_Nodes[i].elem );
+		return i;
+	}
+
+	IndexType_t InsertOrReplace( const KeyType_t &key, const ElemType_t &insert )
+	{
+		unsigned int nHash = m_Hash( key );
+		IndexType_t i = FindNode( key, nHash );
+		if ( i != InvalidIndex() )
+		{
+			m_Nodes[i].elem = insert;
+			return i;
+		}
+
+		i = AllocNode( key, nHash );
+		CopyConstruct( &m_Nodes[i].elem, insert );
+		return i;
+	}
+
+	// Find method
+	IndexType_t  Find( const KeyType_t &key ) const
+	{
+		if ( m_nCount == 0 )
+			return InvalidIndex();
+
+		return FindNode( key, m_Hash( key ) );
+	}
+
+	// Remove methods
+	void     RemoveAt( IndexType_t i )
+	{
+		Assert( IsValidIndex( i ) );
+		RemoveBucket( FindBucket( m_Nodes[i].hash, i ) );
+		FreeNode( i );
+	}
+
+	bool     Remove( const KeyType_t &key )
+	{
+		IndexType_t i = Find( key );
+		if ( i == InvalidIndex() )
+			return false;
+
+		RemoveAt( i );
+		return true;
+	}
+
+	// Removes all elements, keeping the memory
+	void     RemoveAll()
+	{
+		for ( IndexType_t i = 0; i < m_nMaxNode; i++ )
+		{
+			if ( m_Nodes[i].next == NODE_IN_USE )
+			{
+				Destruct( &m_Nodes[i].key );
+				Destruct( &m_Nodes[i].elem );
+			}
+		}
+
+		for ( int b = 0; b <= m_nBucketMask; b++ )
+		{
+			m_pBuckets[b].node = InvalidIndex();
+		}
+
+		m_nCount = 0;
+		m_nMaxNode = 0;
+		m_nFirstFree = InvalidIndex();
+	}
+
+	// Removes all elements and frees the memory
+	void     Purge()
+	{
+		RemoveAll();
+
+		m_Nodes.Purge();
+		delete [] m_pBuckets;
+		m_pBuckets = NULL;
+		m_nBucketMask = -1;
+	}
+
+	// Iteration, in index order
+	IndexType_t  First() const
+	{
+		return Next( InvalidIndex() );
+	}
+
+	IndexType_t  Next( IndexType_t i ) const
+	{
+		for ( i++; i < m_nMaxNode; i++ )
+		{
+			if ( m_Nodes[i].next == NODE_IN_USE )
+				return i;
+		}
+		return InvalidIndex();
+	}
+
+protected:
+	enum
+	{
+		MIN_BUCKETS = 16,
+		NODE_IN_USE = -2,
+	};
+
+	struct Node_t
+	{
+		KeyType_t		key;
+		ElemType_t		elem;
+		unsigned int	hash;
+		IndexType_t		next;	// NODE_IN_USE, or the next node on the free list
+	};
+
+	struct Bucket_t
+	{
+		unsigned int	hash;
+		IndexType_t		node;	// InvalidIndex() when the bucket is empty
+	};
+
+	// How far the bucket's entry sits from where its hash wanted it
+	int ProbeDistance( int nBucket ) const
+	{
+		return ( nBucket - (int)( m_pBuckets[nBucket].hash & m_nBucketMask ) ) & m_nBucketMask;
+	}
+
+	IndexType_t FindNode( const KeyType_t &key, unsigned int nHash ) const
+	{
+		if ( !m_pBuckets )
+			return InvalidIndex();
+
+		int b = nHash & m_nBucketMask;
+		for ( int nDist = 0; ; nDist++ )
+		{
+			const Bucket_t &bucket = m_pBuckets[b];
+
+			// robin hood placement means the key would have displaced
+			// anything closer to home than it is
+			if ( bucket.node == InvalidIndex() || ProbeDistance( b ) < nDist )
+				return InvalidIndex();
+
+			if ( bucket.hash == nHash && m_Equal( m_Nodes[bucket.node].key, key ) )
+				return bucket.node;
+
+			b = ( b + 1 ) & m_nBucketMask;
+		}
+	}
+
+	int FindBucket( unsigned int nHash, IndexType_t node ) const
+	{
+		int b = nHash & m_nBucketMask;
+		while ( m_pBuckets[b].node != node )
+		{
+			Assert( m_pBuckets[b].node != InvalidIndex() );
+			b = ( b + 1 ) & m_nBucketMask;
+		}
+		return b;
+	}
+
+	void InsertBucket( unsigned int nHash, IndexType_t node )
+	{
+		Bucket_t carry;
+		carry.hash = nHash;
+		carry.node = node;
+
+		int b = nHash & m_nBucketMask;
+		for ( int nDist = 0; ; nDist++ )
+		{
+			if ( m_pBuckets[b].node == InvalidIndex() )
+			{
+				m_pBuckets[b] = carry;
+				return;
+			}
+
+			// take the spot from anything closer to home, and keep going with it
+			int nExisting = ProbeDistance( b );
+			if ( nExisting < nDist )
+			{
+				Bucket_t temp = m_pBuckets[b];
+				m_pBuckets[b] = carry;
+				carry = temp;
+				nDist = nExisting;
+			}
+
+			b = ( b + 1 ) & m_nBucketMask;
+		}
+	}
+
+	// Backward shift deletion, so no tombstones are needed
+	void RemoveBucket( int b )
+	{
+		int next = ( b + 1 ) & m_nBucketMask;
+		while ( m_pBuckets[next].node != InvalidIndex() && ProbeDistance( next ) != 0 )
+		{
+			m_pBuckets[b] = m_pBuckets[next];
+			b = next;
+			next = ( next + 1 ) & m_nBucketMask;
+		}
+		m_pBuckets[b].node = InvalidIndex();
+	}
+
+	void Rehash( int nBuckets )
+	{
+		delete [] m_pBuckets;
+		m_pBuckets = new Bucket_t[nBuckets];
+		m_nBucketMask = nBuckets - 1;
+
+		for ( int b = 0; b < nBuckets; b++ )
+		{
+			m_pBuckets[b].node = InvalidIndex();
+		}
+
+		for ( IndexType_t i = 0; i < m_nMaxNode; i++ )
+		{
+			if ( m_Nodes[i].next == NODE_IN_USE )
+			{
+				InsertBucket( m_Nodes[i].hash, i );
+			}
+		}
+	}
+
+	IndexType_t AllocNode( const KeyType_t &key, unsigned int nHash )
+	{
+		if ( ( m_nCount + 1 ) * 5 > (unsigned int)( m_nBucketMask + 1 ) * 4 )
+		{
+			Rehash( m_pBuckets ? ( m_nBucketMask + 1 ) * 2 : MIN_BUCKETS );
+		}
+
+		IndexType_t i = m_nFirstFree;
+		if ( i != InvalidIndex() )
+		{
+			m_nFirstFree = m_Nodes[i].next;
+		}
+		else
+		{
+			if ( m_nMaxNode >= m_Nodes.NumAllocated() )
+			{
+				m_Nodes.Grow();
+			}
+			i = m_nMaxNode++;
+		}
+
+		CopyConstruct( &m_Nodes[i].key, key );
+		m_Nodes[i].hash = nHash;
+		m_Nodes[i].next = NODE_IN_USE;
+		m_nCount++;
+
+		InsertBucket( nHash, i );
+		return i;
+	}
+
+	void FreeNode( IndexType_t i )
+	{
+		Destruct( &m_Nodes[i].key );
+		Destruct( &m_Nodes[i].elem );
+		m_Nodes[i].next = m_nFirstFree;
+		m_nFirstFree = i;
+		m_nCount--;
+	}
+
+	CUtlMemory<Node_t>	m_Nodes;
+	Bucket_t			*m_pBuckets;
+	int					m_nBucketMask;
+	unsigned int		m_nCount;
+	IndexType_t			m_nMaxNode;
+	IndexType_t			m_nFirstFree;
+
+	H					m_Hash;
+	E					m_Equal;
+};
+
+
+//-----------------------------------------------------------------------------
+//
+// Purpose:	A CUtlHashMap with no element, for membership tests
+//
+
+struct CUtlHashSetEmpty_t
+{
+};
+
+template <typename K, typename H = CUtlHashDefault<K>, typename E = CUtlEqualDefault<K> >
+class CUtlHashSet : public CUtlHashMap<K, CUtlHashSetEmpty_t, H, E>
+{
+public:
+	typedef CUtlHashMap<K, CUtlHashSetEmpty_t, H, E> BaseClass;
+
+	CUtlHashSet( int growSize = 0, int initSize = 0 ) : BaseClass( growSize, initSize ) {}
+
+	int Insert( const K &key )				{ return BaseClass::Insert( key ); }
+	bool HasElement( const K &key ) const	{ return BaseClass::Find( key ) != BaseClass::InvalidIndex(); }
+};
+
+//-----------------------------------------------------------------------------
+
+#endif // UTLHASHMAP_H
@@ -14,6 +14,7 @@
 #pragma warning (disable:4514)
 
 #include "utlsymbol.h"
+#include <ctype.h>
 #include "tier0/memdbgon.h"
 
 #define INVALID_STRING_INDEX 0xFFFFFFFF
@@ -213,3 +214,183 @@ void CUtlSymbolTable::RemoveAll()
 	m_Strings.RemoveAll();
 }
 
+
+//-----------------------------------------------------------------------------
+// hashed symbol table
+//-----------------------------------------------------------------------------
+
+#define HASH_SYMBOL_MIN_SLOTS	64
+
+CUtlHashSymbolTable::CUtlHashSymbolTable( int growSize, int initSize, bool caseInsensitive ) : 
+	m_StringOffsets( growSize, initSize ), m_Strings( 256 ), m_bCaseInsensitive( caseInsensitive )
+{
+}
+
+CUtlHashSymbolTable::~CUtlHashSymbolTable()
+{
+}
+
+unsigned int CUtlHashSymbolTable::HashString( char const* pString, bool caseInsensitive )
+{
+	unsigned int nHash = 0;
+	if ( caseInsensitive )
+	{
+		while ( *pString )
+		{
+			nHash = nHash * 31 + tolower( (unsigned char)*pString++ );
+		}
+	}
+	else
+	{
+		while ( *pString )
+		{
+			nHash = nHash * 31 + (unsigned char)*pString++;
+		}
+	}
+
+	// fold the high bits down, the table only looks at the low ones
+	return nHash ^ ( nHash >> 16 );
+}
+
+
+//-----------------------------------------------------------------------------
+// Returns the slot holding pString, or the empty slot it would go in
+//-----------------------------------------------------------------------------
+
+int CUtlHashSymbolTable::FindSlot( char const* pString, unsigned int nHash ) const
+{
+	int nMask = m_Slots.Count() - 1;
+	if ( nMask < 0 )
+		return -1;
+
+	// the table is never more than half full, so this always ends
+	int i = nHash & nMask;
+	while ( true )
+	{
+		HashSlot_t const& slot = m_Slots[i];
+		if ( slot.m_Id == UTL_INVAL_HASH_SYMBOL )
+			return i;
+
+		if ( slot.m_nHash == nHash )
+		{
+			char const* pSymString = &m_Strings[ m_StringOffsets[slot.m_Id] ];
+			int nCompare = m_bCaseInsensitive ? strcmpi( pSymString, pString ) : strcmp( pSymString, pString );
+			if ( nCompare == 0 )
+				return i;
+		}
+
+		i = ( i + 1 ) & nMask;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Doubles the slots; the cached hashes mean no string is looked at again
+//-----------------------------------------------------------------------------
+
+void CUtlHashSymbolTable::GrowSlots()
+{
+	int nOldSlots = m_Slots.Count();
+	int nNewSlots = nOldSlots ? nOldSlots * 2 : HASH_SYMBOL_MIN_SLOTS;
+
+	CUtlVector<HashSlot_t> oldSlots;
+	oldSlots.CopyArray( m_Slots.Base(), nOldSlots );
+
+	m_Slots.SetSize( nNewSlots );
+	int i;
+	for ( i = 0; i < nNewSlots; i++ )
+	{
+		m_Slots[i].m_Id = UTL_INVAL_HASH_SYMBOL;
+	}
+
+	int nMask = nNewSlots - 1;
+	for ( i = 0; i < nOldSlots; i++ )
+	{
+		if ( oldSlots[i].m_Id == UTL_INVAL_HASH_SYMBOL )
+			continue;
+
+		int j = oldSlots[i].m_nHash & nMask;
+		while ( m_Slots[j].m_Id != UTL_INVAL_HASH_SYMBOL )
+		{
+			j = ( j + 1 ) & nMask;
+		}
+		m_Slots[j] = oldSlots[i];
+	}
+}
+
+
+CUtlHashSymbol CUtlHashSymbolTable::Find( char const* pString ) const
+{	
+	if (!pString)
+		return CUtlHashSymbol();
+
+	int i = FindSlot( pString, HashString( pString, m_bCaseInsensitive ) );
+	if ( i < 0 )
+		return CUtlHashSymbol();
+
+	return CUtlHashSymbol( m_Slots[i].m_Id );
+}
+
+
+//-----------------------------------------------------------------------------
+// Finds and/or creates a symbol based on the string
+//-----------------------------------------------------------------------------
+
+CUtlHashSymbol CUtlHashSymbolTable::AddString( char const* pString )
+{
+	if (!pString) 
+		return CUtlHashSymbol( UTL_INVAL_HASH_SYMBOL );
+
+	// make room first so the slot found below stays put
+	if ( ( m_StringOffsets.Count() + 1 ) * 2 > m_Slots.Count() )
+	{
+		GrowSlots();
+	}
+
+	unsigned int nHash = HashString( pString, m_bCaseInsensitive );
+	int i = FindSlot( pString, nHash );
+	if ( m_Slots[i].m_Id != UTL_INVAL_HASH_SYMBOL )
+		return CUtlHashSymbol( m_Slots[i].m_Id );
+
+	// didn't find, insert the string into the vector.
+	int len = strlen(pString) + 1;
+	int stridx = m_Strings.AddMultipleToTail( len );
+	memcpy( &m_Strings[stridx], pString, len * sizeof(char) );
+
+	UtlHashSymId_t id = m_StringOffsets.AddToTail( stridx );
+	m_Slots[i].m_nHash = nHash;
+	m_Slots[i].m_Id = id;
+	return CUtlHashSymbol( id );
+}
+
+
+//-----------------------------------------------------------------------------
+// Look up the string associated with a particular symbol
+//-----------------------------------------------------------------------------
+
+char const* CUtlHashSymbolTable::String( CUtlHashSymbol id ) const
+{
+	if (!id.IsValid()) 
+		return "";
+	
+	Assert( m_StringOffsets.IsValidIndex((UtlHashSymId_t)id) );
+	return &m_Strings[m_StringOffsets[id]];
+}
+
+
+int CUtlHashSymbolTable::Count() const
+{
+	return m_StringOffsets.Count();
+}
+
+
+//-----------------------------------------------------------------------------
+// Remove all symbols in the table.
+//-----------------------------------------------------------------------------
+
+void CUtlHashSymbolTable::RemoveAll()
+{
+	m_Slots.RemoveAll();
+	m_StringOffsets.RemoveAll();
+	m_Strings.RemoveAll();
+}
@@ -120,4 +120,96 @@ protected:
 };
 
 
+//-----------------------------------------------------------------------------
+// A symbol from a CUtlHashSymbolTable. Same idea as CUtlSymbol, but with
+// 32 bit ids, so a table isn't limited to 64K strings, and no global table.
+//-----------------------------------------------------------------------------
+
+typedef unsigned int UtlHashSymId_t;
+
+#define UTL_INVAL_HASH_SYMBOL  ((UtlHashSymId_t)~0)
+
+class CUtlHashSymbol
+{
+public:
+	// constructor, destructor
+	CUtlHashSymbol() : m_Id(UTL_INVAL_HASH_SYMBOL) {}
+	CUtlHashSymbol( UtlHashSymId_t id ) : m_Id(id) {}
+	CUtlHashSymbol( CUtlHashSymbol const& sym ) : m_Id(sym.m_Id) {}
+	
+	// operator=
+	CUtlHashSymbol& operator=( CUtlHashSymbol const& src ) { m_Id = src.m_Id; return *this; }
+	
+	// operator==
+	bool operator==( CUtlHashSymbol const& src ) const { return m_Id == src.m_Id; }
+	
+	// Is valid?
+	bool IsValid() const { return m_Id != UTL_INVAL_HASH_SYMBOL; }
+	
+	// Gets at the symbol
+	operator UtlHashSymId_t const() const { return m_Id; }
+		
+protected:
+	UtlHashSymId_t   m_Id;
+};
+
+
+//-----------------------------------------------------------------------------
+// CUtlHashSymbolTable:
+// description:
+//    Same interface as CUtlSymbolTable, backed by an open addressed hash table
+//    instead of a tree. Each slot keeps the string's full hash, so a probe only
+//    compares strings when the hashes match. Symbols are handed out in the
+//    order strings are added, starting at 0, and the strings themselves are
+//    packed one after another in a single buffer.
+//-----------------------------------------------------------------------------
+
+class CUtlHashSymbolTable
+{
+public:
+	// constructor, destructor
+	CUtlHashSymbolTable( int growSize = 0, int initSize = 32, bool caseInsensitive = false );
+	~CUtlHashSymbolTable();
+	
+	// Finds and/or creates a symbol based on the string
+	CUtlHashSymbol AddString( char const* pString );
+
+	// Finds the symbol for pString
+	CUtlHashSymbol Find( char const* pString ) const;
+	
+	// Look up the string associated with a particular symbol
+	char const* String( CUtlHashSymbol id ) const;
+
+	// Number of symbols in the table
+	int Count() const;
+	
+	// Remove all symbols in the table.
+	void  RemoveAll();
+
+	// Hashes the way the table does
+	static unsigned int HashString( char const* pString, bool caseInsensitive );
+	
+protected:
+	struct HashSlot_t
+	{
+		unsigned int	m_nHash;
+		UtlHashSymId_t	m_Id;		// UTL_INVAL_HASH_SYMBOL when the slot is empty
+	};
+
+	int FindSlot( char const* pString, unsigned int nHash ) const;
+	void GrowSlots();
+
+	// power of two sized, kept at most half full
+	CUtlVector<HashSlot_t> m_Slots;
+
+	// symbol -> offset of its string in m_Strings
+	CUtlVector<unsigned int> m_StringOffsets;
+	
+	// stores the string data
+	CUtlVector<char> m_Strings;
+
+	bool m_bCaseInsensitive;
+};
+
+
 #endif // UTLSYMBOL_H